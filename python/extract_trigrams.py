@@ -2,29 +2,181 @@
 # extract_trigrams.py - Extracts top N trigrams from binary data
 
 import argparse
+import array
 import collections
 import json
+import math
+import struct
 import sys
 
-def extract_trigrams(path, max_count):
+# must match src/trigram_index.hpp
+INDEX_MAGIC = b"TRIIDX01"
+
+# must match src/background.hpp
+BACKGROUND_MAGIC = b"FCBKG001"
+TRIGRAM_BINS = 1 << 24
+
+def load_background(path):
+    """Document count and per-trigram document frequencies from fcube-analyze background."""
+    with open(path, 'rb') as f:
+        magic, documents, _ = struct.unpack("<8sQQ", f.read(24))
+        if magic != BACKGROUND_MAGIC:
+            raise ValueError(f"{path} is not a background model")
+        df = array.array('I')
+        df.frombytes(f.read(TRIGRAM_BINS * 4))
+    if len(df) != TRIGRAM_BINS:
+        raise ValueError(f"{path} is truncated")
+    return documents, df
+
+def bit_phase(data, phase):
+    """The input read as bytes starting `phase` bits in, msb first (fcube-analyze bits)."""
+    if phase == 0:
+        return data
+    return bytes(((data[i] << phase) | (data[i+1] >> (8 - phase))) & 0xff for i in range(len(data) - 1))
+
+def add_positions(data, top):
+    """Mean offset and spread (std dev) of each of the top trigrams, as fractions
+    of the input. A second pass that only looks up the chosen keys, with integer
+    pos16 sums like src/positions.hpp."""
+    slots = {key: slot for slot, (key, _) in enumerate(top)}
+    sums = [0] * len(top)
+    squares = [0] * len(top)
+    scale = (1 << 48) // max(len(data), 1)
+    for i in range(len(data) - 2):
+        slot = slots.get((data[i], data[i+1], data[i+2]))
+        if slot is not None:
+            position = (i * scale) >> 32
+            sums[slot] += position
+            squares[slot] += position * position
+    result = []
+    for slot, (key, count) in enumerate(top):
+        mean = sums[slot] / count
+        spread = max(squares[slot] / count - mean * mean, 0.0) ** 0.5
+        result.append((mean / 65536, spread / 65536))
+    return result
+
+def extract_trigrams(path, max_count, phase=0, background=None, positions=False):
+    """Top trigrams, with positions also the mean offset each occurs at and the
+    spread of its offsets (fcube-analyze scan --positions).
+    With a background the top are picked by count * log((1 + N) / (1 + df)) and
+    trigrams every document has are dropped; counts stay unweighted."""
     freq = collections.Counter()
     with open(path, 'rb') as f:
-        data = f.read()
+        data = bit_phase(f.read(), phase)
     for i in range(len(data) - 2):
-        a, b, c = data[i], data[i+1], data[i+2]
-        freq[(a, b, c)] += 1
+        freq[(data[i], data[i+1], data[i+2])] += 1
+
+    if background:
+        documents, df = background
+        def score(key):
+            weight = math.log((1 + documents) / (1 + df[(key[0] << 16) | (key[1] << 8) | key[2]]))
+            return freq[key] * weight
+        scores = {key: score(key) for key in freq}
+        ranked = sorted((key for key in freq if scores[key] > 0), key=lambda key: -scores[key])[:max_count]
+        top = [(key, freq[key]) for key in ranked]
+    else:
+        top = freq.most_common(max_count)
 
-    top = freq.most_common(max_count)
-    output = [{"x": a, "y": b, "z": c, "count": count} for ((a, b, c), count) in top]
+    output = [{"x": key[0], "y": key[1], "z": key[2], "count": count} for key, count in top]
+    if positions:
+        for entry, (mean, spread) in zip(output, add_positions(data, top)):
+            entry["position"] = round(mean, 5)
+            entry["spread"] = round(spread, 5)
     return output
 
+# must match src/histogram_io.hpp
+FCUBE_MAGIC = b"FCUBE001"
+FCUBE_SHARD = 2
+
+def padded(data):
+    return data + b"\0" * (-len(data) % 8)
+
+def write_shard(path, data, offset, length, name):
+    """Writes the full histogram of data[offset:offset + length] as a one layer
+    shard .fcube, for fcube-analyze merge to combine with the rest of the input."""
+    piece = data[offset:offset + length]
+    counts = collections.Counter()
+    for i in range(len(piece) - 2):
+        counts[(piece[i] << 16) | (piece[i+1] << 8) | piece[i+2]] += 1
+    bins = sorted(counts)
+    edge = min(len(piece), 2)
+    encoded = name.encode()
+
+    with open(path, "wb") as f:
+        f.write(struct.pack("<8sQII", FCUBE_MAGIC, len(piece), 1, FCUBE_SHARD))
+        f.write(struct.pack("<IIQ", len(encoded), len(bins), sum(counts.values())))
+        f.write(padded(encoded))
+        f.write(padded(struct.pack(f"<{len(bins)}I", *bins)))
+        f.write(struct.pack(f"<{len(bins)}Q", *(counts[b] for b in bins)))
+        f.write(struct.pack("<QQQBB2s2s2x", offset, len(piece), len(data), edge, edge,
+                            piece[:edge], piece[len(piece) - edge:]))
+    return len(bins)
+
+def varint(value):
+    out = bytearray()
+    while value >= 0x80:
+        out.append((value & 0x7f) | 0x80)
+        value >>= 7
+    out.append(value)
+    return out
+
+def write_index(path, data, cap):
+    """Writes the trigram -> file offset index the viewer mmaps (--index)."""
+    totals = collections.Counter()
+    offsets = {}
+    for i in range(len(data) - 2):
+        key = (data[i] << 16) | (data[i+1] << 8) | data[i+2]
+        totals[key] += 1
+        stored = offsets.setdefault(key, [])
+        if len(stored) < cap:
+            stored.append(i)
+
+    directory = bytearray()
+    postings = bytearray()
+    for key in sorted(totals):
+        stored = offsets[key]
+        directory += struct.pack("<IIQQ", key, len(stored), totals[key], len(postings))
+        previous = 0
+        for offset in stored:
+            postings += varint(offset - previous)
+            previous = offset
+
+    with open(path, "wb") as f:
+        f.write(struct.pack("<8sQII", INDEX_MAGIC, len(data), cap, len(totals)))
+        f.write(directory)
+        f.write(postings)
+    return len(totals)
+
 if __name__ == "__main__":
     parser = argparse.ArgumentParser()
     parser.add_argument("file", help="Input binary file")
     parser.add_argument("--max", type=int, default=10000, help="Max number of trigrams to output")
+    parser.add_argument("--bit-phase", type=int, default=0, choices=range(8), help="Read the input this many bits in, for data that isn't byte aligned")
+    parser.add_argument("--positions", action="store_true", help="Also write where in the file each trigram sits, for hue by position in the viewer")
+    parser.add_argument("--background", help="Corpus model from fcube-analyze background, keep the trigrams most unusual against it")
+    parser.add_argument("--shard", help="Also write the full histogram of --offset/--length as a shard for fcube-analyze merge")
+    parser.add_argument("--offset", type=int, default=0, help="First byte of the shard")
+    parser.add_argument("--length", type=int, help="Bytes in the shard, to the end of the file by default")
+    parser.add_argument("--index", help="Also write a trigram -> offsets index to this file")
+    parser.add_argument("--index-cap", type=int, default=1024, help="Offsets kept per trigram in the index")
     args = parser.parse_args()
 
-    trigrams = extract_trigrams(args.file, args.max)
+    background = load_background(args.background) if args.background else None
+    trigrams = extract_trigrams(args.file, args.max, args.bit_phase, background, args.positions)
     with open("trigrams.json", "w") as f:
         json.dump(trigrams, f, indent=2)
     print(f"Wrote {len(trigrams)} trigrams to trigrams.json")
+
+    if args.shard:
+        with open(args.file, 'rb') as f:
+            data = f.read()
+        offset = min(args.offset, len(data))
+        length = len(data) - offset if args.length is None else min(args.length, len(data) - offset)
+        entries = write_shard(args.shard, data, offset, length, args.file)
+        print(f"Wrote a shard of {entries} trigrams over bytes {offset}..{offset + length} to {args.shard}")
+
+    if args.index:
+        with open(args.file, 'rb') as f:
+            data = f.read()
+        entries = write_index(args.index, data, args.index_cap)
+        print(f"Wrote offsets of {entries} trigrams to {args.index}")
@@ -1,2 +1,14 @@
-glslc shader.frag -o frag.spv
-glslc shader.vert -o vert.spv
+# vert.spv and frag.spv are checked in for boxes without glslc, rebuild and
+# commit them when shader.vert / shader.frag change
+glslc --target-env=vulkan1.1 shader.frag -o frag.spv
+glslc --target-env=vulkan1.1 shader.vert -o vert.spv
+# the rest only ever come from glslc, cmake builds them when it finds it
+glslc --target-env=vulkan1.1 voxel.vert -o voxel_vert.spv
+glslc --target-env=vulkan1.1 voxel.frag -o voxel_frag.spv
+glslc --target-env=vulkan1.1 point.vert -o point.spv
+glslc --target-env=vulkan1.1 histogram.comp -o histogram.spv
+glslc --target-env=vulkan1.1 -DSUBGROUP_AGGREGATE=0 histogram.comp -o histogram_plain.spv
+glslc --target-env=vulkan1.1 instances.comp -o instances.spv
+glslc --target-env=vulkan1.1 -DSUBGROUP_AGGREGATE=0 instances.comp -o instances_plain.spv
+glslc --target-env=vulkan1.1 rarity.vert -o rarity_vert.spv
+glslc --target-env=vulkan1.1 rarity.frag -o rarity_frag.spv
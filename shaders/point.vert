@@ -0,0 +1,29 @@
+#version 450
+
+// one point per trigram (or pyramid cell), expanded to a screen-space square
+// the size its cube would cover and shaded as a cube impostor in voxel.frag
+
+layout(location = 1) in vec3 instanceOffset;
+layout(location = 2) in float intensity;
+layout(location = 3) in float instanceSize;
+layout(location = 4) in vec2 instancePosition; // mean offset, spread; x < 0 when unknown
+layout(location = 5) in float instanceDelta;    // change against --compare, in [-1, 1]
+
+layout(binding = 0) uniform UniformBufferObject {
+    mat4 mvp;
+    vec4 params; // x = point scale, pixels per unit at w = 1, y = 1 to hue by position, z = 1 to color by delta
+} ubo;
+
+layout(location = 0) out float fragIntensity;
+layout(location = 1) flat out uint fragId; // picked back on the cpu
+layout(location = 2) out vec2 fragPosition;
+layout(location = 3) out float fragDelta; // outside [-1, 1] when not comparing
+
+void main() {
+    gl_Position = ubo.mvp * vec4(instanceOffset, 1.0);
+    gl_PointSize = max(1.0, ubo.params.x * instanceSize / gl_Position.w);
+    fragIntensity = intensity;
+    fragId = uint(gl_InstanceIndex);
+    fragPosition = ubo.params.y > 0.5 ? instancePosition : vec2(-1.0, 0.0);
+    fragDelta = ubo.params.z > 0.5 ? instanceDelta : 2.0;
+}
@@ -0,0 +1,17 @@
+#version 450
+
+// the hilbert image from fcube-analyze rarity, one texel per stretch of the input
+
+layout(binding = 0) uniform sampler2D rarity;
+
+layout(location = 0) in vec2 fragUv;
+
+layout(location = 0) out vec4 outColor;
+layout(location = 1) out uint outId; // nothing to pick in the panel
+
+void main() {
+    // black through red and yellow to white, the rarest stretches burn brightest
+    float r = texture(rarity, fragUv).r * 3.0;
+    outColor = vec4(clamp(vec3(r, r - 1.0, r - 2.0), 0.0, 1.0), 1.0);
+    outId = 0xFFFFFFFFu;
+}
@@ -0,0 +1,13 @@
+#version 450
+
+// one triangle over the whole viewport of the rarity panel, the scissor
+// trims it to the square. uv runs 0..1 across it, v down like image rows
+
+layout(location = 0) out vec2 fragUv;
+
+void main() {
+    // counter-clockwise in framebuffer space, so back face culling keeps it
+    vec2 corners[3] = vec2[](vec2(-1.0, -1.0), vec2(-1.0, 3.0), vec2(3.0, -1.0));
+    gl_Position = vec4(corners[gl_VertexIndex], 0.0, 1.0);
+    fragUv = corners[gl_VertexIndex] * 0.5 + 0.5;
+}
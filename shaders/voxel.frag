@@ -0,0 +1,48 @@
+#version 450
+
+// set for the point pipeline, fragments then come from a point sprite
+layout(constant_id = 0) const bool IMPOSTOR = false;
+
+layout(location = 0) in float fragIntensity;
+layout(location = 1) flat in uint fragId;
+layout(location = 2) in vec2 fragPosition; // mean offset and spread in the input, x < 0 when unknown
+layout(location = 3) in float fragDelta;    // change against --compare, outside [-1, 1] when not comparing
+
+layout(location = 0) out vec4 outColor;
+layout(location = 1) out uint outId; // instance index, read back under the cursor
+
+vec3 hsv2rgb(vec3 c) {
+    vec3 p = abs(fract(c.xxx + vec3(1.0, 2.0 / 3.0, 1.0 / 3.0)) * 6.0 - 3.0);
+    return c.z * mix(vec3(1.0), clamp(p - 1.0, 0.0, 1.0), c.y);
+}
+
+void main() {
+    vec4 color = mix(vec4(0, 0, 1, 1), vec4(1, 0, 0, 1), clamp(fragIntensity, 0.0, 1.0));
+
+    // hue runs red (start of the input) to violet (end), trigrams spread over
+    // the whole input fade to grey (a uniform spread is 0.29), count sets brightness
+    if (fragPosition.x >= 0.0) {
+        float saturation = 1.0 - clamp(fragPosition.y / 0.3, 0.0, 1.0) * 0.85;
+        float value = mix(0.35, 1.0, clamp(fragIntensity, 0.0, 1.0));
+        color = vec4(hsv2rgb(vec3(clamp(fragPosition.x, 0.0, 1.0) * 0.8, saturation, value)), 1.0);
+    }
+
+    // diverging: blue where the compared histogram has less, red where it
+    // has more, grey in between. the square root lifts small changes
+    if (abs(fragDelta) <= 1.0) {
+        float t = sqrt(abs(fragDelta));
+        vec3 toward = fragDelta < 0.0 ? vec3(0.15, 0.35, 1.0) : vec3(1.0, 0.2, 0.1);
+        color = vec4(mix(vec3(0.6), toward, t), 1.0);
+    }
+
+    if (IMPOSTOR) {
+        // fake a lit cube face: lighter towards the top left, darker rim
+        vec2 c = gl_PointCoord * 2.0 - 1.0;
+        float rim = smoothstep(0.75, 1.0, max(abs(c.x), abs(c.y)));
+        float light = 0.85 - 0.15 * (c.x + c.y) * 0.5;
+        color.rgb *= light * mix(1.0, 0.55, rim);
+    }
+
+    outColor = color;
+    outId = fragId;
+}
@@ -0,0 +1,2184 @@
+//   █████╗ ███╗   ██╗ █████╗ ██╗     ██╗   ██╗███████╗███████╗    ██████╗██████╗ ██████╗
+//  ██╔══██╗████╗  ██║██╔══██╗██║     ╚██╗ ██╔╝╚══███╔╝██╔════╝   ██╔════╝██╔══██╗██╔══██╗
+//  ███████║██╔██╗ ██║███████║██║      ╚████╔╝   ███╔╝ █████╗     ██║     ██████╔╝██████╔╝
+//  ██╔══██║██║╚██╗██║██╔══██║██║       ╚██╔╝   ███╔╝  ██╔══╝     ██║     ██╔═══╝ ██╔═══╝
+//  ██║  ██║██║ ╚████║██║  ██║███████╗   ██║   ███████╗███████╗██╗╚██████╗██║     ██║
+//  ╚═╝  ╚═╝╚═╝  ╚═══╝╚═╝  ╚═╝╚══════╝   ╚═╝   ╚══════╝╚══════╝╚═╝ ╚═════╝╚═╝     ╚═╝
+//
+//
+// fcube-analyze: trigram histograms for whole directory trees of samples
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <csignal>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "arg.hpp"
+#include "background.hpp"
+#include "bit_trigrams.hpp"
+#include "classifier.hpp"
+#include "counters.hpp"
+#include "daemon.hpp"
+#include "diff.hpp"
+#include "fingerprint.hpp"
+#include "histogram_io.hpp"
+#include "pipeline.hpp"
+#include "positions.hpp"
+#include "rarity.hpp"
+#include "sampling.hpp"
+#include "sections.hpp"
+#include "segment.hpp"
+#include "shards.hpp"
+#include "sketch.hpp"
+#include "similarity_index.hpp"
+#include "tasks.hpp"
+#include "trigram.hpp"
+
+namespace fs = std::filesystem;
+
+// read only view of a whole input file
+class mapped_file
+{
+private:
+    const uint8_t *data_ = nullptr;
+    size_t size_ = 0;
+
+public:
+    // sequential for inputs read front to back, the page cache is left to
+    // its defaults for ones read in scattered pieces
+    explicit mapped_file(const std::string &path, bool sequential = true)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            throw std::runtime_error("Failed to open " + path);
+        }
+
+        struct stat st{};
+        if (::fstat(fd, &st) != 0)
+        {
+            ::close(fd);
+            throw std::runtime_error("Failed to stat " + path);
+        }
+
+        size_ = static_cast<size_t>(st.st_size);
+        if (size_ > 0)
+        {
+            void *mapping = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED)
+            {
+                ::close(fd);
+                throw std::runtime_error("Failed to map " + path);
+            }
+            if (sequential)
+            {
+                // every byte is read once, front to back
+                ::madvise(mapping, size_, MADV_SEQUENTIAL | MADV_WILLNEED);
+            }
+            data_ = static_cast<const uint8_t *>(mapping);
+        }
+        ::close(fd);
+    }
+
+    ~mapped_file()
+    {
+        if (data_)
+        {
+            ::munmap(const_cast<uint8_t *>(data_), size_);
+        }
+    }
+
+    mapped_file(const mapped_file &) = delete;
+    mapped_file &operator=(const mapped_file &) = delete;
+
+    const uint8_t *data() const
+    {
+        return data_;
+    }
+
+    size_t size() const
+    {
+        return size_;
+    }
+};
+
+// one counter per worker of a pool, made the first time it is used
+class scratch_set
+{
+private:
+    std::vector<std::unique_ptr<trigram_counter>> scratch_;
+
+public:
+    explicit scratch_set(size_t workers) : scratch_(workers) {}
+
+    trigram_counter &operator[](size_t worker)
+    {
+        if (!scratch_[worker])
+        {
+            scratch_[worker] = std::make_unique<trigram_counter>();
+        }
+        return *scratch_[worker];
+    }
+};
+
+// dense sums for one big file, added to by all of its chunks at once
+struct file_accumulator
+{
+    std::vector<std::atomic<uint64_t>> counts = std::vector<std::atomic<uint64_t>>(TRIGRAM_BINS);
+
+    // the sums so far, while nothing is adding to them
+    histogram_layer snapshot(const std::string &name) const
+    {
+        histogram_layer layer;
+        layer.name = name;
+        for (uint32_t bin = 0; bin < TRIGRAM_BINS; ++bin)
+        {
+            uint64_t count = counts[bin].load(std::memory_order_relaxed);
+            if (count)
+            {
+                layer.bins.push_back(bin);
+                layer.counts.push_back(count);
+                layer.total += count;
+            }
+        }
+        return layer;
+    }
+
+    // the accumulator is zero again afterwards, ready for the next file
+    histogram_layer take(const std::string &name)
+    {
+        histogram_layer layer = snapshot(name);
+        for (uint32_t bin : layer.bins)
+        {
+            counts[bin].store(0, std::memory_order_relaxed);
+        }
+        return layer;
+    }
+};
+
+// at most `limit` accumulators (128 MB each) ever exist, a big file waits for
+// one to come back. a worker only starts a new file once no chunk is left to
+// steal, so the chunks holding the accumulators are always being run
+class accumulator_pool
+{
+private:
+    std::mutex mutex_;
+    std::condition_variable available_;
+    std::vector<std::unique_ptr<file_accumulator>> all_;
+    std::vector<file_accumulator *> free_;
+    size_t limit_;
+
+public:
+    explicit accumulator_pool(size_t limit) : limit_(std::max<size_t>(1, limit)) {}
+
+    file_accumulator *acquire()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        available_.wait(lock, [this]()
+                        { return !free_.empty() || all_.size() < limit_; });
+        if (free_.empty())
+        {
+            all_.push_back(std::make_unique<file_accumulator>());
+            return all_.back().get();
+        }
+        file_accumulator *accumulator = free_.back();
+        free_.pop_back();
+        return accumulator;
+    }
+
+    void release(file_accumulator *accumulator)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            free_.push_back(accumulator);
+        }
+        available_.notify_one();
+    }
+};
+
+size_t thread_count(const arg_parser &args)
+{
+    size_t threads = static_cast<size_t>(std::max(args.get_or<int>("--threads", 0), 0));
+    return threads ? threads : std::thread::hardware_concurrency();
+}
+
+bool is_fcube(const fs::path &path)
+{
+    return path.extension() == ".fcube";
+}
+
+struct scan_input
+{
+    std::string path; // as walked, also the layer name
+    std::string relative; // below the root it was found under, for --out
+    uint64_t size;
+};
+
+std::vector<scan_input> collect_inputs(const std::vector<std::string> &roots)
+{
+    std::vector<scan_input> inputs;
+    for (const auto &root : roots)
+    {
+        fs::path root_path(root);
+        if (fs::is_regular_file(root_path))
+        {
+            inputs.push_back({root_path.generic_string(), root_path.filename().generic_string(), fs::file_size(root_path)});
+            continue;
+        }
+        if (!fs::is_directory(root_path))
+        {
+            throw std::runtime_error("No such file or directory: " + root);
+        }
+
+        for (const auto &entry : fs::recursive_directory_iterator(root_path, fs::directory_options::skip_permission_denied))
+        {
+            std::error_code error;
+            if (entry.is_regular_file(error) && !entry.is_symlink(error))
+            {
+                inputs.push_back({entry.path().generic_string(),
+                                  entry.path().lexically_relative(root_path).generic_string(),
+                                  entry.file_size(error)});
+            }
+        }
+    }
+
+    // biggest first, their chunks keep everyone busy while small files fill the gaps
+    std::stable_sort(inputs.begin(), inputs.end(), [](const scan_input &a, const scan_input &b)
+                     { return a.size > b.size; });
+    return inputs;
+}
+
+// the counter picks its tables from the input (counters.hpp), any size fits
+histogram_layer count_layer(trigram_counter &histogram, const uint8_t *data, size_t size, const std::string &name)
+{
+    histogram.count(data, size);
+    return histogram.take(name);
+}
+
+int scan_command(const arg_parser &args, const std::vector<std::string> &roots)
+{
+    std::string out_dir = args.get_or<std::string>("--out", "");
+    std::string store_path = args.get_or<std::string>("--store", "");
+    if (out_dir.empty() == store_path.empty())
+    {
+        throw std::runtime_error("scan needs either --out DIR or --store FILE");
+    }
+    if (roots.empty())
+    {
+        throw std::runtime_error("scan needs at least one file or directory");
+    }
+
+    size_t chunk_bytes = static_cast<size_t>(std::clamp(args.get_or<int>("--chunk-mb", 16), 1, 1024)) << 20;
+    size_t big_bytes = static_cast<size_t>(std::max(args.get_or<int>("--big-file-mb", 64), 1)) << 20;
+    uint32_t flags = args.get_or<bool>("--positions", false) ? FCUBE_POSITIONS : 0;
+    background_model background;
+    std::string background_path = args.get_or<std::string>("--background", "");
+    if (!background_path.empty())
+    {
+        background.open(background_path);
+    }
+    size_t keep = static_cast<size_t>(std::max(args.get_or<int>("--keep", 0), 0));
+    size_t sketch_bytes = static_cast<size_t>(std::max(args.get_or<int>("--sketch-kb", 0), 0)) << 10;
+    if (sketch_bytes && (flags & FCUBE_POSITIONS))
+    {
+        throw std::runtime_error("--positions needs the exact counts, not --sketch-kb");
+    }
+    work_stealing_pool pool(thread_count(args));
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<scan_input> inputs = collect_inputs(roots);
+
+    std::unique_ptr<fcube_writer> store;
+    if (!store_path.empty())
+    {
+        store = std::make_unique<fcube_writer>(store_path, flags);
+    }
+    std::mutex store_mutex;
+    std::atomic<uint64_t> bytes_done{0};
+    std::atomic<size_t> files_done{0};
+    std::atomic<size_t> files_failed{0};
+
+    auto fail = [&](const scan_input &input, const std::exception &e)
+    {
+        files_failed++;
+        std::lock_guard<std::mutex> lock(store_mutex);
+        std::cerr << input.path << ": " << e.what() << std::endl;
+    };
+
+    auto emit = [&](const scan_input &input, histogram_layer layer, uint64_t size)
+    {
+        if (background.is_open())
+        {
+            layer = informative_bins(layer, background, keep);
+        }
+        if (store)
+        {
+            std::lock_guard<std::mutex> lock(store_mutex);
+            store->add(layer);
+        }
+        else
+        {
+            fs::path out_path = fs::path(out_dir) / (input.relative + ".fcube");
+            fs::create_directories(out_path.parent_path());
+            fcube cube;
+            cube.input_size = size;
+            cube.flags = flags;
+            cube.layers.push_back(std::move(layer));
+            write_fcube(out_path.string(), cube);
+        }
+        bytes_done += size;
+        files_done++;
+    };
+
+    scratch_set scratch(pool.size());
+
+    // --positions: add_positions needs a dense slot per bin, one table per worker
+    std::vector<std::vector<uint32_t>> position_slots(pool.size());
+    auto slots = [&](size_t worker)
+    {
+        if (position_slots[worker].empty())
+        {
+            position_slots[worker].assign(TRIGRAM_BINS, 0);
+        }
+        return position_slots[worker].data();
+    };
+
+    // --sketch-kb: a space_saving per worker instead of the 64 MB tables, a
+    // whole file on one worker, top --keep written like an exact layer
+    std::vector<std::unique_ptr<space_saving>> sketches(sketch_bytes ? pool.size() : 0);
+    std::atomic<uint64_t> sketch_error{0};
+    auto sketch_file = [&](const scan_input &input, const mapped_file &map, size_t worker)
+    {
+        if (!sketches[worker])
+        {
+            sketches[worker] = std::make_unique<space_saving>(sketch_bytes);
+        }
+        space_saving &sketch = *sketches[worker];
+        sketch.clear();
+        sketch.count(map.data(), map.size());
+        // a background ranks by tf-idf instead, from everything the sketch kept
+        size_t top = keep && !background.is_open() ? keep : sketch.capacity();
+        uint64_t error = sketch.error_bound();
+        uint64_t seen = sketch_error.load();
+        while (error > seen && !sketch_error.compare_exchange_weak(seen, error))
+        {
+        }
+        emit(input, sketch_layer(input.path, sketch, top), map.size());
+    };
+
+    accumulator_pool accumulators(2);
+
+    struct big_file
+    {
+        const scan_input *input;
+        std::unique_ptr<mapped_file> map;
+        file_accumulator *accumulator;
+        std::atomic<size_t> remaining;
+    };
+
+    std::vector<work_stealing_pool::task> roots_tasks;
+    roots_tasks.reserve(inputs.size());
+    for (const auto &input : inputs)
+    {
+        roots_tasks.push_back([&, in = &input](size_t worker)
+                              {
+            try
+            {
+                auto map = std::make_unique<mapped_file>(in->path);
+                if (sketch_bytes)
+                {
+                    sketch_file(*in, *map, worker);
+                    return;
+                }
+                if (map->size() <= big_bytes)
+                {
+                    trigram_counter &histogram = scratch[worker];
+                    histogram_layer layer = count_layer(histogram, map->data(), map->size(), in->path);
+                    if (flags & FCUBE_POSITIONS)
+                    {
+                        add_positions(layer, map->data(), map->size(), slots(worker));
+                    }
+                    emit(*in, std::move(layer), map->size());
+                    return;
+                }
+
+                // chunks overlap by two bytes so no trigram is lost at a seam
+                auto file = std::make_shared<big_file>();
+                size_t starts = map->size() - 2;
+                size_t chunk_count = (starts + chunk_bytes - 1) / chunk_bytes;
+                file->input = in;
+                file->map = std::move(map);
+                file->accumulator = accumulators.acquire();
+                file->remaining = chunk_count;
+
+                for (size_t chunk = 0; chunk < chunk_count; ++chunk)
+                {
+                    size_t first = chunk * chunk_bytes;
+                    size_t last = std::min(first + chunk_bytes, starts);
+                    pool.spawn(worker, [&, file, first, last](size_t w)
+                               {
+                        trigram_counter &histogram = scratch[w];
+                        histogram.count(file->map->data() + first, last - first + 2);
+                        auto &counts = file->accumulator->counts;
+                        histogram.drain([&](uint32_t bin, uint64_t count)
+                                        { counts[bin].fetch_add(count, std::memory_order_relaxed); });
+
+                        if (--file->remaining == 0)
+                        {
+                            try
+                            {
+                                histogram_layer layer = file->accumulator->take(file->input->path);
+                                // one pass over the whole file on the worker that finished it
+                                if (flags & FCUBE_POSITIONS)
+                                {
+                                    add_positions(layer, file->map->data(), file->map->size(), slots(w));
+                                }
+                                emit(*file->input, std::move(layer), file->map->size());
+                            }
+                            catch (const std::exception &e)
+                            {
+                                fail(*file->input, e);
+                            }
+                            accumulators.release(file->accumulator);
+                        } });
+                }
+            }
+            catch (const std::exception &e)
+            {
+                fail(*in, e);
+            } });
+    }
+    pool.run(std::move(roots_tasks));
+
+    if (store)
+    {
+        store->close(bytes_done);
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double megabytes = bytes_done / double(1 << 20);
+    std::cout << "Scanned " << files_done << " files, " << megabytes << " MB in " << seconds << " s ("
+              << megabytes / std::max(seconds, 1e-9) << " MB/s) on " << pool.size() << " threads";
+    if (files_failed)
+    {
+        std::cout << ", " << files_failed << " failed";
+    }
+    if (sketch_bytes)
+    {
+        std::cout << ", sketched counts at most " << sketch_error << " high";
+    }
+    std::cout << std::endl;
+    return files_failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// .fcube files given directly or found below a directory
+std::vector<std::string> collect_fcubes(const std::vector<std::string> &roots)
+{
+    std::vector<std::string> paths;
+    for (const auto &root : roots)
+    {
+        if (fs::is_directory(root))
+        {
+            for (const auto &entry : fs::recursive_directory_iterator(root, fs::directory_options::skip_permission_denied))
+            {
+                std::error_code error;
+                if (entry.is_regular_file(error) && is_fcube(entry.path()))
+                {
+                    paths.push_back(entry.path().generic_string());
+                }
+            }
+        }
+        else if (fs::is_regular_file(root))
+        {
+            paths.push_back(root);
+        }
+        else
+        {
+            throw std::runtime_error("No such file or directory: " + root);
+        }
+    }
+    std::sort(paths.begin(), paths.end());
+    return paths;
+}
+
+// the layers of an .fcube, or the histogram of any other file counted here
+std::vector<histogram_layer> load_sample(const std::string &path, trigram_counter &histogram)
+{
+    if (is_fcube(path))
+    {
+        return read_fcube(path).layers;
+    }
+
+    mapped_file map(path);
+    std::vector<histogram_layer> layers;
+    layers.push_back(count_layer(histogram, map.data(), map.size(), path));
+    return layers;
+}
+
+int index_command(const arg_parser &args, const std::vector<std::string> &roots)
+{
+    std::string index_path = args.get_or<std::string>("--index", "");
+    if (index_path.empty() || roots.empty())
+    {
+        throw std::runtime_error("index needs --index FILE and at least one .fcube file or directory");
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::string> paths = collect_fcubes(roots);
+
+    // one row per layer, fingerprinted in parallel and sorted by name after
+    struct row
+    {
+        std::string name;
+        std::vector<float> fingerprint;
+    };
+    std::vector<row> rows;
+    std::mutex rows_mutex;
+
+    work_stealing_pool pool(thread_count(args));
+    std::vector<work_stealing_pool::task> tasks;
+    for (const auto &path : paths)
+    {
+        tasks.push_back([&, path](size_t)
+                        {
+            fcube_reader reader(path);
+            histogram_layer layer;
+            while (reader.next(layer))
+            {
+                row r{layer.name, make_fingerprint(layer)};
+                std::lock_guard<std::mutex> lock(rows_mutex);
+                rows.push_back(std::move(r));
+            } });
+    }
+    pool.run(std::move(tasks));
+
+    std::sort(rows.begin(), rows.end(), [](const row &a, const row &b)
+              { return a.name < b.name; });
+    std::vector<std::string> names;
+    std::vector<float> fingerprints;
+    fingerprints.reserve(rows.size() * FINGERPRINT_DIMS);
+    for (auto &r : rows)
+    {
+        names.push_back(std::move(r.name));
+        fingerprints.insert(fingerprints.end(), r.fingerprint.begin(), r.fingerprint.end());
+    }
+
+    uint32_t tables = static_cast<uint32_t>(std::clamp(args.get_or<int>("--lsh-tables", 8), 1, 64));
+    uint32_t bits = static_cast<uint32_t>(std::clamp(args.get_or<int>("--lsh-bits", 14), 1, 31));
+    write_similarity_index(index_path, names, fingerprints, tables, bits);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Indexed " << names.size() << " samples from " << paths.size() << " files into " << index_path
+              << " (" << tables << " tables of " << bits << " bits) in " << seconds << " s" << std::endl;
+    return EXIT_SUCCESS;
+}
+
+// every layer of every .fcube is one document. the counts are shared atomics,
+// a layer only touches the bins it has so workers rarely meet on one
+int background_command(const arg_parser &args, const std::vector<std::string> &roots)
+{
+    std::string background_path = args.get_or<std::string>("--background", "");
+    if (background_path.empty() || roots.empty())
+    {
+        throw std::runtime_error("background needs --background FILE and at least one .fcube file or directory");
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::string> paths = collect_fcubes(roots);
+
+    std::vector<std::atomic<uint32_t>> df(TRIGRAM_BINS);
+    std::atomic<uint64_t> documents{0};
+    std::atomic<uint64_t> input_size{0};
+
+    work_stealing_pool pool(thread_count(args));
+    std::vector<work_stealing_pool::task> tasks;
+    for (const auto &path : paths)
+    {
+        tasks.push_back([&, path](size_t)
+                        {
+            fcube_reader reader(path);
+            input_size += reader.input_size();
+            histogram_layer layer;
+            while (reader.next(layer))
+            {
+                for (uint32_t bin : layer.bins)
+                {
+                    df[bin].fetch_add(1, std::memory_order_relaxed);
+                }
+                documents++;
+            } });
+    }
+    pool.run(std::move(tasks));
+
+    std::vector<uint32_t> counts(TRIGRAM_BINS);
+    size_t seen = 0;
+    for (uint32_t bin = 0; bin < TRIGRAM_BINS; ++bin)
+    {
+        counts[bin] = df[bin].load(std::memory_order_relaxed);
+        seen += counts[bin] != 0;
+    }
+    write_background(background_path, documents, input_size, counts.data());
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Background of " << documents << " documents from " << paths.size() << " files, " << seen
+              << " trigrams seen, written to " << background_path << " in " << seconds << " s" << std::endl;
+    return EXIT_SUCCESS;
+}
+
+int query_command(const arg_parser &args, const std::vector<std::string> &samples)
+{
+    std::string index_path = args.get_or<std::string>("--index", "");
+    if (index_path.empty() || samples.empty())
+    {
+        throw std::runtime_error("query needs --index FILE and at least one sample");
+    }
+
+    std::string metric_name = args.get_or<std::string>("--metric", "js");
+    if (metric_name != "js" && metric_name != "cosine")
+    {
+        throw std::runtime_error("Unknown metric " + metric_name + ", expected js or cosine");
+    }
+    similarity_metric metric = metric_name == "js" ? similarity_metric::js : similarity_metric::cosine;
+    size_t top = static_cast<size_t>(std::max(args.get_or<int>("--top", 10), 1));
+    bool exact = args.get_or<bool>("--exact", false);
+
+    similarity_index index(index_path);
+    trigram_counter histogram;
+    for (const auto &sample : samples)
+    {
+        for (const auto &layer : load_sample(sample, histogram))
+        {
+            auto start = std::chrono::steady_clock::now();
+            std::vector<float> fingerprint = make_fingerprint(layer);
+            size_t scanned = 0;
+            auto matches = index.query(fingerprint.data(), top, metric, exact, &scanned);
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            std::cout << layer.name << ": " << scanned << " of " << index.count() << " compared in " << ms << " ms\n";
+            for (size_t i = 0; i < matches.size(); i++)
+            {
+                std::cout << "  " << i + 1 << "  " << matches[i].distance << "  " << index.name(matches[i].id) << "\n";
+            }
+        }
+    }
+    std::cout << std::flush;
+    return EXIT_SUCCESS;
+}
+
+// every layer of every sample below each class directory of root
+int train_command(const arg_parser &args, const std::vector<std::string> &roots)
+{
+    std::string model_path = args.get_or<std::string>("--model", "");
+    if (model_path.empty() || roots.size() != 1 || !fs::is_directory(roots[0]))
+    {
+        throw std::runtime_error("train needs --model FILE and one directory with a subdirectory per class");
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::pair<std::string, scan_input>> samples;
+    for (const auto &entry : fs::directory_iterator(roots[0]))
+    {
+        if (entry.is_directory())
+        {
+            std::string label = entry.path().filename().string();
+            for (auto &input : collect_inputs({entry.path().string()}))
+            {
+                samples.emplace_back(label, std::move(input));
+            }
+        }
+    }
+    if (samples.empty())
+    {
+        throw std::runtime_error("No samples below " + roots[0]);
+    }
+
+    work_stealing_pool pool(thread_count(args));
+    scratch_set scratch(pool.size());
+    classifier_trainer trainer;
+    std::mutex trainer_mutex;
+    std::atomic<size_t> failed{0};
+
+    std::vector<work_stealing_pool::task> tasks;
+    for (const auto &sample : samples)
+    {
+        tasks.push_back([&, s = &sample](size_t worker)
+                        {
+            try
+            {
+                for (const auto &layer : load_sample(s->second.path, scratch[worker]))
+                {
+                    std::vector<float> features = classifier_features(make_fingerprint(layer));
+                    std::lock_guard<std::mutex> lock(trainer_mutex);
+                    trainer.add(s->first, features);
+                }
+            }
+            catch (const std::exception &e)
+            {
+                failed++;
+                std::lock_guard<std::mutex> lock(trainer_mutex);
+                std::cerr << s->second.path << ": " << e.what() << std::endl;
+            } });
+    }
+    pool.run(std::move(tasks));
+
+    classifier_model model = trainer.finish();
+    write_classifier_model(model_path, model);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Trained " << model.classes.size() << " classes on " << samples.size() - failed << " samples in " << seconds << " s:";
+    for (const auto &c : model.classes)
+    {
+        std::cout << " " << c.name << " (" << c.samples << ")";
+    }
+    std::cout << std::endl;
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// prints "path: class (margin m)" per sample in path order, like file(1)
+int classify_command(const arg_parser &args, const std::vector<std::string> &roots)
+{
+    std::string model_path = args.get_or<std::string>("--model", "");
+    if (model_path.empty() || roots.empty())
+    {
+        throw std::runtime_error("classify needs --model FILE and at least one file or directory");
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    classifier_model model = read_classifier_model(model_path);
+    std::vector<scan_input> inputs = collect_inputs(roots);
+    std::vector<std::string> lines(inputs.size());
+
+    work_stealing_pool pool(thread_count(args));
+    scratch_set scratch(pool.size());
+    std::atomic<size_t> failed{0};
+    std::atomic<uint64_t> bytes{0};
+
+    std::vector<work_stealing_pool::task> tasks;
+    for (size_t i = 0; i < inputs.size(); i++)
+    {
+        tasks.push_back([&, i](size_t worker)
+                        {
+            try
+            {
+                for (const auto &layer : load_sample(inputs[i].path, scratch[worker]))
+                {
+                    classification c = classify(model, classifier_features(make_fingerprint(layer)));
+                    lines[i] += layer.name + ": " + model.classes[c.best].name + " (margin " + std::to_string(c.margin) + ")\n";
+                }
+                bytes += inputs[i].size;
+            }
+            catch (const std::exception &e)
+            {
+                failed++;
+                lines[i] = inputs[i].path + ": error, " + e.what() + "\n";
+            } });
+    }
+    pool.run(std::move(tasks));
+
+    std::vector<size_t> order(inputs.size());
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b)
+              { return inputs[a].path < inputs[b].path; });
+    for (size_t i : order)
+    {
+        std::cout << lines[i];
+    }
+    std::cout << std::flush;
+
+    // stdout stays clean for pipelines
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cerr << "Classified " << inputs.size() - failed << " files, " << bytes / double(1 << 20) << " MB in " << seconds
+              << " s against " << model.classes.size() << " classes" << std::endl;
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// one pass for the cuts, one more to count each region, both linear
+int segment_command(const arg_parser &args, const std::vector<std::string> &files)
+{
+    if (files.empty())
+    {
+        throw std::runtime_error("segment needs at least one file");
+    }
+
+    segment_options options;
+    options.window = static_cast<size_t>(std::clamp(args.get_or<int>("--window-kb", 64), 1, 1 << 20)) << 10;
+    options.threshold = args.get_or<float>("--threshold", 0.1f);
+
+    std::string model_path = args.get_or<std::string>("--model", "");
+    classifier_model model;
+    if (!model_path.empty())
+    {
+        model = read_classifier_model(model_path);
+    }
+
+    std::string store_path = args.get_or<std::string>("--store", "");
+    std::unique_ptr<fcube_writer> store;
+    if (!store_path.empty())
+    {
+        store = std::make_unique<fcube_writer>(store_path);
+    }
+
+    trigram_counter histogram;
+    uint64_t bytes = 0;
+    for (const auto &path : files)
+    {
+        auto start = std::chrono::steady_clock::now();
+        mapped_file map(path);
+        std::vector<segment_region> regions = cut_regions(find_change_points(map.data(), map.size(), options), map.size());
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cout << path << ": " << regions.size() << " regions (" << ms << " ms)\n";
+
+        for (const auto &region : regions)
+        {
+            char line[96];
+            snprintf(line, sizeof(line), "  0x%010llx  %12llu", static_cast<unsigned long long>(region.offset),
+                     static_cast<unsigned long long>(region.length));
+            std::cout << line;
+
+            // trigrams starting in the region, so two bytes may reach past it
+            size_t end = static_cast<size_t>(std::min<uint64_t>(region.offset + region.length + 2, map.size()));
+            snprintf(line, sizeof(line), "@0x%llx+%llu", static_cast<unsigned long long>(region.offset),
+                     static_cast<unsigned long long>(region.length));
+            histogram_layer layer = count_layer(histogram, map.data() + region.offset, end - region.offset, path + line);
+
+            if (!model.classes.empty())
+            {
+                classification c = classify(model, classifier_features(make_fingerprint(layer)));
+                std::cout << "  " << model.classes[c.best].name << " (margin " << c.margin << ")";
+            }
+            std::cout << "\n";
+            if (store)
+            {
+                store->add(layer);
+            }
+        }
+        bytes += map.size();
+    }
+
+    if (store)
+    {
+        store->close(bytes);
+        std::cout << "Regions written to " << store_path << " as layers (N / B in the viewer)\n";
+    }
+    std::cout << std::flush;
+    return EXIT_SUCCESS;
+}
+
+// a layer per section (or, without section headers, per loadable segment)
+// of every ELF, PE and Mach-O file below PATH, named path:section. the
+// sections of a file are counted in parallel, straight from its mapping
+int sections_command(const arg_parser &args, const std::vector<std::string> &roots)
+{
+    std::string out_dir = args.get_or<std::string>("--out", "");
+    std::string store_path = args.get_or<std::string>("--store", "");
+    if (out_dir.empty() == store_path.empty() || roots.empty())
+    {
+        throw std::runtime_error("sections needs either --out DIR or --store FILE, and at least one file or directory");
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<scan_input> inputs = collect_inputs(roots);
+    work_stealing_pool pool(thread_count(args));
+    scratch_set scratch(pool.size());
+    std::unique_ptr<fcube_writer> store;
+    if (!store_path.empty())
+    {
+        store = std::make_unique<fcube_writer>(store_path);
+    }
+    uint64_t bytes = 0;
+    size_t files = 0;
+    size_t sections = 0;
+    size_t failed = 0;
+
+    for (const auto &input : inputs)
+    {
+        // a file that vanished or can't be read is reported, the rest carry on
+        try
+        {
+            mapped_file map(input.path);
+            binary_layout layout;
+            try
+            {
+                layout = parse_sections(map.data(), map.size());
+            }
+            catch (const std::exception &e)
+            {
+                // not an executable, skipped rather than failed
+                std::cerr << input.path << ": " << e.what() << std::endl;
+                continue;
+            }
+
+            std::vector<histogram_layer> layers(layout.sections.size());
+            std::vector<work_stealing_pool::task> tasks;
+            for (size_t i = 0; i < layout.sections.size(); i++)
+            {
+                tasks.push_back([&, i](size_t worker)
+                                {
+                    const binary_section &section = layout.sections[i];
+                    layers[i] = count_layer(scratch[worker], map.data() + section.offset, section.size, input.path + ":" + section.name); });
+            }
+            pool.run(std::move(tasks));
+            std::cout << input.path << ": " << layout.format << ", " << layers.size() << " sections" << std::endl;
+
+            if (store)
+            {
+                for (const auto &layer : layers)
+                {
+                    store->add(layer);
+                }
+            }
+            else
+            {
+                fs::path out_path = fs::path(out_dir) / (input.relative + ".fcube");
+                fs::create_directories(out_path.parent_path());
+                fcube cube;
+                cube.input_size = map.size();
+                cube.layers = std::move(layers);
+                write_fcube(out_path.string(), cube);
+            }
+            bytes += map.size();
+            files++;
+            sections += layout.sections.size();
+        }
+        catch (const std::exception &e)
+        {
+            failed++;
+            std::cerr << input.path << ": " << e.what() << std::endl;
+        }
+    }
+    if (store)
+    {
+        store->close(bytes);
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Counted " << sections << " sections of " << files << " of " << inputs.size() << " files, "
+              << bytes / double(1 << 20) << " MB in " << seconds << " s (N / B and T in the viewer)";
+    if (failed)
+    {
+        std::cout << ", " << failed << " failed";
+    }
+    std::cout << std::endl;
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// DIR/<relative path>.pgm per file: every pixel a stretch of the file along a
+// hilbert curve, brighter the rarer its trigrams are in the whole file.
+// files go one at a time, each spread over the pool tile by tile
+int rarity_command(const arg_parser &args, const std::vector<std::string> &roots)
+{
+    std::string out_dir = args.get_or<std::string>("--out", "");
+    if (out_dir.empty() || roots.empty())
+    {
+        throw std::runtime_error("rarity needs --out DIR and at least one file or directory");
+    }
+    uint32_t side = static_cast<uint32_t>(std::clamp(args.get_or<int>("--side", 512), 2, 4096));
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<scan_input> inputs = collect_inputs(roots);
+    work_stealing_pool pool(thread_count(args));
+    trigram_counter histogram;
+    // the dense counts rarity_cells looks up, zeroed again bin by bin after each file
+    std::vector<uint32_t> counts(TRIGRAM_BINS, 0);
+    uint64_t bytes = 0;
+    size_t failed = 0;
+
+    for (const auto &input : inputs)
+    {
+        histogram_layer layer;
+        // a file that vanished or can't be read is reported, the rest carry on
+        try
+        {
+            mapped_file map(input.path);
+            if (map.size() < 3)
+            {
+                continue;
+            }
+            layer = count_layer(histogram, map.data(), map.size(), input.path);
+            for (size_t i = 0; i < layer.bins.size(); i++)
+            {
+                counts[layer.bins[i]] = static_cast<uint32_t>(std::min<uint64_t>(layer.counts[i], UINT32_MAX));
+            }
+
+            rarity_map rarity = make_rarity_map(map.data(), map.size(), counts.data(), layer.total, side, &pool);
+            fs::path out_path = fs::path(out_dir) / (input.relative + ".pgm");
+            fs::create_directories(out_path.parent_path());
+            write_rarity_pgm(out_path.string(), rarity_pixels(rarity));
+            std::cout << out_path.string() << ": " << rarity.cell_bytes << " bytes per pixel" << std::endl;
+            bytes += map.size();
+        }
+        catch (const std::exception &e)
+        {
+            failed++;
+            std::cerr << input.path << ": " << e.what() << std::endl;
+        }
+
+        // cleared whether or not the file made it, so the next one starts from zero
+        for (uint32_t bin : layer.bins)
+        {
+            counts[bin] = 0;
+        }
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Mapped " << inputs.size() - failed << " files, " << bytes / double(1 << 20) << " MB in " << seconds
+              << " s (--rarity in the viewer)";
+    if (failed)
+    {
+        std::cout << ", " << failed << " failed";
+    }
+    std::cout << std::endl;
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// each phase is counted as its own shifted byte stream through a worker's
+// trigram_counter, cache-blocked on high-entropy input, phases spread over the workers.
+// a phase costs about what scan costs for the same bytes, so all eight keep up with
+// the input only on eight cores; one core manages an eighth of that, or
+// --bit-stride 8 for the bytes alone
+int bits_command(const arg_parser &args, const std::vector<std::string> &roots)
+{
+    std::string out_dir = args.get_or<std::string>("--out", "");
+    std::string store_path = args.get_or<std::string>("--store", "");
+    if (out_dir.empty() == store_path.empty() || roots.empty())
+    {
+        throw std::runtime_error("bits needs either --out DIR or --store FILE, and at least one file or directory");
+    }
+
+    int stride = args.get_or<int>("--bit-stride", 1);
+    if (stride != 1 && stride != 2 && stride != 4 && stride != 8)
+    {
+        throw std::runtime_error("--bit-stride must be 1, 2, 4 or 8");
+    }
+    unsigned mask = bit_stride_mask(stride);
+
+    std::unique_ptr<fcube_writer> store;
+    if (!store_path.empty())
+    {
+        store = std::make_unique<fcube_writer>(store_path);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    work_stealing_pool pool(std::min<size_t>(thread_count(args), BIT_PHASES / stride));
+    // a phase per task, each through its worker's counter
+    scratch_set scratch(pool.size());
+    std::vector<std::vector<uint8_t>> buffers(pool.size());
+    uint64_t bytes = 0;
+    size_t failed = 0;
+
+    std::vector<scan_input> inputs = collect_inputs(roots);
+    for (const auto &input : inputs)
+    {
+        // a file that vanished or can't be read is reported, the rest carry on
+        try
+        {
+            mapped_file map(input.path);
+            std::vector<histogram_layer> layers(BIT_PHASES);
+            std::vector<work_stealing_pool::task> tasks;
+            for (int phase = 0; phase < BIT_PHASES; phase++)
+            {
+                if (mask & (1u << phase))
+                {
+                    tasks.push_back([&, phase](size_t worker)
+                                    { layers[phase] = count_bit_phase(scratch[worker], map.data(), map.size(), phase, buffers[worker],
+                                                                      input.path + "#bit" + std::to_string(phase)); });
+                }
+            }
+            pool.run(std::move(tasks));
+
+            fcube cube;
+            cube.input_size = map.size();
+            for (int phase = 0; phase < BIT_PHASES; phase++)
+            {
+                if (mask & (1u << phase))
+                {
+                    cube.layers.push_back(std::move(layers[phase]));
+                }
+            }
+
+            if (store)
+            {
+                for (const auto &layer : cube.layers)
+                {
+                    store->add(layer);
+                }
+            }
+            else
+            {
+                fs::path out_path = fs::path(out_dir) / (input.relative + ".fcube");
+                fs::create_directories(out_path.parent_path());
+                write_fcube(out_path.string(), cube);
+            }
+            bytes += map.size();
+        }
+        catch (const std::exception &e)
+        {
+            failed++;
+            std::cerr << input.path << ": " << e.what() << std::endl;
+        }
+    }
+
+    if (store)
+    {
+        store->close(bytes);
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double megabytes = bytes / double(1 << 20);
+    std::cout << "Counted " << BIT_PHASES / stride << " bit phases of " << inputs.size() - failed << " files, " << megabytes
+              << " MB in " << seconds << " s (" << megabytes / std::max(seconds, 1e-9) << " MB/s) on " << pool.size() << " threads";
+    if (failed)
+    {
+        std::cout << ", " << failed << " failed";
+    }
+    std::cout << std::endl;
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// "41 42 43 'ABC'", printable bytes shown as text
+std::string describe_trigram(uint32_t bin)
+{
+    char text[32];
+    uint8_t a = uint8_t(bin >> 16), b = uint8_t(bin >> 8), c = uint8_t(bin);
+    auto shown = [](uint8_t byte)
+    { return byte >= 0x20 && byte < 0x7f ? char(byte) : '.'; };
+    snprintf(text, sizeof(text), "%02x %02x %02x '%c%c%c'", a, b, c, shown(a), shown(b), shown(c));
+    return text;
+}
+
+// BEFORE and AFTER are two files, or two trees whose files pair up by
+// relative path. layers pair up by position, pairs are listed most changed
+// first with their --top trigram changes
+int diff_command(const arg_parser &args, const std::vector<std::string> &sides)
+{
+    if (sides.size() != 2)
+    {
+        throw std::runtime_error("diff needs exactly two files or directories, BEFORE and AFTER");
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    struct pair
+    {
+        std::string before, after, name;
+        float distance = -1.0f; // -1 until compared
+        std::string report = "";
+    };
+    std::vector<pair> pairs;
+    size_t unmatched = 0;
+    if (fs::is_directory(sides[0]) && fs::is_directory(sides[1]))
+    {
+        std::vector<scan_input> before = collect_inputs({sides[0]});
+        std::vector<scan_input> after = collect_inputs({sides[1]});
+        std::unordered_map<std::string, const scan_input *> by_relative;
+        for (const auto &input : after)
+        {
+            by_relative[input.relative] = &input;
+        }
+        for (const auto &input : before)
+        {
+            auto match = by_relative.find(input.relative);
+            if (match == by_relative.end())
+            {
+                unmatched++;
+                continue;
+            }
+            pairs.push_back({input.path, match->second->path, input.relative});
+            by_relative.erase(match);
+        }
+        unmatched += by_relative.size();
+    }
+    else
+    {
+        pairs.push_back({sides[0], sides[1], sides[1]});
+    }
+
+    size_t top = static_cast<size_t>(std::max(args.get_or<int>("--top", 10), 0));
+    work_stealing_pool pool(thread_count(args));
+    scratch_set scratch(pool.size());
+    std::atomic<size_t> failed{0};
+
+    std::vector<work_stealing_pool::task> tasks;
+    for (auto &p : pairs)
+    {
+        tasks.push_back([&, entry = &p](size_t worker)
+                        {
+            try
+            {
+                std::vector<histogram_layer> before = load_sample(entry->before, scratch[worker]);
+                std::vector<histogram_layer> after = load_sample(entry->after, scratch[worker]);
+                for (size_t l = 0; l < std::min(before.size(), after.size()); ++l)
+                {
+                    histogram_diff diff = diff_layers(before[l], after[l]);
+                    entry->distance = std::max(entry->distance, diff.distance);
+
+                    char line[160];
+                    snprintf(line, sizeof(line), "%.4f  %s", diff.distance, (before.size() > 1 ? before[l].name : entry->name).c_str());
+                    entry->report += std::string(line) + "\n";
+                    for (size_t i : top_changes(diff, top))
+                    {
+                        if (diff.delta[i] == 0.0f)
+                        {
+                            break; // the rest are unchanged too
+                        }
+                        snprintf(line, sizeof(line), "  %+8.4f%%  %s  %.4f%% -> %.4f%%\n", 100.0f * diff.delta[i],
+                                 describe_trigram(diff.bins[i]).c_str(), 100.0f * diff.before[i], 100.0f * diff.after[i]);
+                        entry->report += line;
+                    }
+                }
+            }
+            catch (const std::exception &e)
+            {
+                failed++;
+                entry->report = entry->name + ": error, " + e.what() + "\n";
+            } });
+    }
+    pool.run(std::move(tasks));
+
+    std::stable_sort(pairs.begin(), pairs.end(), [](const pair &a, const pair &b)
+                     { return a.distance > b.distance; });
+    for (const auto &p : pairs)
+    {
+        std::cout << p.report;
+    }
+    std::cout << std::flush;
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cerr << "Compared " << pairs.size() - failed << " pairs in " << seconds << " s";
+    if (unmatched)
+    {
+        std::cerr << ", " << unmatched << " files only on one side";
+    }
+    std::cerr << std::endl;
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// "START:LENGTH" in bytes, clipped to the file. no --range is the whole file
+std::pair<uint64_t, uint64_t> parse_range(const std::string &range, uint64_t size)
+{
+    if (range.empty())
+    {
+        return {0, size};
+    }
+    size_t colon = range.find(':');
+    if (colon == std::string::npos)
+    {
+        throw std::runtime_error("--range wants START:LENGTH, got " + range);
+    }
+    uint64_t start = std::min<uint64_t>(std::stoull(range.substr(0, colon)), size);
+    uint64_t length = std::min<uint64_t>(std::stoull(range.substr(colon + 1)), size - start);
+    return {start, length};
+}
+
+// entries of an estimate, most common first, at most top of them
+std::vector<size_t> most_common(const histogram_layer &estimate, size_t top)
+{
+    std::vector<size_t> order(estimate.bins.size());
+    std::iota(order.begin(), order.end(), 0);
+    top = std::min(top, order.size());
+    std::partial_sort(order.begin(), order.begin() + top, order.end(), [&](size_t a, size_t b)
+                      { return estimate.counts[a] > estimate.counts[b]; });
+    order.resize(top);
+    return order;
+}
+
+// half the 95% interval over the estimate, the median over `entries`
+double median_error(const histogram_layer &estimate, const std::vector<size_t> &entries)
+{
+    std::vector<double> errors;
+    for (size_t i : entries)
+    {
+        count_interval interval = wilson_interval(sampled_count(estimate, i), estimate.sample);
+        errors.push_back((interval.high - interval.low) / 2 / std::max<double>(estimate.counts[i], 1));
+    }
+    if (errors.empty())
+    {
+        return 0.0;
+    }
+    std::nth_element(errors.begin(), errors.begin() + errors.size() / 2, errors.end());
+    return errors[errors.size() / 2];
+}
+
+// a first estimate of a huge file fast, then better ones until it is exact.
+// blocks come from every stretch of the file (sampling.hpp), each round reads
+// as many as all the rounds before it so the whole costs at most twice a
+// scan, and --store is renamed over after every round so the viewer can
+// follow it. the last one is what scan --store writes for the file
+int sample_command(const arg_parser &args, const std::vector<std::string> &files)
+{
+    std::string store_path = args.get_or<std::string>("--store", "");
+    if (store_path.empty() || files.size() != 1)
+    {
+        throw std::runtime_error("sample needs --store FILE and one file");
+    }
+    uint64_t block_bytes = static_cast<uint64_t>(std::clamp(args.get_or<int>("--block-kb", 1024), 4, 1 << 20)) << 10;
+    uint64_t first_bytes = static_cast<uint64_t>(std::max(args.get_or<int>("--first-mb", 64), 1)) << 20;
+
+    auto start = std::chrono::steady_clock::now();
+    const std::string &path = files[0];
+    // blocks are read out of order, readahead is asked for a round at a time
+    mapped_file map(path, false);
+    sample_plan plan(map.size(), block_bytes);
+    work_stealing_pool pool(thread_count(args));
+    scratch_set scratch(pool.size());
+    file_accumulator accumulator;
+    size_t round_blocks = static_cast<size_t>(std::max<uint64_t>(first_bytes / block_bytes, 1));
+    std::string temporary = store_path + ".part";
+
+    while (!plan.done())
+    {
+        std::vector<sample_block> blocks = plan.next(round_blocks);
+        size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+        for (const sample_block &block : blocks)
+        {
+            uint64_t first = block.offset / page * page;
+            ::madvise(const_cast<uint8_t *>(map.data()) + first, block.offset + block.length + 2 - first, MADV_WILLNEED);
+        }
+
+        std::vector<work_stealing_pool::task> tasks;
+        for (const sample_block &block : blocks)
+        {
+            tasks.push_back([&, block](size_t worker)
+                            {
+                trigram_counter &histogram = scratch[worker];
+                histogram.count(map.data() + block.offset, block.length + 2);
+                histogram.drain([&](uint32_t bin, uint64_t count)
+                                { accumulator.counts[bin].fetch_add(count, std::memory_order_relaxed); }); });
+        }
+        pool.run(std::move(tasks));
+
+        fcube cube;
+        cube.input_size = map.size();
+        histogram_layer sampled = accumulator.snapshot(path);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (plan.done())
+        {
+            cube.layers.push_back(std::move(sampled));
+            std::cout << "Exact after " << seconds << " s" << std::endl;
+        }
+        else
+        {
+            fcube_sample record = plan.record();
+            cube.flags = FCUBE_SAMPLED;
+            cube.layers.push_back(estimate_layer(sampled, record));
+            const histogram_layer &estimate = cube.layers[0];
+            std::cout << 100.0 * record.sampled / record.positions << "% sampled (" << record.blocks_read << " of "
+                      << record.blocks << " blocks) after " << seconds << " s, top 100 trigrams +-"
+                      << 100.0 * median_error(estimate, most_common(estimate, 100)) << "% (median)" << std::endl;
+            if (record.blocks_read == round_blocks)
+            {
+                // the first estimate, the viewer shows any trigram's range when picked
+                for (size_t i : most_common(estimate, static_cast<size_t>(std::max(args.get_or<int>("--top", 10), 0))))
+                {
+                    count_interval interval = wilson_interval(sampled_count(estimate, i), record);
+                    std::cout << "  " << describe_trigram(estimate.bins[i]) << "  " << estimate.counts[i] << "  95% "
+                              << uint64_t(interval.low) << ".." << uint64_t(std::ceil(interval.high)) << std::endl;
+                }
+            }
+        }
+        write_fcube(temporary, cube);
+        fs::rename(temporary, store_path);
+        round_blocks = static_cast<size_t>(plan.blocks_read());
+    }
+
+    if (plan.blocks() == 0)
+    {
+        fcube cube;
+        cube.input_size = map.size();
+        cube.layers.push_back(accumulator.snapshot(path));
+        write_fcube(store_path, cube);
+    }
+    return EXIT_SUCCESS;
+}
+
+// counts --range of each file, cut into --pieces, as shards for merge. each
+// machine given a slice of a huge image runs this on its own range
+int shard_command(const arg_parser &args, const std::vector<std::string> &files)
+{
+    std::string store_path = args.get_or<std::string>("--store", "");
+    if (store_path.empty() || files.empty())
+    {
+        throw std::runtime_error("shard needs --store FILE and at least one file");
+    }
+    size_t pieces = static_cast<size_t>(std::max(args.get_or<int>("--pieces", 1), 1));
+    std::string range = args.get_or<std::string>("--range", "");
+
+    auto start = std::chrono::steady_clock::now();
+    work_stealing_pool pool(thread_count(args));
+    scratch_set scratch(pool.size());
+    fcube_writer store(store_path, FCUBE_SHARD);
+    uint64_t bytes = 0;
+    size_t shards = 0;
+
+    for (const auto &path : files)
+    {
+        mapped_file map(path);
+        auto [first, length] = parse_range(range, map.size());
+        std::vector<histogram_layer> layers(pieces);
+        std::vector<work_stealing_pool::task> tasks;
+        for (size_t piece = 0; piece < pieces; ++piece)
+        {
+            tasks.push_back([&, piece, first = first, length = length](size_t worker)
+                            {
+                uint64_t begin = first + length * piece / pieces;
+                uint64_t end = first + length * (piece + 1) / pieces;
+                layers[piece] = count_layer(scratch[worker], map.data() + begin, end - begin, path);
+                set_shard_edges(layers[piece], map.data() + begin, end - begin, begin, map.size()); });
+        }
+        pool.run(std::move(tasks));
+
+        for (const auto &layer : layers)
+        {
+            store.add(layer);
+        }
+        bytes += length;
+        shards += pieces;
+    }
+    store.close(bytes);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Wrote " << shards << " shards of " << files.size() << " files, " << bytes / double(1 << 20) << " MB in "
+              << seconds << " s to " << store_path << std::endl;
+    return EXIT_SUCCESS;
+}
+
+// every shard below PATH, grouped by input name. a group that covers its
+// whole input comes out as the histogram a scan of it would have written,
+// bit for bit, otherwise the output is a shard again for a later merge
+int merge_command(const arg_parser &args, const std::vector<std::string> &roots)
+{
+    std::string store_path = args.get_or<std::string>("--store", "");
+    if (store_path.empty() || roots.empty())
+    {
+        throw std::runtime_error("merge needs --store FILE and at least one shard .fcube or directory");
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::map<std::string, std::vector<histogram_layer>> groups;
+    size_t shards = 0;
+    for (const auto &path : collect_fcubes(roots))
+    {
+        fcube_reader reader(path);
+        if (!(reader.flags() & FCUBE_SHARD))
+        {
+            throw std::runtime_error(path + " holds no shards");
+        }
+        histogram_layer layer;
+        while (reader.next(layer))
+        {
+            layer.position_mean.clear();
+            layer.position_spread.clear();
+            groups[layer.name].push_back(std::move(layer));
+            shards++;
+        }
+    }
+
+    work_stealing_pool pool(thread_count(args));
+    std::vector<histogram_layer> merged;
+    bool complete = true;
+    uint64_t bytes = 0;
+    for (const auto &group : groups)
+    {
+        std::vector<const histogram_layer *> parts;
+        for (const auto &layer : group.second)
+        {
+            parts.push_back(&layer);
+        }
+        merged.push_back(merge_shards(parts, &pool));
+        complete = complete && shard_complete(merged.back());
+        bytes += merged.back().shard.length;
+    }
+
+    fcube_writer store(store_path, complete ? 0 : FCUBE_SHARD);
+    for (const auto &layer : merged)
+    {
+        store.add(layer);
+    }
+    store.close(bytes);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Merged " << shards << " shards into " << merged.size() << (complete ? " histograms" : " shards") << " in "
+              << seconds << " s" << std::endl;
+    return EXIT_SUCCESS;
+}
+
+// answers COUNT requests on --socket until SIGINT or SIGTERM. at most
+// --threads files are counted at once, each with a scratch table from a
+// free list, however many clients are connected
+int serve_command(const arg_parser &args, const std::vector<std::string> &rest)
+{
+    std::string socket_path = args.get_or<std::string>("--socket", "");
+    if (socket_path.empty() || !rest.empty())
+    {
+        throw std::runtime_error("serve needs --socket PATH and no other arguments");
+    }
+    uint64_t cache_bytes = static_cast<uint64_t>(std::max(args.get_or<int>("--cache-mb", 1024), 0)) << 20;
+
+    size_t workers = thread_count(args);
+    std::vector<std::unique_ptr<trigram_counter>> free_scratch;
+    std::mutex scratch_mutex;
+    std::condition_variable scratch_freed;
+    size_t created = 0;
+
+    histogram_server server(socket_path, cache_bytes, [&](const std::string &path)
+                            {
+        std::unique_ptr<trigram_counter> histogram;
+        {
+            std::unique_lock<std::mutex> lock(scratch_mutex);
+            scratch_freed.wait(lock, [&]() { return !free_scratch.empty() || created < workers; });
+            if (free_scratch.empty())
+            {
+                created++;
+                histogram = std::make_unique<trigram_counter>();
+            }
+            else
+            {
+                histogram = std::move(free_scratch.back());
+                free_scratch.pop_back();
+            }
+        }
+
+        fcube cube;
+        try
+        {
+            auto start = std::chrono::steady_clock::now();
+            mapped_file map(path);
+            cube.input_size = map.size();
+            cube.layers.push_back(count_layer(*histogram, map.data(), map.size(), path));
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            std::cout << "Counted " << path << ", " << map.size() / double(1 << 20) << " MB in " << seconds << " s" << std::endl;
+        }
+        catch (...)
+        {
+            // a failed count leaves the table dirty, so it is dropped
+            std::lock_guard<std::mutex> lock(scratch_mutex);
+            created--;
+            scratch_freed.notify_one();
+            throw;
+        }
+
+        std::lock_guard<std::mutex> lock(scratch_mutex);
+        free_scratch.push_back(std::move(histogram));
+        scratch_freed.notify_one();
+        return cube; });
+
+    // the signals are taken by a thread of their own, stop() isn't safe in a handler
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    std::thread waiter([&]()
+                       {
+        int signal = 0;
+        sigwait(&signals, &signal);
+        server.stop(); });
+
+    std::cout << "Serving on " << socket_path << " with " << workers << " counting threads and "
+              << (cache_bytes >> 20) << " MB of cache" << std::endl;
+    std::exception_ptr failure;
+    try
+    {
+        server.run();
+    }
+    catch (...)
+    {
+        failure = std::current_exception();
+    }
+    pthread_kill(waiter.native_handle(), SIGTERM);
+    waiter.join();
+    if (failure)
+    {
+        std::rethrow_exception(failure);
+    }
+
+    histogram_server::stats stats = server.statistics();
+    std::cout << "Answered " << stats.requests << " requests, " << stats.hits << " from the cache" << std::endl;
+    return EXIT_SUCCESS;
+}
+
+// a file on its way through watch, handed from queue to queue
+struct ingest_item
+{
+    std::string path;
+    std::string relative;
+    std::chrono::steady_clock::time_point seen;
+    std::unique_ptr<mapped_file> map;
+    uint64_t size = 0;
+    histogram_layer layer;
+    std::string label;
+};
+
+using ingest_queue = bounded_queue<std::unique_ptr<ingest_item>>;
+
+// "read,count,fingerprint,write" workers, 0 for one per core
+std::array<size_t, 4> stage_threads(const arg_parser &args)
+{
+    std::string list = args.get_or<std::string>("--stages", "1,0,1,1");
+    std::array<size_t, 4> threads{};
+    size_t stage = 0;
+    size_t begin = 0;
+    while (stage < threads.size() && begin <= list.size())
+    {
+        size_t end = std::min(list.find(',', begin), list.size());
+        int n = std::atoi(list.substr(begin, end - begin).c_str());
+        threads[stage++] = n > 0 ? static_cast<size_t>(n) : std::max<size_t>(std::thread::hardware_concurrency(), 1);
+        begin = end + 1;
+    }
+    if (stage != threads.size())
+    {
+        throw std::runtime_error("--stages needs four worker counts, read,count,fingerprint,write");
+    }
+    return threads;
+}
+
+// ingests every file closed for writing or moved into DIR (and the
+// directories made below it) until SIGINT or SIGTERM, through four stages:
+//
+//   inotify -> read -> count -> fingerprint -> write
+//
+// the queues between them are bounded, so a saturated disk or CPU stalls
+// the stages in front of it and, last, the inotify reader, whose kernel
+// queue takes up the burst. when that overflows too every directory is
+// rescanned for inputs newer than their output. SIGUSR1 prints counters
+int watch_command(const arg_parser &args, const std::vector<std::string> &roots)
+{
+    std::string out_dir = args.get_or<std::string>("--out", "");
+    if (out_dir.empty() || roots.empty())
+    {
+        throw std::runtime_error("watch needs --out DIR and at least one directory");
+    }
+    std::array<size_t, 4> threads = stage_threads(args);
+    size_t depth = static_cast<size_t>(std::clamp(args.get_or<int>("--queue", 16), 1, 1 << 16));
+    background_model background;
+    std::string background_path = args.get_or<std::string>("--background", "");
+    if (!background_path.empty())
+    {
+        background.open(background_path);
+    }
+    size_t keep = static_cast<size_t>(std::max(args.get_or<int>("--keep", 0), 0));
+    classifier_model model;
+    std::string model_path = args.get_or<std::string>("--model", "");
+    if (!model_path.empty())
+    {
+        model = read_classifier_model(model_path);
+    }
+    fs::create_directories(out_dir);
+    fs::path out_root = fs::canonical(out_dir);
+
+    auto start = std::chrono::steady_clock::now();
+    const char *names[] = {"watch", "read", "count", "fingerprint", "write"};
+    std::array<stage_counters, 5> counters;
+    std::array<std::unique_ptr<ingest_queue>, 4> queues;
+    for (auto &queue : queues)
+    {
+        queue = std::make_unique<ingest_queue>(depth);
+    }
+    latency_histogram latency;
+    std::atomic<uint64_t> bytes{0};
+    std::mutex log_mutex;
+
+    auto nanoseconds = [](std::chrono::steady_clock::time_point from)
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - from).count());
+    };
+
+    auto print_stats = [&]()
+    {
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::lock_guard<std::mutex> lock(log_mutex);
+        std::cerr << "After " << seconds << " s: " << counters[4].items << " files, " << bytes / double(1 << 20) << " MB, "
+                  << counters[4].items / seconds << " files/s, " << bytes / double(1 << 20) / seconds << " MB/s\n";
+        for (size_t stage = 0; stage < counters.size(); stage++)
+        {
+            const stage_counters &c = counters[stage];
+            std::cerr << "  " << names[stage] << ": " << c.items << " done, " << c.failed << " failed, busy " << c.busy_ns / 1e9
+                      << " s, blocked " << c.blocked_ns / 1e9 << " s, idle " << c.idle_ns / 1e9 << " s";
+            if (stage < queues.size())
+            {
+                std::cerr << ", " << queues[stage]->size() << " of " << queues[stage]->capacity() << " queued after";
+            }
+            std::cerr << "\n";
+        }
+        std::cerr << "  latency: mean " << latency.mean_us() / 1000 << " ms, p50 " << latency.percentile_us(0.5) / 1000.0
+                  << " ms, p99 " << latency.percentile_us(0.99) / 1000.0 << " ms, max " << latency.max_us() / 1000.0 << " ms"
+                  << std::endl;
+    };
+
+    scratch_set scratch(threads[1]);
+    std::atomic<uint64_t> faulted{0};
+    std::array<std::function<void(ingest_item &, size_t)>, 4> work = {
+        // read: map and fault the file in, so disk time is spent here and not in count
+        [&](ingest_item &item, size_t)
+        {
+            item.map = std::make_unique<mapped_file>(item.path);
+            item.size = item.map->size();
+            uint8_t touched = 0;
+            for (size_t offset = 0; offset < item.size; offset += 4096)
+            {
+                touched ^= item.map->data()[offset];
+            }
+            faulted.fetch_add(touched, std::memory_order_relaxed); // keeps the loop from being optimized away
+        },
+        [&](ingest_item &item, size_t worker)
+        {
+            item.layer = count_layer(scratch[worker], item.map->data(), item.size, item.path);
+            item.map.reset();
+        },
+        [&](ingest_item &item, size_t)
+        {
+            if (background.is_open())
+            {
+                item.layer = informative_bins(item.layer, background, keep);
+            }
+            if (!model.classes.empty())
+            {
+                classification c = classify(model, classifier_features(make_fingerprint(item.layer)));
+                item.label = model.classes[c.best].name;
+            }
+        },
+        [&](ingest_item &item, size_t)
+        {
+            fs::path out_path = fs::path(out_dir) / (item.relative + ".fcube");
+            fs::create_directories(out_path.parent_path());
+            fcube cube;
+            cube.input_size = item.size;
+            cube.layers.push_back(std::move(item.layer));
+            write_fcube(out_path.string(), cube);
+            bytes += item.size;
+            latency.add(nanoseconds(item.seen) / 1000);
+            if (!item.label.empty())
+            {
+                std::lock_guard<std::mutex> lock(log_mutex);
+                std::cout << item.relative << ": " << item.label << std::endl;
+            }
+        }};
+
+    // everything that can fail on the command line's account happens before
+    // a worker exists, there is nothing to shut down yet
+    std::vector<fs::path> dirs;
+    for (const auto &root : roots)
+    {
+        dirs.push_back(fs::canonical(root));
+        if (!fs::is_directory(dirs.back()))
+        {
+            throw std::runtime_error(root + " is not a directory");
+        }
+    }
+    int inotify = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    int wakeup = ::eventfd(0, EFD_CLOEXEC);
+    if (inotify < 0 || wakeup < 0)
+    {
+        if (inotify >= 0)
+        {
+            ::close(inotify);
+        }
+        if (wakeup >= 0)
+        {
+            ::close(wakeup);
+        }
+        throw std::runtime_error("Failed to set up inotify");
+    }
+
+    struct watched_dir
+    {
+        fs::path root;
+        fs::path dir;
+    };
+    std::unordered_map<int, watched_dir> watches;
+
+    auto enqueue = [&](const fs::path &root, const fs::path &path)
+    {
+        auto item = std::make_unique<ingest_item>();
+        item->seen = std::chrono::steady_clock::now();
+        item->path = path.generic_string();
+        item->relative = path.lexically_relative(root).generic_string();
+        auto blocked = std::chrono::steady_clock::now();
+        queues[0]->push(std::move(item));
+        counters[0].blocked_ns += nanoseconds(blocked);
+        counters[0].items++;
+    };
+
+    // only files an output is missing for or older than, a rescan must not redo everything
+    auto enqueue_stale = [&](const fs::path &root, const fs::path &path)
+    {
+        std::error_code error;
+        fs::path out_path = fs::path(out_dir) / (path.lexically_relative(root).generic_string() + ".fcube");
+        auto written = fs::last_write_time(out_path, error);
+        if (error || written < fs::last_write_time(path, error))
+        {
+            enqueue(root, path);
+        }
+    };
+
+    std::function<void(const fs::path &, const fs::path &, bool)> add_watch = [&](const fs::path &root, const fs::path &dir, bool scan)
+    {
+        std::error_code error;
+        if (fs::equivalent(dir, out_root, error))
+        {
+            return; // our own output
+        }
+        int wd = ::inotify_add_watch(inotify, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ONLYDIR);
+        if (wd < 0)
+        {
+            std::lock_guard<std::mutex> lock(log_mutex);
+            std::cerr << dir << ": can't watch" << std::endl;
+            return;
+        }
+        watches[wd] = {root, dir};
+        for (fs::directory_iterator it(dir, error), end; !error && it != end; it.increment(error))
+        {
+            if (it->is_directory(error) && !it->is_symlink(error))
+            {
+                add_watch(root, it->path(), scan);
+            }
+            else if (scan && it->is_regular_file(error) && !is_fcube(it->path()))
+            {
+                enqueue_stale(root, it->path());
+            }
+        }
+    };
+
+    // without a scan nothing is queued, the workers can start after
+    for (const auto &dir : dirs)
+    {
+        add_watch(dir, dir, false);
+    }
+
+    // the signals are taken by a thread of their own, the counters print outside a handler.
+    // blocked before any worker starts, every thread inherits the mask
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    // the last worker of a stage to run out of input closes the next queue,
+    // so shutdown drains the pipeline front to back
+    std::vector<std::thread> workers;
+    std::array<std::atomic<size_t>, 4> running{};
+    for (size_t stage = 0; stage < 4; stage++)
+    {
+        running[stage] = threads[stage];
+        for (size_t worker = 0; worker < threads[stage]; worker++)
+        {
+            workers.emplace_back([&, stage, worker]()
+                                 {
+                stage_counters &c = counters[stage + 1];
+                ingest_queue *out = stage + 1 < queues.size() ? queues[stage + 1].get() : nullptr;
+                std::unique_ptr<ingest_item> item;
+                for (;;)
+                {
+                    auto waiting = std::chrono::steady_clock::now();
+                    if (!queues[stage]->pop(item))
+                    {
+                        break;
+                    }
+                    c.idle_ns += nanoseconds(waiting);
+
+                    auto working = std::chrono::steady_clock::now();
+                    try
+                    {
+                        work[stage](*item, worker);
+                    }
+                    catch (const std::exception &e)
+                    {
+                        c.failed++;
+                        std::lock_guard<std::mutex> lock(log_mutex);
+                        std::cerr << item->path << ": " << e.what() << std::endl;
+                        continue;
+                    }
+                    c.busy_ns += nanoseconds(working);
+                    c.items++;
+
+                    if (out)
+                    {
+                        auto blocked = std::chrono::steady_clock::now();
+                        out->push(std::move(item));
+                        c.blocked_ns += nanoseconds(blocked);
+                    }
+                }
+                if (--running[stage] == 0 && out)
+                {
+                    out->close();
+                } });
+        }
+    }
+
+    std::atomic<bool> stopping{false};
+    std::thread waiter([&]()
+                       {
+        int signal = 0;
+        while (sigwait(&signals, &signal) == 0 && signal == SIGUSR1)
+        {
+            print_stats();
+        }
+        stopping = true;
+        uint64_t one = 1;
+        ssize_t written = ::write(wakeup, &one, sizeof(one));
+        (void)written; });
+
+    std::cerr << "Watching " << watches.size() << " directories with " << threads[0] << " read, " << threads[1] << " count, "
+              << threads[2] << " fingerprint and " << threads[3] << " write workers, queues of " << queues[0]->capacity()
+              << " (SIGUSR1 for counters)" << std::endl;
+
+    std::exception_ptr failure;
+    try
+    {
+        alignas(inotify_event) char buffer[64 * 1024];
+        while (!stopping)
+        {
+            pollfd fds[2] = {{inotify, POLLIN, 0}, {wakeup, POLLIN, 0}};
+            if (::poll(fds, 2, -1) < 0 || !(fds[0].revents & POLLIN))
+            {
+                continue;
+            }
+
+            ssize_t got;
+            while ((got = ::read(inotify, buffer, sizeof(buffer))) > 0)
+            {
+                for (char *at = buffer; at < buffer + got;)
+                {
+                    const inotify_event *event = reinterpret_cast<const inotify_event *>(at);
+                    at += sizeof(inotify_event) + event->len;
+                    if (event->mask & IN_Q_OVERFLOW)
+                    {
+                        {
+                            std::lock_guard<std::mutex> lock(log_mutex);
+                            std::cerr << "inotify queue overflowed, rescanning" << std::endl;
+                        }
+                        std::vector<watched_dir> dirs;
+                        for (const auto &w : watches)
+                        {
+                            dirs.push_back(w.second);
+                        }
+                        for (const auto &w : dirs)
+                        {
+                            std::error_code error;
+                            for (fs::directory_iterator it(w.dir, error), end; !error && it != end; it.increment(error))
+                            {
+                                if (it->is_regular_file(error) && !it->is_symlink(error) && !is_fcube(it->path()))
+                                {
+                                    enqueue_stale(w.root, it->path());
+                                }
+                            }
+                        }
+                        continue;
+                    }
+
+                    auto found = watches.find(event->wd);
+                    if (found == watches.end() || event->len == 0)
+                    {
+                        continue;
+                    }
+                    watched_dir w = found->second;
+                    fs::path path = w.dir / event->name;
+                    if (event->mask & IN_ISDIR)
+                    {
+                        // files written before the watch existed are picked up by the scan
+                        add_watch(w.root, path, true);
+                    }
+                    else if ((event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) && !is_fcube(path))
+                    {
+                        enqueue(w.root, path);
+                    }
+                }
+            }
+        }
+    }
+    catch (...)
+    {
+        failure = std::current_exception();
+    }
+
+    queues[0]->close();
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+    if (!stopping)
+    {
+        pthread_kill(waiter.native_handle(), SIGTERM);
+    }
+    waiter.join();
+    ::close(inotify);
+    ::close(wakeup);
+    if (failure)
+    {
+        std::rethrow_exception(failure);
+    }
+
+    print_stats();
+    return EXIT_SUCCESS;
+}
+
+void print_usage(const arg_parser &args)
+{
+    std::cout << "Usage: fcube-analyze COMMAND [options] PATH...\n\n"
+              << "  scan        count the trigrams of every file below PATH\n"
+              << "  index       build a similarity index from the .fcube files below PATH\n"
+              << "  background  count in how many .fcube layers below PATH each trigram occurs\n"
+              << "  query       find the samples in --index closest to each PATH\n"
+              << "  train       fit --model to PATH/<class>/... samples\n"
+              << "  classify    guess the type of every file below PATH with --model\n"
+              << "  segment     split each file into regions of different shape\n"
+              << "  bits        count trigrams at every bit phase, a layer per phase\n"
+              << "  rarity      draw where in each file its rare trigrams are, as a .pgm\n"
+              << "  sections    count each section of ELF, PE and Mach-O files, a layer per section\n"
+              << "  diff        most changed trigrams from BEFORE to AFTER, files or trees\n"
+              << "  sample      estimate the histogram of one huge file in seconds, then refine it until exact\n"
+              << "  shard       count --range of each file as mergeable shards\n"
+              << "  merge       combine the shards below PATH into whole histograms\n"
+              << "  serve       count files for the viewer on --socket, caching the results\n"
+              << "  watch       ingest every file written below PATH into --out as it lands\n\n";
+    args.print_help();
+}
+
+int main(int argc, char **argv)
+{
+    arg_parser args;
+    args.add_option("--out", "scan, bits, sections, watch: write DIR/<relative path>.fcube per input file, rarity: .pgm", std::string(""));
+    args.add_option("--store", "scan, segment, bits, sections, shard, merge: write one .fcube with a layer per input file, region, phase, section or shard, sample: the estimate, rewritten as it improves", std::string(""));
+    args.add_option("--threads", "Worker threads, 0 = one per core", 0);
+    args.add_option("--chunk-mb", "scan: size of the stealable chunks big files are split into", 16);
+    args.add_option("--big-file-mb", "scan: files above this are split into chunks", 64);
+    args.add_option("--index", "index, query: the similarity index file", std::string(""));
+    args.add_option("--lsh-tables", "index: hash tables, more find more true neighbours", 8);
+    args.add_option("--lsh-bits", "index: hyperplanes per table, more make smaller buckets", 14);
+    args.add_option("--top", "query: neighbours to list, diff: changed trigrams to list per file, sample: common trigrams to list with their ranges", 10);
+    args.add_option("--metric", "query: js (jensen-shannon) or cosine", std::string("js"));
+    args.add_option("--model", "train, classify, segment: the classifier model file, watch: print the class of each file", std::string(""));
+    args.add_option("--bit-stride", "bits: 1 counts all 8 bit phases, 2 every other, 4 two, 8 only bytes", 1);
+    args.add_option("--window-kb", "segment: bytes compared on each side of a cut", 64);
+    args.add_option("--threshold", "segment: squared hellinger distance a cut needs, 0 to 1", 0.1f);
+    args.add_option("--background", "background: the file to write, scan, watch: keep only trigrams it marks as unusual", std::string(""));
+    args.add_option("--keep", "scan, watch: with --background, trigrams kept per file by tf-idf score, scan with --sketch-kb: the most common, 0 for all", 0);
+    args.add_option("--sketch-kb", "scan: count each file in this much memory (space-saving), keeping the most common trigrams with bounded error, 0 for exact counts", 0);
+    args.add_option("--range", "shard: START:LENGTH in bytes to count, the whole file by default", std::string(""));
+    args.add_option("--block-kb", "sample: bytes read at each randomly chosen offset", 1024);
+    args.add_option("--first-mb", "sample: bytes read for the first estimate, each later one reads as much again", 64);
+    args.add_option("--pieces", "shard: shards to cut the range into", 1);
+    args.add_option("--socket", "serve: the unix socket to listen on", std::string(""));
+    args.add_option("--cache-mb", "serve: memory kept for counted histograms", 1024);
+    args.add_option("--side", "rarity: pixels along each side of the image, a power of two", 512);
+    args.add_option("--stages", "watch: read,count,fingerprint,write workers, 0 for one per core", std::string("1,0,1,1"));
+    args.add_option("--queue", "watch: files each stage may have waiting for the next", 16);
+    args.add_option("--positions", "scan: also store the mean offset and spread of every trigram", std::string("false"));
+    args.add_option("--exact", "query: compare against every sample instead of the LSH candidates", std::string("false"));
+
+    try
+    {
+        args.parse(argc, argv);
+        const auto &positional = args.positional();
+        if (positional.empty())
+        {
+            print_usage(args);
+            return EXIT_FAILURE;
+        }
+
+        std::string command = positional[0];
+        std::vector<std::string> rest(positional.begin() + 1, positional.end());
+        if (command == "scan")
+        {
+            return scan_command(args, rest);
+        }
+        if (command == "index")
+        {
+            return index_command(args, rest);
+        }
+        if (command == "background")
+        {
+            return background_command(args, rest);
+        }
+        if (command == "query")
+        {
+            return query_command(args, rest);
+        }
+        if (command == "train")
+        {
+            return train_command(args, rest);
+        }
+        if (command == "classify")
+        {
+            return classify_command(args, rest);
+        }
+        if (command == "segment")
+        {
+            return segment_command(args, rest);
+        }
+        if (command == "bits")
+        {
+            return bits_command(args, rest);
+        }
+        if (command == "rarity")
+        {
+            return rarity_command(args, rest);
+        }
+        if (command == "sections")
+        {
+            return sections_command(args, rest);
+        }
+        if (command == "diff")
+        {
+            return diff_command(args, rest);
+        }
+        if (command == "sample")
+        {
+            return sample_command(args, rest);
+        }
+        if (command == "shard")
+        {
+            return shard_command(args, rest);
+        }
+        if (command == "merge")
+        {
+            return merge_command(args, rest);
+        }
+        if (command == "serve")
+        {
+            return serve_command(args, rest);
+        }
+        if (command == "watch")
+        {
+            return watch_command(args, rest);
+        }
+
+        std::cerr << "Unknown command: " << command << "\n\n";
+        print_usage(args);
+        return EXIT_FAILURE;
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,205 @@
+//  ██████╗  █████╗  ██████╗██╗  ██╗ ██████╗ ██████╗  ██████╗ ██╗   ██╗███╗   ██╗██████╗    ██╗  ██╗██████╗ ██████╗
+//  ██╔══██╗██╔══██╗██╔════╝██║ ██╔╝██╔════╝ ██╔══██╗██╔═══██╗██║   ██║████╗  ██║██╔══██╗   ██║  ██║██╔══██╗██╔══██╗
+//  ██████╔╝███████║██║     █████╔╝ ██║  ███╗██████╔╝██║   ██║██║   ██║██╔██╗ ██║██║  ██║   ███████║██████╔╝██████╔╝
+//  ██╔══██╗██╔══██║██║     ██╔═██╗ ██║   ██║██╔══██╗██║   ██║██║   ██║██║╚██╗██║██║  ██║   ██╔══██║██╔═══╝ ██╔═══╝
+//  ██████╔╝██║  ██║╚██████╗██║  ██╗╚██████╔╝██║  ██║╚██████╔╝╚██████╔╝██║ ╚████║██████╔╝██╗██║  ██║██║     ██║
+//  ╚═════╝ ╚═╝  ╚═╝ ╚═════╝╚═╝  ╚═╝ ╚═════╝ ╚═╝  ╚═╝ ╚═════╝  ╚═════╝ ╚═╝  ╚═══╝╚═════╝ ╚═╝╚═╝  ╚═╝╚═╝     ╚═╝
+//
+//
+//
+// corpus document frequencies, to weigh a sample's trigrams by how unusual they are
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "histogram_io.hpp"
+
+// file layout, all little endian:
+//
+//   header  magic "FCBKG001", document count u64, input size u64
+//   df      u32[TRIGRAM_BINS], how many documents each trigram occurs in
+//
+// dense so a lookup is one load from the mapped file, 64 MB whatever the corpus
+const char BACKGROUND_MAGIC[8] = {'F', 'C', 'B', 'K', 'G', '0', '0', '1'};
+
+struct background_header
+{
+    char magic[8];
+    uint64_t documents;
+    uint64_t input_size; // bytes behind all documents, informational
+};
+
+static_assert(sizeof(background_header) == 24, "header is packed by hand");
+
+inline void write_background(const std::string &path, uint64_t documents, uint64_t input_size, const uint32_t *df)
+{
+    background_header header{};
+    std::memcpy(header.magic, BACKGROUND_MAGIC, sizeof(header.magic));
+    header.documents = documents;
+    header.input_size = input_size;
+
+    std::ofstream out(path, std::ios::binary);
+    if (!out.is_open())
+    {
+        throw std::runtime_error("Failed to create " + path);
+    }
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(df), TRIGRAM_BINS * sizeof(uint32_t));
+    if (!out)
+    {
+        throw std::runtime_error("Failed to write " + path);
+    }
+}
+
+// read only view of a background file
+class background_model
+{
+private:
+    const uint8_t *base_ = nullptr;
+    size_t size_ = 0;
+    const background_header *header_ = nullptr;
+    const uint32_t *df_ = nullptr;
+
+public:
+    background_model() = default;
+
+    explicit background_model(const std::string &path)
+    {
+        open(path);
+    }
+
+    ~background_model()
+    {
+        close();
+    }
+
+    background_model(const background_model &) = delete;
+    background_model &operator=(const background_model &) = delete;
+
+    void open(const std::string &path)
+    {
+        close();
+
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            throw std::runtime_error("Failed to open " + path);
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) != sizeof(background_header) + TRIGRAM_BINS * sizeof(uint32_t))
+        {
+            ::close(fd);
+            throw std::runtime_error("Not a background model: " + path);
+        }
+
+        void *mapped = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED)
+        {
+            throw std::runtime_error("Failed to map " + path);
+        }
+
+        base_ = static_cast<const uint8_t *>(mapped);
+        size_ = static_cast<size_t>(st.st_size);
+        header_ = reinterpret_cast<const background_header *>(base_);
+        df_ = reinterpret_cast<const uint32_t *>(base_ + sizeof(background_header));
+        if (std::memcmp(header_->magic, BACKGROUND_MAGIC, sizeof(header_->magic)) != 0)
+        {
+            close();
+            throw std::runtime_error("Not a background model: " + path);
+        }
+    }
+
+    void close()
+    {
+        if (base_ != nullptr)
+        {
+            munmap(const_cast<uint8_t *>(base_), size_);
+        }
+        base_ = nullptr;
+        size_ = 0;
+        header_ = nullptr;
+        df_ = nullptr;
+    }
+
+    bool is_open() const
+    {
+        return base_ != nullptr;
+    }
+
+    uint64_t documents() const
+    {
+        return header_->documents;
+    }
+
+    uint64_t input_size() const
+    {
+        return header_->input_size;
+    }
+
+    uint32_t df(uint32_t bin) const
+    {
+        return df_[bin];
+    }
+
+    // smoothed inverse document frequency, log((1 + N) / (1 + df)): 0 for a
+    // trigram every document has, largest for one no document has
+    float weight(uint32_t bin) const
+    {
+        return static_cast<float>(std::log((1.0 + double(header_->documents)) / (1.0 + double(df_[bin]))));
+    }
+};
+
+// the `keep` bins of layer with the highest count * weight (all with a weight
+// when keep is 0), still in bin order. counts and positions are copied
+// unweighted, total becomes the sum of what was kept
+inline histogram_layer informative_bins(const histogram_layer &layer, const background_model &background, size_t keep)
+{
+    std::vector<std::pair<float, uint32_t>> scored; // score, index into layer
+    for (size_t i = 0; i < layer.bins.size(); ++i)
+    {
+        float score = static_cast<float>(layer.counts[i]) * background.weight(layer.bins[i]);
+        if (score > 0.0f)
+        {
+            scored.push_back({score, static_cast<uint32_t>(i)});
+        }
+    }
+    if (keep != 0 && scored.size() > keep)
+    {
+        std::nth_element(scored.begin(), scored.begin() + keep, scored.end(), [](const auto &a, const auto &b)
+                         { return a.first > b.first || (a.first == b.first && a.second < b.second); });
+        scored.resize(keep);
+    }
+    std::sort(scored.begin(), scored.end(), [](const auto &a, const auto &b)
+              { return a.second < b.second; });
+
+    histogram_layer kept;
+    kept.name = layer.name;
+    bool positions = layer.position_mean.size() == layer.bins.size();
+    for (const auto &entry : scored)
+    {
+        kept.bins.push_back(layer.bins[entry.second]);
+        kept.counts.push_back(layer.counts[entry.second]);
+        kept.total += layer.counts[entry.second];
+        if (positions)
+        {
+            kept.position_mean.push_back(layer.position_mean[entry.second]);
+            kept.position_spread.push_back(layer.position_spread[entry.second]);
+        }
+    }
+    return kept;
+}
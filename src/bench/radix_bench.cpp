@@ -0,0 +1,139 @@
+//  ██████╗  █████╗ ██████╗ ██╗██╗  ██╗        ██████╗ ███████╗███╗   ██╗ ██████╗██╗  ██╗    ██████╗██████╗ ██████╗
+//  ██╔══██╗██╔══██╗██╔══██╗██║╚██╗██╔╝        ██╔══██╗██╔════╝████╗  ██║██╔════╝██║  ██║   ██╔════╝██╔══██╗██╔══██╗
+//  ██████╔╝███████║██║  ██║██║ ╚███╔╝         ██████╔╝█████╗  ██╔██╗ ██║██║     ███████║   ██║     ██████╔╝██████╔╝
+//  ██╔══██╗██╔══██║██║  ██║██║ ██╔██╗         ██╔══██╗██╔══╝  ██║╚██╗██║██║     ██╔══██║   ██║     ██╔═══╝ ██╔═══╝
+//  ██║  ██║██║  ██║██████╔╝██║██╔╝ ██╗███████╗██████╔╝███████╗██║ ╚████║╚██████╗██║  ██║██╗╚██████╗██║     ██║
+//  ╚═╝  ╚═╝╚═╝  ╚═╝╚═════╝ ╚═╝╚═╝  ╚═╝╚══════╝╚═════╝ ╚══════╝╚═╝  ╚═══╝ ╚═════╝╚═╝  ╚═╝╚═╝ ╚═════╝╚═╝     ╚═╝
+//
+//
+//
+//
+// radix-partitioned against direct counting into the dense tables, and what the entropy probe picks
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../arg.hpp"
+#include "../counters.hpp"
+
+// same bytes for every kind, only how predictable they are changes
+std::vector<uint8_t> synthetic_input(const std::string &kind, size_t size)
+{
+    std::vector<uint8_t> data(size);
+    std::mt19937_64 rng(7);
+    std::geometric_distribution<int> letter(0.2);
+    for (size_t i = 0; i < size; ++i)
+    {
+        if (kind == "random")
+        {
+            data[i] = static_cast<uint8_t>(rng());
+        }
+        else if (kind == "text")
+        {
+            data[i] = static_cast<uint8_t>(' ' + std::min(letter(rng), 90));
+        }
+        else
+        {
+            // 7 random bits of 8, past the probe but not by much
+            data[i] = static_cast<uint8_t>(rng() & 0x7F);
+        }
+    }
+    return data;
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// best of a few runs, so the first touch of the tables isn't what's measured
+double run(trigram_counter &counter, const std::vector<uint8_t> &data, int repeats, histogram_layer &layer)
+{
+    double best = 1e30;
+    for (int r = 0; r < repeats; ++r)
+    {
+        auto start = std::chrono::steady_clock::now();
+        counter.count(data.data(), data.size());
+        best = std::min(best, seconds_since(start));
+        layer = counter.take("");
+    }
+    return best;
+}
+
+void bench(const std::string &name, const std::vector<uint8_t> &data, uint64_t narrow_limit, int repeats)
+{
+    double megabytes = data.size() / double(1 << 20);
+    double entropy = counters_detail::byte_entropy(data.data(), data.size());
+    auto table = narrow_limit ? trigram_counter::mode::narrow : trigram_counter::mode::wide;
+    std::cout << name << ": " << std::fixed << std::setprecision(1) << megabytes << " MB, " << std::setprecision(2)
+              << entropy << " bits/byte, probe picks " << (trigram_counter::high_entropy(data.data(), data.size(), table) ? "radix" : "direct") << "\n"
+              << std::setprecision(1);
+
+    const char *names[] = {"direct", "radix", "automatic"};
+    trigram_counter::dense_path paths[] = {trigram_counter::dense_path::direct, trigram_counter::dense_path::radix,
+                                           trigram_counter::dense_path::automatic};
+    histogram_layer reference;
+    for (int p = 0; p < 3; ++p)
+    {
+        trigram_counter counter(narrow_limit);
+        counter.set_dense_path(paths[p]);
+        histogram_layer layer;
+        double seconds = run(counter, data, repeats, layer);
+        if (p == 0)
+        {
+            reference = layer;
+        }
+        bool same = layer.bins == reference.bins && layer.counts == reference.counts;
+        std::cout << "  " << std::left << std::setw(10) << names[p] << std::right << std::setw(9) << megabytes / seconds
+                  << " MB/s" << (same ? "" : "  COUNTS DIFFER") << "\n";
+    }
+}
+
+int main(int argc, char **argv)
+{
+    arg_parser args;
+    args.add_option("--synthetic-mb", "size of each generated input when no files are given", 256);
+    args.add_option("--repeats", "runs per path, the best is reported", 3);
+    args.add_option("--wide", "count into u64 bins instead of u16 ones", std::string("false"));
+
+    try
+    {
+        args.parse(argc, argv);
+        int repeats = std::max(args.get_or<int>("--repeats", 3), 1);
+        uint64_t narrow_limit = args.get_or<bool>("--wide", false) ? 0 : COUNTER_NARROW_LIMIT;
+
+        if (args.positional().empty())
+        {
+            size_t size = static_cast<size_t>(std::max(args.get_or<int>("--synthetic-mb", 256), 1)) << 20;
+            for (const char *kind : {"random", "seven-bit", "text"})
+            {
+                bench(kind, synthetic_input(kind, size), narrow_limit, repeats);
+            }
+        }
+        for (const auto &path : args.positional())
+        {
+            std::ifstream in(path, std::ios::binary);
+            if (!in)
+            {
+                throw std::runtime_error("Failed to open " + path);
+            }
+            std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)), {});
+            bench(path, data, narrow_limit, repeats);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
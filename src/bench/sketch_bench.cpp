@@ -0,0 +1,153 @@
+//  ███████╗██╗  ██╗███████╗████████╗ ██████╗██╗  ██╗        ██████╗ ███████╗███╗   ██╗ ██████╗██╗  ██╗    ██████╗██████╗ ██████╗
+//  ██╔════╝██║ ██╔╝██╔════╝╚══██╔══╝██╔════╝██║  ██║        ██╔══██╗██╔════╝████╗  ██║██╔════╝██║  ██║   ██╔════╝██╔══██╗██╔══██╗
+//  ███████╗█████╔╝ █████╗     ██║   ██║     ███████║        ██████╔╝█████╗  ██╔██╗ ██║██║     ███████║   ██║     ██████╔╝██████╔╝
+//  ╚════██║██╔═██╗ ██╔══╝     ██║   ██║     ██╔══██║        ██╔══██╗██╔══╝  ██║╚██╗██║██║     ██╔══██║   ██║     ██╔═══╝ ██╔═══╝
+//  ███████║██║  ██╗███████╗   ██║   ╚██████╗██║  ██║███████╗██████╔╝███████╗██║ ╚████║╚██████╗██║  ██║██╗╚██████╗██║     ██║
+//  ╚══════╝╚═╝  ╚═╝╚══════╝   ╚═╝    ╚═════╝╚═╝  ╚═╝╚══════╝╚═════╝ ╚══════╝╚═╝  ╚═══╝ ╚═════╝╚═╝  ╚═╝╚═╝ ╚═════╝╚═╝     ╚═╝
+//
+//
+//
+//
+// recall and speed of the space-saving sketch against exact counting, over budgets
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "../arg.hpp"
+#include "../sketch.hpp"
+#include "../trigram.hpp"
+
+// text-like runs, zero padding and random stretches, roughly a binary's mix
+std::vector<uint8_t> synthetic_input(size_t size)
+{
+    std::vector<uint8_t> data(size);
+    std::mt19937 rng(9);
+    std::geometric_distribution<int> letter(0.2);
+    size_t i = 0;
+    while (i < size)
+    {
+        size_t length = std::min<size_t>(size - i, 4096 + rng() % 65536);
+        int kind = rng() % 4;
+        for (size_t j = 0; j < length; ++j, ++i)
+        {
+            data[i] = kind == 0 ? uint8_t(rng()) : kind == 1 ? 0 : uint8_t(' ' + std::min(letter(rng), 90));
+        }
+    }
+    return data;
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void bench(const std::string &name, const std::vector<uint8_t> &data, const std::vector<size_t> &budgets, size_t top)
+{
+    double megabytes = data.size() / double(1 << 20);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<uint32_t> counts(TRIGRAM_BINS, 0);
+    count_trigrams(data.data(), data.size(), counts);
+    std::vector<uint32_t> exact;
+    for (uint32_t bin = 0; bin < TRIGRAM_BINS; ++bin)
+    {
+        if (counts[bin])
+        {
+            exact.push_back(bin);
+        }
+    }
+    size_t n = std::min(top, exact.size());
+    std::partial_sort(exact.begin(), exact.begin() + n, exact.end(), [&](uint32_t a, uint32_t b)
+                      { return counts[a] != counts[b] ? counts[a] > counts[b] : a < b; });
+    exact.resize(n);
+    double exact_seconds = seconds_since(start);
+
+    std::cout << name << ": " << std::fixed << std::setprecision(1) << megabytes << " MB, top " << n << "\n"
+              << "  exact       64 MB table  " << std::setw(8) << megabytes / exact_seconds << " MB/s\n";
+
+    // ties at the last place make any of them a right answer, so those count as found
+    uint32_t last = n ? counts[exact.back()] : 0;
+    for (size_t budget : budgets)
+    {
+        start = std::chrono::steady_clock::now();
+        space_saving sketch(budget);
+        sketch.count(data.data(), data.size());
+        std::vector<sketch_entry> found = sketch.top(n);
+        double sketch_seconds = seconds_since(start);
+
+        std::unordered_set<uint32_t> reported;
+        uint64_t worst = 0;
+        bool bracketed = true;
+        for (const auto &entry : found)
+        {
+            reported.insert(entry.bin);
+            worst = std::max(worst, entry.count - counts[entry.bin]);
+            bracketed = bracketed && entry.count - entry.error <= counts[entry.bin] && counts[entry.bin] <= entry.count;
+        }
+        size_t hits = 0;
+        for (uint32_t bin : exact)
+        {
+            hits += reported.count(bin) || counts[bin] == last;
+        }
+
+        std::ostringstream memory;
+        memory << (budget >> 10) << " KB sketch";
+        std::cout << "  " << std::left << std::setw(22) << memory.str() << std::right << std::setw(9)
+                  << megabytes / sketch_seconds << " MB/s  recall " << std::setprecision(3) << (n ? double(hits) / n : 1.0)
+                  << "  counters " << sketch.capacity() << "  worst error " << worst << " of bound " << sketch.error_bound()
+                  << (bracketed ? "" : "  BOUND VIOLATED") << std::setprecision(1) << "\n";
+    }
+}
+
+int main(int argc, char **argv)
+{
+    arg_parser args;
+    args.add_option("--top", "trigrams reported, recall is measured against the exact top this many", 10000);
+    args.add_option("--budgets-kb", "sketch sizes to try", std::string("64,256,1024,4096"));
+    args.add_option("--synthetic-mb", "input generated when no files are given", 256);
+
+    try
+    {
+        args.parse(argc, argv);
+        size_t top = static_cast<size_t>(std::max(args.get_or<int>("--top", 10000), 1));
+        std::vector<size_t> budgets;
+        std::stringstream list(args.get_or<std::string>("--budgets-kb", "64,256,1024,4096"));
+        for (std::string kb; std::getline(list, kb, ',');)
+        {
+            budgets.push_back(static_cast<size_t>(std::stoul(kb)) << 10);
+        }
+
+        if (args.positional().empty())
+        {
+            size_t size = static_cast<size_t>(std::max(args.get_or<int>("--synthetic-mb", 256), 1)) << 20;
+            bench("synthetic", synthetic_input(size), budgets, top);
+        }
+        for (const auto &path : args.positional())
+        {
+            std::ifstream in(path, std::ios::binary);
+            if (!in)
+            {
+                throw std::runtime_error("Failed to open " + path);
+            }
+            std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)), {});
+            bench(path, data, budgets, top);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,104 @@
+//  ██████╗ ██╗████████╗        ████████╗██████╗ ██╗ ██████╗ ██████╗  █████╗ ███╗   ███╗███████╗   ██╗  ██╗██████╗ ██████╗
+//  ██╔══██╗██║╚══██╔══╝        ╚══██╔══╝██╔══██╗██║██╔════╝ ██╔══██╗██╔══██╗████╗ ████║██╔════╝   ██║  ██║██╔══██╗██╔══██╗
+//  ██████╔╝██║   ██║              ██║   ██████╔╝██║██║  ███╗██████╔╝███████║██╔████╔██║███████╗   ███████║██████╔╝██████╔╝
+//  ██╔══██╗██║   ██║              ██║   ██╔══██╗██║██║   ██║██╔══██╗██╔══██║██║╚██╔╝██║╚════██║   ██╔══██║██╔═══╝ ██╔═══╝
+//  ██████╔╝██║   ██║   ███████╗   ██║   ██║  ██║██║╚██████╔╝██║  ██║██║  ██║██║ ╚═╝ ██║███████║██╗██║  ██║██║     ██║
+//  ╚═════╝ ╚═╝   ╚═╝   ╚══════╝   ╚═╝   ╚═╝  ╚═╝╚═╝ ╚═════╝ ╚═╝  ╚═╝╚═╝  ╚═╝╚═╝     ╚═╝╚══════╝╚═╝╚═╝  ╚═╝╚═╝     ╚═╝
+//
+//
+// trigrams of 8 bit symbols at every bit phase, for data that isn't byte aligned
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "counters.hpp"
+#include "cpu.hpp"
+#include "trigram.hpp"
+
+// phase b reads the input as bytes starting b bits in, msb first. phase 0
+// is the ordinary byte trigram histogram
+const int BIT_PHASES = 8;
+
+// the 24 bits starting at bit 8 * i + phase of p = data + i, which needs
+// p[3] for every phase but 0
+inline uint32_t bit_trigram(const uint8_t *p, int phase)
+{
+    uint32_t word = uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 | p[3];
+    return (word >> (8 - phase)) & (TRIGRAM_BINS - 1);
+}
+
+// phases a bit stride of 1, 2, 4 or 8 visits, as a mask
+inline unsigned bit_stride_mask(int stride)
+{
+    unsigned mask = 0;
+    for (int phase = 0; phase < BIT_PHASES; phase += stride)
+    {
+        mask |= 1u << phase;
+    }
+    return mask;
+}
+
+// shifted bytes handed to the counter per piece, long enough for it to
+// partition high-entropy pieces (COUNTER_RADIX_BATCH positions)
+constexpr size_t BIT_PHASE_BLOCK = size_t(16) << 20;
+
+// the input as phase reads it: out[j] is the 8 bits starting at bit
+// 8 * (first + j) + phase. needs data[first + count] for every phase but 0
+inline void shift_bytes(const uint8_t *data, size_t first, size_t count, int phase, uint8_t *out)
+{
+    if (phase == 0)
+    {
+        std::memcpy(out, data + first, count);
+        return;
+    }
+    const uint8_t *in = data + first;
+    size_t j = 0;
+#if defined(CPU_X86) && defined(__SSE2__)
+    // byte pairs widened to 16 bits, shifted, narrowed: 16 bytes a step
+    const __m128i shift = _mm_cvtsi32_si128(8 - phase);
+    const __m128i low = _mm_set1_epi16(0xff);
+    for (; j + 16 <= count; j += 16)
+    {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + j));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + j + 1));
+        __m128i first_half = _mm_and_si128(_mm_srl_epi16(_mm_unpacklo_epi8(b, a), shift), low);
+        __m128i second_half = _mm_and_si128(_mm_srl_epi16(_mm_unpackhi_epi8(b, a), shift), low);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + j), _mm_packus_epi16(first_half, second_half));
+    }
+#endif
+    for (; j < count; j++)
+    {
+        out[j] = static_cast<uint8_t>(in[j] << phase | in[j + 1] >> (8 - phase));
+    }
+}
+
+// the histogram of one phase, a count of bit_trigram at every position
+// where all 24 bits lie inside data. the shifted input is an ordinary byte
+// stream, so it goes through trigram_counter a block at a time and gets
+// its cache-blocked counting. buffer is per thread scratch, up to block + 2
+// bytes
+//
+// a pass per phase rather than one pass for all eight: the increments are
+// the same either way, but this way a worker holds one dense table and the
+// phases spread over eight cores
+inline histogram_layer count_bit_phase(trigram_counter &counter, const uint8_t *data, size_t size, int phase,
+                                       std::vector<uint8_t> &buffer, const std::string &name,
+                                       size_t block = BIT_PHASE_BLOCK)
+{
+    // a shifted stream ends a byte early, its last byte needs the one after
+    size_t length = phase == 0 || size == 0 ? size : size - 1;
+    buffer.resize(std::min(length, block + 2));
+    for (size_t first = 0; first + 2 < length; first += block)
+    {
+        size_t count = std::min(block + 2, length - first);
+        shift_bytes(data, first, count, phase, buffer.data());
+        counter.count(buffer.data(), count);
+    }
+    return counter.take(name);
+}
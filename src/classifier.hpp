@@ -0,0 +1,256 @@
+//   ██████╗██╗      █████╗ ███████╗███████╗██╗███████╗██╗███████╗██████╗    ██╗  ██╗██████╗ ██████╗
+//  ██╔════╝██║     ██╔══██╗██╔════╝██╔════╝██║██╔════╝██║██╔════╝██╔══██╗   ██║  ██║██╔══██╗██╔══██╗
+//  ██║     ██║     ███████║███████╗███████╗██║█████╗  ██║█████╗  ██████╔╝   ███████║██████╔╝██████╔╝
+//  ██║     ██║     ██╔══██║╚════██║╚════██║██║██╔══╝  ██║██╔══╝  ██╔══██╗   ██╔══██║██╔═══╝ ██╔═══╝
+//  ╚██████╗███████╗██║  ██║███████║███████║██║██║     ██║███████╗██║  ██║██╗██║  ██║██║     ██║
+//   ╚═════╝╚══════╝╚═╝  ╚═╝╚══════╝╚══════╝╚═╝╚═╝     ╚═╝╚══════╝╚═╝  ╚═╝╚═╝╚═╝  ╚═╝╚═╝     ╚═╝
+//
+//
+// file type guesses from trigram shapes, one diagonal gaussian per labelled class
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "fingerprint.hpp"
+
+// file layout, all little endian:
+//
+//   header   magic "FCMDL001", dims u32, class count u32
+//   classes  one after the other:
+//              name length u32, samples u32, name bytes zero padded to 4,
+//              mean float[dims], variance float[dims]
+//
+// features are the square roots of a fingerprint: euclidean distance there
+// is the hellinger distance, and the variance of rare cells stops swamping
+// that of common ones
+const char CLASSIFIER_MAGIC[8] = {'F', 'C', 'M', 'D', 'L', '0', '0', '1'};
+
+// no class is ever so certain of a cell that one stray trigram rules it out
+const float CLASSIFIER_VARIANCE_FLOOR = 1e-4f;
+
+struct classifier_header
+{
+    char magic[8];
+    uint32_t dims;
+    uint32_t class_count;
+};
+
+static_assert(sizeof(classifier_header) == 16, "header is packed by hand");
+
+struct class_model
+{
+    std::string name;
+    uint32_t samples = 0;
+    std::vector<float> mean;
+    std::vector<float> variance;
+
+    // derived from variance by prepare()
+    std::vector<float> inverse_variance;
+    float log_determinant = 0.0f;
+
+    void prepare()
+    {
+        inverse_variance.resize(variance.size());
+        log_determinant = 0.0f;
+        for (size_t i = 0; i < variance.size(); i++)
+        {
+            float v = std::max(variance[i], CLASSIFIER_VARIANCE_FLOOR);
+            inverse_variance[i] = 1.0f / v;
+            log_determinant += std::log(v);
+        }
+    }
+};
+
+struct classifier_model
+{
+    std::vector<class_model> classes;
+};
+
+struct classification
+{
+    size_t best = 0;
+    float score = 0.0f;  // negative log likelihood of the best class, lower is closer
+    float margin = 0.0f; // how much worse the runner-up scored, 0 with one class
+};
+
+inline std::vector<float> classifier_features(const std::vector<float> &fingerprint)
+{
+    std::vector<float> features(fingerprint.size());
+    for (size_t i = 0; i < fingerprint.size(); i++)
+    {
+        features[i] = std::sqrt(fingerprint[i]);
+    }
+    return features;
+}
+
+// sums per label as samples come in, in double so 100k of them stay exact
+class classifier_trainer
+{
+private:
+    struct sums
+    {
+        uint32_t samples = 0;
+        std::vector<double> sum = std::vector<double>(FINGERPRINT_DIMS, 0.0);
+        std::vector<double> squares = std::vector<double>(FINGERPRINT_DIMS, 0.0);
+    };
+
+    std::map<std::string, sums> labels_;
+
+public:
+    void add(const std::string &label, const std::vector<float> &features)
+    {
+        sums &s = labels_[label];
+        s.samples++;
+        for (size_t i = 0; i < FINGERPRINT_DIMS; i++)
+        {
+            s.sum[i] += features[i];
+            s.squares[i] += double(features[i]) * features[i];
+        }
+    }
+
+    // classes in label order
+    classifier_model finish() const
+    {
+        classifier_model model;
+        for (const auto &[label, s] : labels_)
+        {
+            class_model c;
+            c.name = label;
+            c.samples = s.samples;
+            c.mean.resize(FINGERPRINT_DIMS);
+            c.variance.resize(FINGERPRINT_DIMS);
+            for (size_t i = 0; i < FINGERPRINT_DIMS; i++)
+            {
+                double mean = s.sum[i] / s.samples;
+                c.mean[i] = static_cast<float>(mean);
+                c.variance[i] = static_cast<float>(std::max(0.0, s.squares[i] / s.samples - mean * mean));
+            }
+            c.prepare();
+            model.classes.push_back(std::move(c));
+        }
+        return model;
+    }
+};
+
+// one weighted distance per class, so this costs next to nothing next to
+// counting the trigrams in the first place
+inline classification classify(const classifier_model &model, const std::vector<float> &features)
+{
+    if (model.classes.empty())
+    {
+        throw std::runtime_error("Classifier model has no classes");
+    }
+
+    classification result;
+    float best = std::numeric_limits<float>::infinity();
+    float second = std::numeric_limits<float>::infinity();
+    for (size_t i = 0; i < model.classes.size(); i++)
+    {
+        const class_model &c = model.classes[i];
+        float score = 0.5f * (weighted_distance(features.data(), c.mean.data(), c.inverse_variance.data(), features.size()) + c.log_determinant);
+        if (score < best)
+        {
+            second = best;
+            best = score;
+            result.best = i;
+        }
+        else if (score < second)
+        {
+            second = score;
+        }
+    }
+    result.score = best;
+    result.margin = std::isinf(second) ? 0.0f : second - best;
+    return result;
+}
+
+inline void write_classifier_model(const std::string &path, const classifier_model &model)
+{
+    std::ofstream out(path, std::ios::binary);
+    if (!out)
+    {
+        throw std::runtime_error("Failed to create " + path);
+    }
+
+    classifier_header header{};
+    std::memcpy(header.magic, CLASSIFIER_MAGIC, sizeof(header.magic));
+    header.dims = static_cast<uint32_t>(FINGERPRINT_DIMS);
+    header.class_count = static_cast<uint32_t>(model.classes.size());
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    static const char zeros[4] = {};
+    for (const auto &c : model.classes)
+    {
+        uint32_t name_length = static_cast<uint32_t>(c.name.size());
+        out.write(reinterpret_cast<const char *>(&name_length), sizeof(name_length));
+        out.write(reinterpret_cast<const char *>(&c.samples), sizeof(c.samples));
+        out.write(c.name.data(), c.name.size());
+        out.write(zeros, (4 - c.name.size() % 4) % 4);
+        out.write(reinterpret_cast<const char *>(c.mean.data()), FINGERPRINT_DIMS * sizeof(float));
+        out.write(reinterpret_cast<const char *>(c.variance.data()), FINGERPRINT_DIMS * sizeof(float));
+    }
+
+    if (!out)
+    {
+        throw std::runtime_error("Failed to write " + path);
+    }
+}
+
+inline classifier_model read_classifier_model(const std::string &path)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+    {
+        throw std::runtime_error("Failed to open " + path);
+    }
+
+    classifier_header header{};
+    in.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (!in || std::memcmp(header.magic, CLASSIFIER_MAGIC, sizeof(header.magic)) != 0)
+    {
+        throw std::runtime_error("Not a classifier model: " + path);
+    }
+    if (header.dims != FINGERPRINT_DIMS)
+    {
+        throw std::runtime_error("Classifier model " + path + " was trained on other fingerprints");
+    }
+
+    classifier_model model;
+    for (uint32_t i = 0; i < header.class_count; i++)
+    {
+        uint32_t name_length = 0;
+        class_model c;
+        in.read(reinterpret_cast<char *>(&name_length), sizeof(name_length));
+        in.read(reinterpret_cast<char *>(&c.samples), sizeof(c.samples));
+        if (!in || name_length > 4096)
+        {
+            throw std::runtime_error("Corrupt class in " + path);
+        }
+
+        char padding[4];
+        c.name.resize(name_length);
+        in.read(&c.name[0], name_length);
+        in.read(padding, (4 - name_length % 4) % 4);
+        c.mean.resize(FINGERPRINT_DIMS);
+        c.variance.resize(FINGERPRINT_DIMS);
+        in.read(reinterpret_cast<char *>(c.mean.data()), FINGERPRINT_DIMS * sizeof(float));
+        in.read(reinterpret_cast<char *>(c.variance.data()), FINGERPRINT_DIMS * sizeof(float));
+        if (!in)
+        {
+            throw std::runtime_error("Truncated class in " + path);
+        }
+        c.prepare();
+        model.classes.push_back(std::move(c));
+    }
+    return model;
+}
@@ -0,0 +1,637 @@
+//   ██████╗ ██████╗ ██╗   ██╗███╗   ██╗████████╗███████╗██████╗ ███████╗   ██╗  ██╗██████╗ ██████╗
+//  ██╔════╝██╔═══██╗██║   ██║████╗  ██║╚══██╔══╝██╔════╝██╔══██╗██╔════╝   ██║  ██║██╔══██╗██╔══██╗
+//  ██║     ██║   ██║██║   ██║██╔██╗ ██║   ██║   █████╗  ██████╔╝███████╗   ███████║██████╔╝██████╔╝
+//  ██║     ██║   ██║██║   ██║██║╚██╗██║   ██║   ██╔══╝  ██╔══██╗╚════██║   ██╔══██║██╔═══╝ ██╔═══╝
+//  ╚██████╗╚██████╔╝╚██████╔╝██║ ╚████║   ██║   ███████╗██║  ██║███████║██╗██║  ██║██║     ██║
+//   ╚═════╝ ╚═════╝  ╚═════╝ ╚═╝  ╚═══╝   ╚═╝   ╚══════╝╚═╝  ╚═╝╚══════╝╚═╝╚═╝  ╚═╝╚═╝     ╚═╝
+//
+//
+//
+// trigram counts that start as a small hash and widen to dense tables only when the input needs them
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "cpu.hpp"
+#include "histogram_io.hpp"
+#include "trigram.hpp"
+
+// hash slots the counter grows to before it goes dense. at half load that is
+// 32768 distinct trigrams in 768 KB, most small files never leave the cache
+constexpr size_t COUNTER_HASH_SLOTS = size_t(1) << 16;
+
+// past this many trigram positions u64 counters beat u16 ones plus carries
+constexpr uint64_t COUNTER_NARROW_LIMIT = uint64_t(1) << 32;
+
+// below this many positions the dense tables list the bins they touch, past
+// it sweeping the table is cheaper than keeping the list
+constexpr uint64_t COUNTER_TRACK_LIMIT = uint64_t(4) << 20;
+
+// bits per byte past which a dense count partitions first. random, compressed
+// and encrypted data sit near 8, text and code well below 7
+constexpr double COUNTER_RADIX_ENTROPY = 7.5;
+
+// positions partitioned per batch, 16 MB of u16 keys. a bucket gets 32K of
+// them, enough that every line of its table slice is hit again while cached;
+// a batch of 1M was no faster than direct
+constexpr size_t COUNTER_RADIX_BATCH = size_t(1) << 23;
+
+namespace counters_detail
+{
+    // the top 8 bits of a trigram pick its bucket, so each bucket counts into
+    // 64K bins: 128 KB of narrow or 512 KB of wide table, both within L2
+    constexpr unsigned RADIX_BUCKETS = 256;
+    // u16 keys per 64 byte line, the unit a bucket is written out in
+    constexpr size_t RADIX_LINE = 32;
+
+    // shannon entropy of the bytes of 16 windows spread across data
+    inline double byte_entropy(const uint8_t *data, size_t size)
+    {
+        const size_t window = 4096, windows = 16;
+        uint64_t counts[256] = {};
+        size_t sampled = 0;
+        if (size <= window * windows)
+        {
+            for (size_t i = 0; i < size; ++i)
+            {
+                counts[data[i]]++;
+            }
+            sampled = size;
+        }
+        else
+        {
+            for (size_t w = 0; w < windows; ++w)
+            {
+                const uint8_t *start = data + (size - window) * w / (windows - 1);
+                for (size_t i = 0; i < window; ++i)
+                {
+                    counts[start[i]]++;
+                }
+            }
+            sampled = window * windows;
+        }
+        double bits = 0;
+        for (uint64_t count : counts)
+        {
+            if (count)
+            {
+                double p = double(count) / sampled;
+                bits -= p * std::log2(p);
+            }
+        }
+        return bits;
+    }
+
+    // one full line of keys to the partition without pulling it into cache,
+    // it is read back only after the whole batch is out
+    inline void stream_line(uint16_t *to, const uint16_t *line)
+    {
+#ifdef CPU_X86
+        const __m128i *from = reinterpret_cast<const __m128i *>(line);
+        __m128i *out = reinterpret_cast<__m128i *>(to);
+        _mm_stream_si128(out, _mm_load_si128(from));
+        _mm_stream_si128(out + 1, _mm_load_si128(from + 1));
+        _mm_stream_si128(out + 2, _mm_load_si128(from + 2));
+        _mm_stream_si128(out + 3, _mm_load_si128(from + 3));
+#else
+        std::memcpy(to, line, RADIX_LINE * sizeof(uint16_t));
+#endif
+    }
+
+    inline void stream_fence()
+    {
+#ifdef CPU_X86
+        _mm_sfence();
+#endif
+    }
+}
+
+// counts the trigrams of one input, fed in one or more pieces, in whatever
+// fits it best:
+//
+//   hash    open addressing, up to COUNTER_HASH_SLOTS, where every input starts
+//   narrow  u16 per bin (32 MB) and a side table of what didn't fit in 16 bits
+//   wide    u64 per bin (128 MB), for inputs past COUNTER_NARROW_LIMIT
+//
+// the hash goes dense once it sees too many distinct trigrams, narrow goes
+// wide once the input grows past the limit. the counts come out the same in
+// every mode. dense tables are kept once made, reused by the next input
+//
+// a dense table is far bigger than any cache, so high-entropy input misses on
+// nearly every increment. large pieces of it are counted in two passes
+// instead: keys partitioned by their top bits, then each bucket counted into
+// its own cache-sized slice of the table
+class trigram_counter
+{
+public:
+    enum class mode
+    {
+        hash,
+        narrow,
+        wide
+    };
+
+    // how large untracked pieces reach a dense table
+    enum class dense_path
+    {
+        automatic, // radix when byte_entropy clears COUNTER_RADIX_ENTROPY
+        direct,
+        radix
+    };
+
+private:
+    static constexpr uint32_t EMPTY = UINT32_MAX;
+    static constexpr size_t FIRST_SLOTS = 1024;
+    // a narrow counter is moved to the side table a little before it would
+    // wrap, so zero always means untouched
+    static constexpr uint16_t NARROW_TOP = 0xFFFF;
+
+    uint64_t narrow_limit_;
+    mode mode_ = mode::hash;
+    uint64_t positions_ = 0;
+
+    std::vector<uint32_t> keys_ = std::vector<uint32_t>(FIRST_SLOTS, EMPTY);
+    std::vector<uint64_t> values_ = std::vector<uint64_t>(FIRST_SLOTS, 0);
+    size_t used_ = 0;
+    uint32_t shift_ = 22; // 32 - log2(slots)
+
+    std::vector<uint16_t> narrow_;
+    std::unordered_map<uint32_t, uint64_t> carries_;
+    std::vector<uint64_t> wide_;
+    std::vector<uint32_t> touched_;
+    bool untracked_ = false;
+
+    dense_path path_ = dense_path::automatic;
+    // low 16 bits of each key, grouped by bucket, each bucket starting on a
+    // line. a streamed line that straddles two cache lines halves the
+    // scatter's speed, so lines count from the first 64 byte boundary
+    std::vector<uint16_t> partition_;
+
+    size_t slot_of(uint32_t key) const
+    {
+        return (key * 0x9E3779B1u) >> shift_;
+    }
+
+    void grow_hash()
+    {
+        std::vector<uint32_t> keys(keys_.size() * 2, EMPTY);
+        std::vector<uint64_t> values(keys.size(), 0);
+        keys_.swap(keys);
+        values_.swap(values);
+        shift_--;
+        size_t mask = keys_.size() - 1;
+        for (size_t i = 0; i < keys.size(); ++i)
+        {
+            if (keys[i] != EMPTY)
+            {
+                size_t slot = slot_of(keys[i]);
+                while (keys_[slot] != EMPTY)
+                {
+                    slot = (slot + 1) & mask;
+                }
+                keys_[slot] = keys[i];
+                values_[slot] = values[i];
+            }
+        }
+    }
+
+    // an empty table of about twice the positions coming, so a small input
+    // never rehashes. capacity stays, only a change of size costs a fill
+    void size_hash(uint64_t positions)
+    {
+        size_t slots = FIRST_SLOTS;
+        shift_ = 22;
+        while (slots < 2 * positions && slots < COUNTER_HASH_SLOTS)
+        {
+            slots <<= 1;
+            shift_--;
+        }
+        if (keys_.size() != slots)
+        {
+            keys_.assign(slots, EMPTY);
+            values_.resize(slots);
+        }
+        used_ = 0;
+    }
+
+    void add_narrow(uint32_t bin, uint64_t count)
+    {
+        uint64_t total = narrow_[bin] + count;
+        if (narrow_[bin] == 0 && !untracked_)
+        {
+            touched_.push_back(bin);
+        }
+        if (total >= NARROW_TOP)
+        {
+            carries_[bin] += total - 1;
+            total = 1;
+        }
+        narrow_[bin] = static_cast<uint16_t>(total);
+    }
+
+    uint64_t narrow_count(uint32_t bin) const
+    {
+        uint64_t count = narrow_[bin];
+        if (!carries_.empty())
+        {
+            auto carry = carries_.find(bin);
+            if (carry != carries_.end())
+            {
+                count += carry->second;
+            }
+        }
+        return count;
+    }
+
+    void add_wide(uint32_t bin, uint64_t count)
+    {
+        if (wide_[bin] == 0 && !untracked_)
+        {
+            touched_.push_back(bin);
+        }
+        wide_[bin] += count;
+    }
+
+    // the hash's counts into a dense table, the rest of the input goes there
+    void leave_hash(uint64_t expected)
+    {
+        mode_ = expected > narrow_limit_ ? mode::wide : mode::narrow;
+        untracked_ = expected > COUNTER_TRACK_LIMIT;
+        if (mode_ == mode::narrow && narrow_.empty())
+        {
+            narrow_.assign(TRIGRAM_BINS, 0);
+        }
+        if (mode_ == mode::wide && wide_.empty())
+        {
+            wide_.assign(TRIGRAM_BINS, 0);
+        }
+        for (size_t i = 0; i < keys_.size(); ++i)
+        {
+            if (keys_[i] != EMPTY)
+            {
+                mode_ == mode::wide ? add_wide(keys_[i], values_[i]) : add_narrow(keys_[i], values_[i]);
+                keys_[i] = EMPTY;
+            }
+        }
+        used_ = 0;
+    }
+
+    void narrow_to_wide()
+    {
+        if (wide_.empty())
+        {
+            wide_.assign(TRIGRAM_BINS, 0);
+        }
+        untracked_ = true;
+        touched_.clear();
+        for (uint32_t bin = 0; bin < TRIGRAM_BINS; ++bin)
+        {
+            if (narrow_[bin])
+            {
+                wide_[bin] = narrow_count(bin);
+                narrow_[bin] = 0;
+            }
+        }
+        carries_.clear();
+        mode_ = mode::wide;
+    }
+
+    // trigram positions [i, size) in the hash, returns where it had to stop
+    size_t count_hash(const uint8_t *data, size_t size, size_t i, uint32_t &key)
+    {
+        size_t mask = keys_.size() - 1;
+        for (; i < size; ++i)
+        {
+            key = (key << 8 | data[i]) & (TRIGRAM_BINS - 1);
+            size_t slot = slot_of(key);
+            while (keys_[slot] != key && keys_[slot] != EMPTY)
+            {
+                slot = (slot + 1) & mask;
+            }
+            if (keys_[slot] == EMPTY)
+            {
+                if (2 * (used_ + 1) > keys_.size())
+                {
+                    if (keys_.size() == COUNTER_HASH_SLOTS)
+                    {
+                        // key is counted again by whoever takes over
+                        key >>= 8;
+                        return i;
+                    }
+                    grow_hash();
+                    mask = keys_.size() - 1;
+                    slot = slot_of(key);
+                    while (keys_[slot] != EMPTY)
+                    {
+                        slot = (slot + 1) & mask;
+                    }
+                }
+                keys_[slot] = key;
+                values_[slot] = 0;
+                used_++;
+            }
+            values_[slot]++;
+        }
+        return i;
+    }
+
+    bool use_radix(const uint8_t *data, size_t size) const
+    {
+        if (!untracked_ || path_ == dense_path::direct)
+        {
+            return false;
+        }
+        return path_ == dense_path::radix || (size >= COUNTER_TRACK_LIMIT && high_entropy(data, size, mode_));
+    }
+
+    // trigram positions [i, size) into the dense table by bump(bin), a batch
+    // at a time: a pass sizing the buckets, one scattering keys into them
+    // through a staged line per bucket, then the buckets in turn
+    template <typename Bump>
+    void count_radix(const uint8_t *data, size_t size, size_t i, uint32_t &key, Bump bump)
+    {
+        using namespace counters_detail;
+        partition_.resize(COUNTER_RADIX_BATCH + (RADIX_BUCKETS + 1) * RADIX_LINE);
+        uint16_t *lines = partition_.data() + (-reinterpret_cast<uintptr_t>(partition_.data()) & 63) / sizeof(uint16_t);
+        alignas(64) uint16_t staged[RADIX_BUCKETS][RADIX_LINE];
+        uint32_t sizes[RADIX_BUCKETS], starts[RADIX_BUCKETS], cursors[RADIX_BUCKETS], fill[RADIX_BUCKETS];
+
+        while (i < size)
+        {
+            size_t end = std::min(size, i + COUNTER_RADIX_BATCH);
+            std::fill(sizes, sizes + RADIX_BUCKETS, 0);
+            uint32_t ahead = key;
+            for (size_t j = i; j < end; ++j)
+            {
+                ahead = (ahead << 8 | data[j]) & (TRIGRAM_BINS - 1);
+                sizes[ahead >> 16]++;
+            }
+            uint32_t at = 0;
+            for (unsigned b = 0; b < RADIX_BUCKETS; ++b)
+            {
+                starts[b] = cursors[b] = at;
+                fill[b] = 0;
+                at += (sizes[b] + RADIX_LINE - 1) / RADIX_LINE * RADIX_LINE;
+            }
+
+            for (; i < end; ++i)
+            {
+                key = (key << 8 | data[i]) & (TRIGRAM_BINS - 1);
+                uint32_t b = key >> 16;
+                staged[b][fill[b]++] = static_cast<uint16_t>(key);
+                if (fill[b] == RADIX_LINE)
+                {
+                    stream_line(lines + cursors[b], staged[b]);
+                    cursors[b] += RADIX_LINE;
+                    fill[b] = 0;
+                }
+            }
+            for (unsigned b = 0; b < RADIX_BUCKETS; ++b)
+            {
+                std::memcpy(lines + cursors[b], staged[b], fill[b] * sizeof(uint16_t));
+            }
+            stream_fence();
+
+            for (unsigned b = 0; b < RADIX_BUCKETS; ++b)
+            {
+                const uint16_t *low = lines + starts[b];
+                uint32_t high = b << 16;
+                for (uint32_t n = 0; n < sizes[b]; ++n)
+                {
+                    bump(high | low[n]);
+                }
+            }
+        }
+    }
+
+public:
+    explicit trigram_counter(uint64_t narrow_limit = COUNTER_NARROW_LIMIT) : narrow_limit_(narrow_limit) {}
+
+    mode current_mode() const
+    {
+        return mode_;
+    }
+
+    // the probe behind dense_path::automatic. a u64 bin is four u16 ones, and
+    // the same footprint in cache comes from 2/3 of a bit less per byte of a
+    // three byte trigram
+    static bool high_entropy(const uint8_t *data, size_t size, mode table)
+    {
+        double threshold = COUNTER_RADIX_ENTROPY - (table == mode::wide ? 2.0 / 3 : 0.0);
+        return counters_detail::byte_entropy(data, size) >= threshold;
+    }
+
+    // automatic unless a test or bench wants one path
+    void set_dense_path(dense_path path)
+    {
+        path_ = path;
+    }
+
+    // bytes of tables held, kept between inputs
+    size_t memory() const
+    {
+        return keys_.size() * (sizeof(uint32_t) + sizeof(uint64_t)) + narrow_.size() * sizeof(uint16_t) +
+               wide_.size() * sizeof(uint64_t) + touched_.capacity() * sizeof(uint32_t) +
+               partition_.capacity() * sizeof(uint16_t);
+    }
+
+    // adds every trigram of data. pieces of one input overlap by two bytes,
+    // as they do everywhere else
+    void count(const uint8_t *data, size_t size)
+    {
+        if (size < 3)
+        {
+            return;
+        }
+        uint64_t expected = positions_ + (size - 2);
+        uint32_t key = uint32_t(data[0]) << 8 | data[1];
+        size_t i = 2;
+        if (mode_ == mode::hash)
+        {
+            if (positions_ == 0)
+            {
+                size_hash(expected);
+            }
+            i = count_hash(data, size, i, key);
+            if (i == size)
+            {
+                positions_ = expected;
+                return;
+            }
+            leave_hash(expected);
+        }
+        if (mode_ == mode::narrow && expected > narrow_limit_)
+        {
+            narrow_to_wide();
+        }
+        if (expected > COUNTER_TRACK_LIMIT)
+        {
+            untracked_ = true;
+        }
+
+        if (use_radix(data + i, size - i))
+        {
+            if (mode_ == mode::narrow)
+            {
+                count_radix(data, size, i, key, [&](uint32_t bin)
+                            {
+                                uint16_t &count = narrow_[bin];
+                                if (++count == NARROW_TOP)
+                                {
+                                    carries_[bin] += NARROW_TOP - 1;
+                                    count = 1;
+                                } });
+            }
+            else
+            {
+                count_radix(data, size, i, key, [&](uint32_t bin)
+                            { wide_[bin]++; });
+            }
+        }
+        else if (mode_ == mode::narrow)
+        {
+            for (; i < size; ++i)
+            {
+                key = (key << 8 | data[i]) & (TRIGRAM_BINS - 1);
+                uint16_t &count = narrow_[key];
+                if (count == 0 && !untracked_)
+                {
+                    touched_.push_back(key);
+                }
+                if (++count == NARROW_TOP)
+                {
+                    carries_[key] += NARROW_TOP - 1;
+                    count = 1;
+                }
+            }
+        }
+        else
+        {
+            for (; i < size; ++i)
+            {
+                key = (key << 8 | data[i]) & (TRIGRAM_BINS - 1);
+                uint64_t &count = wide_[key];
+                if (count == 0 && !untracked_)
+                {
+                    touched_.push_back(key);
+                }
+                count++;
+            }
+        }
+        positions_ = expected;
+    }
+
+    // nonzero bins so far, a sweep of the table once it stops listing them
+    size_t distinct() const
+    {
+        if (mode_ == mode::hash)
+        {
+            return used_;
+        }
+        if (!untracked_)
+        {
+            return touched_.size();
+        }
+        if (mode_ == mode::narrow)
+        {
+            return TRIGRAM_BINS - std::count(narrow_.begin(), narrow_.end(), uint16_t(0));
+        }
+        return TRIGRAM_BINS - std::count(wide_.begin(), wide_.end(), uint64_t(0));
+    }
+
+    // hands every nonzero bin to f(bin, count), in bin order when sorted is
+    // set, and leaves the counter empty and back in the hash
+    template <typename F>
+    void drain(F &&f, bool sorted = false)
+    {
+        if (mode_ == mode::hash)
+        {
+            std::vector<std::pair<uint32_t, uint64_t>> entries;
+            entries.reserve(used_);
+            for (size_t i = 0; i < keys_.size(); ++i)
+            {
+                if (keys_[i] != EMPTY)
+                {
+                    entries.push_back({keys_[i], values_[i]});
+                    keys_[i] = EMPTY;
+                }
+            }
+            if (sorted)
+            {
+                std::sort(entries.begin(), entries.end());
+            }
+            for (const auto &entry : entries)
+            {
+                f(entry.first, entry.second);
+            }
+        }
+        else
+        {
+            // a long touched list is also cheaper to sweep than to sort
+            bool sweep = untracked_ || (sorted && touched_.size() > TRIGRAM_BINS / 32);
+            if (!sweep && sorted)
+            {
+                std::sort(touched_.begin(), touched_.end());
+            }
+            auto emit = [&](uint32_t bin)
+            {
+                if (mode_ == mode::narrow && narrow_[bin])
+                {
+                    f(bin, narrow_count(bin));
+                    narrow_[bin] = 0;
+                }
+                else if (mode_ == mode::wide && wide_[bin])
+                {
+                    f(bin, wide_[bin]);
+                    wide_[bin] = 0;
+                }
+            };
+            if (sweep)
+            {
+                for (uint32_t bin = 0; bin < TRIGRAM_BINS; ++bin)
+                {
+                    emit(bin);
+                }
+            }
+            else
+            {
+                for (uint32_t bin : touched_)
+                {
+                    emit(bin);
+                }
+            }
+        }
+
+        touched_.clear();
+        carries_.clear();
+        untracked_ = false;
+        positions_ = 0;
+        used_ = 0;
+        mode_ = mode::hash;
+    }
+
+    histogram_layer take(const std::string &name)
+    {
+        histogram_layer layer;
+        layer.name = name;
+        // sized up front, a dense layer is 16M entries and growing it copies them over and over
+        size_t n = distinct();
+        layer.bins.reserve(n);
+        layer.counts.reserve(n);
+        drain([&](uint32_t bin, uint64_t count)
+              {
+                  layer.bins.push_back(bin);
+                  layer.counts.push_back(count);
+                  layer.total += count; },
+              true);
+        return layer;
+    }
+};
@@ -0,0 +1,41 @@
+//   ██████╗██████╗ ██╗   ██╗   ██╗  ██╗██████╗ ██████╗
+//  ██╔════╝██╔══██╗██║   ██║   ██║  ██║██╔══██╗██╔══██╗
+//  ██║     ██████╔╝██║   ██║   ███████║██████╔╝██████╔╝
+//  ██║     ██╔═══╝ ██║   ██║   ██╔══██║██╔═══╝ ██╔═══╝
+//  ╚██████╗██║     ╚██████╔╝██╗██║  ██║██║     ██║
+//   ╚═════╝╚═╝      ╚═════╝ ╚═╝╚═╝  ╚═╝╚═╝     ╚═╝
+//
+//
+//
+// what the running cpu can do, for the kernels that pick avx2 at run time
+
+#pragma once
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CPU_X86 1
+#endif
+
+#ifdef CPU_X86
+// asked once per process, avx2 kernels only run when this holds
+inline bool cpu_has_avx2()
+{
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+}
+
+inline bool cpu_has_fma()
+{
+    static const bool supported = __builtin_cpu_supports("fma");
+    return supported;
+}
+
+// the eight lanes of v added up
+__attribute__((target("avx2"))) inline float hsum(__m256 v)
+{
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+}
+#endif
@@ -0,0 +1,513 @@
+//  ██████╗  █████╗ ███████╗███╗   ███╗ ██████╗ ███╗   ██╗   ██╗  ██╗██████╗ ██████╗
+//  ██╔══██╗██╔══██╗██╔════╝████╗ ████║██╔═══██╗████╗  ██║   ██║  ██║██╔══██╗██╔══██╗
+//  ██║  ██║███████║█████╗  ██╔████╔██║██║   ██║██╔██╗ ██║   ███████║██████╔╝██████╔╝
+//  ██║  ██║██╔══██║██╔══╝  ██║╚██╔╝██║██║   ██║██║╚██╗██║   ██╔══██║██╔═══╝ ██╔═══╝
+//  ██████╔╝██║  ██║███████╗██║ ╚═╝ ██║╚██████╔╝██║ ╚████║██╗██║  ██║██║     ██║
+//  ╚═════╝ ╚═╝  ╚═╝╚══════╝╚═╝     ╚═╝ ╚═════╝ ╚═╝  ╚═══╝╚═╝╚═╝  ╚═╝╚═╝     ╚═╝
+//
+//
+//
+//
+// a local counting service: histograms handed over as sealed memfds on a unix socket
+
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "histogram_io.hpp"
+
+// one request per connection: "COUNT <absolute path>\n" is answered with
+// "OK <bytes>\n" carrying the memfd, or "ERR <message>\n"
+namespace daemon_detail
+{
+    constexpr size_t MAX_LINE = PATH_MAX + 16;
+
+    inline sockaddr_un address(const std::string &socket_path)
+    {
+        sockaddr_un addr{};
+        if (socket_path.size() >= sizeof(addr.sun_path))
+        {
+            throw std::runtime_error("Socket path too long: " + socket_path);
+        }
+        addr.sun_family = AF_UNIX;
+        std::memcpy(addr.sun_path, socket_path.c_str(), socket_path.size() + 1);
+        return addr;
+    }
+
+    inline void send_reply(int socket, const std::string &line, int fd = -1)
+    {
+        iovec iov{const_cast<char *>(line.data()), line.size()};
+        msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+        if (fd >= 0)
+        {
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+            cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type = SCM_RIGHTS;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+            std::memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+        }
+        // a client that hung up must not take the daemon down with SIGPIPE
+        ::sendmsg(socket, &msg, MSG_NOSIGNAL);
+    }
+
+    // reads up to the newline, keeping the first descriptor that came along
+    inline std::string receive_line(int socket, int *fd)
+    {
+        std::string line;
+        while (line.size() < MAX_LINE)
+        {
+            char buffer[512];
+            iovec iov{buffer, sizeof(buffer)};
+            alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+            msghdr msg{};
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = fd ? control : nullptr;
+            msg.msg_controllen = fd ? sizeof(control) : 0;
+
+            ssize_t got = ::recvmsg(socket, &msg, MSG_CMSG_CLOEXEC);
+            if (got <= 0)
+            {
+                break;
+            }
+            for (cmsghdr *cmsg = fd ? CMSG_FIRSTHDR(&msg) : nullptr; cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+            {
+                if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+                {
+                    int passed;
+                    std::memcpy(&passed, CMSG_DATA(cmsg), sizeof(int));
+                    if (*fd < 0)
+                    {
+                        *fd = passed;
+                    }
+                    else
+                    {
+                        ::close(passed);
+                    }
+                }
+            }
+
+            line.append(buffer, static_cast<size_t>(got));
+            size_t end = line.find('\n');
+            if (end != std::string::npos)
+            {
+                line.resize(end);
+                return line;
+            }
+        }
+        throw std::runtime_error("Connection closed mid request");
+    }
+}
+
+// a histogram the daemon counted, mapped read only straight from its memfd
+class daemon_histogram
+{
+private:
+    const uint8_t *data_ = nullptr;
+    size_t size_ = 0;
+
+public:
+    daemon_histogram(int fd, size_t size) : size_(size)
+    {
+        void *mapping = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED)
+        {
+            throw std::runtime_error("Failed to map the daemon's histogram");
+        }
+        data_ = static_cast<const uint8_t *>(mapping);
+    }
+
+    ~daemon_histogram()
+    {
+        ::munmap(const_cast<uint8_t *>(data_), size_);
+    }
+
+    daemon_histogram(const daemon_histogram &) = delete;
+    daemon_histogram &operator=(const daemon_histogram &) = delete;
+
+    const uint8_t *data() const { return data_; }
+    size_t size() const { return size_; }
+    std::vector<fcube_layer_view> layers() const { return view_fcube(data_, size_); }
+};
+
+inline std::unique_ptr<daemon_histogram> request_histogram(const std::string &socket_path, const std::string &file)
+{
+    char absolute[PATH_MAX];
+    if (!::realpath(file.c_str(), absolute))
+    {
+        throw std::runtime_error("Failed to resolve " + file);
+    }
+
+    int socket = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_un addr = daemon_detail::address(socket_path);
+    if (socket < 0 || ::connect(socket, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0)
+    {
+        if (socket >= 0)
+        {
+            ::close(socket);
+        }
+        throw std::runtime_error("No daemon listening on " + socket_path);
+    }
+
+    int fd = -1;
+    std::string reply;
+    try
+    {
+        std::string request = std::string("COUNT ") + absolute + "\n";
+        if (::send(socket, request.data(), request.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(request.size()))
+        {
+            throw std::runtime_error("Failed to send request to " + socket_path);
+        }
+        reply = daemon_detail::receive_line(socket, &fd);
+    }
+    catch (...)
+    {
+        ::close(socket);
+        if (fd >= 0)
+        {
+            ::close(fd);
+        }
+        throw;
+    }
+    ::close(socket);
+
+    if (reply.compare(0, 3, "OK ") != 0 || fd < 0)
+    {
+        if (fd >= 0)
+        {
+            ::close(fd);
+        }
+        throw std::runtime_error("Daemon failed on " + file + ": " + (reply.compare(0, 4, "ERR ") == 0 ? reply.substr(4) : reply));
+    }
+    return std::make_unique<daemon_histogram>(fd, std::strtoull(reply.c_str() + 3, nullptr, 10));
+}
+
+// counts each file once however many ask for it at the same time, and keeps
+// recent results as sealed memfds until they no longer fit in cache_bytes
+class histogram_server
+{
+public:
+    using counter = std::function<fcube(const std::string &path)>;
+
+    // a sealed memfd holding one .fcube, closed when the last holder lets go
+    struct result
+    {
+        int fd = -1;
+        size_t bytes = 0;
+
+        ~result()
+        {
+            if (fd >= 0)
+            {
+                ::close(fd);
+            }
+        }
+    };
+
+    struct stats
+    {
+        uint64_t requests = 0;
+        uint64_t hits = 0;
+        uint64_t counts = 0;
+        uint64_t cached_bytes = 0;
+        size_t entries = 0;
+    };
+
+private:
+    struct entry
+    {
+        std::shared_future<std::shared_ptr<result>> pending;
+        std::list<std::string>::iterator recent;
+        size_t bytes = 0;
+        bool ready = false;
+    };
+
+    struct connection
+    {
+        std::thread thread;
+        std::atomic<bool> done{false};
+    };
+
+    std::string socket_path_;
+    uint64_t cache_bytes_;
+    counter count_;
+
+    std::mutex mutex_;
+    std::unordered_map<std::string, entry> entries_;
+    std::list<std::string> recent_;
+    stats stats_;
+
+    int listener_ = -1;
+    std::atomic<bool> stopping_{false};
+    std::list<connection> connections_;
+    std::unordered_set<int> clients_;
+
+    // the same path rewritten is a different histogram
+    static std::string key_of(const std::string &path, std::string &canonical)
+    {
+        char resolved[PATH_MAX];
+        struct stat st{};
+        if (!::realpath(path.c_str(), resolved) || ::stat(resolved, &st) != 0 || !S_ISREG(st.st_mode))
+        {
+            throw std::runtime_error("Not a readable file: " + path);
+        }
+        canonical = resolved;
+        return canonical + '\0' + std::to_string(st.st_size) + '\0' + std::to_string(st.st_mtim.tv_sec) + '.' +
+               std::to_string(st.st_mtim.tv_nsec);
+    }
+
+    std::shared_ptr<result> serialize(const fcube &cube)
+    {
+        auto out = std::make_shared<result>();
+        out->fd = ::memfd_create("fcube", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+        if (out->fd < 0)
+        {
+            throw std::runtime_error("Failed to create a memfd");
+        }
+        write_fcube("/proc/self/fd/" + std::to_string(out->fd), cube);
+
+        struct stat st{};
+        ::fstat(out->fd, &st);
+        out->bytes = static_cast<size_t>(st.st_size);
+        // sealed, so every client can map the one copy without trusting the others
+        if (::fcntl(out->fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) != 0)
+        {
+            throw std::runtime_error("Failed to seal a memfd");
+        }
+        return out;
+    }
+
+    // oldest first, never a result still being counted; callers hold mutex_
+    void evict()
+    {
+        auto it = recent_.end();
+        while (stats_.cached_bytes > cache_bytes_ && it != recent_.begin())
+        {
+            --it;
+            auto found = entries_.find(*it);
+            if (!found->second.ready)
+            {
+                continue;
+            }
+            stats_.cached_bytes -= found->second.bytes;
+            entries_.erase(found);
+            it = recent_.erase(it);
+        }
+        stats_.entries = entries_.size();
+    }
+
+    void serve(int client)
+    {
+        std::string reply;
+        std::shared_ptr<result> found;
+        try
+        {
+            std::string line = daemon_detail::receive_line(client, nullptr);
+            if (line.compare(0, 6, "COUNT ") != 0)
+            {
+                throw std::runtime_error("Unknown request");
+            }
+            found = histogram(line.substr(6));
+            reply = "OK " + std::to_string(found->bytes) + "\n";
+        }
+        catch (const std::exception &e)
+        {
+            reply = std::string("ERR ") + e.what() + "\n";
+        }
+        daemon_detail::send_reply(client, reply, found ? found->fd : -1);
+    }
+
+public:
+    histogram_server(std::string socket_path, uint64_t cache_bytes, counter count)
+        : socket_path_(std::move(socket_path)), cache_bytes_(cache_bytes), count_(std::move(count)) {}
+
+    ~histogram_server()
+    {
+        stop();
+    }
+
+    histogram_server(const histogram_server &) = delete;
+    histogram_server &operator=(const histogram_server &) = delete;
+
+    // the cached result for path, counting it first if no one has yet
+    std::shared_ptr<result> histogram(const std::string &path)
+    {
+        std::string canonical;
+        std::string key = key_of(path, canonical);
+
+        std::promise<std::shared_ptr<result>> promise;
+        std::shared_future<std::shared_ptr<result>> future;
+        bool owner = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stats_.requests++;
+            auto it = entries_.find(key);
+            if (it != entries_.end())
+            {
+                stats_.hits++;
+                recent_.splice(recent_.begin(), recent_, it->second.recent);
+                future = it->second.pending;
+            }
+            else
+            {
+                owner = true;
+                stats_.counts++;
+                recent_.push_front(key);
+                entry &e = entries_[key];
+                e.pending = future = promise.get_future().share();
+                e.recent = recent_.begin();
+                stats_.entries = entries_.size();
+            }
+        }
+
+        if (owner)
+        {
+            std::shared_ptr<result> out;
+            try
+            {
+                out = serialize(count_(canonical));
+            }
+            catch (...)
+            {
+                // everyone waiting sees the failure, the next request tries again
+                promise.set_exception(std::current_exception());
+                std::lock_guard<std::mutex> lock(mutex_);
+                auto it = entries_.find(key);
+                recent_.erase(it->second.recent);
+                entries_.erase(it);
+                stats_.entries = entries_.size();
+                throw;
+            }
+
+            promise.set_value(out);
+            std::lock_guard<std::mutex> lock(mutex_);
+            entry &e = entries_[key];
+            e.bytes = out->bytes;
+            e.ready = true;
+            stats_.cached_bytes += out->bytes;
+            evict();
+        }
+        return future.get();
+    }
+
+    stats statistics()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stats_;
+    }
+
+    // accepts until stop(), one thread per connection
+    void run()
+    {
+        sockaddr_un addr = daemon_detail::address(socket_path_);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            listener_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            ::unlink(socket_path_.c_str());
+            // owner only: anyone who can connect gets the histogram of any file
+            // this process can read. no one can connect before listen()
+            if (listener_ < 0 || ::bind(listener_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+                ::chmod(socket_path_.c_str(), S_IRUSR | S_IWUSR) != 0 || ::listen(listener_, 64) != 0)
+            {
+                if (listener_ >= 0)
+                {
+                    ::close(listener_);
+                    listener_ = -1;
+                }
+                throw std::runtime_error("Failed to listen on " + socket_path_);
+            }
+        }
+
+        while (!stopping_)
+        {
+            int client = ::accept4(listener_, nullptr, nullptr, SOCK_CLOEXEC);
+            if (client < 0)
+            {
+                if (errno == EINTR || errno == ECONNABORTED)
+                {
+                    continue;
+                }
+                break;
+            }
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            connections_.remove_if([](connection &c)
+                                   {
+                if (!c.done)
+                {
+                    return false;
+                }
+                c.thread.join();
+                return true; });
+            clients_.insert(client);
+            connections_.emplace_back();
+            connection &c = connections_.back();
+            c.thread = std::thread([this, client, &c]()
+                                   {
+                serve(client);
+                std::lock_guard<std::mutex> lock(mutex_);
+                clients_.erase(client);
+                ::close(client);
+                c.done = true; });
+        }
+
+        std::list<connection> remaining;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ::close(listener_);
+            listener_ = -1;
+            remaining.splice(remaining.end(), connections_);
+        }
+        for (auto &c : remaining)
+        {
+            c.thread.join();
+        }
+        ::unlink(socket_path_.c_str());
+    }
+
+    // wakes run() and every connection blocked on a slow client
+    void stop()
+    {
+        stopping_ = true;
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (listener_ >= 0)
+        {
+            ::shutdown(listener_, SHUT_RDWR);
+        }
+        for (int client : clients_)
+        {
+            ::shutdown(client, SHUT_RDWR);
+        }
+    }
+};
@@ -0,0 +1,131 @@
+//  ██████╗ ██╗███████╗███████╗   ██╗  ██╗██████╗ ██████╗
+//  ██╔══██╗██║██╔════╝██╔════╝   ██║  ██║██╔══██╗██╔══██╗
+//  ██║  ██║██║█████╗  █████╗     ███████║██████╔╝██████╔╝
+//  ██║  ██║██║██╔══╝  ██╔══╝     ██╔══██║██╔═══╝ ██╔═══╝
+//  ██████╔╝██║██║     ██║     ██╗██║  ██║██║     ██║
+//  ╚═════╝ ╚═╝╚═╝     ╚═╝     ╚═╝╚═╝  ╚═╝╚═╝     ╚═╝
+//
+//
+//
+// normalized per trigram differences between two histograms
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "cpu.hpp"
+#include "histogram_io.hpp"
+
+// both sides over the union of their bins, as shares of their own totals so
+// a histogram of a bigger build doesn't look like it grew everywhere
+struct histogram_diff
+{
+    std::vector<uint32_t> bins; // every bin either side has, sorted
+    std::vector<float> before;  // share of the before total, 0 where absent
+    std::vector<float> after;
+    std::vector<float> delta;   // after - before
+    float distance = 0.0f;      // total variation, half the sum of |delta|, in [0, 1]
+};
+
+namespace diff_detail
+{
+    // scales a and b from counts to shares in place, writes their difference
+    // and returns the sum of its magnitudes
+    inline float shares_scalar(float *a, float *b, float *delta, float scale_a, float scale_b, size_t n)
+    {
+        float sum = 0.0f;
+        for (size_t i = 0; i < n; i++)
+        {
+            a[i] *= scale_a;
+            b[i] *= scale_b;
+            delta[i] = b[i] - a[i];
+            sum += std::fabs(delta[i]);
+        }
+        return sum;
+    }
+
+#ifdef CPU_X86
+    __attribute__((target("avx2"))) inline float shares_avx2(float *a, float *b, float *delta, float scale_a, float scale_b, size_t n)
+    {
+        const __m256 sa = _mm256_set1_ps(scale_a), sb = _mm256_set1_ps(scale_b);
+        const __m256 magnitude = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+        __m256 sum = _mm256_setzero_ps();
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            __m256 va = _mm256_mul_ps(_mm256_loadu_ps(a + i), sa);
+            __m256 vb = _mm256_mul_ps(_mm256_loadu_ps(b + i), sb);
+            __m256 d = _mm256_sub_ps(vb, va);
+            _mm256_storeu_ps(a + i, va);
+            _mm256_storeu_ps(b + i, vb);
+            _mm256_storeu_ps(delta + i, d);
+            sum = _mm256_add_ps(sum, _mm256_and_ps(d, magnitude));
+        }
+        return hsum(sum) + shares_scalar(a + i, b + i, delta + i, scale_a, scale_b, n - i);
+    }
+#endif
+
+    inline float shares(float *a, float *b, float *delta, float scale_a, float scale_b, size_t n)
+    {
+#ifdef CPU_X86
+        if (cpu_has_avx2())
+        {
+            return shares_avx2(a, b, delta, scale_a, scale_b, n);
+        }
+#endif
+        return shares_scalar(a, b, delta, scale_a, scale_b, n);
+    }
+}
+
+// one merge of the sorted bins lines the sides up, the arithmetic then runs
+// over flat arrays
+inline histogram_diff diff_layers(const histogram_layer &before, const histogram_layer &after)
+{
+    histogram_diff diff;
+    size_t capacity = before.bins.size() + after.bins.size();
+    diff.bins.reserve(capacity);
+    diff.before.reserve(capacity);
+    diff.after.reserve(capacity);
+
+    size_t i = 0, j = 0;
+    while (i < before.bins.size() || j < after.bins.size())
+    {
+        uint32_t a = i < before.bins.size() ? before.bins[i] : UINT32_MAX;
+        uint32_t b = j < after.bins.size() ? after.bins[j] : UINT32_MAX;
+        uint32_t bin = std::min(a, b);
+        diff.bins.push_back(bin);
+        diff.before.push_back(a == bin ? static_cast<float>(before.counts[i++]) : 0.0f);
+        diff.after.push_back(b == bin ? static_cast<float>(after.counts[j++]) : 0.0f);
+    }
+
+    diff.delta.resize(diff.bins.size());
+    float scale_before = before.total ? static_cast<float>(1.0 / double(before.total)) : 0.0f;
+    float scale_after = after.total ? static_cast<float>(1.0 / double(after.total)) : 0.0f;
+    float sum = diff_detail::shares(diff.before.data(), diff.after.data(), diff.delta.data(),
+                                    scale_before, scale_after, diff.bins.size());
+    diff.distance = std::min(0.5f * sum, 1.0f);
+    return diff;
+}
+
+// indexes into diff of the `top` largest changes either way, largest first
+inline std::vector<size_t> top_changes(const histogram_diff &diff, size_t top)
+{
+    std::vector<size_t> order(diff.bins.size());
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        order[i] = i;
+    }
+    auto larger = [&](size_t a, size_t b)
+    {
+        float da = std::fabs(diff.delta[a]), db = std::fabs(diff.delta[b]);
+        return da > db || (da == db && a < b);
+    };
+    top = std::min(top, order.size());
+    std::partial_sort(order.begin(), order.begin() + top, order.end(), larger);
+    order.resize(top);
+    return order;
+}
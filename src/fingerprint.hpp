@@ -0,0 +1,250 @@
+//  ███████╗██╗███╗   ██╗ ██████╗ ███████╗██████╗ ██████╗ ██████╗ ██╗███╗   ██╗████████╗   ██╗  ██╗██████╗ ██████╗
+//  ██╔════╝██║████╗  ██║██╔════╝ ██╔════╝██╔══██╗██╔══██╗██╔══██╗██║████╗  ██║╚══██╔══╝   ██║  ██║██╔══██╗██╔══██╗
+//  █████╗  ██║██╔██╗ ██║██║  ███╗█████╗  ██████╔╝██████╔╝██████╔╝██║██╔██╗ ██║   ██║      ███████║██████╔╝██████╔╝
+//  ██╔══╝  ██║██║╚██╗██║██║   ██║██╔══╝  ██╔══██╗██╔═══╝ ██╔══██╗██║██║╚██╗██║   ██║      ██╔══██║██╔═══╝ ██╔═══╝
+//  ██║     ██║██║ ╚████║╚██████╔╝███████╗██║  ██║██║     ██║  ██║██║██║ ╚████║   ██║   ██╗██║  ██║██║     ██║
+//  ╚═╝     ╚═╝╚═╝  ╚═══╝ ╚═════╝ ╚══════╝╚═╝  ╚═╝╚═╝     ╚═╝  ╚═╝╚═╝╚═╝  ╚═══╝   ╚═╝   ╚═╝╚═╝  ╚═╝╚═╝     ╚═╝
+//
+//
+// downsampled trigram histograms and the distance kernels comparing them
+
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "cpu.hpp"
+#include "histogram_io.hpp"
+#include "trigram.hpp"
+
+// 8 x 8 x 8 cells of 32^3 trigrams each, 2 KB a sample. enough to tell the
+// shapes apart, small enough that 100k samples fit in memory
+const int FINGERPRINT_SIDE = 8;
+const int FINGERPRINT_SHIFT = 5; // 256 / FINGERPRINT_SIDE = 1 << 5
+const size_t FINGERPRINT_DIMS = FINGERPRINT_SIDE * FINGERPRINT_SIDE * FINGERPRINT_SIDE;
+
+inline size_t fingerprint_cell(uint32_t bin)
+{
+    size_t x = (bin >> 16) >> FINGERPRINT_SHIFT;
+    size_t y = ((bin >> 8) & 0xff) >> FINGERPRINT_SHIFT;
+    size_t z = (bin & 0xff) >> FINGERPRINT_SHIFT;
+    return (x * FINGERPRINT_SIDE + y) * FINGERPRINT_SIDE + z;
+}
+
+// normalized to sum to 1, so files of any size compare and the
+// fingerprint is a distribution for jensen-shannon. all zero when empty
+inline std::vector<float> make_fingerprint(const histogram_layer &layer)
+{
+    std::vector<double> sums(FINGERPRINT_DIMS, 0.0);
+    double total = 0.0;
+    for (size_t i = 0; i < layer.bins.size(); i++)
+    {
+        sums[fingerprint_cell(layer.bins[i])] += double(layer.counts[i]);
+        total += double(layer.counts[i]);
+    }
+
+    std::vector<float> fingerprint(FINGERPRINT_DIMS, 0.0f);
+    for (size_t i = 0; total > 0.0 && i < FINGERPRINT_DIMS; i++)
+    {
+        fingerprint[i] = static_cast<float>(sums[i] / total);
+    }
+    return fingerprint;
+}
+
+namespace fingerprint_detail
+{
+    inline float dot_scalar(const float *a, const float *b, size_t n)
+    {
+        float dot = 0.0f;
+        for (size_t i = 0; i < n; i++)
+        {
+            dot += a[i] * b[i];
+        }
+        return dot;
+    }
+
+    inline float cosine_scalar(const float *a, const float *b, size_t n)
+    {
+        float dot = 0.0f, aa = 0.0f, bb = 0.0f;
+        for (size_t i = 0; i < n; i++)
+        {
+            dot += a[i] * b[i];
+            aa += a[i] * a[i];
+            bb += b[i] * b[i];
+        }
+        return aa > 0.0f && bb > 0.0f ? 1.0f - dot / std::sqrt(aa * bb) : 1.0f;
+    }
+
+    inline float weighted_scalar(const float *x, const float *mean, const float *weight, size_t n)
+    {
+        float sum = 0.0f;
+        for (size_t i = 0; i < n; i++)
+        {
+            float d = x[i] - mean[i];
+            sum += d * d * weight[i];
+        }
+        return sum;
+    }
+
+    // sum of p log2(p / m) + q log2(q / m), twice the divergence
+    inline float js_sum_scalar(const float *p, const float *q, size_t n)
+    {
+        float sum = 0.0f;
+        for (size_t i = 0; i < n; i++)
+        {
+            float m = 0.5f * (p[i] + q[i]);
+            if (p[i] > 0.0f)
+            {
+                sum += p[i] * std::log2(p[i] / m);
+            }
+            if (q[i] > 0.0f)
+            {
+                sum += q[i] * std::log2(q[i] / m);
+            }
+        }
+        return sum;
+    }
+
+    inline float js_scalar(const float *p, const float *q, size_t n)
+    {
+        return std::sqrt(std::max(0.0f, 0.5f * js_sum_scalar(p, q, n)));
+    }
+
+#ifdef CPU_X86
+    // log2 of positive normal floats: exponent plus a series in
+    // t = (m - 1) / (m + 1) for the mantissa m folded into [0.707, 1.414),
+    // where |t| < 0.18 and four terms are good to about 1e-7
+    __attribute__((target("avx2,fma"))) inline __m256 log2_ps(__m256 x)
+    {
+        const __m256i bits = _mm256_castps_si256(x);
+        __m256 exponent = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(127)));
+        __m256 mantissa = _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x007fffff)),
+                                                               _mm256_set1_epi32(0x3f800000)));
+        __m256 big = _mm256_cmp_ps(mantissa, _mm256_set1_ps(1.41421356f), _CMP_GT_OQ);
+        mantissa = _mm256_blendv_ps(mantissa, _mm256_mul_ps(mantissa, _mm256_set1_ps(0.5f)), big);
+        exponent = _mm256_add_ps(exponent, _mm256_and_ps(big, _mm256_set1_ps(1.0f)));
+
+        const __m256 one = _mm256_set1_ps(1.0f);
+        __m256 t = _mm256_div_ps(_mm256_sub_ps(mantissa, one), _mm256_add_ps(mantissa, one));
+        __m256 t2 = _mm256_mul_ps(t, t);
+        __m256 series = _mm256_fmadd_ps(t2, _mm256_set1_ps(1.0f / 7.0f), _mm256_set1_ps(1.0f / 5.0f));
+        series = _mm256_fmadd_ps(t2, series, _mm256_set1_ps(1.0f / 3.0f));
+        series = _mm256_fmadd_ps(t2, series, one);
+        series = _mm256_mul_ps(_mm256_mul_ps(t, series), _mm256_set1_ps(2.0f / 0.69314718f));
+        return _mm256_add_ps(exponent, series);
+    }
+
+    __attribute__((target("avx2,fma"))) inline float dot_avx2(const float *a, const float *b, size_t n)
+    {
+        __m256 dot = _mm256_setzero_ps();
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            dot = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), dot);
+        }
+        return hsum(dot) + dot_scalar(a + i, b + i, n - i);
+    }
+
+    __attribute__((target("avx2,fma"))) inline float weighted_avx2(const float *x, const float *mean, const float *weight, size_t n)
+    {
+        __m256 sum = _mm256_setzero_ps();
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            __m256 d = _mm256_sub_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(mean + i));
+            sum = _mm256_fmadd_ps(_mm256_mul_ps(d, d), _mm256_loadu_ps(weight + i), sum);
+        }
+        return hsum(sum) + weighted_scalar(x + i, mean + i, weight + i, n - i);
+    }
+
+    __attribute__((target("avx2,fma"))) inline float cosine_avx2(const float *a, const float *b, size_t n)
+    {
+        __m256 dot = _mm256_setzero_ps(), aa = _mm256_setzero_ps(), bb = _mm256_setzero_ps();
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            __m256 va = _mm256_loadu_ps(a + i), vb = _mm256_loadu_ps(b + i);
+            dot = _mm256_fmadd_ps(va, vb, dot);
+            aa = _mm256_fmadd_ps(va, va, aa);
+            bb = _mm256_fmadd_ps(vb, vb, bb);
+        }
+        float d = hsum(dot), sa = hsum(aa), sb = hsum(bb);
+        for (; i < n; i++)
+        {
+            d += a[i] * b[i];
+            sa += a[i] * a[i];
+            sb += b[i] * b[i];
+        }
+        return sa > 0.0f && sb > 0.0f ? 1.0f - d / std::sqrt(sa * sb) : 1.0f;
+    }
+
+    // zero entries contribute nothing, the masks drop whatever log2 made of them
+    __attribute__((target("avx2,fma"))) inline float js_avx2(const float *p, const float *q, size_t n)
+    {
+        const __m256 zero = _mm256_setzero_ps(), half = _mm256_set1_ps(0.5f);
+        __m256 sum = zero;
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            __m256 vp = _mm256_loadu_ps(p + i), vq = _mm256_loadu_ps(q + i);
+            __m256 m = _mm256_mul_ps(half, _mm256_add_ps(vp, vq));
+            __m256 lm = log2_ps(m);
+            __m256 tp = _mm256_mul_ps(vp, _mm256_sub_ps(log2_ps(vp), lm));
+            __m256 tq = _mm256_mul_ps(vq, _mm256_sub_ps(log2_ps(vq), lm));
+            sum = _mm256_add_ps(sum, _mm256_and_ps(tp, _mm256_cmp_ps(vp, zero, _CMP_GT_OQ)));
+            sum = _mm256_add_ps(sum, _mm256_and_ps(tq, _mm256_cmp_ps(vq, zero, _CMP_GT_OQ)));
+        }
+        float total = hsum(sum) + js_sum_scalar(p + i, q + i, n - i);
+        return std::sqrt(std::max(0.0f, 0.5f * total));
+    }
+#endif
+}
+
+inline float dot_product(const float *a, const float *b, size_t n = FINGERPRINT_DIMS)
+{
+#ifdef CPU_X86
+    if (cpu_has_avx2() && cpu_has_fma())
+    {
+        return fingerprint_detail::dot_avx2(a, b, n);
+    }
+#endif
+    return fingerprint_detail::dot_scalar(a, b, n);
+}
+
+// sum of weight * (x - mean)^2, a mahalanobis distance for diagonal models
+inline float weighted_distance(const float *x, const float *mean, const float *weight, size_t n = FINGERPRINT_DIMS)
+{
+#ifdef CPU_X86
+    if (cpu_has_avx2() && cpu_has_fma())
+    {
+        return fingerprint_detail::weighted_avx2(x, mean, weight, n);
+    }
+#endif
+    return fingerprint_detail::weighted_scalar(x, mean, weight, n);
+}
+
+// 1 - cosine similarity, in [0, 1] for fingerprints
+inline float cosine_distance(const float *a, const float *b, size_t n = FINGERPRINT_DIMS)
+{
+#ifdef CPU_X86
+    if (cpu_has_avx2() && cpu_has_fma())
+    {
+        return fingerprint_detail::cosine_avx2(a, b, n);
+    }
+#endif
+    return fingerprint_detail::cosine_scalar(a, b, n);
+}
+
+// square root of the jensen-shannon divergence (base 2), a metric in [0, 1]
+inline float js_distance(const float *p, const float *q, size_t n = FINGERPRINT_DIMS)
+{
+#ifdef CPU_X86
+    if (cpu_has_avx2() && cpu_has_fma())
+    {
+        return fingerprint_detail::js_avx2(p, q, n);
+    }
+#endif
+    return fingerprint_detail::js_scalar(p, q, n);
+}
@@ -0,0 +1,447 @@
+//  ██╗  ██╗██╗███████╗████████╗ ██████╗  ██████╗ ██████╗  █████╗ ███╗   ███╗        ██╗ ██████╗    ██╗  ██╗██████╗ ██████╗
+//  ██║  ██║██║██╔════╝╚══██╔══╝██╔═══██╗██╔════╝ ██╔══██╗██╔══██╗████╗ ████║        ██║██╔═══██╗   ██║  ██║██╔══██╗██╔══██╗
+//  ███████║██║███████╗   ██║   ██║   ██║██║  ███╗██████╔╝███████║██╔████╔██║        ██║██║   ██║   ███████║██████╔╝██████╔╝
+//  ██╔══██║██║╚════██║   ██║   ██║   ██║██║   ██║██╔══██╗██╔══██║██║╚██╔╝██║        ██║██║   ██║   ██╔══██║██╔═══╝ ██╔═══╝
+//  ██║  ██║██║███████║   ██║   ╚██████╔╝╚██████╔╝██║  ██║██║  ██║██║ ╚═╝ ██║███████╗██║╚██████╔╝██╗██║  ██║██║     ██║
+//  ╚═╝  ╚═╝╚═╝╚══════╝   ╚═╝    ╚═════╝  ╚═════╝ ╚═╝  ╚═╝╚═╝  ╚═╝╚═╝     ╚═╝╚══════╝╚═╝ ╚═════╝ ╚═╝╚═╝  ╚═╝╚═╝     ╚═╝
+//
+//
+// sparse binary trigram histograms (.fcube), written by fcube-analyze, read by the viewer
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "trigram.hpp"
+
+// file layout, all little endian, every section starts 8 byte aligned:
+//
+//   header  magic "FCUBE001", input size u64, layer count u32, flags u32
+//   layers  one after the other:
+//             name length u32, entry count u32, total u64
+//             name bytes, zero padded to 8
+//             bins u32[entry count], sorted, zero padded to 8
+//             counts u64[entry count]
+//             with FCUBE_POSITIONS only:
+//               position means u16[entry count], zero padded to 8
+//               position spreads u16[entry count], zero padded to 8
+//             with FCUBE_SHARD only:
+//               fcube_shard, where the layer's bytes sit in the whole input
+//             with FCUBE_SAMPLED only:
+//               fcube_sample, how much of the input the estimate has seen
+//
+// a layer is one histogram: a whole file, one sample of a corpus store, ...
+const char FCUBE_MAGIC[8] = {'F', 'C', 'U', 'B', 'E', '0', '0', '1'};
+const uint32_t FCUBE_MAX_NAME = 4096;
+
+// every layer carries where in its input each trigram sits (positions.hpp)
+const uint32_t FCUBE_POSITIONS = 1;
+// every layer counts one piece of a bigger input, to be merged (shards.hpp)
+const uint32_t FCUBE_SHARD = 2;
+// every layer is an estimate scaled up from a sample of its input (sampling.hpp)
+const uint32_t FCUBE_SAMPLED = 4;
+
+struct fcube_header
+{
+    char magic[8];
+    uint64_t input_size;
+    uint32_t layer_count;
+    uint32_t flags; // FCUBE_*, zero in files from before there were any
+};
+
+struct fcube_layer_header
+{
+    uint32_t name_length;
+    uint32_t entry_count;
+    uint64_t total;
+};
+
+// a shard holds only the trigrams wholly inside [offset, offset + length),
+// plus the first and last two bytes so a merge can count the ones across
+// each seam. head and tail are shorter when the shard is
+struct fcube_shard
+{
+    uint64_t offset;
+    uint64_t length;
+    uint64_t input_size; // of the whole input
+    uint8_t head_length;
+    uint8_t tail_length;
+    uint8_t head[2];
+    uint8_t tail[2];
+    uint8_t reserved[2];
+};
+
+// counts of a sampled layer are the sampled counts times positions / sampled,
+// rounded, so the sampled ones can be had back exactly (sampled_count)
+struct fcube_sample
+{
+    uint64_t sampled;   // trigram positions counted so far
+    uint64_t positions; // in the whole input
+    uint64_t blocks_read;
+    uint64_t blocks;
+};
+
+static_assert(sizeof(fcube_header) == 24, "header is packed by hand");
+static_assert(sizeof(fcube_shard) == 32, "shard record is packed by hand");
+static_assert(sizeof(fcube_sample) == 32, "sample record is packed by hand");
+static_assert(sizeof(fcube_layer_header) == 16, "layer header is packed by hand");
+
+struct histogram_layer
+{
+    std::string name;
+    uint64_t total = 0; // sum of counts
+    std::vector<uint32_t> bins;
+    std::vector<uint64_t> counts;
+
+    // mean offset of each bin's trigrams and their standard deviation, both
+    // in 1/65536ths of the input. empty unless the layer was counted with them
+    std::vector<uint16_t> position_mean;
+    std::vector<uint16_t> position_spread;
+
+    bool has_positions() const
+    {
+        return !bins.empty() && position_mean.size() == bins.size();
+    }
+
+    fcube_shard shard{};   // only read and written with FCUBE_SHARD
+    fcube_sample sample{}; // only read and written with FCUBE_SAMPLED
+};
+
+struct fcube
+{
+    uint64_t input_size = 0; // bytes counted over all layers
+    uint32_t flags = 0;
+    std::vector<histogram_layer> layers;
+
+    const histogram_layer *find(const std::string &name) const
+    {
+        for (const auto &layer : layers)
+        {
+            if (layer.name == name)
+            {
+                return &layer;
+            }
+        }
+        return nullptr;
+    }
+};
+
+// sparse copy of a dense TRIGRAM_BINS histogram
+template <typename T>
+histogram_layer layer_from_dense(const std::string &name, const T *counts)
+{
+    histogram_layer layer;
+    layer.name = name;
+    for (uint32_t bin = 0; bin < TRIGRAM_BINS; ++bin)
+    {
+        if (counts[bin])
+        {
+            layer.bins.push_back(bin);
+            layer.counts.push_back(counts[bin]);
+            layer.total += counts[bin];
+        }
+    }
+    return layer;
+}
+
+namespace fcube_detail
+{
+    inline size_t padding(size_t size)
+    {
+        return (8 - size % 8) % 8;
+    }
+
+    inline void write_padded(std::ofstream &out, const void *data, size_t size)
+    {
+        static const char zeros[8] = {};
+        out.write(static_cast<const char *>(data), size);
+        out.write(zeros, padding(size));
+    }
+
+    inline void read_padded(std::ifstream &in, void *data, size_t size)
+    {
+        char skip[8];
+        in.read(static_cast<char *>(data), size);
+        in.read(skip, padding(size));
+    }
+}
+
+// streams layers out one at a time, so a corpus store never has to fit in
+// memory. the layer count and input size in the header are patched on close
+class fcube_writer
+{
+private:
+    std::string path_;
+    std::ofstream out_;
+    uint32_t flags_;
+    uint32_t layer_count_ = 0;
+
+public:
+    explicit fcube_writer(const std::string &path, uint32_t flags = 0)
+        : path_(path), out_(path, std::ios::binary), flags_(flags)
+    {
+        if (!out_)
+        {
+            throw std::runtime_error("Failed to create " + path);
+        }
+
+        fcube_header header{};
+        std::memcpy(header.magic, FCUBE_MAGIC, sizeof(header.magic));
+        header.flags = flags_;
+        out_.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    }
+
+    void add(const histogram_layer &layer)
+    {
+        bool positions = flags_ & FCUBE_POSITIONS;
+        if (layer.name.size() > FCUBE_MAX_NAME || layer.bins.size() != layer.counts.size() ||
+            (positions && (layer.position_mean.size() != layer.bins.size() ||
+                           layer.position_spread.size() != layer.bins.size())))
+        {
+            throw std::runtime_error("Bad histogram layer " + layer.name);
+        }
+
+        fcube_layer_header layer_header{};
+        layer_header.name_length = static_cast<uint32_t>(layer.name.size());
+        layer_header.entry_count = static_cast<uint32_t>(layer.bins.size());
+        layer_header.total = layer.total;
+        out_.write(reinterpret_cast<const char *>(&layer_header), sizeof(layer_header));
+        fcube_detail::write_padded(out_, layer.name.data(), layer.name.size());
+        fcube_detail::write_padded(out_, layer.bins.data(), layer.bins.size() * sizeof(uint32_t));
+        out_.write(reinterpret_cast<const char *>(layer.counts.data()), layer.counts.size() * sizeof(uint64_t));
+        if (positions)
+        {
+            fcube_detail::write_padded(out_, layer.position_mean.data(), layer.position_mean.size() * sizeof(uint16_t));
+            fcube_detail::write_padded(out_, layer.position_spread.data(), layer.position_spread.size() * sizeof(uint16_t));
+        }
+        if (flags_ & FCUBE_SHARD)
+        {
+            out_.write(reinterpret_cast<const char *>(&layer.shard), sizeof(layer.shard));
+        }
+        if (flags_ & FCUBE_SAMPLED)
+        {
+            out_.write(reinterpret_cast<const char *>(&layer.sample), sizeof(layer.sample));
+        }
+        layer_count_++;
+    }
+
+    void close(uint64_t input_size)
+    {
+        out_.seekp(offsetof(fcube_header, input_size));
+        out_.write(reinterpret_cast<const char *>(&input_size), sizeof(input_size));
+        out_.write(reinterpret_cast<const char *>(&layer_count_), sizeof(layer_count_));
+        out_.close();
+        if (!out_)
+        {
+            throw std::runtime_error("Failed to write " + path_);
+        }
+    }
+};
+
+inline void write_fcube(const std::string &path, const fcube &cube)
+{
+    fcube_writer writer(path, cube.flags);
+    for (const auto &layer : cube.layers)
+    {
+        writer.add(layer);
+    }
+    writer.close(cube.input_size);
+}
+
+// reads layers back one at a time, the counterpart of fcube_writer
+class fcube_reader
+{
+private:
+    std::string path_;
+    std::ifstream in_;
+    fcube_header header_{};
+    uint32_t layers_read_ = 0;
+
+public:
+    explicit fcube_reader(const std::string &path)
+        : path_(path), in_(path, std::ios::binary)
+    {
+        if (!in_)
+        {
+            throw std::runtime_error("Failed to open " + path);
+        }
+
+        in_.read(reinterpret_cast<char *>(&header_), sizeof(header_));
+        if (!in_ || std::memcmp(header_.magic, FCUBE_MAGIC, sizeof(header_.magic)) != 0)
+        {
+            throw std::runtime_error("Not an fcube histogram: " + path);
+        }
+    }
+
+    uint64_t input_size() const
+    {
+        return header_.input_size;
+    }
+
+    uint32_t layer_count() const
+    {
+        return header_.layer_count;
+    }
+
+    uint32_t flags() const
+    {
+        return header_.flags;
+    }
+
+    // false once every layer has been read
+    bool next(histogram_layer &layer)
+    {
+        if (layers_read_ == header_.layer_count)
+        {
+            return false;
+        }
+
+        fcube_layer_header layer_header{};
+        in_.read(reinterpret_cast<char *>(&layer_header), sizeof(layer_header));
+        if (!in_ || layer_header.name_length > FCUBE_MAX_NAME || layer_header.entry_count > TRIGRAM_BINS)
+        {
+            throw std::runtime_error("Corrupt layer header in " + path_);
+        }
+
+        layer.total = layer_header.total;
+        layer.name.resize(layer_header.name_length);
+        layer.bins.resize(layer_header.entry_count);
+        layer.counts.resize(layer_header.entry_count);
+        fcube_detail::read_padded(in_, &layer.name[0], layer.name.size());
+        fcube_detail::read_padded(in_, layer.bins.data(), layer.bins.size() * sizeof(uint32_t));
+        in_.read(reinterpret_cast<char *>(layer.counts.data()), layer.counts.size() * sizeof(uint64_t));
+        if (header_.flags & FCUBE_POSITIONS)
+        {
+            layer.position_mean.resize(layer_header.entry_count);
+            layer.position_spread.resize(layer_header.entry_count);
+            fcube_detail::read_padded(in_, layer.position_mean.data(), layer.position_mean.size() * sizeof(uint16_t));
+            fcube_detail::read_padded(in_, layer.position_spread.data(), layer.position_spread.size() * sizeof(uint16_t));
+        }
+        else
+        {
+            layer.position_mean.clear();
+            layer.position_spread.clear();
+        }
+        layer.shard = fcube_shard{};
+        if (header_.flags & FCUBE_SHARD)
+        {
+            in_.read(reinterpret_cast<char *>(&layer.shard), sizeof(layer.shard));
+        }
+        layer.sample = fcube_sample{};
+        if (header_.flags & FCUBE_SAMPLED)
+        {
+            in_.read(reinterpret_cast<char *>(&layer.sample), sizeof(layer.sample));
+        }
+        if (!in_)
+        {
+            throw std::runtime_error("Truncated layer in " + path_);
+        }
+
+        for (size_t j = 0; j < layer.bins.size(); ++j)
+        {
+            if (layer.bins[j] >= TRIGRAM_BINS || (j > 0 && layer.bins[j] <= layer.bins[j - 1]))
+            {
+                throw std::runtime_error("Unsorted bins in layer " + layer.name + " of " + path_);
+            }
+        }
+        layers_read_++;
+        return true;
+    }
+};
+
+inline fcube read_fcube(const std::string &path)
+{
+    fcube_reader reader(path);
+    fcube cube;
+    cube.input_size = reader.input_size();
+    cube.flags = reader.flags();
+    histogram_layer layer;
+    while (reader.next(layer))
+    {
+        cube.layers.push_back(std::move(layer));
+    }
+    return cube;
+}
+
+// a layer read in place from an .fcube already in memory (a mapped file, a
+// daemon's memfd), bins and counts point into that memory
+struct fcube_layer_view
+{
+    std::string name;
+    uint64_t total = 0;
+    size_t entries = 0;
+    const uint32_t *bins = nullptr;
+    const uint64_t *counts = nullptr;
+};
+
+// data must be 8 byte aligned, as any mapping is
+inline std::vector<fcube_layer_view> view_fcube(const uint8_t *data, size_t size)
+{
+    size_t at = 0;
+    auto take = [&](size_t bytes)
+    {
+        if (bytes > size - at)
+        {
+            throw std::runtime_error("Truncated fcube in memory");
+        }
+        const uint8_t *p = data + at;
+        at += bytes;
+        return p;
+    };
+
+    fcube_header header;
+    std::memcpy(&header, take(sizeof(header)), sizeof(header));
+    if (std::memcmp(header.magic, FCUBE_MAGIC, sizeof(header.magic)) != 0)
+    {
+        throw std::runtime_error("Not an fcube histogram in memory");
+    }
+
+    std::vector<fcube_layer_view> layers;
+    for (uint32_t l = 0; l < header.layer_count; ++l)
+    {
+        fcube_layer_header layer_header;
+        std::memcpy(&layer_header, take(sizeof(layer_header)), sizeof(layer_header));
+        if (layer_header.name_length > FCUBE_MAX_NAME || layer_header.entry_count > TRIGRAM_BINS)
+        {
+            throw std::runtime_error("Corrupt layer header in memory");
+        }
+
+        fcube_layer_view view;
+        size_t n = layer_header.entry_count;
+        view.total = layer_header.total;
+        view.entries = n;
+        const char *name = reinterpret_cast<const char *>(take(layer_header.name_length + fcube_detail::padding(layer_header.name_length)));
+        view.name.assign(name, layer_header.name_length);
+        view.bins = reinterpret_cast<const uint32_t *>(take(n * sizeof(uint32_t) + fcube_detail::padding(n * sizeof(uint32_t))));
+        view.counts = reinterpret_cast<const uint64_t *>(take(n * sizeof(uint64_t)));
+        if (header.flags & FCUBE_POSITIONS)
+        {
+            take(2 * (n * sizeof(uint16_t) + fcube_detail::padding(n * sizeof(uint16_t))));
+        }
+        if (header.flags & FCUBE_SHARD)
+        {
+            take(sizeof(fcube_shard));
+        }
+        if (header.flags & FCUBE_SAMPLED)
+        {
+            take(sizeof(fcube_sample));
+        }
+
+        for (size_t j = 0; j < n; ++j)
+        {
+            if (view.bins[j] >= TRIGRAM_BINS || (j > 0 && view.bins[j] <= view.bins[j - 1]))
+            {
+                throw std::runtime_error("Unsorted bins in layer " + view.name + " in memory");
+            }
+        }
+        layers.push_back(std::move(view));
+    }
+    return layers;
+}
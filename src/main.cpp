@@ -26,12 +26,27 @@
 #include <set>
 #include <optional>
 #include <chrono>
+#include <cstdio>
 #include <cstring>
 #include <cstdlib>
+#include <cmath>
 #include <algorithm>
+#include <filesystem>
 #include <stdexcept>
 
 #include "arg.hpp"
+#include "tasks.hpp"
+#include "pyramid.hpp"
+#include "slab.hpp"
+#include "trigram_index.hpp"
+#include "background.hpp"
+#include "histogram_io.hpp"
+#include "positions.hpp"
+#include "classifier.hpp"
+#include "diff.hpp"
+#include "daemon.hpp"
+#include "rarity.hpp"
+#include "sampling.hpp"
 
 // ┌───────────────────────────────────────────────────────────────────────────────────────────┐
 // │                                                                                           │
@@ -43,6 +58,25 @@ const uint32_t WINDOW_WIDTH = 800;
 const uint32_t WINDOW_HEIGHT = 600;
 const int MAX_FRAMES_IN_FLIGHT = 2;
 
+// below this many draws per recording thread the frame is recorded inline,
+// handing a couple of draws to another thread costs more than it saves
+const size_t MIN_DRAWS_PER_RECORD_THREAD = 16;
+
+// gpu counting: trigram starts per histogram.comp workgroup, and the number
+// of instances.comp workgroups that cover all 2^24 bins (256 x 16 bins each)
+const uint32_t TRIGRAMS_PER_WORKGROUP = 256 * 64;
+const uint32_t BIN_WORKGROUPS = static_cast<uint32_t>(TRIGRAM_BINS / (256 * 16));
+
+// offsets printed per drill-down, the index may hold many more
+const size_t OFFSETS_SHOWN = 16;
+
+// the id attachment is cleared to this, so it also means nothing under the cursor
+const uint32_t NO_PICK = 0xFFFFFFFF;
+
+// pick buffer layout: the id texel, then (gpu counting) the picked InstanceData
+const VkDeviceSize PICK_INSTANCE_OFFSET = 16;
+const VkDeviceSize PICK_BUFFER_SIZE = 64;
+
 const std::vector<const char *> validationLayers = {
     "VK_LAYER_KHRONOS_validation"};
 
@@ -59,16 +93,19 @@ const bool enableValidationLayers = false;
 const bool enableValidationLayers = true;
 #endif
 
+// set by cmake: 1 when glslc built the voxel, point, compute and rarity
+// shaders, 0 when only the checked in vert.spv / frag.spv were copied and
+// the viewer is limited to plain cubes
+#ifndef FCUBE_SHADER_MODES
+#define FCUBE_SHADER_MODES 1
+#endif
+const bool SHADER_MODES = FCUBE_SHADER_MODES != 0;
+
 // ┌───────────────────────────────────────────────────────────────────────────────────────────┐
 // │                                                                                           │
 // ├────────────────┬──────────────────────────────────────────────────────────────────────────┘
 // │  structures    │
 // └────────────────┘
-struct Voxel
-{
-    int x, y, z, count;
-};
-
 struct Vertex
 {
     glm::vec3 pos;
@@ -99,6 +136,9 @@ struct InstanceData
 {
     glm::vec3 offset;
     float intensity;
+    float size; // edge length in level 0 voxels, 2^level for pyramid cells
+    glm::vec2 position; // mean offset and spread as in Voxel, x < 0 when unknown
+    float delta;        // change against --compare over the level's largest, in [-1, 1]
 
     static VkVertexInputBindingDescription getBindingDescription()
     {
@@ -109,9 +149,9 @@ struct InstanceData
         return bindingDescription;
     }
 
-    static std::array<VkVertexInputAttributeDescription, 2> getAttributeDescriptions()
+    static std::array<VkVertexInputAttributeDescription, 5> getAttributeDescriptions()
     {
-        std::array<VkVertexInputAttributeDescription, 2> attributeDescriptions{};
+        std::array<VkVertexInputAttributeDescription, 5> attributeDescriptions{};
 
         attributeDescriptions[0].binding = 1;
         attributeDescriptions[0].location = 1;
@@ -123,13 +163,43 @@ struct InstanceData
         attributeDescriptions[1].format = VK_FORMAT_R32_SFLOAT;
         attributeDescriptions[1].offset = offsetof(InstanceData, intensity);
 
+        attributeDescriptions[2].binding = 1;
+        attributeDescriptions[2].location = 3;
+        attributeDescriptions[2].format = VK_FORMAT_R32_SFLOAT;
+        attributeDescriptions[2].offset = offsetof(InstanceData, size);
+
+        attributeDescriptions[3].binding = 1;
+        attributeDescriptions[3].location = 4;
+        attributeDescriptions[3].format = VK_FORMAT_R32G32_SFLOAT;
+        attributeDescriptions[3].offset = offsetof(InstanceData, position);
+
+        attributeDescriptions[4].binding = 1;
+        attributeDescriptions[4].location = 5;
+        attributeDescriptions[4].format = VK_FORMAT_R32_SFLOAT;
+        attributeDescriptions[4].offset = offsetof(InstanceData, delta);
+
         return attributeDescriptions;
     }
 };
 
+// one vkCmdDrawIndexed worth of instances
+struct DrawRange
+{
+    uint32_t firstInstance;
+    uint32_t instanceCount;
+};
+
 struct UniformBufferObject
 {
     alignas(16) glm::mat4 mvp;
+    alignas(16) glm::vec4 params; // x = point scale, pixels per unit at w = 1, y = 1 to hue by position, z = 1 to color by delta
+};
+
+// instanced unit cubes, or one screen-space impostor point per trigram
+enum class RenderMode
+{
+    Cubes,
+    Points
 };
 
 struct QueueFamilyIndices
@@ -167,7 +237,10 @@ public:
     {
         initWindow();
         initVulkan();
-        mainLoop();
+        if (!gpuSelfTest)
+        {
+            mainLoop();
+        }
         cleanup();
     }
 
@@ -195,6 +268,7 @@ private:
     VkDescriptorSetLayout descriptorSetLayout;
     VkPipelineLayout pipelineLayout;
     VkPipeline graphicsPipeline;
+    VkPipeline pointPipeline = VK_NULL_HANDLE;
 
     VkCommandPool commandPool;
 
@@ -202,6 +276,39 @@ private:
     VkDeviceMemory depthImageMemory;
     VkImageView depthImageView;
 
+    // picking: the second colour attachment holds the instance index of every
+    // pixel. each frame copies the texel under the cursor into that frame's
+    // pick buffer, which is read once its fence has been waited on anyway
+    std::vector<VkImage> idImages; // per swapchain image, like the framebuffers
+    std::vector<VkDeviceMemory> idImagesMemory;
+    std::vector<VkImageView> idImageViews;
+    std::vector<VkBuffer> pickBuffers; // per frame in flight, persistently mapped
+    std::vector<VkDeviceMemory> pickBuffersMemory;
+    std::vector<void *> pickBuffersMapped;
+    std::array<bool, MAX_FRAMES_IN_FLIGHT> pickIssued{};
+    std::array<uint32_t, MAX_FRAMES_IN_FLIGHT> pickInstanceIssued{NO_PICK, NO_PICK};
+    uint32_t pickedInstance = NO_PICK;
+    std::optional<Voxel> pickedVoxel;
+    int pickedLevel = 0;
+    std::string windowTitle;
+    std::string fileClass; // from --model, empty without one
+    std::optional<classifier_model> classModel;
+
+    // .fcube input keeps every layer, N / B step through them. T adds the
+    // current one to (or takes it from) layerShown, whose sum is drawn
+    // instead while any is in it, e.g. just the code sections of a binary
+    fcube inputCube;
+    size_t layerIndex = 0;
+    int pendingLayerStep = 0;
+    bool pendingLayerToggle = false;
+    std::vector<bool> layerShown;
+
+    // an estimate from fcube-analyze sample is rewritten as the sample grows,
+    // checked for about once a second until the exact counts replace it
+    std::string inputCubePath;
+    std::filesystem::file_time_type inputCubeWritten;
+    std::chrono::steady_clock::time_point lastRefinementCheck;
+
     VkBuffer vertexBuffer;
     VkDeviceMemory vertexBufferMemory;
     VkBuffer indexBuffer;
@@ -209,6 +316,10 @@ private:
     VkBuffer instanceBuffer;
     VkDeviceMemory instanceBufferMemory;
 
+    // gpu counting only: the cube and point draws, written by instances.comp
+    VkBuffer indirectBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory indirectBufferMemory = VK_NULL_HANDLE;
+
     std::vector<VkBuffer> uniformBuffers;
     std::vector<VkDeviceMemory> uniformBuffersMemory;
     std::vector<void *> uniformBuffersMapped;
@@ -218,14 +329,90 @@ private:
 
     std::vector<VkCommandBuffer> commandBuffers;
 
+    // [frame][thread], each recording thread owns its pool so no locking is needed
+    uint32_t recordThreads = 1;
+    std::vector<std::vector<VkCommandPool>> recordPools;
+    std::vector<std::vector<VkCommandBuffer>> recordBuffers;
+
     std::vector<VkSemaphore> imageAvailableSemaphores;
     std::vector<VkSemaphore> renderFinishedSemaphores;
     std::vector<VkFence> inFlightFences;
     uint32_t currentFrame = 0;
 
+    // init and per-frame work is spread over this
+    thread_pool workerPool;
+
+    std::vector<char> vertShaderCode;
+    std::vector<char> fragShaderCode;
+    std::vector<char> pointVertShaderCode;
+    std::vector<char> histogramShaderCode;      // with subgroup ballots
+    std::vector<char> histogramPlainShaderCode; // without
+    std::vector<char> instancesShaderCode;
+    std::vector<char> instancesPlainShaderCode;
+    std::vector<char> rarityVertShaderCode;
+    std::vector<char> rarityFragShaderCode;
+
+    // --rarity: the hilbert image from fcube-analyze rarity, drawn in a
+    // square panel right of the cube while rarityPanel is on (M)
+    rarity_image rarityImage;
+    bool rarityPanel = false;
+    VkImage rarityTexture = VK_NULL_HANDLE;
+    VkDeviceMemory rarityTextureMemory = VK_NULL_HANDLE;
+    VkImageView rarityTextureView = VK_NULL_HANDLE;
+    VkSampler raritySampler = VK_NULL_HANDLE;
+    VkDescriptorSetLayout raritySetLayout = VK_NULL_HANDLE;
+    VkDescriptorPool rarityDescriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSet rarityDescriptorSet = VK_NULL_HANDLE;
+    VkPipelineLayout rarityPipelineLayout = VK_NULL_HANDLE;
+    VkPipeline rarityPipeline = VK_NULL_HANDLE;
+
+    // --gpu-count: --inputfile is the raw binary, counted by histogram.comp
+    // and turned into instanceBuffer + indirectBuffer by instances.comp.
+    // lod and slabs need the cpu side layout and are off in this mode
+    bool gpuCount = false;
+    bool gpuSelfTest = false; // count a built-in input, check it and exit
+    uint32_t gpuMaxCount = 0; // to turn a picked instance's intensity back into a count
+
     // Application data
     std::vector<Voxel> voxels;
     std::vector<InstanceData> instanceData;
+    std::vector<DrawRange> drawRanges;
+    RenderMode renderMode = RenderMode::Cubes;
+    bool positionHue = true; // color by where in the input a trigram sits, when known
+    bool deltaColors = true; // with --compare, color by the change instead
+
+    // level of detail: instanceData holds every pyramid level back to back,
+    // levelBase[l] is where level l starts
+    voxel_pyramid pyramid;
+    std::array<uint32_t, PYRAMID_LEVELS> levelBase{};
+    bool lodEnabled = true;
+    float lodPixels = 2.0f;
+    int lodBias = 0; // raised while frames run over budget
+    float frameBudgetMs = 25.0f;
+    float frameTimeMs = 0.0f; // smoothed frame to frame interval
+    int framesSinceLodChange = 0;
+    std::chrono::steady_clock::time_point lastFrameTime;
+    glm::vec3 cameraPosition{0.0f}; // in model (trigram) space
+    float pointScale = 1.0f;       // pixels per unit at w = 1
+
+    // --index: where in the input each trigram occurs, mmapped
+    trigram_index offsetIndex;
+
+    // --background: corpus document frequencies, mmapped. the pyramid then
+    // holds count * weight scores instead of counts
+    background_model background;
+
+    // --compare: the histogram diffed against. the pyramid then holds the
+    // union of both with each trigram's change in share
+    std::vector<Voxel> compareVoxels;
+
+    // slab slicing: level 0 is appended once more per axis, sorted by that
+    // coordinate, so any slab is one range and scrubbing uploads nothing
+    axis_index slabIndex;
+    std::array<uint32_t, AXIS_COUNT> axisBase{};
+    int sliceAxis = -1; // -1 shows the whole cube
+    int slabStart = 0;
+    int slabWidth = 16;
     std::chrono::steady_clock::time_point startTime;
 
     // Cube vertices (unit cube centered at origin)
@@ -257,1221 +444,3250 @@ private:
         window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "Trigram Voxel Viewer", nullptr, nullptr);
 
         glfwSetWindowUserPointer(window, this);
-    }
-
-    void initVulkan()
-    {
-        std::string ifile = args_.get<std::string>("--inputfile");
-        std::cout << "initVulkan(): if = " << ifile << std::endl;
-        loadTrigrams(ifile);
-
-        createInstance();
-        setupDebugMessenger();
-        createSurface();
-        pickPhysicalDevice();
-        createLogicalDevice();
-        createSwapChain();
-        createImageViews();
-        createRenderPass();
-        createDescriptorSetLayout();
-        createGraphicsPipeline();
-        createDepthResources();
-        createFramebuffers();
-        createCommandPool();
-        createVertexBuffer();
-        createIndexBuffer();
-        createInstanceBuffer();
-        createUniformBuffers();
-        createDescriptorPool();
-        createDescriptorSets();
-        createCommandBuffers();
-        createSyncObjects();
-
-        startTime = std::chrono::steady_clock::now();
-    }
+        glfwSetKeyCallback(window, keyCallback);
 
-    void loadTrigrams(const std::string &filename)
-    {
-        std::ifstream file(filename);
-        if (!file.is_open())
+        if (!SHADER_MODES)
         {
-            throw std::runtime_error("Failed to open " + filename);
+            std::cout << "Built without glslc: plain cubes only, points, picking, level of detail, gpu counting, "
+                         "hue, change colors and the rarity map need the shaders glslc builds" << std::endl;
         }
 
-        nlohmann::json j;
-        file >> j;
-
-        voxels.clear();
-        for (const auto &item : j)
+        if (args_.get_or<std::string>("--render-mode", "cubes") == "points")
         {
-            Voxel voxel;
-            voxel.x = item["x"];
-            voxel.y = item["y"];
-            voxel.z = item["z"];
-            voxel.count = item["count"];
-            voxels.push_back(voxel);
+            if (SHADER_MODES)
+            {
+                renderMode = RenderMode::Points;
+            }
+            else
+            {
+                std::cout << "--render-mode points needs glslc, drawing cubes" << std::endl;
+            }
         }
 
-        int maxCount = 1;
-        for (const auto &voxel : voxels)
+        gpuSelfTest = args_.get_or<bool>("--gpu-self-test", false);
+        gpuCount = args_.get_or<bool>("--gpu-count", false) || gpuSelfTest;
+        if (gpuCount && !SHADER_MODES)
         {
-            maxCount = std::max(maxCount, voxel.count);
+            throw std::runtime_error("GPU counting needs the compute shaders, rebuild with glslc on the PATH");
         }
-
-        instanceData.clear();
-        for (const auto &voxel : voxels)
+        if (!args_.get_or<std::string>("--rarity", "").empty() && !SHADER_MODES)
         {
-            InstanceData instance;
-            instance.offset = glm::vec3(voxel.x, voxel.y, voxel.z);
-            instance.intensity = static_cast<float>(voxel.count) / maxCount;
-            instanceData.push_back(instance);
+            throw std::runtime_error("--rarity needs the rarity shaders, rebuild with glslc on the PATH");
         }
+        lodEnabled = args_.get_or<bool>("--lod", true) && !gpuCount && SHADER_MODES;
+        lodPixels = args_.get_or<float>("--lod-pixels", 2.0f);
+        frameBudgetMs = args_.get_or<float>("--frame-budget-ms", 25.0f);
 
-        std::cout << "Loaded " << voxels.size() << " voxels" << std::endl;
+        std::string axis = args_.get_or<std::string>("--slice-axis", "none");
+        if (axis == "x" || axis == "y" || axis == "z")
+        {
+            sliceAxis = axis[0] - 'x';
+        }
+        else if (axis != "none")
+        {
+            throw std::runtime_error("Unknown slice axis " + axis + ", expected x, y, z or none");
+        }
+        slabStart = std::clamp(args_.get_or<int>("--slab-start", 0), 0, SLICE_COUNT - 1);
+        slabWidth = std::clamp(args_.get_or<int>("--slab-width", 16), 1, SLICE_COUNT);
     }
 
-    void mainLoop()
+    static void keyCallback(GLFWwindow *window, int key, int scancode, int action, int mods)
     {
-        while (!glfwWindowShouldClose(window))
+        if (action == GLFW_RELEASE)
         {
-            glfwPollEvents();
-            drawFrame();
+            return;
         }
 
-        vkDeviceWaitIdle(device);
-    }
+        auto app = reinterpret_cast<vulkan_trigram_viewer *>(glfwGetWindowUserPointer(window));
 
-    void cleanup()
-    {
-        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+        // [ ]: scrub the slab, - =: make it thinner / thicker. these repeat
+        // while held, the others only fire on press
+        if (key == GLFW_KEY_LEFT_BRACKET || key == GLFW_KEY_RIGHT_BRACKET || key == GLFW_KEY_MINUS || key == GLFW_KEY_EQUAL)
         {
-            vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
-            vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
-            vkDestroyFence(device, inFlightFences[i], nullptr);
+            int step = (mods & GLFW_MOD_SHIFT) ? 8 : 1;
+            if (key == GLFW_KEY_LEFT_BRACKET)
+            {
+                app->slabStart = std::max(app->slabStart - step, 0);
+            }
+            else if (key == GLFW_KEY_RIGHT_BRACKET)
+            {
+                app->slabStart = std::min(app->slabStart + step, SLICE_COUNT - 1);
+            }
+            else if (key == GLFW_KEY_MINUS)
+            {
+                app->slabWidth = std::max(app->slabWidth - step, 1);
+            }
+            else
+            {
+                app->slabWidth = std::min(app->slabWidth + step, SLICE_COUNT);
+            }
+            app->printSlab();
+            return;
         }
 
-        vkDestroyCommandPool(device, commandPool, nullptr);
-
-        for (auto framebuffer : swapChainFramebuffers)
+        if (action != GLFW_PRESS)
         {
-            vkDestroyFramebuffer(device, framebuffer, nullptr);
+            return;
         }
 
-        vkDestroyPipeline(device, graphicsPipeline, nullptr);
-        vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
-        vkDestroyRenderPass(device, renderPass, nullptr);
+        // P: toggle cubes / point impostors
+        if (key == GLFW_KEY_P && !SHADER_MODES)
+        {
+            std::cout << "Points need the shaders glslc builds" << std::endl;
+        }
+        else if (key == GLFW_KEY_P)
+        {
+            app->renderMode = app->renderMode == RenderMode::Cubes ? RenderMode::Points : RenderMode::Cubes;
+            std::cout << "Render mode: " << (app->renderMode == RenderMode::Cubes ? "cubes" : "points") << std::endl;
+        }
 
-        for (auto imageView : swapChainImageViews)
+        // H: toggle hue by position / by count, D: coloring by the change against --compare
+        if ((key == GLFW_KEY_H || key == GLFW_KEY_D) && !SHADER_MODES)
         {
-            vkDestroyImageView(device, imageView, nullptr);
+            std::cout << "Hue and change colors need the shaders glslc builds" << std::endl;
+        }
+        else if (key == GLFW_KEY_H)
+        {
+            app->positionHue = !app->positionHue;
+            std::cout << "Color by: " << (app->positionHue ? "position" : "count") << std::endl;
+        }
+        else if (key == GLFW_KEY_D && !app->compareVoxels.empty())
+        {
+            app->deltaColors = !app->deltaColors;
+            std::cout << "Color by change: " << (app->deltaColors ? "on" : "off") << std::endl;
         }
 
-        vkDestroySwapchainKHR(device, swapChain, nullptr);
+        // M: toggle the rarity map panel
+        if (key == GLFW_KEY_M && app->rarityPipeline != VK_NULL_HANDLE)
+        {
+            app->rarityPanel = !app->rarityPanel;
+            std::cout << "Rarity map: " << (app->rarityPanel ? "on" : "off") << std::endl;
+        }
 
-        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+        // L: toggle level of detail
+        if (key == GLFW_KEY_L && !SHADER_MODES)
         {
-            vkDestroyBuffer(device, uniformBuffers[i], nullptr);
-            vkFreeMemory(device, uniformBuffersMemory[i], nullptr);
+            std::cout << "Level of detail needs the shaders glslc builds" << std::endl;
+        }
+        else if (key == GLFW_KEY_L)
+        {
+            app->lodEnabled = !app->lodEnabled;
+            app->lodBias = 0;
+            std::cout << "Level of detail: " << (app->lodEnabled ? "on" : "off") << std::endl;
         }
 
-        vkDestroyDescriptorPool(device, descriptorPool, nullptr);
-        vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+        // I: where the trigram under the cursor, or else the hottest one, lives in the input
+        if (key == GLFW_KEY_I)
+        {
+            if (app->pickedVoxel && app->pickedLevel == 0)
+            {
+                app->printOffsets(*app->pickedVoxel);
+            }
+            else
+            {
+                auto hottest = std::max_element(app->voxels.begin(), app->voxels.end(), [](const Voxel &a, const Voxel &b)
+                                                { return a.count < b.count; });
+                if (hottest != app->voxels.end())
+                {
+                    app->printOffsets(*hottest);
+                }
+            }
+        }
 
-        vkDestroyBuffer(device, instanceBuffer, nullptr);
-        vkFreeMemory(device, instanceBufferMemory, nullptr);
+        // N B: next / previous layer of an .fcube, e.g. the regions from fcube-analyze segment
+        if (key == GLFW_KEY_N || key == GLFW_KEY_B)
+        {
+            app->pendingLayerStep += key == GLFW_KEY_N ? 1 : -1;
+        }
 
-        vkDestroyBuffer(device, indexBuffer, nullptr);
-        vkFreeMemory(device, indexBufferMemory, nullptr);
+        // T: draw the current layer together with the others toggled on, fcube-analyze sections has one per section
+        if (key == GLFW_KEY_T)
+        {
+            app->pendingLayerToggle = true;
+        }
 
-        vkDestroyBuffer(device, vertexBuffer, nullptr);
-        vkFreeMemory(device, vertexBufferMemory, nullptr);
+        // X Y Z: slice along that axis, 0: back to the whole cube
+        if (key == GLFW_KEY_X || key == GLFW_KEY_Y || key == GLFW_KEY_Z)
+        {
+            app->sliceAxis = key - GLFW_KEY_X;
+            app->printSlab();
+        }
+        if (key == GLFW_KEY_0)
+        {
+            app->sliceAxis = -1;
+            app->printSlab();
+        }
+    }
 
-        vkDestroyImageView(device, depthImageView, nullptr);
-        vkDestroyImage(device, depthImage, nullptr);
-        vkFreeMemory(device, depthImageMemory, nullptr);
+    void printOffsets(const Voxel &voxel) const
+    {
+        std::cout << "Trigram " << voxel.x << "," << voxel.y << "," << voxel.z << " count " << voxel.count;
+        if (!offsetIndex.is_open())
+        {
+            std::cout << " (no --index loaded)" << std::endl;
+            return;
+        }
 
-        vkDestroyDevice(device, nullptr);
+        auto lookupStart = std::chrono::steady_clock::now();
+        uint32_t bin = trigram_bin(static_cast<uint8_t>(voxel.x), static_cast<uint8_t>(voxel.y), static_cast<uint8_t>(voxel.z));
+        const trigram_index_entry *entry = offsetIndex.find(bin);
+        std::vector<uint64_t> offsets = offsetIndex.offsets(bin, OFFSETS_SHOWN);
+        float lookupUs = std::chrono::duration<float, std::chrono::microseconds::period>(std::chrono::steady_clock::now() - lookupStart).count();
 
-        if (enableValidationLayers)
+        std::cout << ", " << (entry ? entry->total : 0) << " in the index (" << lookupUs << " us):" << std::hex;
+        for (uint64_t offset : offsets)
         {
-            DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
+            std::cout << " 0x" << offset;
+        }
+        std::cout << std::dec;
+        if (entry && entry->total > offsets.size())
+        {
+            std::cout << " ...";
         }
+        std::cout << std::endl;
+    }
 
-        vkDestroySurfaceKHR(instance, surface, nullptr);
-        vkDestroyInstance(instance, nullptr);
+    void printSlab() const
+    {
+        if (sliceAxis < 0)
+        {
+            std::cout << "Slab: off" << std::endl;
+            return;
+        }
 
-        glfwDestroyWindow(window);
-        glfwTerminate();
+        int last = std::min(slabStart + slabWidth, SLICE_COUNT) - 1;
+        std::cout << "Slab: " << static_cast<char>('x' + sliceAxis) << " in [" << slabStart << ", " << last << "], "
+                  << slabIndex.slab_end(sliceAxis, last) - slabIndex.slab_begin(sliceAxis, slabStart) << " voxels" << std::endl;
     }
 
-    void createInstance()
+    // init runs as a small dependency graph on workerPool:
+    //
+    //   trigrams ──────────────────────────────────────────┐
+    //   shaders ─────────────────┬─────────────────────────┤
+    //   device (instance … descriptor layout) ─┬─ pipeline │
+    //                                          └─ targets ─┴─ instances
+    //
+    // so parsing the JSON, reading SPIR-V and compiling the pipeline overlap
+    // and the instance buffer upload is the only step that waits on the parse.
+    // with --gpu-count there is nothing to parse and instances runs the
+    // compute shaders over the raw file instead
+    void initVulkan()
     {
-        if (enableValidationLayers && !checkValidationLayerSupport())
+        auto initStart = std::chrono::steady_clock::now();
+
+        // the self-test brings its own input
+        std::string ifile = gpuSelfTest ? writeSelfTestInput() : args_.get_or<std::string>("--inputfile", "");
+        if (ifile.empty())
         {
-            throw std::runtime_error("validation layers requested, but not available!");
+            throw std::runtime_error("--inputfile is required");
         }
+        std::cout << "initVulkan(): if = " << ifile << std::endl;
 
-        VkApplicationInfo appInfo{};
-        appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
-        appInfo.pApplicationName = "Trigram Voxel Viewer";
-        appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
-        appInfo.pEngineName = "No Engine";
-        appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-        appInfo.apiVersion = VK_API_VERSION_1_0;
+        task_graph init;
+        init.add("trigrams", [this, ifile]()
+                 {
+                     if (!gpuCount)
+                     {
+                         loadTrigrams(ifile);
+                     } });
+        init.add("shaders", [this]()
+                 { loadShaders(); });
+        init.add("rarity", [this]()
+                 { loadRarityImage(); });
+        init.add("index", [this]()
+                 { loadOffsetIndex(); });
+        init.add("classify", [this, ifile]()
+                 { classifyInput(ifile); }, {"trigrams"});
+        init.add("device", [this]()
+                 {
+                     createInstance();
+                     setupDebugMessenger();
+                     createSurface();
+                     pickPhysicalDevice();
+                     createLogicalDevice();
+                     createSwapChain();
+                     createImageViews();
+                     createRenderPass();
+                     createDescriptorSetLayout(); });
+        init.add("pipeline", [this]()
+                 { createGraphicsPipeline(); }, {"device", "shaders"});
+        // everything in here shares commandPool and graphicsQueue, so it stays serial
+        init.add("targets", [this]()
+                 {
+                     createDepthResources();
+                     createIdResources();
+                     createFramebuffers();
+                     createCommandPool();
+                     createVertexBuffer();
+                     createIndexBuffer();
+                     createUniformBuffers();
+                     createPickBuffers();
+                     createDescriptorPool();
+                     createDescriptorSets();
+                     createCommandBuffers();
+                     createRecordPools();
+                     createSyncObjects(); }, {"device"});
+        init.add("instances", [this, ifile]()
+                 {
+                     if (gpuCount)
+                     {
+                         countTrigramsOnGpu(ifile);
+                     }
+                     else
+                     {
+                         createInstanceBuffer();
+                     }
+                     createRarityPanel(); }, {"trigrams", "targets", "shaders", "rarity"});
+        init.run(workerPool);
 
-        VkInstanceCreateInfo createInfo{};
-        createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
-        createInfo.pApplicationInfo = &appInfo;
+        startTime = std::chrono::steady_clock::now();
 
-        auto extensions = getRequiredExtensions();
-        createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
-        createInfo.ppEnabledExtensionNames = extensions.data();
+        float initMs = std::chrono::duration<float, std::chrono::milliseconds::period>(startTime - initStart).count();
+        std::cout << "initVulkan(): ready in " << initMs << " ms on " << workerPool.size() << " threads" << std::endl;
+    }
 
-        VkDebugUtilsMessengerCreateInfoEXT debugCreateInfo{};
-        if (enableValidationLayers)
+    void loadTrigrams(const std::string &filename)
+    {
+        std::string backgroundPath = args_.get_or<std::string>("--background", "");
+        if (!backgroundPath.empty())
         {
-            createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
-            createInfo.ppEnabledLayerNames = validationLayers.data();
+            background.open(backgroundPath);
+            std::cout << "Background " << backgroundPath << ": " << background.documents() << " documents" << std::endl;
+        }
 
-            populateDebugMessengerCreateInfo(debugCreateInfo);
-            createInfo.pNext = (VkDebugUtilsMessengerCreateInfoEXT *)&debugCreateInfo;
+        voxels.clear();
+        if (isFcube(filename))
+        {
+            loadFcube(filename);
+            layerVoxels(layerIndex);
+        }
+        else if (!daemonSocket().empty())
+        {
+            voxels = daemonVoxels(filename);
         }
         else
         {
-            createInfo.enabledLayerCount = 0;
-            createInfo.pNext = nullptr;
+            voxels = readJsonVoxels(filename);
         }
 
-        if (vkCreateInstance(&createInfo, nullptr, &instance) != VK_SUCCESS)
+        std::string comparePath = args_.get_or<std::string>("--compare", "");
+        if (!comparePath.empty())
         {
-            throw std::runtime_error("failed to create instance!");
+            loadComparison(comparePath);
         }
+
+        buildInstances();
     }
 
-    void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT &createInfo)
+    std::string daemonSocket() const
     {
-        createInfo = {};
-        createInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
-        createInfo.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT |
-                                     VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT |
-                                     VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
-        createInfo.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT |
-                                 VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
-                                 VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
-        createInfo.pfnUserCallback = debugCallback;
+        return args_.get_or<std::string>("--daemon", "");
     }
 
-    void setupDebugMessenger()
+    // with --daemon anything but an .fcube is a raw file for fcube-analyze
+    // serve to count. the voxels come straight out of its sealed memfd, a file
+    // opened before is answered from its cache without counting again
+    std::vector<Voxel> daemonVoxels(const std::string &filename) const
     {
-        if (!enableValidationLayers)
-            return;
-
-        VkDebugUtilsMessengerCreateInfoEXT createInfo;
-        populateDebugMessengerCreateInfo(createInfo);
-
-        if (CreateDebugUtilsMessengerEXT(instance, &createInfo, nullptr, &debugMessenger) != VK_SUCCESS)
+        auto start = std::chrono::steady_clock::now();
+        std::unique_ptr<daemon_histogram> histogram = request_histogram(daemonSocket(), filename);
+        std::vector<fcube_layer_view> layers = histogram->layers();
+        if (layers.empty())
         {
-            throw std::runtime_error("failed to set up debug messenger!");
+            throw std::runtime_error("No layers from the daemon for " + filename);
         }
-    }
 
-    void createSurface()
-    {
-        if (glfwCreateWindowSurface(instance, window, nullptr, &surface) != VK_SUCCESS)
+        const fcube_layer_view &layer = layers[0];
+        std::vector<Voxel> result(layer.entries);
+        for (size_t i = 0; i < layer.entries; i++)
         {
-            throw std::runtime_error("failed to create window surface!");
+            uint32_t bin = layer.bins[i];
+            result[i].x = static_cast<int>(bin >> 16);
+            result[i].y = static_cast<int>((bin >> 8) & 0xff);
+            result[i].z = static_cast<int>(bin & 0xff);
+            result[i].count = layer.counts[i];
         }
+
+        float ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "Daemon counted " << filename << ": " << result.size() << " voxels in " << ms << " ms" << std::endl;
+        return result;
     }
 
-    void pickPhysicalDevice()
+    static bool isFcube(const std::string &filename)
     {
-        uint32_t deviceCount = 0;
-        vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
+        return filename.size() > 6 && filename.compare(filename.size() - 6, 6, ".fcube") == 0;
+    }
 
-        if (deviceCount == 0)
+    static std::vector<Voxel> readJsonVoxels(const std::string &filename)
+    {
+        std::ifstream file(filename);
+        if (!file.is_open())
         {
-            throw std::runtime_error("failed to find GPUs with Vulkan support!");
+            throw std::runtime_error("Failed to open " + filename);
         }
 
-        std::vector<VkPhysicalDevice> devices(deviceCount);
-        vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
+        nlohmann::json j;
+        file >> j;
 
-        for (const auto &device : devices)
+        std::vector<Voxel> result;
+        for (const auto &item : j)
         {
-            if (isDeviceSuitable(device))
+            Voxel voxel;
+            voxel.x = item["x"];
+            voxel.y = item["y"];
+            voxel.z = item["z"];
+            voxel.count = item["count"];
+            if (item.contains("position"))
             {
-                physicalDevice = device;
-                break;
+                voxel.position = item["position"];
+                voxel.spread = item.value("spread", 0.0f);
             }
+            result.push_back(voxel);
         }
+        return result;
+    }
 
-        if (physicalDevice == VK_NULL_HANDLE)
+    static std::vector<Voxel> layerToVoxels(const histogram_layer &layer)
+    {
+        std::vector<Voxel> result;
+        result.reserve(layer.bins.size());
+        for (size_t i = 0; i < layer.bins.size(); i++)
         {
-            throw std::runtime_error("failed to find a suitable GPU!");
+            uint32_t bin = layer.bins[i];
+            Voxel voxel;
+            voxel.x = static_cast<int>(bin >> 16);
+            voxel.y = static_cast<int>((bin >> 8) & 0xff);
+            voxel.z = static_cast<int>(bin & 0xff);
+            voxel.count = layer.counts[i];
+            if (layer.has_positions())
+            {
+                voxel.position = static_cast<float>(layer.position_mean[i]) / POSITION_ONE;
+                voxel.spread = static_cast<float>(layer.position_spread[i]) / POSITION_ONE;
+            }
+            result.push_back(voxel);
         }
+        return result;
     }
 
-    void createLogicalDevice()
+    // sorted sparse copy of voxels, what the histogram tools take
+    static histogram_layer voxelLayer(const std::vector<Voxel> &source)
     {
-        QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
-
-        std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-        std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily.value(), indices.presentFamily.value()};
+        std::vector<std::pair<uint32_t, uint64_t>> entries;
+        entries.reserve(source.size());
+        for (const auto &voxel : source)
+        {
+            entries.push_back({trigram_bin(static_cast<uint8_t>(voxel.x), static_cast<uint8_t>(voxel.y), static_cast<uint8_t>(voxel.z)),
+                               voxel.count});
+        }
+        std::sort(entries.begin(), entries.end());
 
-        float queuePriority = 1.0f;
-        for (uint32_t queueFamily : uniqueQueueFamilies)
+        histogram_layer layer;
+        for (const auto &entry : entries)
         {
-            VkDeviceQueueCreateInfo queueCreateInfo{};
-            queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-            queueCreateInfo.queueFamilyIndex = queueFamily;
-            queueCreateInfo.queueCount = 1;
-            queueCreateInfo.pQueuePriorities = &queuePriority;
-            queueCreateInfos.push_back(queueCreateInfo);
+            if (!layer.bins.empty() && layer.bins.back() == entry.first)
+            {
+                layer.counts.back() += entry.second;
+            }
+            else
+            {
+                layer.bins.push_back(entry.first);
+                layer.counts.push_back(entry.second);
+            }
+            layer.total += entry.second;
         }
+        return layer;
+    }
 
-        VkPhysicalDeviceFeatures deviceFeatures{};
-        deviceFeatures.samplerAnisotropy = VK_TRUE;
-
-        VkDeviceCreateInfo createInfo{};
-        createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-        createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
-        createInfo.pQueueCreateInfos = queueCreateInfos.data();
-        createInfo.pEnabledFeatures = &deviceFeatures;
-        createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-        createInfo.ppEnabledExtensionNames = deviceExtensions.data();
-
-        if (enableValidationLayers)
+    // an .fcube compares its layer of the same name, or its first
+    void loadComparison(const std::string &path)
+    {
+        if (isFcube(path))
         {
-            createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
-            createInfo.ppEnabledLayerNames = validationLayers.data();
+            fcube cube = read_fcube(path);
+            if (cube.layers.empty())
+            {
+                throw std::runtime_error("No layers in " + path);
+            }
+            const histogram_layer *layer = inputCube.layers.empty() ? nullptr : cube.find(inputCube.layers[layerIndex].name);
+            compareVoxels = layerToVoxels(layer ? *layer : cube.layers[0]);
+        }
+        else if (!daemonSocket().empty())
+        {
+            compareVoxels = daemonVoxels(path);
         }
         else
         {
-            createInfo.enabledLayerCount = 0;
+            compareVoxels = readJsonVoxels(path);
         }
+        std::cout << "Comparing against " << path << ": " << compareVoxels.size() << " voxels (D to toggle colors)" << std::endl;
+    }
 
-        if (vkCreateDevice(physicalDevice, &createInfo, nullptr, &device) != VK_SUCCESS)
+    // the union of voxels and compareVoxels, sized by the larger count of
+    // the two and carrying the change in share from one to the other
+    std::vector<Voxel> diffVoxels() const
+    {
+        histogram_layer before = voxelLayer(voxels);
+        histogram_layer after = voxelLayer(compareVoxels);
+        histogram_diff diff = diff_layers(before, after);
+
+        std::vector<Voxel> result;
+        result.reserve(diff.bins.size());
+        for (size_t i = 0; i < diff.bins.size(); i++)
         {
-            throw std::runtime_error("failed to create logical device!");
+            double count = std::max(double(diff.before[i]) * double(before.total), double(diff.after[i]) * double(after.total));
+            Voxel voxel;
+            voxel.x = static_cast<int>(diff.bins[i] >> 16);
+            voxel.y = static_cast<int>((diff.bins[i] >> 8) & 0xff);
+            voxel.z = static_cast<int>(diff.bins[i] & 0xff);
+            voxel.count = static_cast<uint64_t>(std::max(std::llround(count), 1ll));
+            voxel.delta = diff.delta[i];
+            result.push_back(voxel);
         }
-
-        vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
-        vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
+        std::cout << "Total variation " << diff.distance << " over " << diff.bins.size() << " trigrams" << std::endl;
+        return result;
     }
 
-    void createSwapChain()
+    // pyramid levels and slab orderings of the current voxels
+    void buildInstances()
     {
-        SwapChainSupportDetails swapChainSupport = querySwapChainSupport(physicalDevice);
+        std::vector<Voxel> shown = compareVoxels.empty() ? voxels : diffVoxels();
+        if (background.is_open())
+        {
+            shown = weightedVoxels(shown);
+        }
+        pyramid.build(shown);
 
-        VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
-        VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
-        VkExtent2D extent = chooseSwapExtent(swapChainSupport.capabilities);
+        // every level normalizes against its own max, summed cells would
+        // otherwise wash out everything below them
+        instanceData.clear();
+        for (int level = 0; level < PYRAMID_LEVELS; level++)
+        {
+            levelBase[level] = static_cast<uint32_t>(instanceData.size());
 
-        uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
-        if (swapChainSupport.capabilities.maxImageCount > 0 &&
-            imageCount > swapChainSupport.capabilities.maxImageCount)
+            float size = static_cast<float>(voxel_pyramid::cell_size(level));
+            float center = 0.5f * (size - 1.0f);
+            float maxCount = static_cast<float>(std::max<int64_t>(1, pyramid.max_count(level)));
+            float maxDelta = 1e-12f;
+            for (const auto &cell : pyramid.cells(level))
+            {
+                maxDelta = std::max(maxDelta, std::abs(cell.delta));
+            }
+
+            for (const auto &cell : pyramid.cells(level))
+            {
+                InstanceData instance;
+                instance.offset = glm::vec3(cell.x * size + center, cell.y * size + center, cell.z * size + center);
+                instance.intensity = static_cast<float>(cell.count) / maxCount;
+                instance.size = size;
+                instance.position = glm::vec2(cell.position, cell.spread);
+                instance.delta = cell.delta / maxDelta;
+                instanceData.push_back(instance);
+            }
+        }
+
+        // level 0 again in x, y and z order for slicing
+        slabIndex.build(pyramid.cells(0));
+        for (int axis = 0; axis < AXIS_COUNT; axis++)
         {
-            imageCount = swapChainSupport.capabilities.maxImageCount;
+            axisBase[axis] = static_cast<uint32_t>(instanceData.size());
+            for (uint32_t cell : slabIndex.order(axis))
+            {
+                instanceData.push_back(instanceData[levelBase[0] + cell]);
+            }
         }
 
-        VkSwapchainCreateInfoKHR createInfo{};
-        createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
-        createInfo.surface = surface;
-        createInfo.minImageCount = imageCount;
-        createInfo.imageFormat = surfaceFormat.format;
-        createInfo.imageColorSpace = surfaceFormat.colorSpace;
-        createInfo.imageExtent = extent;
-        createInfo.imageArrayLayers = 1;
-        createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+        std::cout << "Loaded " << voxels.size() << " voxels, " << instanceData.size() << " instances over "
+                  << PYRAMID_LEVELS << " levels and " << AXIS_COUNT << " slab orderings" << std::endl;
+    }
 
-        QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
-        uint32_t queueFamilyIndices[] = {indices.graphicsFamily.value(), indices.presentFamily.value()};
+    // voxels scored count * weight with the ones every corpus document has
+    // dropped, and only the --keep best when set, so the instance buffer
+    // carries what sets this input apart rather than zero runs and ascii
+    std::vector<Voxel> weightedVoxels(const std::vector<Voxel> &source) const
+    {
+        std::vector<std::pair<float, Voxel>> scored;
+        for (const auto &voxel : source)
+        {
+            float weight = background.weight(trigram_bin(static_cast<uint8_t>(voxel.x), static_cast<uint8_t>(voxel.y), static_cast<uint8_t>(voxel.z)));
+            if (weight > 0.0f && voxel.count > 0)
+            {
+                scored.push_back({voxel.count * weight, voxel});
+            }
+        }
 
-        if (indices.graphicsFamily != indices.presentFamily)
+        size_t keep = static_cast<size_t>(std::max(args_.get_or<int>("--keep", 0), 0));
+        if (keep != 0 && scored.size() > keep)
         {
-            createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
-            createInfo.queueFamilyIndexCount = 2;
-            createInfo.pQueueFamilyIndices = queueFamilyIndices;
+            std::nth_element(scored.begin(), scored.begin() + keep, scored.end(), [](const auto &a, const auto &b)
+                             { return a.first > b.first; });
+            scored.resize(keep);
         }
-        else
+
+        std::vector<Voxel> weighted;
+        weighted.reserve(scored.size());
+        for (auto &entry : scored)
         {
-            createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            entry.second.count = static_cast<uint64_t>(std::max(std::llround(entry.first), 1ll));
+            weighted.push_back(entry.second);
         }
+        std::cout << "Kept " << weighted.size() << " of " << source.size() << " voxels against the background" << std::endl;
+        return weighted;
+    }
 
-        createInfo.preTransform = swapChainSupport.capabilities.currentTransform;
-        createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-        createInfo.presentMode = presentMode;
-        createInfo.clipped = VK_TRUE;
-        createInfo.oldSwapchain = VK_NULL_HANDLE;
+    // keeps every layer of an fcube-analyze output, starts on the first
+    // unless --layer names another
+    void loadFcube(const std::string &filename)
+    {
+        inputCube = read_fcube(filename);
+        if (inputCube.layers.empty())
+        {
+            throw std::runtime_error("No layers in " + filename);
+        }
+        inputCubePath = filename;
+        inputCubeWritten = std::filesystem::last_write_time(filename);
+        if (inputCube.flags & FCUBE_SAMPLED)
+        {
+            std::cout << "Sampled " << samplePercent() << "% of the input so far, following " << filename << std::endl;
+        }
 
-        if (vkCreateSwapchainKHR(device, &createInfo, nullptr, &swapChain) != VK_SUCCESS)
+        std::string name = args_.get_or<std::string>("--layer", "");
+        if (!name.empty())
         {
-            throw std::runtime_error("failed to create swap chain!");
+            const histogram_layer *layer = inputCube.find(name);
+            if (!layer)
+            {
+                throw std::runtime_error("No layer " + name + " in " + filename);
+            }
+            layerIndex = static_cast<size_t>(layer - inputCube.layers.data());
         }
+    }
 
-        vkGetSwapchainImagesKHR(device, swapChain, &imageCount, nullptr);
-        swapChainImages.resize(imageCount);
-        vkGetSwapchainImagesKHR(device, swapChain, &imageCount, swapChainImages.data());
+    void layerVoxels(size_t index)
+    {
+        const histogram_layer &layer = inputCube.layers[index];
+        voxels = layerToVoxels(layer);
+        std::cout << "Layer " << index + 1 << " of " << inputCube.layers.size() << ": " << layer.name << std::endl;
+    }
 
-        swapChainImageFormat = surfaceFormat.format;
-        swapChainExtent = extent;
+    size_t shownLayers() const
+    {
+        return static_cast<size_t>(std::count(layerShown.begin(), layerShown.end(), true));
     }
 
-    void createImageViews()
+    // the sum of the toggled layers, or the current one when none are
+    void shownVoxels()
     {
-        swapChainImageViews.resize(swapChainImages.size());
+        if (shownLayers() == 0)
+        {
+            layerVoxels(layerIndex);
+            return;
+        }
 
-        for (size_t i = 0; i < swapChainImages.size(); i++)
+        std::vector<Voxel> all;
+        std::cout << "Drawing " << shownLayers() << " layers:";
+        for (size_t i = 0; i < inputCube.layers.size(); i++)
         {
-            swapChainImageViews[i] = createImageView(swapChainImages[i], swapChainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT);
+            if (layerShown[i])
+            {
+                std::vector<Voxel> layer = layerToVoxels(inputCube.layers[i]);
+                all.insert(all.end(), layer.begin(), layer.end());
+                std::cout << " " << inputCube.layers[i].name;
+            }
         }
+        std::cout << std::endl;
+        voxels = layerToVoxels(voxelLayer(all));
     }
 
-    void createRenderPass()
+    void toggleLayer()
     {
+        if (inputCube.layers.size() < 2)
+        {
+            std::cout << "Only one layer to show" << std::endl;
+            return;
+        }
+        layerShown.resize(inputCube.layers.size(), false);
+        layerShown[layerIndex] = !layerShown[layerIndex];
+        reloadLayers();
+    }
 
-        // color
-        VkAttachmentDescription colorAttachment{};
-        colorAttachment.format = swapChainImageFormat;
-        colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-        colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-        colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-        colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-        colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-        colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-
-        // depth
-        VkAttachmentDescription depthAttachment{};
-        depthAttachment.format = findDepthFormat();
-        depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-        depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-        depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-        depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-        depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-        depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    // between frames: the old instance buffer may still be in use until the device idles
+    void reloadLayers()
+    {
+        vkDeviceWaitIdle(device);
+        shownVoxels();
+        std::string comparePath = args_.get_or<std::string>("--compare", "");
+        if (!comparePath.empty())
+        {
+            loadComparison(comparePath); // its layer of the new name
+        }
+        buildInstances();
 
-        VkAttachmentReference colorAttachmentRef{};
-        colorAttachmentRef.attachment = 0;
-        colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        vkDestroyBuffer(device, instanceBuffer, nullptr);
+        vkFreeMemory(device, instanceBufferMemory, nullptr);
+        createInstanceBuffer();
 
-        VkAttachmentReference depthAttachmentRef{};
-        depthAttachmentRef.attachment = 1;
-        depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+        pickIssued.fill(false);
+        pickedInstance = NO_PICK;
+        pickedVoxel.reset();
+        classifyVoxels();
+    }
 
-        VkSubpassDescription subpass{};
-        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-        subpass.colorAttachmentCount = 1;
-        subpass.pColorAttachments = &colorAttachmentRef;
-        subpass.pDepthStencilAttachment = &depthAttachmentRef;
+    double samplePercent() const
+    {
+        const fcube_sample &sample = inputCube.layers[layerIndex].sample;
+        return sample.positions ? 100.0 * sample.sampled / sample.positions : 100.0;
+    }
 
-        VkSubpassDependency dependency{};
-        dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-        dependency.dstSubpass = 0;
-        dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-        dependency.srcAccessMask = 0;
-        dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-        dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    // rereads a sampled input once fcube-analyze sample has renamed a
+    // refinement over it, staying on the same layer
+    void checkRefinement()
+    {
+        if (!(inputCube.flags & FCUBE_SAMPLED))
+        {
+            return;
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastRefinementCheck < std::chrono::seconds(1))
+        {
+            return;
+        }
+        lastRefinementCheck = now;
 
-        std::array<VkAttachmentDescription, 2> attachments = {colorAttachment, depthAttachment};
-        VkRenderPassCreateInfo renderPassInfo{};
-        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-        renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
-        renderPassInfo.pAttachments = attachments.data();
-        renderPassInfo.subpassCount = 1;
-        renderPassInfo.pSubpasses = &subpass;
-        renderPassInfo.dependencyCount = 1;
-        renderPassInfo.pDependencies = &dependency;
+        std::error_code error;
+        auto written = std::filesystem::last_write_time(inputCubePath, error);
+        if (error || written == inputCubeWritten)
+        {
+            return;
+        }
 
-        if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS)
+        fcube cube;
+        try
         {
-            throw std::runtime_error("failed to create render pass!");
+            cube = read_fcube(inputCubePath);
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Skipping a refinement: " << e.what() << std::endl;
+            return;
+        }
+        const histogram_layer *layer = cube.find(inputCube.layers[layerIndex].name);
+        if (!layer)
+        {
+            return;
         }
+        layerIndex = static_cast<size_t>(layer - cube.layers.data());
+        layerShown.resize(cube.layers.size(), false);
+        inputCube = std::move(cube);
+        inputCubeWritten = written;
+        if (inputCube.flags & FCUBE_SAMPLED)
+        {
+            std::cout << "Refined: " << samplePercent() << "% sampled" << std::endl;
+        }
+        else
+        {
+            std::cout << "Refined: exact counts" << std::endl;
+        }
+        reloadLayers();
     }
 
-    void createDescriptorSetLayout()
+    // " 95% 1200..1350" for a trigram of a sampled layer, the range its whole input count is in
+    std::string sampledRange(const Voxel &v) const
     {
-        VkDescriptorSetLayoutBinding uboLayoutBinding{};
-        uboLayoutBinding.binding = 0;
-        uboLayoutBinding.descriptorCount = 1;
-        uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        uboLayoutBinding.pImmutableSamplers = nullptr;
-        uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+        const histogram_layer &layer = inputCube.layers[layerIndex];
+        uint32_t bin = trigram_bin(static_cast<uint8_t>(v.x), static_cast<uint8_t>(v.y), static_cast<uint8_t>(v.z));
+        auto it = std::lower_bound(layer.bins.begin(), layer.bins.end(), bin);
+        if (it == layer.bins.end() || *it != bin)
+        {
+            return "";
+        }
+        count_interval interval = wilson_interval(sampled_count(layer, it - layer.bins.begin()), layer.sample);
+        char range[64];
+        snprintf(range, sizeof(range), " 95%% %.0f..%.0f", interval.low, interval.high);
+        return range;
+    }
 
-        std::array<VkDescriptorSetLayoutBinding, 1> bindings = {uboLayoutBinding};
-        VkDescriptorSetLayoutCreateInfo layoutInfo{};
-        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
-        layoutInfo.pBindings = bindings.data();
+    // N / B, skipping empty layers
+    void switchLayer(int step)
+    {
+        long count = static_cast<long>(inputCube.layers.size());
+        if (count < 2)
+        {
+            std::cout << "Only one layer to show" << std::endl;
+            return;
+        }
+        size_t next = static_cast<size_t>(((static_cast<long>(layerIndex) + step) % count + count) % count);
+        if (inputCube.layers[next].bins.empty())
+        {
+            std::cout << "Layer " << inputCube.layers[next].name << " is empty" << std::endl;
+            return;
+        }
 
-        if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS)
+        layerIndex = next;
+        if (shownLayers() != 0)
         {
-            throw std::runtime_error("failed to create descriptor set layout!");
+            // the toggled sum stays on screen, N / B only pick what T toggles next
+            std::cout << "Layer " << layerIndex + 1 << " of " << count << ": " << inputCube.layers[layerIndex].name
+                      << (layerShown[layerIndex] ? " (shown, T to hide)" : " (hidden, T to show)") << std::endl;
+            return;
         }
+        reloadLayers();
     }
 
-    // vert and frag shaders for now
-    // cd shaders
-    // glslc shader.frag -o frag.spv
-    // glslc shader.vert -o vert.spv
-    void createGraphicsPipeline()
+    // GPU counted input never reaches the CPU, so that one is counted again here
+    void classifyInput(const std::string &filename)
     {
-        auto vertShaderCode = readFile("shaders/vert.spv");
-        auto fragShaderCode = readFile("shaders/frag.spv");
+        std::string path = args_.get_or<std::string>("--model", "");
+        if (path.empty())
+        {
+            return;
+        }
 
-        VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
-        VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
+        classModel = read_classifier_model(path);
+        if (!gpuCount)
+        {
+            classifyVoxels();
+            return;
+        }
 
-        VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
-        vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-        vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-        vertShaderStageInfo.module = vertShaderModule;
-        vertShaderStageInfo.pName = "main";
+        std::ifstream file(filename, std::ios::binary);
+        if (!file.is_open())
+        {
+            throw std::runtime_error("Failed to open " + filename);
+        }
+        std::vector<uint32_t> counts(TRIGRAM_BINS, 0);
+        count_trigrams(file, counts);
+        classifyLayer(layer_from_dense(filename, counts.data()));
+    }
 
-        VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
-        fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-        fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-        fragShaderStageInfo.module = fragShaderModule;
-        fragShaderStageInfo.pName = "main";
+    void classifyVoxels()
+    {
+        if (!classModel)
+        {
+            return;
+        }
 
-        VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo, fragShaderStageInfo};
+        classifyLayer(voxelLayer(voxels));
+    }
 
-        auto bindingDescription = Vertex::getBindingDescription();
-        auto attributeDescriptions = Vertex::getAttributeDescriptions();
+    void classifyLayer(const histogram_layer &layer)
+    {
+        classification result = classify(*classModel, classifier_features(make_fingerprint(layer)));
+        fileClass = classModel->classes[result.best].name;
+        std::cout << "Classified as " << fileClass << " (margin " << result.margin << ")" << std::endl;
+    }
 
-        auto instanceBindingDescription = InstanceData::getBindingDescription();
-        auto instanceAttributeDescriptions = InstanceData::getAttributeDescriptions();
+    void loadOffsetIndex()
+    {
+        std::string path = args_.get_or<std::string>("--index", "");
+        if (path.empty())
+        {
+            return;
+        }
 
-        std::vector<VkVertexInputBindingDescription> bindingDescriptions = {
-            bindingDescription, instanceBindingDescription};
+        offsetIndex.open(path);
+        std::cout << "Index " << path << ": " << offsetIndex.entry_count() << " trigrams over "
+                  << offsetIndex.input_size() << " bytes, up to " << offsetIndex.cap() << " offsets each (I to look up)" << std::endl;
+    }
 
-        std::vector<VkVertexInputAttributeDescription> allAttributeDescriptions;
+    // built by cmake, or by hand with shaders/build_shaders.sh. without
+    // glslc only the checked in vert.spv / frag.spv exist
+    void loadShaders()
+    {
+        if (!SHADER_MODES)
+        {
+            vertShaderCode = readFile("shaders/vert.spv");
+            fragShaderCode = readFile("shaders/frag.spv");
+            return;
+        }
+
+        vertShaderCode = readFile("shaders/voxel_vert.spv");
+        fragShaderCode = readFile("shaders/voxel_frag.spv");
+        pointVertShaderCode = readFile("shaders/point.spv");
+
+        if (!args_.get_or<std::string>("--rarity", "").empty())
+        {
+            rarityVertShaderCode = readFile("shaders/rarity_vert.spv");
+            rarityFragShaderCode = readFile("shaders/rarity_frag.spv");
+        }
+
+        if (gpuCount)
+        {
+            histogramShaderCode = readFile("shaders/histogram.spv");
+            histogramPlainShaderCode = readFile("shaders/histogram_plain.spv");
+            instancesShaderCode = readFile("shaders/instances.spv");
+            instancesPlainShaderCode = readFile("shaders/instances_plain.spv");
+        }
+    }
+
+    void mainLoop()
+    {
+        while (!glfwWindowShouldClose(window))
+        {
+            glfwPollEvents();
+            if (pendingLayerStep != 0)
+            {
+                switchLayer(pendingLayerStep);
+                pendingLayerStep = 0;
+            }
+            if (pendingLayerToggle)
+            {
+                toggleLayer();
+                pendingLayerToggle = false;
+            }
+            checkRefinement();
+            drawFrame();
+        }
+
+        vkDeviceWaitIdle(device);
+    }
+
+    void cleanup()
+    {
+        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+        {
+            vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
+            vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
+            vkDestroyFence(device, inFlightFences[i], nullptr);
+        }
+
+        for (auto &framePools : recordPools)
+        {
+            for (auto pool : framePools)
+            {
+                vkDestroyCommandPool(device, pool, nullptr);
+            }
+        }
+
+        vkDestroyCommandPool(device, commandPool, nullptr);
+
+        for (auto framebuffer : swapChainFramebuffers)
+        {
+            vkDestroyFramebuffer(device, framebuffer, nullptr);
+        }
+
+        for (size_t i = 0; i < idImages.size(); i++)
+        {
+            vkDestroyImageView(device, idImageViews[i], nullptr);
+            vkDestroyImage(device, idImages[i], nullptr);
+            vkFreeMemory(device, idImagesMemory[i], nullptr);
+        }
+
+        for (size_t i = 0; i < pickBuffers.size(); i++)
+        {
+            vkDestroyBuffer(device, pickBuffers[i], nullptr);
+            vkFreeMemory(device, pickBuffersMemory[i], nullptr);
+        }
+
+        if (rarityPipeline != VK_NULL_HANDLE)
+        {
+            vkDestroyPipeline(device, rarityPipeline, nullptr);
+            vkDestroyPipelineLayout(device, rarityPipelineLayout, nullptr);
+            vkDestroyDescriptorPool(device, rarityDescriptorPool, nullptr);
+            vkDestroyDescriptorSetLayout(device, raritySetLayout, nullptr);
+            vkDestroySampler(device, raritySampler, nullptr);
+            vkDestroyImageView(device, rarityTextureView, nullptr);
+            vkDestroyImage(device, rarityTexture, nullptr);
+            vkFreeMemory(device, rarityTextureMemory, nullptr);
+        }
+
+        vkDestroyPipeline(device, pointPipeline, nullptr);
+        vkDestroyPipeline(device, graphicsPipeline, nullptr);
+        vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+        vkDestroyRenderPass(device, renderPass, nullptr);
+
+        for (auto imageView : swapChainImageViews)
+        {
+            vkDestroyImageView(device, imageView, nullptr);
+        }
+
+        vkDestroySwapchainKHR(device, swapChain, nullptr);
+
+        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+        {
+            vkDestroyBuffer(device, uniformBuffers[i], nullptr);
+            vkFreeMemory(device, uniformBuffersMemory[i], nullptr);
+        }
+
+        vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+        vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+
+        vkDestroyBuffer(device, instanceBuffer, nullptr);
+        vkFreeMemory(device, instanceBufferMemory, nullptr);
+
+        vkDestroyBuffer(device, indirectBuffer, nullptr);
+        vkFreeMemory(device, indirectBufferMemory, nullptr);
+
+        vkDestroyBuffer(device, indexBuffer, nullptr);
+        vkFreeMemory(device, indexBufferMemory, nullptr);
+
+        vkDestroyBuffer(device, vertexBuffer, nullptr);
+        vkFreeMemory(device, vertexBufferMemory, nullptr);
+
+        vkDestroyImageView(device, depthImageView, nullptr);
+        vkDestroyImage(device, depthImage, nullptr);
+        vkFreeMemory(device, depthImageMemory, nullptr);
+
+        vkDestroyDevice(device, nullptr);
+
+        if (enableValidationLayers)
+        {
+            DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
+        }
+
+        vkDestroySurfaceKHR(instance, surface, nullptr);
+        vkDestroyInstance(instance, nullptr);
+
+        glfwDestroyWindow(window);
+        glfwTerminate();
+    }
+
+    void createInstance()
+    {
+        if (enableValidationLayers && !checkValidationLayerSupport())
+        {
+            throw std::runtime_error("validation layers requested, but not available!");
+        }
+
+        VkApplicationInfo appInfo{};
+        appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+        appInfo.pApplicationName = "Trigram Voxel Viewer";
+        appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
+        appInfo.pEngineName = "No Engine";
+        appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
+        appInfo.apiVersion = VK_API_VERSION_1_1; // subgroup operations in compute
+
+        VkInstanceCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+        createInfo.pApplicationInfo = &appInfo;
+
+        auto extensions = getRequiredExtensions();
+        createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+        createInfo.ppEnabledExtensionNames = extensions.data();
+
+        VkDebugUtilsMessengerCreateInfoEXT debugCreateInfo{};
+        if (enableValidationLayers)
+        {
+            createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
+            createInfo.ppEnabledLayerNames = validationLayers.data();
+
+            populateDebugMessengerCreateInfo(debugCreateInfo);
+            createInfo.pNext = (VkDebugUtilsMessengerCreateInfoEXT *)&debugCreateInfo;
+        }
+        else
+        {
+            createInfo.enabledLayerCount = 0;
+            createInfo.pNext = nullptr;
+        }
+
+        if (vkCreateInstance(&createInfo, nullptr, &instance) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create instance!");
+        }
+    }
+
+    void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT &createInfo)
+    {
+        createInfo = {};
+        createInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
+        createInfo.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT |
+                                     VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT |
+                                     VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+        createInfo.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT |
+                                 VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
+                                 VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+        createInfo.pfnUserCallback = debugCallback;
+    }
+
+    void setupDebugMessenger()
+    {
+        if (!enableValidationLayers)
+            return;
+
+        VkDebugUtilsMessengerCreateInfoEXT createInfo;
+        populateDebugMessengerCreateInfo(createInfo);
+
+        if (CreateDebugUtilsMessengerEXT(instance, &createInfo, nullptr, &debugMessenger) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to set up debug messenger!");
+        }
+    }
+
+    void createSurface()
+    {
+        if (glfwCreateWindowSurface(instance, window, nullptr, &surface) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create window surface!");
+        }
+    }
+
+    void pickPhysicalDevice()
+    {
+        uint32_t deviceCount = 0;
+        vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
+
+        if (deviceCount == 0)
+        {
+            throw std::runtime_error("failed to find GPUs with Vulkan support!");
+        }
+
+        std::vector<VkPhysicalDevice> devices(deviceCount);
+        vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
+
+        for (const auto &device : devices)
+        {
+            if (isDeviceSuitable(device))
+            {
+                physicalDevice = device;
+                break;
+            }
+        }
+
+        if (physicalDevice == VK_NULL_HANDLE)
+        {
+            throw std::runtime_error("failed to find a suitable GPU!");
+        }
+    }
+
+    void createLogicalDevice()
+    {
+        QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+
+        std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
+        std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily.value(), indices.presentFamily.value()};
+
+        float queuePriority = 1.0f;
+        for (uint32_t queueFamily : uniqueQueueFamilies)
+        {
+            VkDeviceQueueCreateInfo queueCreateInfo{};
+            queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+            queueCreateInfo.queueFamilyIndex = queueFamily;
+            queueCreateInfo.queueCount = 1;
+            queueCreateInfo.pQueuePriorities = &queuePriority;
+            queueCreateInfos.push_back(queueCreateInfo);
+        }
+
+        VkPhysicalDeviceFeatures supportedFeatures;
+        vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+
+        VkPhysicalDeviceFeatures deviceFeatures{};
+        deviceFeatures.samplerAnisotropy = VK_TRUE;
+        deviceFeatures.largePoints = supportedFeatures.largePoints; // gl_PointSize > 1 for impostors
+
+        VkDeviceCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+        createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
+        createInfo.pQueueCreateInfos = queueCreateInfos.data();
+        createInfo.pEnabledFeatures = &deviceFeatures;
+        createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
+        createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+
+        if (enableValidationLayers)
+        {
+            createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
+            createInfo.ppEnabledLayerNames = validationLayers.data();
+        }
+        else
+        {
+            createInfo.enabledLayerCount = 0;
+        }
+
+        if (vkCreateDevice(physicalDevice, &createInfo, nullptr, &device) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create logical device!");
+        }
+
+        vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
+        vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
+    }
+
+    void createSwapChain()
+    {
+        SwapChainSupportDetails swapChainSupport = querySwapChainSupport(physicalDevice);
+
+        VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
+        VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
+        VkExtent2D extent = chooseSwapExtent(swapChainSupport.capabilities);
+
+        uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
+        if (swapChainSupport.capabilities.maxImageCount > 0 &&
+            imageCount > swapChainSupport.capabilities.maxImageCount)
+        {
+            imageCount = swapChainSupport.capabilities.maxImageCount;
+        }
+
+        VkSwapchainCreateInfoKHR createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+        createInfo.surface = surface;
+        createInfo.minImageCount = imageCount;
+        createInfo.imageFormat = surfaceFormat.format;
+        createInfo.imageColorSpace = surfaceFormat.colorSpace;
+        createInfo.imageExtent = extent;
+        createInfo.imageArrayLayers = 1;
+        createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+
+        QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+        uint32_t queueFamilyIndices[] = {indices.graphicsFamily.value(), indices.presentFamily.value()};
+
+        if (indices.graphicsFamily != indices.presentFamily)
+        {
+            createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
+            createInfo.queueFamilyIndexCount = 2;
+            createInfo.pQueueFamilyIndices = queueFamilyIndices;
+        }
+        else
+        {
+            createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        }
+
+        createInfo.preTransform = swapChainSupport.capabilities.currentTransform;
+        createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+        createInfo.presentMode = presentMode;
+        createInfo.clipped = VK_TRUE;
+        createInfo.oldSwapchain = VK_NULL_HANDLE;
+
+        if (vkCreateSwapchainKHR(device, &createInfo, nullptr, &swapChain) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create swap chain!");
+        }
+
+        vkGetSwapchainImagesKHR(device, swapChain, &imageCount, nullptr);
+        swapChainImages.resize(imageCount);
+        vkGetSwapchainImagesKHR(device, swapChain, &imageCount, swapChainImages.data());
+
+        swapChainImageFormat = surfaceFormat.format;
+        swapChainExtent = extent;
+    }
+
+    void createImageViews()
+    {
+        swapChainImageViews.resize(swapChainImages.size());
+
+        for (size_t i = 0; i < swapChainImages.size(); i++)
+        {
+            swapChainImageViews[i] = createImageView(swapChainImages[i], swapChainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT);
+        }
+    }
+
+    void createRenderPass()
+    {
+
+        // color
+        VkAttachmentDescription colorAttachment{};
+        colorAttachment.format = swapChainImageFormat;
+        colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+        colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+        // depth
+        VkAttachmentDescription depthAttachment{};
+        depthAttachment.format = findDepthFormat();
+        depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+        depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+        // instance ids, left ready to copy the texel under the cursor out
+        VkAttachmentDescription idAttachment{};
+        idAttachment.format = VK_FORMAT_R32_UINT;
+        idAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+        idAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        idAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        idAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        idAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        idAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        idAttachment.finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+        std::array<VkAttachmentReference, 2> colorAttachmentRefs{};
+        colorAttachmentRefs[0].attachment = 0;
+        colorAttachmentRefs[0].layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        colorAttachmentRefs[1].attachment = 2;
+        colorAttachmentRefs[1].layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+        VkAttachmentReference depthAttachmentRef{};
+        depthAttachmentRef.attachment = 1;
+        depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+        VkSubpassDescription subpass{};
+        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpass.colorAttachmentCount = static_cast<uint32_t>(colorAttachmentRefs.size());
+        subpass.pColorAttachments = colorAttachmentRefs.data();
+        subpass.pDepthStencilAttachment = &depthAttachmentRef;
+
+        // in: the previous pick copy out of this id image has to finish before
+        // it is cleared. out: the ids are written before this frame's copy
+        std::array<VkSubpassDependency, 2> dependencies{};
+        dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+        dependencies[0].dstSubpass = 0;
+        dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+        dependencies[0].srcAccessMask = 0;
+        dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+        dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+        dependencies[1].srcSubpass = 0;
+        dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+        dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        dependencies[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        dependencies[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+        std::array<VkAttachmentDescription, 3> attachments = {colorAttachment, depthAttachment, idAttachment};
+        VkRenderPassCreateInfo renderPassInfo{};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+        renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+        renderPassInfo.pAttachments = attachments.data();
+        renderPassInfo.subpassCount = 1;
+        renderPassInfo.pSubpasses = &subpass;
+        renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+        renderPassInfo.pDependencies = dependencies.data();
+
+        if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create render pass!");
+        }
+    }
+
+    void createDescriptorSetLayout()
+    {
+        VkDescriptorSetLayoutBinding uboLayoutBinding{};
+        uboLayoutBinding.binding = 0;
+        uboLayoutBinding.descriptorCount = 1;
+        uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        uboLayoutBinding.pImmutableSamplers = nullptr;
+        uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+        std::array<VkDescriptorSetLayoutBinding, 1> bindings = {uboLayoutBinding};
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        layoutInfo.pBindings = bindings.data();
+
+        if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create descriptor set layout!");
+        }
+    }
+
+    void createGraphicsPipeline()
+    {
+        VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
+        VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+
+        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create pipeline layout!");
+        }
+
+        auto bindingDescription = Vertex::getBindingDescription();
+        auto attributeDescriptions = Vertex::getAttributeDescriptions();
+
+        auto instanceBindingDescription = InstanceData::getBindingDescription();
+        auto instanceAttributeDescriptions = InstanceData::getAttributeDescriptions();
+
+        std::vector<VkVertexInputAttributeDescription> instanceAttributes(
+            instanceAttributeDescriptions.begin(), instanceAttributeDescriptions.end());
+
+        std::vector<VkVertexInputAttributeDescription> allAttributeDescriptions;
         allAttributeDescriptions.insert(allAttributeDescriptions.end(),
                                         attributeDescriptions.begin(), attributeDescriptions.end());
         allAttributeDescriptions.insert(allAttributeDescriptions.end(),
-                                        instanceAttributeDescriptions.begin(), instanceAttributeDescriptions.end());
+                                        instanceAttributes.begin(), instanceAttributes.end());
+
+        // cubes: the unit cube mesh on binding 0, instanced from binding 1
+        graphicsPipeline = createPipeline(vertShaderModule, fragShaderModule, VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+                                          {bindingDescription, instanceBindingDescription}, allAttributeDescriptions, false);
+
+        // points: no mesh, one point per instance
+        if (SHADER_MODES)
+        {
+            VkShaderModule pointVertShaderModule = createShaderModule(pointVertShaderCode);
+            pointPipeline = createPipeline(pointVertShaderModule, fragShaderModule, VK_PRIMITIVE_TOPOLOGY_POINT_LIST,
+                                           {instanceBindingDescription}, instanceAttributes, true);
+            vkDestroyShaderModule(device, pointVertShaderModule, nullptr);
+        }
+
+        vkDestroyShaderModule(device, fragShaderModule, nullptr);
+        vkDestroyShaderModule(device, vertShaderModule, nullptr);
+    }
+
+    VkPipeline createPipeline(VkShaderModule vertShaderModule, VkShaderModule fragShaderModule, VkPrimitiveTopology topology,
+                              const std::vector<VkVertexInputBindingDescription> &bindingDescriptions,
+                              const std::vector<VkVertexInputAttributeDescription> &attributeDescriptions,
+                              bool impostor, VkPipelineLayout layout = VK_NULL_HANDLE)
+    {
+        // constant_id 0 in voxel.frag, the prebuilt frag.spv has no constants and ignores it
+        VkBool32 impostorValue = impostor ? VK_TRUE : VK_FALSE;
+
+        VkSpecializationMapEntry impostorEntry{};
+        impostorEntry.constantID = 0;
+        impostorEntry.offset = 0;
+        impostorEntry.size = sizeof(VkBool32);
+
+        VkSpecializationInfo fragSpecialization{};
+        fragSpecialization.mapEntryCount = 1;
+        fragSpecialization.pMapEntries = &impostorEntry;
+        fragSpecialization.dataSize = sizeof(VkBool32);
+        fragSpecialization.pData = &impostorValue;
+
+        VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
+        vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
+        vertShaderStageInfo.module = vertShaderModule;
+        vertShaderStageInfo.pName = "main";
+
+        VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
+        fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+        fragShaderStageInfo.module = fragShaderModule;
+        fragShaderStageInfo.pName = "main";
+        fragShaderStageInfo.pSpecializationInfo = &fragSpecialization;
+
+        VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo, fragShaderStageInfo};
+
+        // vertex input info
+        VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+        vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+        vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(bindingDescriptions.size());
+        vertexInputInfo.pVertexBindingDescriptions = bindingDescriptions.data();
+        vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
+        vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+
+        // input assembly
+        VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+        inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+        inputAssembly.topology = topology;
+        inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+        // viewport state
+        VkPipelineViewportStateCreateInfo viewportState{};
+        viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+        viewportState.viewportCount = 1;
+        viewportState.scissorCount = 1;
+
+        // rasterizer
+        VkPipelineRasterizationStateCreateInfo rasterizer{};
+        rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+        rasterizer.depthClampEnable = VK_FALSE;
+        rasterizer.rasterizerDiscardEnable = VK_FALSE;
+        rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+        rasterizer.lineWidth = 1.0f;
+        rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
+        rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+        rasterizer.depthBiasEnable = VK_FALSE;
+
+        // multisampling
+        VkPipelineMultisampleStateCreateInfo multisampling{};
+        multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+        multisampling.sampleShadingEnable = VK_FALSE;
+        multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+        // depth stencil
+        VkPipelineDepthStencilStateCreateInfo depthStencil{};
+        depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+        depthStencil.depthTestEnable = VK_TRUE;
+        depthStencil.depthWriteEnable = VK_TRUE;
+        depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+        depthStencil.depthBoundsTestEnable = VK_FALSE;
+        depthStencil.stencilTestEnable = VK_FALSE;
+
+        VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+        colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+                                              VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+        colorBlendAttachment.blendEnable = VK_FALSE;
+
+        // integer attachments can't blend. frag.spv has no id output, so
+        // without glslc the attachment keeps its NO_PICK clear
+        VkPipelineColorBlendAttachmentState idBlendAttachment{};
+        idBlendAttachment.colorWriteMask = SHADER_MODES ? VK_COLOR_COMPONENT_R_BIT : 0;
+        idBlendAttachment.blendEnable = VK_FALSE;
+
+        std::array<VkPipelineColorBlendAttachmentState, 2> blendAttachments = {colorBlendAttachment, idBlendAttachment};
+
+        VkPipelineColorBlendStateCreateInfo colorBlending{};
+        colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+        colorBlending.logicOpEnable = VK_FALSE;
+        colorBlending.logicOp = VK_LOGIC_OP_COPY;
+        colorBlending.attachmentCount = static_cast<uint32_t>(blendAttachments.size());
+        colorBlending.pAttachments = blendAttachments.data();
+        colorBlending.blendConstants[0] = 0.0f;
+        colorBlending.blendConstants[1] = 0.0f;
+        colorBlending.blendConstants[2] = 0.0f;
+        colorBlending.blendConstants[3] = 0.0f;
+
+        std::vector<VkDynamicState> dynamicStates = {
+            VK_DYNAMIC_STATE_VIEWPORT,
+            VK_DYNAMIC_STATE_SCISSOR};
+        VkPipelineDynamicStateCreateInfo dynamicState{};
+        dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+        dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+        dynamicState.pDynamicStates = dynamicStates.data();
+
+        // pipeline info
+        VkGraphicsPipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineInfo.stageCount = 2;
+        pipelineInfo.pStages = shaderStages;
+        pipelineInfo.pVertexInputState = &vertexInputInfo;
+        pipelineInfo.pInputAssemblyState = &inputAssembly;
+        pipelineInfo.pViewportState = &viewportState;
+        pipelineInfo.pRasterizationState = &rasterizer;
+        pipelineInfo.pMultisampleState = &multisampling;
+        pipelineInfo.pDepthStencilState = &depthStencil;
+        pipelineInfo.pColorBlendState = &colorBlending;
+        pipelineInfo.pDynamicState = &dynamicState;
+        pipelineInfo.layout = layout != VK_NULL_HANDLE ? layout : pipelineLayout;
+        pipelineInfo.renderPass = renderPass;
+        pipelineInfo.subpass = 0;
+        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+
+        VkPipeline pipeline;
+        if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create graphics pipeline!");
+        }
+
+        return pipeline;
+    }
+
+    // drawing frame
+    void drawFrame()
+    {
+        vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+
+        readPick(currentFrame);
+
+        uint32_t imageIndex;
+        vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+
+        vkResetFences(device, 1, &inFlightFences[currentFrame]);
+
+        updateUniformBuffer(currentFrame);
+
+        adaptLevelOfDetail();
+        buildDrawRanges();
+
+        vkResetCommandBuffer(commandBuffers[currentFrame], 0);
+        recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+
+        VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame]};
+        VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+        submitInfo.waitSemaphoreCount = 1;
+        submitInfo.pWaitSemaphores = waitSemaphores;
+        submitInfo.pWaitDstStageMask = waitStages;
+
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
+
+        VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame]};
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = signalSemaphores;
+
+        if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to submit draw command buffer!");
+        }
+
+        VkPresentInfoKHR presentInfo{};
+        presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+        presentInfo.waitSemaphoreCount = 1;
+        presentInfo.pWaitSemaphores = signalSemaphores;
+
+        VkSwapchainKHR swapChains[] = {swapChain};
+        presentInfo.swapchainCount = 1;
+        presentInfo.pSwapchains = swapChains;
+        presentInfo.pImageIndices = &imageIndex;
+
+        vkQueuePresentKHR(presentQueue, &presentInfo);
+
+        currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+    }
+
+    // this is responsible for current animation
+    // TODO: have this mouse-draggable in 3D
+    void updateUniformBuffer(uint32_t currentImage)
+    {
+        auto currentTime = std::chrono::steady_clock::now();
+        float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
+
+        UniformBufferObject ubo{};
+
+        glm::mat4 model = glm::rotate(glm::mat4(1.0f), time * 0.3f, glm::vec3(0.0f, 1.0f, 0.0f));
+        glm::mat4 view = glm::translate(glm::mat4(1.0f), glm::vec3(-128.0f, -128.0f, -512.0f));
+        glm::mat4 proj = glm::perspective(glm::radians(45.0f),
+                                          cubeExtent().width / (float)swapChainExtent.height,
+                                          0.1f, 1000.0f);
+        proj[1][1] *= -1; // flip y (vulkan)
+
+        ubo.mvp = proj * view * model;
+        ubo.params = glm::vec4(0.5f * swapChainExtent.height * std::abs(proj[1][1]), positionHue ? 1.0f : 0.0f,
+                               deltaColors && !compareVoxels.empty() ? 1.0f : 0.0f, 0.0f);
+
+        pointScale = ubo.params.x;
+        cameraPosition = glm::vec3(glm::inverse(view * model) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+
+        memcpy(uniformBuffersMapped[currentImage], &ubo, sizeof(ubo));
+    }
+
+    // do we need this function?
+    bool checkValidationLayerSupport() { return true; }
+
+    std::vector<const char *> getRequiredExtensions()
+    {
+        uint32_t glfwExtensionCount = 0;
+        const char **glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        std::vector<const char *> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+        if (enableValidationLayers)
+        {
+            extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+        }
+        return extensions;
+    }
+
+    static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
+        VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
+        VkDebugUtilsMessageTypeFlagsEXT messageType,
+        const VkDebugUtilsMessengerCallbackDataEXT *pCallbackData,
+        void *pUserData)
+    {
+
+        std::cerr << "validation layer: " << pCallbackData->pMessage << std::endl;
+        return VK_FALSE;
+    }
+
+    VkResult CreateDebugUtilsMessengerEXT(VkInstance instance,
+                                          const VkDebugUtilsMessengerCreateInfoEXT *pCreateInfo,
+                                          const VkAllocationCallbacks *pAllocator,
+                                          VkDebugUtilsMessengerEXT *pDebugMessenger)
+    {
+        auto func = (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkCreateDebugUtilsMessengerEXT");
+        if (func != nullptr)
+        {
+            return func(instance, pCreateInfo, pAllocator, pDebugMessenger);
+        }
+        else
+        {
+            return VK_ERROR_EXTENSION_NOT_PRESENT;
+        }
+    }
+
+    void DestroyDebugUtilsMessengerEXT(VkInstance instance,
+                                       VkDebugUtilsMessengerEXT debugMessenger,
+                                       const VkAllocationCallbacks *pAllocator)
+    {
+        auto func = (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkDestroyDebugUtilsMessengerEXT");
+        if (func != nullptr)
+        {
+            func(instance, debugMessenger, pAllocator);
+        }
+    }
+
+    bool isDeviceSuitable(VkPhysicalDevice device)
+    {
+        return findQueueFamilies(device).isComplete();
+    }
+
+    QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device)
+    {
+        QueueFamilyIndices indices;
+        // Simplified implementation
+        indices.graphicsFamily = 0;
+        indices.presentFamily = 0;
+        return indices;
+    }
+
+    SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device)
+    {
+        SwapChainSupportDetails details;
+
+        vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface, &details.capabilities);
+
+        uint32_t formatCount;
+        vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, nullptr);
+
+        if (formatCount != 0)
+        {
+            details.formats.resize(formatCount);
+            vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, details.formats.data());
+        }
+
+        uint32_t presentModeCount;
+        vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &presentModeCount, nullptr);
+
+        if (presentModeCount != 0)
+        {
+            details.presentModes.resize(presentModeCount);
+            vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &presentModeCount, details.presentModes.data());
+        }
+
+        return details;
+    }
+
+    VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR> &availableFormats)
+    {
+        return availableFormats[0];
+    }
+
+    VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR> &availablePresentModes)
+    {
+        return VK_PRESENT_MODE_FIFO_KHR;
+    }
+
+    VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR &capabilities)
+    {
+        return {WINDOW_WIDTH, WINDOW_HEIGHT};
+    }
+
+    VkShaderModule createShaderModule(const std::vector<char> &code)
+    {
+        VkShaderModuleCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        createInfo.codeSize = code.size();
+        createInfo.pCode = reinterpret_cast<const uint32_t *>(code.data());
+
+        VkShaderModule shaderModule;
+        if (vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create shader module!");
+        }
+
+        return shaderModule;
+    }
+
+    std::vector<char> readFile(const std::string &filename)
+    {
+        std::ifstream file(filename, std::ios::ate | std::ios::binary);
+        if (!file.is_open())
+        {
+            throw std::runtime_error("failed to open file " + filename);
+        }
+        size_t fileSize = (size_t)file.tellg();
+        std::vector<char> buffer(fileSize);
+        file.seekg(0);
+        file.read(buffer.data(), fileSize);
+        file.close();
+        return buffer;
+    }
+
+    //    void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+    // Simplified implementation
+    //  }
+    uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties)
+    {
+        VkPhysicalDeviceMemoryProperties memProperties;
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+
+        for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++)
+        {
+            if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties)
+            {
+                return i;
+            }
+        }
+
+        throw std::runtime_error("failed to find suitable memory type!");
+    }
+
+    void createCommandPool()
+    {
+        std::cout << "Creating command pool..." << std::endl;
+
+        QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
+
+        if (!queueFamilyIndices.graphicsFamily.has_value())
+        {
+            throw std::runtime_error("Graphics queue family not found!");
+        }
+
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+
+        std::cout << "Using graphics queue family index: " << queueFamilyIndices.graphicsFamily.value() << std::endl;
+
+        VkResult result = vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool);
+        if (result != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create command pool! Error code: " + std::to_string(result));
+        }
 
-        // vertex input info
-        VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
-        vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-        vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(bindingDescriptions.size());
-        vertexInputInfo.pVertexBindingDescriptions = bindingDescriptions.data();
-        vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(allAttributeDescriptions.size());
-        vertexInputInfo.pVertexAttributeDescriptions = allAttributeDescriptions.data();
+        std::cout << "Command pool created successfully" << std::endl;
+    }
 
-        // input assembly
-        VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
-        inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-        inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-        inputAssembly.primitiveRestartEnable = VK_FALSE;
+    void createDepthResources()
+    {
+        std::cout << "Creating depth resources..." << std::endl;
 
-        // viewport state
-        VkPipelineViewportStateCreateInfo viewportState{};
-        viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-        viewportState.viewportCount = 1;
-        viewportState.scissorCount = 1;
+        VkFormat depthFormat = findDepthFormat();
 
-        // rasterizer
-        VkPipelineRasterizationStateCreateInfo rasterizer{};
-        rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-        rasterizer.depthClampEnable = VK_FALSE;
-        rasterizer.rasterizerDiscardEnable = VK_FALSE;
-        rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-        rasterizer.lineWidth = 1.0f;
-        rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-        rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-        rasterizer.depthBiasEnable = VK_FALSE;
+        createImage(swapChainExtent.width, swapChainExtent.height, depthFormat,
+                    VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depthImage, depthImageMemory);
 
-        // multisampling
-        VkPipelineMultisampleStateCreateInfo multisampling{};
-        multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-        multisampling.sampleShadingEnable = VK_FALSE;
-        multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+        depthImageView = createImageView(depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
 
-        // depth stencil
-        VkPipelineDepthStencilStateCreateInfo depthStencil{};
-        depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-        depthStencil.depthTestEnable = VK_TRUE;
-        depthStencil.depthWriteEnable = VK_TRUE;
-        depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
-        depthStencil.depthBoundsTestEnable = VK_FALSE;
-        depthStencil.stencilTestEnable = VK_FALSE;
+        std::cout << "Depth resources created successfully" << std::endl;
+    }
 
-        VkPipelineColorBlendAttachmentState colorBlendAttachment{};
-        colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
-                                              VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-        colorBlendAttachment.blendEnable = VK_FALSE;
+    void createIdResources()
+    {
+        idImages.resize(swapChainImages.size());
+        idImagesMemory.resize(swapChainImages.size());
+        idImageViews.resize(swapChainImages.size());
+
+        for (size_t i = 0; i < swapChainImages.size(); i++)
+        {
+            createImage(swapChainExtent.width, swapChainExtent.height, VK_FORMAT_R32_UINT,
+                        VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, idImages[i], idImagesMemory[i]);
+            idImageViews[i] = createImageView(idImages[i], VK_FORMAT_R32_UINT, VK_IMAGE_ASPECT_COLOR_BIT);
+        }
+    }
+
+    void createFramebuffers()
+    {
+        std::cout << "Creating framebuffers..." << std::endl;
+
+        swapChainFramebuffers.resize(swapChainImageViews.size());
+
+        for (size_t i = 0; i < swapChainImageViews.size(); i++)
+        {
+            std::array<VkImageView, 3> attachments = {
+                swapChainImageViews[i],
+                depthImageView,
+                idImageViews[i]};
+
+            VkFramebufferCreateInfo framebufferInfo{};
+            framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+            framebufferInfo.renderPass = renderPass;
+            framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+            framebufferInfo.pAttachments = attachments.data();
+            framebufferInfo.width = swapChainExtent.width;
+            framebufferInfo.height = swapChainExtent.height;
+            framebufferInfo.layers = 1;
+
+            if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &swapChainFramebuffers[i]) != VK_SUCCESS)
+            {
+                throw std::runtime_error("failed to create framebuffer!");
+            }
+        }
+
+        std::cout << "Created " << swapChainFramebuffers.size() << " framebuffers successfully" << std::endl;
+    }
+
+    // Helper functions these depend on:
+
+    void createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling,
+                     VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage &image, VkDeviceMemory &imageMemory)
+    {
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.extent.width = width;
+        imageInfo.extent.height = height;
+        imageInfo.extent.depth = 1;
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.format = format;
+        imageInfo.tiling = tiling;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageInfo.usage = usage;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (vkCreateImage(device, &imageInfo, nullptr, &image) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create image!");
+        }
+
+        VkMemoryRequirements memRequirements;
+        vkGetImageMemoryRequirements(device, image, &memRequirements);
+
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = memRequirements.size;
+        allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+
+        if (vkAllocateMemory(device, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to allocate image memory!");
+        }
+
+        vkBindImageMemory(device, image, imageMemory, 0);
+    }
+
+    VkFormat findDepthFormat()
+    {
+        return findSupportedFormat(
+            {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT},
+            VK_IMAGE_TILING_OPTIMAL,
+            VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+    }
+
+    VkFormat findSupportedFormat(const std::vector<VkFormat> &candidates, VkImageTiling tiling, VkFormatFeatureFlags features)
+    {
+        for (VkFormat format : candidates)
+        {
+            VkFormatProperties props;
+            vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &props);
+
+            if (tiling == VK_IMAGE_TILING_LINEAR && (props.linearTilingFeatures & features) == features)
+            {
+                return format;
+            }
+            else if (tiling == VK_IMAGE_TILING_OPTIMAL && (props.optimalTilingFeatures & features) == features)
+            {
+                return format;
+            }
+        }
+
+        throw std::runtime_error("failed to find supported format!");
+    }
+
+    VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags)
+    {
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = image;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = format;
+        viewInfo.subresourceRange.aspectMask = aspectFlags;
+        viewInfo.subresourceRange.baseMipLevel = 0;
+        viewInfo.subresourceRange.levelCount = 1;
+        viewInfo.subresourceRange.baseArrayLayer = 0;
+        viewInfo.subresourceRange.layerCount = 1;
+
+        VkImageView imageView;
+        if (vkCreateImageView(device, &viewInfo, nullptr, &imageView) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create texture image view!");
+        }
+
+        return imageView;
+    }
+
+    void createVertexBuffer()
+    {
+        VkDeviceSize bufferSize = sizeof(cubeVertices[0]) * cubeVertices.size();
+
+        VkBuffer stagingBuffer;
+        VkDeviceMemory stagingBufferMemory;
+        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+
+        void *data;
+        vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
+        memcpy(data, cubeVertices.data(), (size_t)bufferSize);
+        vkUnmapMemory(device, stagingBufferMemory);
+
+        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexBufferMemory);
+
+        copyBuffer(stagingBuffer, vertexBuffer, bufferSize);
+
+        vkDestroyBuffer(device, stagingBuffer, nullptr);
+        vkFreeMemory(device, stagingBufferMemory, nullptr);
+    }
+
+    void createIndexBuffer()
+    {
+        VkDeviceSize bufferSize = sizeof(cubeIndices[0]) * cubeIndices.size();
+
+        VkBuffer stagingBuffer;
+        VkDeviceMemory stagingBufferMemory;
+        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+
+        void *data;
+        vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
+        memcpy(data, cubeIndices.data(), (size_t)bufferSize);
+        vkUnmapMemory(device, stagingBufferMemory);
+
+        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer, indexBufferMemory);
+
+        copyBuffer(stagingBuffer, indexBuffer, bufferSize);
+
+        vkDestroyBuffer(device, stagingBuffer, nullptr);
+        vkFreeMemory(device, stagingBufferMemory, nullptr);
+    }
+
+    void createInstanceBuffer()
+    {
+        VkDeviceSize bufferSize = sizeof(InstanceData) * instanceData.size();
+
+        createBuffer(bufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, instanceBuffer, instanceBufferMemory);
+
+        void *data;
+        vkMapMemory(device, instanceBufferMemory, 0, bufferSize, 0, &data);
+        memcpy(data, instanceData.data(), (size_t)bufferSize);
+        vkUnmapMemory(device, instanceBufferMemory);
+    }
+
+    // streams the raw file through histogram.comp in chunks, double buffered
+    // so reading the next chunk overlaps counting the last one. the 2^24 bin
+    // histogram stays on the device, instances.comp then writes instanceBuffer
+    // and the indirect draws from it
+    void countTrigramsOnGpu(const std::string &filename)
+    {
+        auto countStart = std::chrono::steady_clock::now();
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        if (properties.limits.maxStorageBufferRange < TRIGRAM_BINS * sizeof(uint32_t))
+        {
+            throw std::runtime_error("GPU counting needs a 64 MB storage buffer, this device allows " +
+                                     std::to_string(properties.limits.maxStorageBufferRange) + " bytes");
+        }
+
+        uint32_t familyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, nullptr);
+        std::vector<VkQueueFamilyProperties> families(familyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, families.data());
+        if (!(families[findQueueFamilies(physicalDevice).graphicsFamily.value()].queueFlags & VK_QUEUE_COMPUTE_BIT))
+        {
+            throw std::runtime_error("GPU counting needs a graphics queue that also supports compute");
+        }
+
+        // ballots in compute are near universal but not required by the spec
+        VkPhysicalDeviceSubgroupProperties subgroup{};
+        subgroup.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+        VkPhysicalDeviceProperties2 properties2{};
+        properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties2.pNext = &subgroup;
+        vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+        bool ballots = (subgroup.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT) &&
+                       (subgroup.supportedOperations & VK_SUBGROUP_FEATURE_BALLOT_BIT);
+
+        // the self-test input spans three 1 MB chunks
+        uint32_t chunkBytes = static_cast<uint32_t>(std::clamp(args_.get_or<int>("--gpu-chunk-mb", gpuSelfTest ? 1 : 16), 1, 256)) << 20;
+        uint32_t minCount = static_cast<uint32_t>(std::max(args_.get_or<int>("--gpu-min-count", 1), 1));
+        uint32_t capacity = static_cast<uint32_t>(std::max(args_.get_or<int>("--gpu-max-instances", 1 << 20), 1));
+
+        std::ifstream file(filename, std::ios::binary | std::ios::ate);
+        if (!file.is_open())
+        {
+            throw std::runtime_error("Failed to open " + filename);
+        }
+        uint64_t fileSize = static_cast<uint64_t>(file.tellg());
+
+        // descriptors: 0 the chunk, 1 histogram, 2 stats, 3 instances, 4 indirect
+        std::array<VkDescriptorSetLayoutBinding, 5> bindings{};
+        for (uint32_t i = 0; i < bindings.size(); i++)
+        {
+            bindings[i].binding = i;
+            bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            bindings[i].descriptorCount = 1;
+            bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        }
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        layoutInfo.pBindings = bindings.data();
 
-        VkPipelineColorBlendStateCreateInfo colorBlending{};
-        colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-        colorBlending.logicOpEnable = VK_FALSE;
-        colorBlending.logicOp = VK_LOGIC_OP_COPY;
-        colorBlending.attachmentCount = 1;
-        colorBlending.pAttachments = &colorBlendAttachment;
-        colorBlending.blendConstants[0] = 0.0f;
-        colorBlending.blendConstants[1] = 0.0f;
-        colorBlending.blendConstants[2] = 0.0f;
-        colorBlending.blendConstants[3] = 0.0f;
+        VkDescriptorSetLayout computeSetLayout;
+        if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &computeSetLayout) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create compute descriptor set layout!");
+        }
 
-        std::vector<VkDynamicState> dynamicStates = {
-            VK_DYNAMIC_STATE_VIEWPORT,
-            VK_DYNAMIC_STATE_SCISSOR};
-        VkPipelineDynamicStateCreateInfo dynamicState{};
-        dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-        dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
-        dynamicState.pDynamicStates = dynamicStates.data();
+        VkPushConstantRange pushRange{};
+        pushRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushRange.offset = 0;
+        pushRange.size = 4 * sizeof(uint32_t);
 
         VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
         pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
         pipelineLayoutInfo.setLayoutCount = 1;
-        pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+        pipelineLayoutInfo.pSetLayouts = &computeSetLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushRange;
 
-        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS)
+        VkPipelineLayout computeLayout;
+        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &computeLayout) != VK_SUCCESS)
         {
-            throw std::runtime_error("failed to create pipeline layout!");
+            throw std::runtime_error("failed to create compute pipeline layout!");
         }
 
-        // pipeline info
-        VkGraphicsPipelineCreateInfo pipelineInfo{};
-        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-        pipelineInfo.stageCount = 2;
-        pipelineInfo.pStages = shaderStages;
-        pipelineInfo.pVertexInputState = &vertexInputInfo;
-        pipelineInfo.pInputAssemblyState = &inputAssembly;
-        pipelineInfo.pViewportState = &viewportState;
-        pipelineInfo.pRasterizationState = &rasterizer;
-        pipelineInfo.pMultisampleState = &multisampling;
-        pipelineInfo.pDepthStencilState = &depthStencil;
-        pipelineInfo.pColorBlendState = &colorBlending;
-        pipelineInfo.pDynamicState = &dynamicState;
-        pipelineInfo.layout = pipelineLayout;
-        pipelineInfo.renderPass = renderPass;
-        pipelineInfo.subpass = 0;
-        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+        VkPipeline histogramPipeline = createComputePipeline(ballots ? histogramShaderCode : histogramPlainShaderCode, computeLayout);
+        VkPipeline instancesPipeline = createComputePipeline(ballots ? instancesShaderCode : instancesPlainShaderCode, computeLayout);
 
-        if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS)
+        // buffers: the chunks are written by the host, the rest stays on the device
+        std::array<VkBuffer, 2> chunkBuffers;
+        std::array<VkDeviceMemory, 2> chunkMemory;
+        std::array<void *, 2> chunkMapped;
+        VkDeviceSize chunkBufferSize = chunkBytes + 4; // + the 2 bytes that finish the last trigram, word aligned
+        for (size_t i = 0; i < chunkBuffers.size(); i++)
         {
-            throw std::runtime_error("failed to create graphics pipeline!");
+            createBuffer(chunkBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, chunkBuffers[i], chunkMemory[i]);
+            vkMapMemory(device, chunkMemory[i], 0, chunkBufferSize, 0, &chunkMapped[i]);
         }
 
-        vkDestroyShaderModule(device, fragShaderModule, nullptr);
-        vkDestroyShaderModule(device, vertShaderModule, nullptr);
-    }
+        VkDeviceSize histogramSize = TRIGRAM_BINS * sizeof(uint32_t);
+        VkBuffer histogramBuffer;
+        VkDeviceMemory histogramMemory;
+        createBuffer(histogramSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, histogramBuffer, histogramMemory);
 
-    // drawing frame
-    void drawFrame()
-    {
-        vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+        // tiny and read once by the host for the log line
+        VkDeviceSize statsSize = 4 * sizeof(uint32_t);
+        VkBuffer statsBuffer;
+        VkDeviceMemory statsMemory;
+        createBuffer(statsSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, statsBuffer, statsMemory);
 
-        uint32_t imageIndex;
-        vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+        VkDeviceSize instancesSize = static_cast<VkDeviceSize>(capacity) * sizeof(InstanceData);
+        createBuffer(instancesSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, instanceBuffer, instanceBufferMemory);
 
-        vkResetFences(device, 1, &inFlightFences[currentFrame]);
+        VkDeviceSize indirectSize = sizeof(VkDrawIndexedIndirectCommand) + sizeof(VkDrawIndirectCommand);
+        createBuffer(indirectSize, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indirectBuffer, indirectBufferMemory);
 
-        vkResetCommandBuffer(commandBuffers[currentFrame], 0);
-        recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
+        // one descriptor set per chunk buffer, they differ in binding 0 only
+        VkDescriptorPoolSize poolSize{};
+        poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        poolSize.descriptorCount = static_cast<uint32_t>(chunkBuffers.size() * bindings.size());
 
-        updateUniformBuffer(currentFrame);
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = 1;
+        poolInfo.pPoolSizes = &poolSize;
+        poolInfo.maxSets = static_cast<uint32_t>(chunkBuffers.size());
 
-        VkSubmitInfo submitInfo{};
-        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        VkDescriptorPool computePool;
+        if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &computePool) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create compute descriptor pool!");
+        }
 
-        VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame]};
-        VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-        submitInfo.waitSemaphoreCount = 1;
-        submitInfo.pWaitSemaphores = waitSemaphores;
-        submitInfo.pWaitDstStageMask = waitStages;
+        std::array<VkDescriptorSetLayout, 2> setLayouts = {computeSetLayout, computeSetLayout};
+        VkDescriptorSetAllocateInfo setInfo{};
+        setInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        setInfo.descriptorPool = computePool;
+        setInfo.descriptorSetCount = static_cast<uint32_t>(setLayouts.size());
+        setInfo.pSetLayouts = setLayouts.data();
 
-        submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
+        std::array<VkDescriptorSet, 2> computeSets;
+        if (vkAllocateDescriptorSets(device, &setInfo, computeSets.data()) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to allocate compute descriptor sets!");
+        }
 
-        VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame]};
-        submitInfo.signalSemaphoreCount = 1;
-        submitInfo.pSignalSemaphores = signalSemaphores;
+        for (size_t i = 0; i < computeSets.size(); i++)
+        {
+            std::array<VkDescriptorBufferInfo, 5> bufferInfos = {{{chunkBuffers[i], 0, chunkBufferSize},
+                                                                  {histogramBuffer, 0, histogramSize},
+                                                                  {statsBuffer, 0, statsSize},
+                                                                  {instanceBuffer, 0, instancesSize},
+                                                                  {indirectBuffer, 0, indirectSize}}};
+
+            std::array<VkWriteDescriptorSet, 5> writes{};
+            for (uint32_t b = 0; b < writes.size(); b++)
+            {
+                writes[b].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                writes[b].dstSet = computeSets[i];
+                writes[b].dstBinding = b;
+                writes[b].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                writes[b].descriptorCount = 1;
+                writes[b].pBufferInfo = &bufferInfos[b];
+            }
+            vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+        }
 
-        if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS)
+        std::array<VkCommandBuffer, 2> computeCommands;
+        VkCommandBufferAllocateInfo commandInfo{};
+        commandInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        commandInfo.commandPool = commandPool;
+        commandInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        commandInfo.commandBufferCount = static_cast<uint32_t>(computeCommands.size());
+        if (vkAllocateCommandBuffers(device, &commandInfo, computeCommands.data()) != VK_SUCCESS)
         {
-            throw std::runtime_error("failed to submit draw command buffer!");
+            throw std::runtime_error("failed to allocate compute command buffers!");
         }
 
-        VkPresentInfoKHR presentInfo{};
-        presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-        presentInfo.waitSemaphoreCount = 1;
-        presentInfo.pWaitSemaphores = signalSemaphores;
+        VkFenceCreateInfo fenceInfo{};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-        VkSwapchainKHR swapChains[] = {swapChain};
-        presentInfo.swapchainCount = 1;
-        presentInfo.pSwapchains = swapChains;
-        presentInfo.pImageIndices = &imageIndex;
+        std::array<VkFence, 2> chunkFences;
+        for (auto &fence : chunkFences)
+        {
+            if (vkCreateFence(device, &fenceInfo, nullptr, &fence) != VK_SUCCESS)
+            {
+                throw std::runtime_error("failed to create compute fence!");
+            }
+        }
 
-        vkQueuePresentKHR(presentQueue, &presentInfo);
+        // a barrier at the top of every submission orders it after everything
+        // submitted before it: the clears, and the chunk that last used its buffer
+        auto computeBarrier = [](VkCommandBuffer cmd, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+        {
+            VkMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+            barrier.dstAccessMask = dstAccess;
+            vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, dstStage,
+                                 0, 1, &barrier, 0, nullptr, 0, nullptr);
+        };
+
+        auto submit = [this, &computeCommands, &chunkFences](size_t slot)
+        {
+            vkEndCommandBuffer(computeCommands[slot]);
 
-        currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
-    }
+            VkSubmitInfo submitInfo{};
+            submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            submitInfo.commandBufferCount = 1;
+            submitInfo.pCommandBuffers = &computeCommands[slot];
+            if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, chunkFences[slot]) != VK_SUCCESS)
+            {
+                throw std::runtime_error("failed to submit compute work!");
+            }
+        };
 
-    // this is responsible for current animation
-    // TODO: have this mouse-draggable in 3D
-    void updateUniformBuffer(uint32_t currentImage)
-    {
-        auto currentTime = std::chrono::steady_clock::now();
-        float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
+        auto begin = [this, &computeCommands, &chunkFences](size_t slot)
+        {
+            vkWaitForFences(device, 1, &chunkFences[slot], VK_TRUE, UINT64_MAX);
+            vkResetFences(device, 1, &chunkFences[slot]);
+            vkResetCommandBuffer(computeCommands[slot], 0);
+
+            VkCommandBufferBeginInfo beginInfo{};
+            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+            vkBeginCommandBuffer(computeCommands[slot], &beginInfo);
+            return computeCommands[slot];
+        };
+
+        VkCommandBuffer cmd = begin(0);
+        vkCmdFillBuffer(cmd, histogramBuffer, 0, VK_WHOLE_SIZE, 0);
+        vkCmdFillBuffer(cmd, statsBuffer, 0, VK_WHOLE_SIZE, 0);
+        submit(0);
+
+        // chunks overlap by 2 bytes so trigrams across a boundary count once
+        uint64_t trigramTotal = fileSize > 2 ? fileSize - 2 : 0;
+        size_t chunkIndex = 1;
+        for (uint64_t start = 0; start < trigramTotal; start += chunkBytes, chunkIndex++)
+        {
+            size_t slot = chunkIndex % chunkBuffers.size();
+            uint32_t trigrams = static_cast<uint32_t>(std::min<uint64_t>(chunkBytes, trigramTotal - start));
 
-        UniformBufferObject ubo{};
+            cmd = begin(slot);
 
-        glm::mat4 model = glm::rotate(glm::mat4(1.0f), time * 0.3f, glm::vec3(0.0f, 1.0f, 0.0f));
-        glm::mat4 view = glm::translate(glm::mat4(1.0f), glm::vec3(-128.0f, -128.0f, -512.0f));
-        glm::mat4 proj = glm::perspective(glm::radians(45.0f),
-                                          swapChainExtent.width / (float)swapChainExtent.height,
-                                          0.1f, 1000.0f);
-        proj[1][1] *= -1; // flip y (vulkan)
+            file.seekg(static_cast<std::streamoff>(start));
+            file.read(static_cast<char *>(chunkMapped[slot]), trigrams + 2);
+            if (static_cast<uint32_t>(file.gcount()) != trigrams + 2)
+            {
+                throw std::runtime_error("Short read from " + filename);
+            }
 
-        ubo.mvp = proj * view * model;
+            computeBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, histogramPipeline);
+            vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, computeLayout, 0, 1, &computeSets[slot], 0, nullptr);
 
-        memcpy(uniformBuffersMapped[currentImage], &ubo, sizeof(ubo));
-    }
+            std::array<uint32_t, 4> push = {trigrams, TRIGRAMS_PER_WORKGROUP, 0, 0};
+            vkCmdPushConstants(cmd, computeLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), push.data());
+            vkCmdDispatch(cmd, (trigrams + TRIGRAMS_PER_WORKGROUP - 1) / TRIGRAMS_PER_WORKGROUP, 1, 1);
+            submit(slot);
+        }
 
-    // do we need this function?
-    bool checkValidationLayerSupport() { return true; }
+        // max, compact and the indirect commands in one submission
+        size_t slot = chunkIndex % chunkBuffers.size();
+        cmd = begin(slot);
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, instancesPipeline);
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, computeLayout, 0, 1, &computeSets[slot], 0, nullptr);
 
-    std::vector<const char *> getRequiredExtensions()
-    {
-        uint32_t glfwExtensionCount = 0;
-        const char **glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-        std::vector<const char *> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
-        if (enableValidationLayers)
+        uint32_t indexCount = static_cast<uint32_t>(cubeIndices.size());
+        for (uint32_t stage = 0; stage < 3; stage++)
         {
-            extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+            computeBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+            std::array<uint32_t, 4> push = {stage, minCount, capacity, indexCount};
+            vkCmdPushConstants(cmd, computeLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), push.data());
+            vkCmdDispatch(cmd, stage == 2 ? 1 : BIN_WORKGROUPS, 1, 1);
         }
-        return extensions;
-    }
-
-    static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
-        VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
-        VkDebugUtilsMessageTypeFlagsEXT messageType,
-        const VkDebugUtilsMessengerCallbackDataEXT *pCallbackData,
-        void *pUserData)
-    {
-
-        std::cerr << "validation layer: " << pCallbackData->pMessage << std::endl;
-        return VK_FALSE;
-    }
+        computeBarrier(cmd, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+                       VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_HOST_READ_BIT);
+        submit(slot);
+        vkQueueWaitIdle(graphicsQueue);
 
-    VkResult CreateDebugUtilsMessengerEXT(VkInstance instance,
-                                          const VkDebugUtilsMessengerCreateInfoEXT *pCreateInfo,
-                                          const VkAllocationCallbacks *pAllocator,
-                                          VkDebugUtilsMessengerEXT *pDebugMessenger)
-    {
-        auto func = (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkCreateDebugUtilsMessengerEXT");
-        if (func != nullptr)
+        std::array<uint32_t, 4> stats;
+        void *statsMapped;
+        vkMapMemory(device, statsMemory, 0, statsSize, 0, &statsMapped);
+        memcpy(stats.data(), statsMapped, sizeof(stats));
+        vkUnmapMemory(device, statsMemory);
+
+        float countMs = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::steady_clock::now() - countStart).count();
+        std::cout << "Counted " << fileSize << " bytes on the GPU in " << countMs << " ms ("
+                  << (ballots ? "subgroup" : "plain") << " atomics): " << stats[2] << " distinct trigrams, "
+                  << std::min(stats[1], capacity) << " drawn, max count " << stats[0] << std::endl;
+        gpuMaxCount = stats[0];
+        if (stats[1] > capacity)
         {
-            return func(instance, pCreateInfo, pAllocator, pDebugMessenger);
+            std::cout << stats[1] - capacity << " trigrams did not fit, raise --gpu-max-instances or --gpu-min-count" << std::endl;
         }
-        else
+
+        if (gpuSelfTest || args_.get_or<bool>("--validate", false))
         {
-            return VK_ERROR_EXTENSION_NOT_PRESENT;
+            validateGpuCount(filename, histogramBuffer, stats, minCount, capacity);
         }
-    }
 
-    void DestroyDebugUtilsMessengerEXT(VkInstance instance,
-                                       VkDebugUtilsMessengerEXT debugMessenger,
-                                       const VkAllocationCallbacks *pAllocator)
-    {
-        auto func = (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkDestroyDebugUtilsMessengerEXT");
-        if (func != nullptr)
+        for (size_t i = 0; i < chunkBuffers.size(); i++)
         {
-            func(instance, debugMessenger, pAllocator);
+            vkDestroyFence(device, chunkFences[i], nullptr);
+            vkDestroyBuffer(device, chunkBuffers[i], nullptr);
+            vkFreeMemory(device, chunkMemory[i], nullptr);
         }
+        vkFreeCommandBuffers(device, commandPool, static_cast<uint32_t>(computeCommands.size()), computeCommands.data());
+        vkDestroyDescriptorPool(device, computePool, nullptr);
+        vkDestroyBuffer(device, statsBuffer, nullptr);
+        vkFreeMemory(device, statsMemory, nullptr);
+        vkDestroyBuffer(device, histogramBuffer, nullptr);
+        vkFreeMemory(device, histogramMemory, nullptr);
+        vkDestroyPipeline(device, instancesPipeline, nullptr);
+        vkDestroyPipeline(device, histogramPipeline, nullptr);
+        vkDestroyPipelineLayout(device, computeLayout, nullptr);
+        vkDestroyDescriptorSetLayout(device, computeSetLayout, nullptr);
     }
 
-    bool isDeviceSuitable(VkPhysicalDevice device)
-    {
-        return findQueueFamilies(device).isComplete();
-    }
-
-    QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device)
-    {
-        QueueFamilyIndices indices;
-        // Simplified implementation
-        indices.graphicsFamily = 0;
-        indices.presentFamily = 0;
-        return indices;
-    }
-
-    SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device)
+    // --validate and --gpu-self-test: reads the histogram back and compares
+    // it bin by bin with the same file counted on the cpu, then checks what
+    // instances.comp made of it: the stats and every instance it wrote
+    void validateGpuCount(const std::string &filename, VkBuffer histogramBuffer, const std::array<uint32_t, 4> &stats,
+                          uint32_t minCount, uint32_t capacity)
     {
-        SwapChainSupportDetails details;
-
-        vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface, &details.capabilities);
+        std::vector<uint32_t> gpuCounts(TRIGRAM_BINS);
+        readBack(histogramBuffer, gpuCounts.data(), TRIGRAM_BINS * sizeof(uint32_t));
+
+        std::ifstream file(filename, std::ios::binary);
+        std::vector<uint32_t> cpuCounts(TRIGRAM_BINS, 0);
+        count_trigrams(file, cpuCounts);
+
+        size_t mismatches = 0;
+        uint32_t maxCount = 0;
+        uint32_t used = 0;
+        uint32_t kept = 0;
+        for (size_t bin = 0; bin < TRIGRAM_BINS; bin++)
+        {
+            if (gpuCounts[bin] != cpuCounts[bin])
+            {
+                if (mismatches++ < 8)
+                {
+                    std::cerr << "bin " << bin << ": gpu " << gpuCounts[bin] << ", cpu " << cpuCounts[bin] << std::endl;
+                }
+            }
+            maxCount = std::max(maxCount, cpuCounts[bin]);
+            used += cpuCounts[bin] != 0 ? 1 : 0;
+            kept += cpuCounts[bin] != 0 && cpuCounts[bin] >= minCount ? 1 : 0;
+        }
 
-        uint32_t formatCount;
-        vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, nullptr);
+        if (mismatches != 0)
+        {
+            throw std::runtime_error("GPU histogram differs from the CPU count in " + std::to_string(mismatches) + " bins");
+        }
 
-        if (formatCount != 0)
+        if (stats[0] != maxCount || stats[1] != kept || stats[2] != used)
         {
-            details.formats.resize(formatCount);
-            vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, details.formats.data());
+            throw std::runtime_error("GPU stats differ from the CPU count: max " + std::to_string(stats[0]) + " / " + std::to_string(maxCount) +
+                                     ", kept " + std::to_string(stats[1]) + " / " + std::to_string(kept) +
+                                     ", non-empty " + std::to_string(stats[2]) + " / " + std::to_string(used));
         }
 
-        uint32_t presentModeCount;
-        vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &presentModeCount, nullptr);
+        // every instance names a distinct kept bin, scaled by the largest count
+        uint32_t instanceCount = std::min(kept, capacity);
+        std::vector<InstanceData> instances(instanceCount);
+        readBack(instanceBuffer, instances.data(), instanceCount * sizeof(InstanceData));
 
-        if (presentModeCount != 0)
+        std::vector<bool> seen(TRIGRAM_BINS, false);
+        for (const InstanceData &instance : instances)
         {
-            details.presentModes.resize(presentModeCount);
-            vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &presentModeCount, details.presentModes.data());
+            uint32_t bin = (static_cast<uint32_t>(instance.offset.x) << 16) | (static_cast<uint32_t>(instance.offset.y) << 8) |
+                           static_cast<uint32_t>(instance.offset.z);
+            uint32_t count = bin < TRIGRAM_BINS ? cpuCounts[bin] : 0;
+            float intensity = static_cast<float>(count) / static_cast<float>(std::max(maxCount, 1u));
+            if (count == 0 || count < minCount || seen[bin] || std::fabs(instance.intensity - intensity) > 1e-6f)
+            {
+                throw std::runtime_error("GPU instance for bin " + std::to_string(bin) + " does not match the CPU count " + std::to_string(count));
+            }
+            seen[bin] = true;
         }
-
-        return details;
+        std::cout << "GPU histogram and " << instanceCount << " instances match the CPU count" << std::endl;
     }
 
-    VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR> &availableFormats)
+    // copies a device local buffer into host memory through a staging buffer
+    void readBack(VkBuffer srcBuffer, void *out, VkDeviceSize size)
     {
-        return availableFormats[0];
-    }
+        if (size == 0)
+        {
+            return;
+        }
 
-    VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR> &availablePresentModes)
-    {
-        return VK_PRESENT_MODE_FIFO_KHR;
-    }
+        VkBuffer readbackBuffer;
+        VkDeviceMemory readbackMemory;
+        createBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, readbackBuffer, readbackMemory);
+        copyBuffer(srcBuffer, readbackBuffer, size);
 
-    VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR &capabilities)
-    {
-        return {WINDOW_WIDTH, WINDOW_HEIGHT};
+        void *data;
+        vkMapMemory(device, readbackMemory, 0, size, 0, &data);
+        memcpy(out, data, static_cast<size_t>(size));
+        vkUnmapMemory(device, readbackMemory);
+        vkDestroyBuffer(device, readbackBuffer, nullptr);
+        vkFreeMemory(device, readbackMemory, nullptr);
     }
 
-    VkShaderModule createShaderModule(const std::vector<char> &code)
+    // --gpu-self-test: a fixed input over three 1 MB chunks. noise over 16
+    // byte values so every bin is hit hundreds of times, a run of zeros so
+    // whole subgroups hit one bin, and a short repeating pattern, the last
+    // two straddling chunk boundaries
+    std::string writeSelfTestInput()
     {
-        VkShaderModuleCreateInfo createInfo{};
-        createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-        createInfo.codeSize = code.size();
-        createInfo.pCode = reinterpret_cast<const uint32_t *>(code.data());
-
-        VkShaderModule shaderModule;
-        if (vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS)
+        const size_t MB = 1 << 20;
+        std::vector<char> data(2 * MB + MB / 2 + 1);
+        uint32_t x = 0x9E3779B9u;
+        for (char &byte : data)
         {
-            throw std::runtime_error("failed to create shader module!");
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            byte = static_cast<char>(x & 0xC3);
+        }
+        std::fill(data.begin() + MB - 4096, data.begin() + MB + 4096, 0);
+        for (size_t i = 2 * MB - 4096; i < 2 * MB + 4096; i++)
+        {
+            data[i] = "fcube"[i % 5];
         }
 
-        return shaderModule;
-    }
-
-    std::vector<char> readFile(const std::string &filename)
-    {
-        std::ifstream file(filename, std::ios::ate | std::ios::binary);
-        if (!file.is_open())
+        std::string path = (std::filesystem::temp_directory_path() / "fcube-gpu-self-test.bin").string();
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(data.data(), static_cast<std::streamsize>(data.size()));
+        if (!out)
         {
-            throw std::runtime_error("failed to open file!");
+            throw std::runtime_error("Failed to write " + path);
         }
-        size_t fileSize = (size_t)file.tellg();
-        std::vector<char> buffer(fileSize);
-        file.seekg(0);
-        file.read(buffer.data(), fileSize);
-        file.close();
-        return buffer;
+        std::cout << "GPU self-test: " << data.size() << " bytes in " << path << std::endl;
+        return path;
     }
 
-    //    void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
-    // Simplified implementation
-    //  }
-    uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties)
+    VkPipeline createComputePipeline(const std::vector<char> &code, VkPipelineLayout layout)
     {
-        VkPhysicalDeviceMemoryProperties memProperties;
-        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
-
-        for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++)
+        VkShaderModule module = createShaderModule(code);
+
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = module;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.layout = layout;
+
+        VkPipeline pipeline;
+        if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS)
         {
-            if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties)
-            {
-                return i;
-            }
+            throw std::runtime_error("failed to create compute pipeline!");
         }
 
-        throw std::runtime_error("failed to find suitable memory type!");
+        vkDestroyShaderModule(device, module, nullptr);
+        return pipeline;
     }
 
-    void createCommandPool()
+    void createUniformBuffers()
     {
-        std::cout << "Creating command pool..." << std::endl;
+        VkDeviceSize bufferSize = sizeof(UniformBufferObject);
 
-        QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
+        uniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+        uniformBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
+        uniformBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
 
-        if (!queueFamilyIndices.graphicsFamily.has_value())
+        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
         {
-            throw std::runtime_error("Graphics queue family not found!");
-        }
+            createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformBuffers[i], uniformBuffersMemory[i]);
 
-        VkCommandPoolCreateInfo poolInfo{};
-        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-        poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-        poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+            vkMapMemory(device, uniformBuffersMemory[i], 0, bufferSize, 0, &uniformBuffersMapped[i]);
+        }
+    }
 
-        std::cout << "Using graphics queue family index: " << queueFamilyIndices.graphicsFamily.value() << std::endl;
+    void createPickBuffers()
+    {
+        pickBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+        pickBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
+        pickBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
 
-        VkResult result = vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool);
-        if (result != VK_SUCCESS)
+        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
         {
-            throw std::runtime_error("failed to create command pool! Error code: " + std::to_string(result));
-        }
+            createBuffer(PICK_BUFFER_SIZE, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, pickBuffers[i], pickBuffersMemory[i]);
 
-        std::cout << "Command pool created successfully" << std::endl;
+            vkMapMemory(device, pickBuffersMemory[i], 0, PICK_BUFFER_SIZE, 0, &pickBuffersMapped[i]);
+        }
     }
 
-    void createDepthResources()
+    void createDescriptorPool()
     {
-        std::cout << "Creating depth resources..." << std::endl;
-
-        VkFormat depthFormat = findDepthFormat();
-
-        createImage(swapChainExtent.width, swapChainExtent.height, depthFormat,
-                    VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depthImage, depthImageMemory);
+        VkDescriptorPoolSize poolSize{};
+        poolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        poolSize.descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
 
-        depthImageView = createImageView(depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = 1;
+        poolInfo.pPoolSizes = &poolSize;
+        poolInfo.maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
 
-        std::cout << "Depth resources created successfully" << std::endl;
+        if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create descriptor pool!");
+        }
     }
 
-    void createFramebuffers()
+    void createDescriptorSets()
     {
-        std::cout << "Creating framebuffers..." << std::endl;
+        std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT, descriptorSetLayout);
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = descriptorPool;
+        allocInfo.descriptorSetCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+        allocInfo.pSetLayouts = layouts.data();
 
-        swapChainFramebuffers.resize(swapChainImageViews.size());
+        descriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
+        if (vkAllocateDescriptorSets(device, &allocInfo, descriptorSets.data()) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to allocate descriptor sets!");
+        }
 
-        for (size_t i = 0; i < swapChainImageViews.size(); i++)
+        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
         {
-            std::array<VkImageView, 2> attachments = {
-                swapChainImageViews[i],
-                depthImageView};
+            VkDescriptorBufferInfo bufferInfo{};
+            bufferInfo.buffer = uniformBuffers[i];
+            bufferInfo.offset = 0;
+            bufferInfo.range = sizeof(UniformBufferObject);
 
-            VkFramebufferCreateInfo framebufferInfo{};
-            framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-            framebufferInfo.renderPass = renderPass;
-            framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
-            framebufferInfo.pAttachments = attachments.data();
-            framebufferInfo.width = swapChainExtent.width;
-            framebufferInfo.height = swapChainExtent.height;
-            framebufferInfo.layers = 1;
+            VkWriteDescriptorSet descriptorWrite{};
+            descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrite.dstSet = descriptorSets[i];
+            descriptorWrite.dstBinding = 0;
+            descriptorWrite.dstArrayElement = 0;
+            descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+            descriptorWrite.descriptorCount = 1;
+            descriptorWrite.pBufferInfo = &bufferInfo;
 
-            if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &swapChainFramebuffers[i]) != VK_SUCCESS)
-            {
-                throw std::runtime_error("failed to create framebuffer!");
-            }
+            vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
         }
-
-        std::cout << "Created " << swapChainFramebuffers.size() << " framebuffers successfully" << std::endl;
     }
 
-    // Helper functions these depend on:
-
-    void createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling,
-                     VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage &image, VkDeviceMemory &imageMemory)
+    // Helper functions:
+    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer &buffer, VkDeviceMemory &bufferMemory)
     {
-        VkImageCreateInfo imageInfo{};
-        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-        imageInfo.imageType = VK_IMAGE_TYPE_2D;
-        imageInfo.extent.width = width;
-        imageInfo.extent.height = height;
-        imageInfo.extent.depth = 1;
-        imageInfo.mipLevels = 1;
-        imageInfo.arrayLayers = 1;
-        imageInfo.format = format;
-        imageInfo.tiling = tiling;
-        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        imageInfo.usage = usage;
-        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = usage;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-        if (vkCreateImage(device, &imageInfo, nullptr, &image) != VK_SUCCESS)
+        if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS)
         {
-            throw std::runtime_error("failed to create image!");
+            throw std::runtime_error("failed to create buffer!");
         }
 
         VkMemoryRequirements memRequirements;
-        vkGetImageMemoryRequirements(device, image, &memRequirements);
+        vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
 
         VkMemoryAllocateInfo allocInfo{};
         allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
         allocInfo.allocationSize = memRequirements.size;
         allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
 
-        if (vkAllocateMemory(device, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS)
+        if (vkAllocateMemory(device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS)
         {
-            throw std::runtime_error("failed to allocate image memory!");
+            throw std::runtime_error("failed to allocate buffer memory!");
         }
 
-        vkBindImageMemory(device, image, imageMemory, 0);
+        vkBindBufferMemory(device, buffer, bufferMemory, 0);
     }
 
-    VkFormat findDepthFormat()
+    void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size)
     {
-        return findSupportedFormat(
-            {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT},
-            VK_IMAGE_TILING_OPTIMAL,
-            VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandPool = commandPool;
+        allocInfo.commandBufferCount = 1;
+
+        VkCommandBuffer commandBuffer;
+        vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+        vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+        VkBufferCopy copyRegion{};
+        copyRegion.size = size;
+        vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+
+        vkEndCommandBuffer(commandBuffer);
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &commandBuffer;
+
+        vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
+        vkQueueWaitIdle(graphicsQueue);
+
+        vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
     }
 
-    VkFormat findSupportedFormat(const std::vector<VkFormat> &candidates, VkImageTiling tiling, VkFormatFeatureFlags features)
+    // what to draw this frame, as instance ranges into instanceBuffer.
+    // with lod on every non-empty brick picks the level whose cells come out
+    // about lodPixels wide at its distance, then adds lodBias. bricks are laid
+    // out in order within each level so neighbours on one level merge.
+    // a slab is always drawn at full detail as a single range
+    void buildDrawRanges()
     {
-        for (VkFormat format : candidates)
+        drawRanges.clear();
+
+        // counted on the gpu: one indirect draw, see recordDraws
+        if (gpuCount)
         {
-            VkFormatProperties props;
-            vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &props);
+            drawRanges.push_back({0, 0});
+            return;
+        }
 
-            if (tiling == VK_IMAGE_TILING_LINEAR && (props.linearTilingFeatures & features) == features)
+        if (sliceAxis >= 0)
+        {
+            int last = std::min(slabStart + slabWidth, SLICE_COUNT) - 1;
+            uint32_t first = slabIndex.slab_begin(sliceAxis, slabStart);
+            uint32_t end = slabIndex.slab_end(sliceAxis, last);
+            if (end > first)
             {
-                return format;
+                drawRanges.push_back({axisBase[sliceAxis] + first, end - first});
             }
-            else if (tiling == VK_IMAGE_TILING_OPTIMAL && (props.optimalTilingFeatures & features) == features)
+            return;
+        }
+
+        if (!lodEnabled)
+        {
+            if (!pyramid.cells(0).empty())
             {
-                return format;
+                drawRanges.push_back({levelBase[0], static_cast<uint32_t>(pyramid.cells(0).size())});
             }
+            return;
         }
 
-        throw std::runtime_error("failed to find supported format!");
+        for (int brick = 0; brick < BRICK_COUNT; brick++)
+        {
+            if (pyramid.brick_begin(0, brick) == pyramid.brick_end(0, brick))
+            {
+                continue;
+            }
+
+            int bx = brick % BRICKS_PER_AXIS;
+            int by = (brick / BRICKS_PER_AXIS) % BRICKS_PER_AXIS;
+            int bz = brick / (BRICKS_PER_AXIS * BRICKS_PER_AXIS);
+            glm::vec3 center = glm::vec3(bx, by, bz) * static_cast<float>(BRICK_SIZE) + glm::vec3(0.5f * (BRICK_SIZE - 1));
+
+            float distance = std::max(1.0f, glm::distance(cameraPosition, center));
+            int level = static_cast<int>(std::floor(std::log2(lodPixels * distance / pointScale)));
+            level = std::clamp(std::max(level, 0) + lodBias, 0, PYRAMID_LEVELS - 1);
+
+            uint32_t first = levelBase[level] + pyramid.brick_begin(level, brick);
+            uint32_t count = pyramid.brick_end(level, brick) - pyramid.brick_begin(level, brick);
+
+            if (!drawRanges.empty() && drawRanges.back().firstInstance + drawRanges.back().instanceCount == first)
+            {
+                drawRanges.back().instanceCount += count;
+            }
+            else
+            {
+                drawRanges.push_back({first, count});
+            }
+        }
     }
 
-    VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags)
+    // coarsens everything by a level while the smoothed frame interval is over
+    // budget and refines again once there is plenty of headroom. frames are
+    // paced by FIFO present, so the budget should sit above the refresh interval
+    void adaptLevelOfDetail()
     {
-        VkImageViewCreateInfo viewInfo{};
-        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-        viewInfo.image = image;
-        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-        viewInfo.format = format;
-        viewInfo.subresourceRange.aspectMask = aspectFlags;
-        viewInfo.subresourceRange.baseMipLevel = 0;
-        viewInfo.subresourceRange.levelCount = 1;
-        viewInfo.subresourceRange.baseArrayLayer = 0;
-        viewInfo.subresourceRange.layerCount = 1;
+        auto now = std::chrono::steady_clock::now();
+        if (lastFrameTime.time_since_epoch().count() != 0)
+        {
+            float frameMs = std::chrono::duration<float, std::chrono::milliseconds::period>(now - lastFrameTime).count();
+            frameTimeMs = frameTimeMs == 0.0f ? frameMs : 0.9f * frameTimeMs + 0.1f * frameMs;
+        }
+        lastFrameTime = now;
 
-        VkImageView imageView;
-        if (vkCreateImageView(device, &viewInfo, nullptr, &imageView) != VK_SUCCESS)
+        if (!lodEnabled || ++framesSinceLodChange < 30)
         {
-            throw std::runtime_error("failed to create texture image view!");
+            return;
         }
 
-        return imageView;
+        if (frameTimeMs > frameBudgetMs && lodBias < PYRAMID_LEVELS - 1)
+        {
+            lodBias++;
+        }
+        else if (frameTimeMs < 0.5f * frameBudgetMs && lodBias > 0)
+        {
+            lodBias--;
+        }
+        else
+        {
+            return;
+        }
+
+        framesSinceLodChange = 0;
+        std::cout << "Frame time " << frameTimeMs << " ms, lod bias now " << lodBias << std::endl;
     }
 
-    void createVertexBuffer()
+    void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex)
     {
-        VkDeviceSize bufferSize = sizeof(cubeVertices[0]) * cubeVertices.size();
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 
-        VkBuffer stagingBuffer;
-        VkDeviceMemory stagingBufferMemory;
-        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to begin recording command buffer!");
+        }
 
-        void *data;
-        vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-        memcpy(data, cubeVertices.data(), (size_t)bufferSize);
-        vkUnmapMemory(device, stagingBufferMemory);
+        VkRenderPassBeginInfo renderPassInfo{};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        renderPassInfo.renderPass = renderPass;
+        renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
+        renderPassInfo.renderArea.offset = {0, 0};
+        renderPassInfo.renderArea.extent = swapChainExtent;
 
-        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexBufferMemory);
+        std::array<VkClearValue, 3> clearValues{};
+        clearValues[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}};
+        clearValues[1].depthStencil = {1.0f, 0};
+        clearValues[2].color.uint32[0] = NO_PICK;
+
+        renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+        renderPassInfo.pClearValues = clearValues.data();
+
+        uint32_t threads = static_cast<uint32_t>(std::min<size_t>(recordThreads, drawRanges.size() / MIN_DRAWS_PER_RECORD_THREAD));
+        if (threads <= 1)
+        {
+            vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+            recordDraws(commandBuffer, 0, drawRanges.size());
+            recordRarityPanel(commandBuffer);
+        }
+        else
+        {
+            vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+            recordSecondaryBuffers(imageIndex, threads);
+            vkCmdExecuteCommands(commandBuffer, threads, recordBuffers[currentFrame].data());
+        }
+
+        vkCmdEndRenderPass(commandBuffer);
 
-        copyBuffer(stagingBuffer, vertexBuffer, bufferSize);
+        recordPick(commandBuffer, imageIndex);
 
-        vkDestroyBuffer(device, stagingBuffer, nullptr);
-        vkFreeMemory(device, stagingBufferMemory, nullptr);
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to record command buffer!");
+        }
     }
 
-    void createIndexBuffer()
+    // copies the id under the cursor into this frame's pick buffer. with gpu
+    // counting the instance data lives only on the device, so the instance
+    // picked last time is copied along with it and resolved a frame later
+    void recordPick(VkCommandBuffer commandBuffer, uint32_t imageIndex)
     {
-        VkDeviceSize bufferSize = sizeof(cubeIndices[0]) * cubeIndices.size();
+        pickIssued[currentFrame] = false;
+        pickInstanceIssued[currentFrame] = NO_PICK;
+
+        double cursorX, cursorY;
+        int windowWidth, windowHeight;
+        glfwGetCursorPos(window, &cursorX, &cursorY);
+        glfwGetWindowSize(window, &windowWidth, &windowHeight);
+
+        // window coordinates are not pixels on high dpi displays
+        int x = static_cast<int>(cursorX * swapChainExtent.width / std::max(windowWidth, 1));
+        int y = static_cast<int>(cursorY * swapChainExtent.height / std::max(windowHeight, 1));
+        if (x >= 0 && y >= 0 && x < static_cast<int>(swapChainExtent.width) && y < static_cast<int>(swapChainExtent.height))
+        {
+            VkBufferImageCopy region{};
+            region.bufferOffset = 0;
+            region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.imageSubresource.mipLevel = 0;
+            region.imageSubresource.baseArrayLayer = 0;
+            region.imageSubresource.layerCount = 1;
+            region.imageOffset = {x, y, 0};
+            region.imageExtent = {1, 1, 1};
+            vkCmdCopyImageToBuffer(commandBuffer, idImages[imageIndex], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, pickBuffers[currentFrame], 1, &region);
+            pickIssued[currentFrame] = true;
+        }
 
-        VkBuffer stagingBuffer;
-        VkDeviceMemory stagingBufferMemory;
-        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+        if (gpuCount && pickedInstance != NO_PICK)
+        {
+            VkBufferCopy copy{};
+            copy.srcOffset = static_cast<VkDeviceSize>(pickedInstance) * sizeof(InstanceData);
+            copy.dstOffset = PICK_INSTANCE_OFFSET;
+            copy.size = sizeof(InstanceData);
+            vkCmdCopyBuffer(commandBuffer, instanceBuffer, pickBuffers[currentFrame], 1, &copy);
+            pickInstanceIssued[currentFrame] = pickedInstance;
+        }
 
-        void *data;
-        vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-        memcpy(data, cubeIndices.data(), (size_t)bufferSize);
-        vkUnmapMemory(device, stagingBufferMemory);
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
 
-        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer, indexBufferMemory);
+    // called right after the frame's fence wait, so whatever recordPick
+    // copied for this frame slot is complete
+    void readPick(uint32_t frame)
+    {
+        if (pickIssued[frame])
+        {
+            uint32_t id;
+            memcpy(&id, pickBuffersMapped[frame], sizeof(id));
+            if (id != pickedInstance)
+            {
+                pickedInstance = id;
+                pickedVoxel.reset();
+                if (!gpuCount && id != NO_PICK)
+                {
+                    pickedVoxel = instanceVoxel(id, pickedLevel);
+                }
+            }
+        }
 
-        copyBuffer(stagingBuffer, indexBuffer, bufferSize);
+        if (pickInstanceIssued[frame] != NO_PICK && pickInstanceIssued[frame] == pickedInstance)
+        {
+            InstanceData instance;
+            memcpy(&instance, static_cast<const char *>(pickBuffersMapped[frame]) + PICK_INSTANCE_OFFSET, sizeof(instance));
+            pickedLevel = 0;
+            pickedVoxel = Voxel{static_cast<int>(instance.offset.x), static_cast<int>(instance.offset.y), static_cast<int>(instance.offset.z),
+                                static_cast<uint64_t>(std::llround(instance.intensity * gpuMaxCount)), instance.position.x, instance.position.y};
+        }
 
-        vkDestroyBuffer(device, stagingBuffer, nullptr);
-        vkFreeMemory(device, stagingBufferMemory, nullptr);
+        updateWindowTitle();
     }
 
-    void createInstanceBuffer()
+    // instanceData index back to the cell it draws: one of the pyramid levels,
+    // or a level 0 voxel in one of the slab orderings
+    std::optional<Voxel> instanceVoxel(uint32_t index, int &level) const
     {
-        VkDeviceSize bufferSize = sizeof(InstanceData) * instanceData.size();
+        if (index >= instanceData.size())
+        {
+            return std::nullopt;
+        }
 
-        createBuffer(bufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, instanceBuffer, instanceBufferMemory);
+        level = 0;
+        const pyramid_cell *cell = nullptr;
+        if (index >= axisBase[0])
+        {
+            int axis = AXIS_COUNT - 1;
+            while (index < axisBase[axis])
+            {
+                axis--;
+            }
+            cell = &pyramid.cells(0)[slabIndex.order(axis)[index - axisBase[axis]]];
+        }
+        else
+        {
+            level = PYRAMID_LEVELS - 1;
+            while (index < levelBase[level])
+            {
+                level--;
+            }
+            cell = &pyramid.cells(level)[index - levelBase[level]];
+        }
 
-        void *data;
-        vkMapMemory(device, instanceBufferMemory, 0, bufferSize, 0, &data);
-        memcpy(data, instanceData.data(), (size_t)bufferSize);
-        vkUnmapMemory(device, instanceBufferMemory);
+        return Voxel{cell->x, cell->y, cell->z, static_cast<uint64_t>(cell->count), cell->position, cell->spread, cell->delta};
     }
 
-    void createUniformBuffers()
+    void updateWindowTitle()
     {
-        VkDeviceSize bufferSize = sizeof(UniformBufferObject);
+        std::string title = "Trigram Voxel Viewer";
+        if (inputCube.layers.size() > 1)
+        {
+            title += " - " + inputCube.layers[layerIndex].name;
+            if (shownLayers() != 0)
+            {
+                title += " (" + std::to_string(shownLayers()) + " of " + std::to_string(inputCube.layers.size()) + " layers shown)";
+            }
+        }
+        if (!fileClass.empty())
+        {
+            title += " [" + fileClass + "]";
+        }
+        if (inputCube.flags & FCUBE_SAMPLED)
+        {
+            char sampled[32];
+            snprintf(sampled, sizeof(sampled), " (sampled %.1f%%)", samplePercent());
+            title += sampled;
+        }
+        if (std::optional<uint64_t> offset = rarityOffsetUnderCursor())
+        {
+            char where[64];
+            snprintf(where, sizeof(where), " - offset 0x%llx +%llu", static_cast<unsigned long long>(*offset),
+                     static_cast<unsigned long long>(rarityImage.cell_bytes));
+            title += where;
+        }
+        if (pickedVoxel)
+        {
+            const Voxel &v = *pickedVoxel;
+            const char *countLabel = background.is_open() ? " score " : " count ";
+            if (pickedLevel == 0)
+            {
+                title += " - " + std::to_string(v.x) + "," + std::to_string(v.y) + "," + std::to_string(v.z) +
+                         countLabel + std::to_string(v.count);
+                if ((inputCube.flags & FCUBE_SAMPLED) && shownLayers() == 0 && compareVoxels.empty() && !background.is_open())
+                {
+                    title += sampledRange(v);
+                }
+
+                if (offsetIndex.is_open())
+                {
+                    std::vector<uint64_t> offsets = offsetIndex.offsets(trigram_bin(static_cast<uint8_t>(v.x), static_cast<uint8_t>(v.y), static_cast<uint8_t>(v.z)), 3);
+                    for (size_t i = 0; i < offsets.size(); i++)
+                    {
+                        char hex[24];
+                        snprintf(hex, sizeof(hex), "%s0x%llx", i == 0 ? " at " : ", ", static_cast<unsigned long long>(offsets[i]));
+                        title += hex;
+                    }
+                }
+            }
+            else
+            {
+                int size = voxel_pyramid::cell_size(pickedLevel);
+                title += " - level " + std::to_string(pickedLevel) + " cell " + std::to_string(v.x * size) + "," +
+                         std::to_string(v.y * size) + "," + std::to_string(v.z * size) + " (" + std::to_string(size) +
+                         "^3)" + countLabel + std::to_string(v.count);
+            }
 
-        uniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-        uniformBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
-        uniformBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
+            if (!compareVoxels.empty())
+            {
+                char change[32];
+                snprintf(change, sizeof(change), " change %+.3f%%", v.delta * 100.0f);
+                title += change;
+            }
+            else if (v.position >= 0.0f)
+            {
+                char where[48];
+                snprintf(where, sizeof(where), " around %.0f%% +- %.0f%%", v.position * 100.0f, v.spread * 100.0f);
+                title += where;
+            }
+        }
 
-        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+        if (title != windowTitle)
         {
-            createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformBuffers[i], uniformBuffersMemory[i]);
-
-            vkMapMemory(device, uniformBuffersMemory[i], 0, bufferSize, 0, &uniformBuffersMapped[i]);
+            windowTitle = title;
+            glfwSetWindowTitle(window, windowTitle.c_str());
         }
     }
 
-    void createDescriptorPool()
+    // splits drawRanges into contiguous chunks and records one secondary buffer
+    // per chunk on workerPool. the frame's fence has already been waited on, so
+    // its pools can be reset wholesale instead of buffer by buffer
+    void recordSecondaryBuffers(uint32_t imageIndex, uint32_t threads)
     {
-        VkDescriptorPoolSize poolSize{};
-        poolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        poolSize.descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+        std::vector<std::future<void>> recorded;
+        recorded.reserve(threads);
 
-        VkDescriptorPoolCreateInfo poolInfo{};
-        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-        poolInfo.poolSizeCount = 1;
-        poolInfo.pPoolSizes = &poolSize;
-        poolInfo.maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+        for (uint32_t t = 0; t < threads; t++)
+        {
+            size_t first = drawRanges.size() * t / threads;
+            size_t last = drawRanges.size() * (t + 1) / threads;
 
-        if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS)
+            auto record = [this, t, first, last, imageIndex, threads]()
+            {
+                VkCommandBuffer secondary = recordBuffers[currentFrame][t];
+                vkResetCommandPool(device, recordPools[currentFrame][t], 0);
+
+                VkCommandBufferInheritanceInfo inheritanceInfo{};
+                inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+                inheritanceInfo.renderPass = renderPass;
+                inheritanceInfo.subpass = 0;
+                inheritanceInfo.framebuffer = swapChainFramebuffers[imageIndex];
+
+                VkCommandBufferBeginInfo beginInfo{};
+                beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+                beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+                beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+                if (vkBeginCommandBuffer(secondary, &beginInfo) != VK_SUCCESS)
+                {
+                    throw std::runtime_error("failed to begin recording secondary command buffer!");
+                }
+
+                recordDraws(secondary, first, last);
+                if (t + 1 == threads)
+                {
+                    recordRarityPanel(secondary);
+                }
+
+                if (vkEndCommandBuffer(secondary) != VK_SUCCESS)
+                {
+                    throw std::runtime_error("failed to record secondary command buffer!");
+                }
+            };
+            recorded.push_back(workerPool.submit(record));
+        }
+
+        for (auto &result : recorded)
         {
-            throw std::runtime_error("failed to create descriptor pool!");
+            result.get();
         }
     }
 
-    void createDescriptorSets()
+    // the cube's share of the window, all of it unless the rarity panel is on
+    VkExtent2D cubeExtent() const
     {
-        std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT, descriptorSetLayout);
-        VkDescriptorSetAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-        allocInfo.descriptorPool = descriptorPool;
-        allocInfo.descriptorSetCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
-        allocInfo.pSetLayouts = layouts.data();
+        return {swapChainExtent.width - rarityPanelRect().extent.width, swapChainExtent.height};
+    }
 
-        descriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
-        if (vkAllocateDescriptorSets(device, &allocInfo, descriptorSets.data()) != VK_SUCCESS)
+    // a square on the right, at most half the window wide
+    VkRect2D rarityPanelRect() const
+    {
+        VkRect2D rect{};
+        if (!rarityPanel)
         {
-            throw std::runtime_error("failed to allocate descriptor sets!");
+            return rect;
         }
+        uint32_t side = std::min(swapChainExtent.height, swapChainExtent.width / 2);
+        rect.offset = {static_cast<int32_t>(swapChainExtent.width - side), static_cast<int32_t>((swapChainExtent.height - side) / 2)};
+        rect.extent = {side, side};
+        return rect;
+    }
 
-        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    void recordRarityPanel(VkCommandBuffer commandBuffer)
+    {
+        VkRect2D rect = rarityPanelRect();
+        if (rect.extent.width == 0)
         {
-            VkDescriptorBufferInfo bufferInfo{};
-            bufferInfo.buffer = uniformBuffers[i];
-            bufferInfo.offset = 0;
-            bufferInfo.range = sizeof(UniformBufferObject);
-
-            VkWriteDescriptorSet descriptorWrite{};
-            descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descriptorWrite.dstSet = descriptorSets[i];
-            descriptorWrite.dstBinding = 0;
-            descriptorWrite.dstArrayElement = 0;
-            descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-            descriptorWrite.descriptorCount = 1;
-            descriptorWrite.pBufferInfo = &bufferInfo;
-
-            vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+            return;
         }
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, rarityPipeline);
+        VkViewport viewport{};
+        viewport.x = static_cast<float>(rect.offset.x);
+        viewport.y = static_cast<float>(rect.offset.y);
+        viewport.width = static_cast<float>(rect.extent.width);
+        viewport.height = static_cast<float>(rect.extent.height);
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+        vkCmdSetScissor(commandBuffer, 0, 1, &rect);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, rarityPipelineLayout, 0, 1, &rarityDescriptorSet, 0, nullptr);
+        vkCmdDraw(commandBuffer, 3, 1, 0, 0);
     }
 
-    // Helper functions:
-    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer &buffer, VkDeviceMemory &bufferMemory)
+    // the input offset under the cursor when it is over the rarity panel
+    std::optional<uint64_t> rarityOffsetUnderCursor() const
     {
-        VkBufferCreateInfo bufferInfo{};
-        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-        bufferInfo.size = size;
-        bufferInfo.usage = usage;
-        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-        if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS)
+        VkRect2D rect = rarityPanelRect();
+        if (rect.extent.width == 0)
         {
-            throw std::runtime_error("failed to create buffer!");
+            return std::nullopt;
         }
 
-        VkMemoryRequirements memRequirements;
-        vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
-
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memRequirements.size;
-        allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+        double cursorX, cursorY;
+        int windowWidth, windowHeight;
+        glfwGetCursorPos(window, &cursorX, &cursorY);
+        glfwGetWindowSize(window, &windowWidth, &windowHeight);
+        double x = cursorX * swapChainExtent.width / std::max(windowWidth, 1) - rect.offset.x;
+        double y = cursorY * swapChainExtent.height / std::max(windowHeight, 1) - rect.offset.y;
+        if (x < 0 || y < 0 || x >= rect.extent.width || y >= rect.extent.height)
+        {
+            return std::nullopt;
+        }
 
-        if (vkAllocateMemory(device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS)
+        uint32_t px = static_cast<uint32_t>(x * rarityImage.side / rect.extent.width);
+        uint32_t py = static_cast<uint32_t>(y * rarityImage.side / rect.extent.height);
+        uint64_t offset = hilbert_index(rarityImage.side, px, py) * rarityImage.cell_bytes;
+        if (offset >= rarityImage.input_size)
         {
-            throw std::runtime_error("failed to allocate buffer memory!");
+            return std::nullopt;
         }
+        return offset;
+    }
 
-        vkBindBufferMemory(device, buffer, bufferMemory, 0);
+    void loadRarityImage()
+    {
+        std::string path = args_.get_or<std::string>("--rarity", "");
+        if (path.empty())
+        {
+            return;
+        }
+        rarityImage = read_rarity_pgm(path);
+        rarityPanel = true;
+        std::cout << "Rarity map " << path << ": " << rarityImage.side << " x " << rarityImage.side << ", "
+                  << rarityImage.cell_bytes << " bytes per pixel (M to toggle)" << std::endl;
     }
 
-    void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size)
+    // texture, sampler, descriptor and pipeline of the panel. runs with the
+    // instance upload, which shares commandPool and graphicsQueue
+    void createRarityPanel()
     {
+        if (rarityImage.pixels.empty())
+        {
+            return;
+        }
+
+        uint32_t side = rarityImage.side;
+        VkDeviceSize size = rarityImage.pixels.size();
+        VkBuffer stagingBuffer;
+        VkDeviceMemory stagingBufferMemory;
+        createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                     stagingBuffer, stagingBufferMemory);
+        void *data;
+        vkMapMemory(device, stagingBufferMemory, 0, size, 0, &data);
+        memcpy(data, rarityImage.pixels.data(), static_cast<size_t>(size));
+        vkUnmapMemory(device, stagingBufferMemory);
+
+        createImage(side, side, VK_FORMAT_R8_UNORM, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, rarityTexture, rarityTextureMemory);
+
         VkCommandBufferAllocateInfo allocInfo{};
         allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
         allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
         allocInfo.commandPool = commandPool;
         allocInfo.commandBufferCount = 1;
-
         VkCommandBuffer commandBuffer;
         vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
 
         VkCommandBufferBeginInfo beginInfo{};
         beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
         beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
         vkBeginCommandBuffer(commandBuffer, &beginInfo);
 
-        VkBufferCopy copyRegion{};
-        copyRegion.size = size;
-        vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = rarityTexture;
+        barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        VkBufferImageCopy region{};
+        region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+        region.imageExtent = {side, side, 1};
+        vkCmdCopyBufferToImage(commandBuffer, stagingBuffer, rarityTexture, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
 
         vkEndCommandBuffer(commandBuffer);
-
         VkSubmitInfo submitInfo{};
         submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
         submitInfo.commandBufferCount = 1;
         submitInfo.pCommandBuffers = &commandBuffer;
-
         vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
         vkQueueWaitIdle(graphicsQueue);
-
         vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
-    }
+        vkDestroyBuffer(device, stagingBuffer, nullptr);
+        vkFreeMemory(device, stagingBufferMemory, nullptr);
 
-    void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex)
-    {
-        VkCommandBufferBeginInfo beginInfo{};
-        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        rarityTextureView = createImageView(rarityTexture, VK_FORMAT_R8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT);
+
+        // one texel per stretch of the input, no blurring islands into their neighbours
+        VkSamplerCreateInfo samplerInfo{};
+        samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        samplerInfo.magFilter = VK_FILTER_NEAREST;
+        samplerInfo.minFilter = VK_FILTER_NEAREST;
+        samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        if (vkCreateSampler(device, &samplerInfo, nullptr, &raritySampler) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create rarity sampler!");
+        }
 
-        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+        VkDescriptorSetLayoutBinding samplerBinding{};
+        samplerBinding.binding = 0;
+        samplerBinding.descriptorCount = 1;
+        samplerBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        samplerBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = 1;
+        layoutInfo.pBindings = &samplerBinding;
+        if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &raritySetLayout) != VK_SUCCESS)
         {
-            throw std::runtime_error("failed to begin recording command buffer!");
+            throw std::runtime_error("failed to create rarity descriptor set layout!");
         }
 
-        VkRenderPassBeginInfo renderPassInfo{};
-        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        renderPassInfo.renderPass = renderPass;
-        renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
-        renderPassInfo.renderArea.offset = {0, 0};
-        renderPassInfo.renderArea.extent = swapChainExtent;
+        VkDescriptorPoolSize poolSize{};
+        poolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        poolSize.descriptorCount = 1;
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = 1;
+        poolInfo.pPoolSizes = &poolSize;
+        poolInfo.maxSets = 1;
+        if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &rarityDescriptorPool) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create rarity descriptor pool!");
+        }
 
-        std::array<VkClearValue, 2> clearValues{};
-        clearValues[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}};
-        clearValues[1].depthStencil = {1.0f, 0};
+        VkDescriptorSetAllocateInfo setInfo{};
+        setInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        setInfo.descriptorPool = rarityDescriptorPool;
+        setInfo.descriptorSetCount = 1;
+        setInfo.pSetLayouts = &raritySetLayout;
+        if (vkAllocateDescriptorSets(device, &setInfo, &rarityDescriptorSet) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to allocate the rarity descriptor set!");
+        }
 
-        renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-        renderPassInfo.pClearValues = clearValues.data();
+        VkDescriptorImageInfo imageInfo{};
+        imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        imageInfo.imageView = rarityTextureView;
+        imageInfo.sampler = raritySampler;
+        VkWriteDescriptorSet write{};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = rarityDescriptorSet;
+        write.dstBinding = 0;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        write.descriptorCount = 1;
+        write.pImageInfo = &imageInfo;
+        vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &raritySetLayout;
+        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &rarityPipelineLayout) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create rarity pipeline layout!");
+        }
 
-        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+        // no vertex input, rarity.vert makes its triangle from gl_VertexIndex
+        VkShaderModule vertShaderModule = createShaderModule(rarityVertShaderCode);
+        VkShaderModule fragShaderModule = createShaderModule(rarityFragShaderCode);
+        rarityPipeline = createPipeline(vertShaderModule, fragShaderModule, VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, {}, {}, false, rarityPipelineLayout);
+        vkDestroyShaderModule(device, fragShaderModule, nullptr);
+        vkDestroyShaderModule(device, vertShaderModule, nullptr);
+    }
 
-        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+    // state and draws for drawRanges[first, last). used by the inline path and
+    // by every secondary, since secondaries don't inherit any bound state
+    void recordDraws(VkCommandBuffer commandBuffer, size_t first, size_t last)
+    {
+        bool points = renderMode == RenderMode::Points;
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, points ? pointPipeline : graphicsPipeline);
 
         VkViewport viewport{};
         viewport.x = 0.0f;
         viewport.y = 0.0f;
-        viewport.width = (float)swapChainExtent.width;
+        viewport.width = (float)cubeExtent().width;
         viewport.height = (float)swapChainExtent.height;
         viewport.minDepth = 0.0f;
         viewport.maxDepth = 1.0f;
@@ -1479,26 +3695,48 @@ private:
 
         VkRect2D scissor{};
         scissor.offset = {0, 0};
-        scissor.extent = swapChainExtent;
+        scissor.extent = cubeExtent();
         vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[currentFrame], 0, nullptr);
+
+        if (points)
+        {
+            // 1 vertex per trigram instead of 36 indices / 8 vertices
+            VkDeviceSize offset = 0;
+            vkCmdBindVertexBuffers(commandBuffer, 1, 1, &instanceBuffer, &offset);
+
+            if (gpuCount)
+            {
+                vkCmdDrawIndirect(commandBuffer, indirectBuffer, sizeof(VkDrawIndexedIndirectCommand), 1, sizeof(VkDrawIndirectCommand));
+                return;
+            }
+
+            for (size_t i = first; i < last; i++)
+            {
+                vkCmdDraw(commandBuffer, 1, drawRanges[i].instanceCount, 0, drawRanges[i].firstInstance);
+            }
+            return;
+        }
+
         VkBuffer vertexBuffers[] = {vertexBuffer, instanceBuffer};
         VkDeviceSize offsets[] = {0, 0};
         vkCmdBindVertexBuffers(commandBuffer, 0, 2, vertexBuffers, offsets);
 
         vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT16);
 
-        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[currentFrame], 0, nullptr);
-
-        vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(cubeIndices.size()), static_cast<uint32_t>(instanceData.size()), 0, 0, 0);
-
-        vkCmdEndRenderPass(commandBuffer);
+        if (gpuCount)
+        {
+            vkCmdDrawIndexedIndirect(commandBuffer, indirectBuffer, 0, 1, sizeof(VkDrawIndexedIndirectCommand));
+            return;
+        }
 
-        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+        for (size_t i = first; i < last; i++)
         {
-            throw std::runtime_error("failed to record command buffer!");
+            vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(cubeIndices.size()), drawRanges[i].instanceCount, 0, 0, drawRanges[i].firstInstance);
         }
     }
+
     void createCommandBuffers()
     {
         commandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
@@ -1514,6 +3752,50 @@ private:
             throw std::runtime_error("failed to allocate command buffers!");
         }
     }
+
+    // one transient pool + secondary buffer per recording thread per frame
+    void createRecordPools()
+    {
+        recordThreads = args_.get_or<uint32_t>("--record-threads", 0);
+        if (recordThreads == 0 || recordThreads > workerPool.size())
+        {
+            recordThreads = static_cast<uint32_t>(workerPool.size());
+        }
+
+        QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
+
+        recordPools.assign(MAX_FRAMES_IN_FLIGHT, std::vector<VkCommandPool>(recordThreads));
+        recordBuffers.assign(MAX_FRAMES_IN_FLIGHT, std::vector<VkCommandBuffer>(recordThreads));
+
+        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+        {
+            for (uint32_t t = 0; t < recordThreads; t++)
+            {
+                VkCommandPoolCreateInfo poolInfo{};
+                poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+                poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+                poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+
+                if (vkCreateCommandPool(device, &poolInfo, nullptr, &recordPools[i][t]) != VK_SUCCESS)
+                {
+                    throw std::runtime_error("failed to create recording command pool!");
+                }
+
+                VkCommandBufferAllocateInfo allocInfo{};
+                allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+                allocInfo.commandPool = recordPools[i][t];
+                allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+                allocInfo.commandBufferCount = 1;
+
+                if (vkAllocateCommandBuffers(device, &allocInfo, &recordBuffers[i][t]) != VK_SUCCESS)
+                {
+                    throw std::runtime_error("failed to allocate secondary command buffers!");
+                }
+            }
+        }
+
+        std::cout << "Recording with up to " << recordThreads << " threads" << std::endl;
+    }
     void createSyncObjects()
     {
         imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
@@ -1542,7 +3824,29 @@ private:
 int main(int argc, char **argv)
 {
     vulkan_trigram_viewer app;
-    app.args_.add_option("--inputfile", "JSON file with trigram data", true);
+    app.args_.add_option("--inputfile", "JSON file with trigram data, an .fcube from fcube-analyze, or the raw binary with --gpu-count", std::string(""));
+    app.args_.add_option("--model", "Classifier model from fcube-analyze train, the guess goes in the title", std::string(""));
+    app.args_.add_option("--background", "Corpus model from fcube-analyze background, weighs trigrams by how unusual they are", std::string(""));
+    app.args_.add_option("--keep", "With --background, draw only this many of the highest scoring trigrams, 0 for all", 0);
+    app.args_.add_option("--compare", "Second JSON or .fcube to diff against, colors show the change (toggle with D)", std::string(""));
+    app.args_.add_option("--daemon", "Socket of fcube-analyze serve, counts raw --inputfile and --compare files there and caches them", std::string(""));
+    app.args_.add_option("--rarity", "Hilbert .pgm from fcube-analyze rarity, shown beside the cube (toggle with M)", std::string(""));
+    app.args_.add_option("--layer", "Layer of an .fcube store to show, the first by default", std::string(""));
+    app.args_.add_option("--gpu-count", "Count the trigrams of a raw binary on the GPU", false);
+    app.args_.add_option("--gpu-chunk-mb", "Size of the chunks the binary is streamed in", 16);
+    app.args_.add_option("--gpu-min-count", "Only draw trigrams seen at least this often", 1);
+    app.args_.add_option("--gpu-max-instances", "Room in the instance buffer for GPU counted trigrams", 1 << 20);
+    app.args_.add_option("--index", "Trigram offset index from extract_trigrams.py --index", std::string(""));
+    app.args_.add_option("--validate", "Check the GPU histogram and instances against a CPU count", false);
+    app.args_.add_option("--gpu-self-test", "Count a built-in input on the GPU, check it against the CPU and exit", false);
+    app.args_.add_option("--render-mode", "cubes or points (toggle with P)", std::string("cubes"));
+    app.args_.add_option("--lod", "Distance based level of detail (toggle with L)", std::string("true"));
+    app.args_.add_option("--lod-pixels", "Coarsen a brick once its voxels would be smaller than this", 2.0f);
+    app.args_.add_option("--frame-budget-ms", "Coarsen further while frames take longer than this", 25.0f);
+    app.args_.add_option("--slice-axis", "Show only a slab along x, y or z (keys X Y Z, 0 for none)", std::string("none"));
+    app.args_.add_option("--slab-start", "First coordinate of the slab (scrub with [ and ])", 0);
+    app.args_.add_option("--slab-width", "Slab thickness in voxels (change with - and =)", 16);
+    app.args_.add_option("--record-threads", "Threads recording secondary command buffers, 0 = one per core", 0);
     app.args_.parse(argc, argv);
 
     try
@@ -0,0 +1,260 @@
+//  ██████╗ ██╗██████╗ ███████╗██╗     ██╗███╗   ██╗███████╗   ██╗  ██╗██████╗ ██████╗
+//  ██╔══██╗██║██╔══██╗██╔════╝██║     ██║████╗  ██║██╔════╝   ██║  ██║██╔══██╗██╔══██╗
+//  ██████╔╝██║██████╔╝█████╗  ██║     ██║██╔██╗ ██║█████╗     ███████║██████╔╝██████╔╝
+//  ██╔═══╝ ██║██╔═══╝ ██╔══╝  ██║     ██║██║╚██╗██║██╔══╝     ██╔══██║██╔═══╝ ██╔═══╝
+//  ██║     ██║██║     ███████╗███████╗██║██║ ╚████║███████╗██╗██║  ██║██║     ██║
+//  ╚═╝     ╚═╝╚═╝     ╚══════╝╚══════╝╚═╝╚═╝  ╚═══╝╚══════╝╚═╝╚═╝  ╚═╝╚═╝     ╚═╝
+//
+//
+//
+//
+// bounded queues and counters for staged pipelines that must not outrun their slowest stage
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <utility>
+
+// fixed capacity many-producer many-consumer ring. every cell carries a
+// sequence number telling producers and consumers whose turn it is, so a
+// push or pop is one compare-exchange on its own index and never a lock.
+// push blocks while the ring is full, which is the backpressure: a stage
+// that can't keep up slows the one feeding it instead of growing a backlog
+template <typename T>
+class bounded_queue
+{
+private:
+    struct cell
+    {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<cell[]> cells_;
+    size_t mask_;
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+    alignas(64) std::atomic<bool> closed_{false};
+
+    // spins briefly, then yields, then sleeps up to a millisecond
+    struct backoff
+    {
+        unsigned rounds = 0;
+
+        void wait()
+        {
+            if (rounds < 64)
+            {
+                // nothing, just try again
+            }
+            else if (rounds < 128)
+            {
+                std::this_thread::yield();
+            }
+            else
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(std::min(1000u, 1u << std::min(rounds - 128, 10u))));
+            }
+            rounds++;
+        }
+    };
+
+public:
+    // rounded up to a power of two
+    explicit bounded_queue(size_t capacity)
+    {
+        size_t size = 2;
+        while (size < capacity)
+        {
+            size <<= 1;
+        }
+        cells_ = std::make_unique<cell[]>(size);
+        mask_ = size - 1;
+        for (size_t i = 0; i < size; i++)
+        {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    bounded_queue(const bounded_queue &) = delete;
+    bounded_queue &operator=(const bounded_queue &) = delete;
+
+    size_t capacity() const { return mask_ + 1; }
+
+    // about how many items wait, exact only when nobody is pushing or popping
+    size_t size() const
+    {
+        size_t head = head_.load(std::memory_order_relaxed);
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        return head > tail ? head - tail : 0;
+    }
+
+    // value is moved from only on success
+    bool try_push(T &value)
+    {
+        size_t pos = head_.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            cell &c = cells_[pos & mask_];
+            size_t sequence = c.sequence.load(std::memory_order_acquire);
+            intptr_t lag = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (lag == 0)
+            {
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    c.value = std::move(value);
+                    c.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (lag < 0)
+            {
+                return false; // full
+            }
+            else
+            {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool try_pop(T &value)
+    {
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            cell &c = cells_[pos & mask_];
+            size_t sequence = c.sequence.load(std::memory_order_acquire);
+            intptr_t lag = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+            if (lag == 0)
+            {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    value = std::move(c.value);
+                    c.value = T(); // whatever it held is freed now, not when the cell comes round again
+                    c.sequence.store(pos + mask_ + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (lag < 0)
+            {
+                return false; // empty
+            }
+            else
+            {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // false only once the queue is closed
+    bool push(T value)
+    {
+        backoff wait;
+        while (!try_push(value))
+        {
+            if (closed_.load(std::memory_order_acquire))
+            {
+                return false;
+            }
+            wait.wait();
+        }
+        return true;
+    }
+
+    // false once the queue is closed and drained
+    bool pop(T &value)
+    {
+        backoff wait;
+        while (!try_pop(value))
+        {
+            if (closed_.load(std::memory_order_acquire))
+            {
+                return try_pop(value);
+            }
+            wait.wait();
+        }
+        return true;
+    }
+
+    // call after the last push, consumers still get everything already in
+    void close()
+    {
+        closed_.store(true, std::memory_order_release);
+    }
+};
+
+// what one stage did, updated by its workers as they go
+struct stage_counters
+{
+    std::atomic<uint64_t> items{0};
+    std::atomic<uint64_t> failed{0};
+    std::atomic<uint64_t> busy_ns{0};    // working on items
+    std::atomic<uint64_t> blocked_ns{0}; // waiting for room downstream
+    std::atomic<uint64_t> idle_ns{0};    // waiting for work upstream
+};
+
+// log2 buckets of microseconds, enough for percentiles of seconds long latencies
+class latency_histogram
+{
+private:
+    static constexpr size_t BUCKETS = 40;
+    std::array<std::atomic<uint64_t>, BUCKETS> buckets_{};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_us_{0};
+    std::atomic<uint64_t> max_us_{0};
+
+public:
+    void add(uint64_t us)
+    {
+        size_t bucket = 0;
+        while (bucket + 1 < BUCKETS && (us >> (bucket + 1)) != 0)
+        {
+            bucket++;
+        }
+        buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_us_.fetch_add(us, std::memory_order_relaxed);
+        uint64_t seen = max_us_.load(std::memory_order_relaxed);
+        while (us > seen && !max_us_.compare_exchange_weak(seen, us, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    uint64_t max_us() const { return max_us_.load(std::memory_order_relaxed); }
+
+    double mean_us() const
+    {
+        uint64_t n = count();
+        return n ? double(sum_us_.load(std::memory_order_relaxed)) / n : 0.0;
+    }
+
+    // the upper edge of the bucket holding quantile q, within a factor of two
+    uint64_t percentile_us(double q) const
+    {
+        uint64_t n = count();
+        if (n == 0)
+        {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(q * double(n - 1)) + 1;
+        uint64_t seen = 0;
+        for (size_t bucket = 0; bucket < BUCKETS; bucket++)
+        {
+            seen += buckets_[bucket].load(std::memory_order_relaxed);
+            if (seen >= rank)
+            {
+                return std::min(max_us(), (uint64_t(2) << bucket) - 1);
+            }
+        }
+        return max_us();
+    }
+};
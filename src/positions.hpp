@@ -0,0 +1,92 @@
+//  ██████╗  ██████╗ ███████╗██╗████████╗██╗ ██████╗ ███╗   ██╗███████╗   ██╗  ██╗██████╗ ██████╗
+//  ██╔══██╗██╔═══██╗██╔════╝██║╚══██╔══╝██║██╔═══██╗████╗  ██║██╔════╝   ██║  ██║██╔══██╗██╔══██╗
+//  ██████╔╝██║   ██║███████╗██║   ██║   ██║██║   ██║██╔██╗ ██║███████╗   ███████║██████╔╝██████╔╝
+//  ██╔═══╝ ██║   ██║╚════██║██║   ██║   ██║██║   ██║██║╚██╗██║╚════██║   ██╔══██║██╔═══╝ ██╔═══╝
+//  ██║     ╚██████╔╝███████║██║   ██║   ██║╚██████╔╝██║ ╚████║███████║██╗██║  ██║██║     ██║
+//  ╚═╝      ╚═════╝ ╚══════╝╚═╝   ╚═╝   ╚═╝ ╚═════╝ ╚═╝  ╚═══╝╚══════╝╚═╝╚═╝  ╚═╝╚═╝     ╚═╝
+//
+//
+//
+// where in its input each trigram sits: mean offset and spread per histogram bin
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "histogram_io.hpp"
+
+// offsets are counted in 1/65536ths of the input (pos16), so every file lands
+// on the same scale and a layer only needs two u16 per bin
+const uint32_t POSITION_ONE = 1 << 16;
+
+namespace positions_detail
+{
+    // pos16 sums, squared ones shifted right far enough that a whole input
+    // of them fits in 64 bits
+    struct sums
+    {
+        uint64_t sum = 0;
+        uint64_t squares = 0;
+    };
+
+    inline int square_shift(size_t size)
+    {
+        int bits = 0;
+        while (bits < 64 && (size >> bits) != 0)
+        {
+            bits++;
+        }
+        return std::max(0, bits - 32);
+    }
+}
+
+// fills layer.position_mean and layer.position_spread from a second pass over
+// the data the layer was counted from. slots is TRIGRAM_BINS of zeroed scratch
+// (a drained counts table does) and is zero again afterwards
+inline void add_positions(histogram_layer &layer, const uint8_t *data, size_t size, uint32_t *slots)
+{
+    size_t n = layer.bins.size();
+    layer.position_mean.assign(n, 0);
+    layer.position_spread.assign(n, 0);
+    if (n == 0 || size < 3)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        slots[layer.bins[i]] = static_cast<uint32_t>(i);
+    }
+
+    // pos16 of offset i is (i * scale) >> 32, a multiply instead of a divide
+    // per byte. i * scale stays below 2^48 for any i < size
+    uint64_t scale = (uint64_t(1) << 48) / size;
+    int shift = positions_detail::square_shift(size);
+    std::vector<positions_detail::sums> sums(n);
+
+    uint32_t key = uint32_t(data[0]) << 8 | data[1];
+    for (size_t i = 2; i < size; ++i)
+    {
+        key = (key << 8 | data[i]) & (TRIGRAM_BINS - 1);
+        uint64_t position = ((i - 2) * scale) >> 32;
+        auto &entry = sums[slots[key]];
+        entry.sum += position;
+        entry.squares += (position * position) >> shift;
+    }
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        slots[layer.bins[i]] = 0;
+
+        double count = static_cast<double>(std::max<uint64_t>(layer.counts[i], 1));
+        double mean = sums[i].sum / count;
+        double variance = std::ldexp(static_cast<double>(sums[i].squares), shift) / count - mean * mean;
+        double spread = std::sqrt(std::max(variance, 0.0));
+        layer.position_mean[i] = static_cast<uint16_t>(std::min(std::lround(mean), 65535l));
+        layer.position_spread[i] = static_cast<uint16_t>(std::min(std::lround(spread), 65535l));
+    }
+}
@@ -0,0 +1,182 @@
+//  ██████╗ ██╗   ██╗██████╗  █████╗ ███╗   ███╗██╗██████╗    ██╗  ██╗██████╗ ██████╗
+//  ██╔══██╗╚██╗ ██╔╝██╔══██╗██╔══██╗████╗ ████║██║██╔══██╗   ██║  ██║██╔══██╗██╔══██╗
+//  ██████╔╝ ╚████╔╝ ██████╔╝███████║██╔████╔██║██║██║  ██║   ███████║██████╔╝██████╔╝
+//  ██╔═══╝   ╚██╔╝  ██╔══██╗██╔══██║██║╚██╔╝██║██║██║  ██║   ██╔══██║██╔═══╝ ██╔═══╝
+//  ██║        ██║   ██║  ██║██║  ██║██║ ╚═╝ ██║██║██████╔╝██╗██║  ██║██║     ██║
+//  ╚═╝        ╚═╝   ╚═╝  ╚═╝╚═╝  ╚═╝╚═╝     ╚═╝╚═╝╚═════╝ ╚═╝╚═╝  ╚═╝╚═╝     ╚═╝
+//
+// histogram mip pyramid for distance based level of detail
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "trigram.hpp"
+
+// level 0 is the 256³ trigram space itself, every level above it halves each
+// axis (128³, 64³, 32³, 16³) and sums the counts of the 8 cells below
+const int PYRAMID_LEVELS = 5;
+
+// the space is cut into 16³ bricks of level 0 voxels, a level is picked per
+// brick, and any brick at any level is one contiguous run of cells
+const int BRICK_SIZE = 16;
+const int BRICKS_PER_AXIS = 256 / BRICK_SIZE;
+const int BRICK_COUNT = BRICKS_PER_AXIS * BRICKS_PER_AXIS * BRICKS_PER_AXIS;
+
+struct pyramid_cell
+{
+    int x, y, z; // in cells of this level
+    int64_t count;
+    float position = -1.0f; // as in Voxel, pooled over the cells below
+    float spread = 0.0f;
+    float delta = 0.0f; // summed over the cells below
+};
+
+class voxel_pyramid
+{
+private:
+    std::array<std::vector<pyramid_cell>, PYRAMID_LEVELS> cells_;
+    std::array<std::vector<uint32_t>, PYRAMID_LEVELS> offsets_;
+    std::array<int64_t, PYRAMID_LEVELS> max_count_{};
+
+public:
+    static int cell_size(int level)
+    {
+        return 1 << level;
+    }
+
+    static int brick_of(const pyramid_cell &cell, int level)
+    {
+        int shift = 4 - level; // BRICK_SIZE >> level cells per brick axis
+        return ((cell.z >> shift) * BRICKS_PER_AXIS + (cell.y >> shift)) * BRICKS_PER_AXIS + (cell.x >> shift);
+    }
+
+    void build(const std::vector<Voxel> &voxels)
+    {
+        // level 0: bucket the voxels by brick, a counting sort keeps input order
+        std::vector<pyramid_cell> base;
+        base.reserve(voxels.size());
+        for (const auto &voxel : voxels)
+        {
+            if (voxel.x < 0 || voxel.x > 255 || voxel.y < 0 || voxel.y > 255 || voxel.z < 0 || voxel.z > 255)
+            {
+                throw std::runtime_error("Voxel outside the 256^3 trigram space: " +
+                                         std::to_string(voxel.x) + "," + std::to_string(voxel.y) + "," + std::to_string(voxel.z));
+            }
+            base.push_back({voxel.x, voxel.y, voxel.z, static_cast<int64_t>(voxel.count), voxel.position, voxel.spread, voxel.delta});
+        }
+        bucket(0, base);
+
+        for (int level = 1; level < PYRAMID_LEVELS; level++)
+        {
+            const auto &below = cells_[level - 1];
+            std::vector<pyramid_cell> merged;
+
+            // parents never leave their brick, so each brick merges on its own
+            for (int brick = 0; brick < BRICK_COUNT; brick++)
+            {
+                size_t first = merged.size();
+                for (uint32_t i = offsets_[level - 1][brick]; i < offsets_[level - 1][brick + 1]; i++)
+                {
+                    merged.push_back({below[i].x >> 1, below[i].y >> 1, below[i].z >> 1, below[i].count,
+                                      below[i].position, below[i].spread, below[i].delta});
+                }
+
+                auto key = [](const pyramid_cell &c)
+                { return (c.z << 16) | (c.y << 8) | c.x; };
+                std::sort(merged.begin() + first, merged.end(), [&](const pyramid_cell &a, const pyramid_cell &b)
+                          { return key(a) < key(b); });
+
+                size_t out = first;
+                for (size_t i = first; i < merged.size(); i++)
+                {
+                    if (out > first && key(merged[out - 1]) == key(merged[i]))
+                    {
+                        pool_positions(merged[out - 1], merged[i]);
+                        merged[out - 1].count += merged[i].count;
+                        merged[out - 1].delta += merged[i].delta;
+                    }
+                    else
+                    {
+                        merged[out++] = merged[i];
+                    }
+                }
+                merged.resize(out);
+            }
+
+            bucket(level, merged);
+        }
+    }
+
+    const std::vector<pyramid_cell> &cells(int level) const
+    {
+        return cells_[level];
+    }
+
+    // [brick_begin, brick_end) indexes cells(level)
+    uint32_t brick_begin(int level, int brick) const
+    {
+        return offsets_[level][brick];
+    }
+
+    uint32_t brick_end(int level, int brick) const
+    {
+        return offsets_[level][brick + 1];
+    }
+
+    int64_t max_count(int level) const
+    {
+        return max_count_[level];
+    }
+
+private:
+    // count weighted mean of the two, and the spread of the union of their
+    // offsets: E[x^2] pooled, minus the new mean squared
+    static void pool_positions(pyramid_cell &into, const pyramid_cell &from)
+    {
+        if (into.position < 0.0f || from.position < 0.0f)
+        {
+            into.position = -1.0f;
+            return;
+        }
+
+        double a = static_cast<double>(into.count);
+        double b = static_cast<double>(from.count);
+        double total = std::max(a + b, 1.0);
+        double mean = (a * into.position + b * from.position) / total;
+        double square = (a * (into.spread * into.spread + into.position * into.position) +
+                         b * (from.spread * from.spread + from.position * from.position)) / total;
+        into.position = static_cast<float>(mean);
+        into.spread = static_cast<float>(std::sqrt(std::max(square - mean * mean, 0.0)));
+    }
+
+    void bucket(int level, const std::vector<pyramid_cell> &cells)
+    {
+        auto &offsets = offsets_[level];
+        offsets.assign(BRICK_COUNT + 1, 0);
+        for (const auto &cell : cells)
+        {
+            offsets[brick_of(cell, level) + 1]++;
+        }
+        for (int brick = 0; brick < BRICK_COUNT; brick++)
+        {
+            offsets[brick + 1] += offsets[brick];
+        }
+
+        std::vector<uint32_t> next(offsets.begin(), offsets.end() - 1);
+        auto &sorted = cells_[level];
+        sorted.resize(cells.size());
+        max_count_[level] = 0;
+        for (const auto &cell : cells)
+        {
+            sorted[next[brick_of(cell, level)]++] = cell;
+            max_count_[level] = std::max(max_count_[level], cell.count);
+        }
+    }
+};
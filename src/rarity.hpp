@@ -0,0 +1,261 @@
+//  ██████╗  █████╗ ██████╗ ██╗████████╗██╗   ██╗   ██╗  ██╗██████╗ ██████╗
+//  ██╔══██╗██╔══██╗██╔══██╗██║╚══██╔══╝╚██╗ ██╔╝   ██║  ██║██╔══██╗██╔══██╗
+//  ██████╔╝███████║██████╔╝██║   ██║    ╚████╔╝    ███████║██████╔╝██████╔╝
+//  ██╔══██╗██╔══██║██╔══██╗██║   ██║     ╚██╔╝     ██╔══██║██╔═══╝ ██╔═══╝
+//  ██║  ██║██║  ██║██║  ██║██║   ██║      ██║   ██╗██║  ██║██║     ██║
+//  ╚═╝  ╚═╝╚═╝  ╚═╝╚═╝  ╚═╝╚═╝   ╚═╝      ╚═╝   ╚═╝╚═╝  ╚═╝╚═╝     ╚═╝
+//
+//
+//
+//
+// the histogram projected back onto the file: how unusual the trigrams around every offset are, as a hilbert curve image
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "tasks.hpp"
+#include "trigram.hpp"
+
+// surprisal is averaged over blocks and a cell keeps its rarest block, so an
+// island of a few hundred bytes still lights up a cell of megabytes
+constexpr size_t RARITY_BLOCK = 64;
+
+// trigram starts looked ahead when prefetching their count, about the
+// latency of a cache miss into the 64 MB table
+constexpr size_t RARITY_PREFETCH = 16;
+
+// input bytes per task, whole cells each, so tasks never share a cell
+constexpr size_t RARITY_TILE = size_t(16) << 20;
+
+struct rarity_map
+{
+    uint32_t side = 0;       // side x side cells
+    uint64_t cell_bytes = 0; // input bytes per cell, a multiple of RARITY_BLOCK
+    uint64_t input_size = 0;
+    std::vector<float> cells; // along the curve, bits of surprisal, 0 past the end of the input
+};
+
+// a greyscale image of a map, rows of pixels, as written to and read from .pgm
+struct rarity_image
+{
+    uint32_t side = 0;
+    uint64_t cell_bytes = 0;
+    uint64_t input_size = 0;
+    std::vector<uint8_t> pixels;
+};
+
+namespace rarity_detail
+{
+    inline void rotate(uint32_t n, uint32_t &x, uint32_t &y, uint32_t rx, uint32_t ry)
+    {
+        if (ry == 0)
+        {
+            if (rx == 1)
+            {
+                x = n - 1 - x;
+                y = n - 1 - y;
+            }
+            std::swap(x, y);
+        }
+    }
+
+    // exponent plus the mantissa as a straight line, within 0.09 bits
+    inline float fast_log2(uint32_t count)
+    {
+        float f = static_cast<float>(count);
+        uint32_t bits;
+        std::memcpy(&bits, &f, sizeof(bits));
+        return static_cast<float>(static_cast<int>(bits >> 23) - 127) + static_cast<float>(bits & 0x7fffff) * (1.0f / (1 << 23));
+    }
+
+    inline uint32_t bin_at(const uint8_t *data, size_t i)
+    {
+        return trigram_bin(data[i], data[i + 1], data[i + 2]);
+    }
+}
+
+// cell d of a side x side hilbert curve, side a power of two
+inline void hilbert_point(uint32_t side, uint64_t d, uint32_t &x, uint32_t &y)
+{
+    x = y = 0;
+    for (uint32_t s = 1; s < side; s *= 2)
+    {
+        uint32_t rx = 1 & static_cast<uint32_t>(d / 2);
+        uint32_t ry = 1 & static_cast<uint32_t>(d ^ rx);
+        rarity_detail::rotate(s, x, y, rx, ry);
+        x += s * rx;
+        y += s * ry;
+        d /= 4;
+    }
+}
+
+inline uint64_t hilbert_index(uint32_t side, uint32_t x, uint32_t y)
+{
+    uint64_t d = 0;
+    for (uint32_t s = side / 2; s > 0; s /= 2)
+    {
+        uint32_t rx = (x & s) ? 1 : 0;
+        uint32_t ry = (y & s) ? 1 : 0;
+        d += uint64_t(s) * s * ((3 * rx) ^ ry);
+        rarity_detail::rotate(side, x, y, rx, ry);
+    }
+    return d;
+}
+
+// cells [first, last) of map. counts is the dense histogram of all of data
+// and log_total log2 of its sum. the count of the trigram RARITY_PREFETCH
+// starts ahead is prefetched, the table is far too big for the cache
+inline void rarity_cells(const uint8_t *data, size_t size, const uint32_t *counts, float log_total, rarity_map &map,
+                         size_t first, size_t last)
+{
+    size_t starts = size >= 3 ? size - 2 : 0;
+    for (size_t cell = first; cell < last; cell++)
+    {
+        uint64_t begin = cell * map.cell_bytes;
+        uint64_t end = std::min<uint64_t>(begin + map.cell_bytes, starts);
+        float best = 0.0f;
+        for (uint64_t block = begin; block < end; block += RARITY_BLOCK)
+        {
+            uint64_t stop = std::min<uint64_t>(block + RARITY_BLOCK, end);
+            float sum = 0.0f;
+            for (uint64_t i = block; i < stop; i++)
+            {
+                if (i + RARITY_PREFETCH < starts)
+                {
+                    __builtin_prefetch(&counts[rarity_detail::bin_at(data, i + RARITY_PREFETCH)]);
+                }
+                sum += rarity_detail::fast_log2(std::max<uint32_t>(counts[rarity_detail::bin_at(data, i)], 1));
+            }
+            best = std::max(best, log_total - sum / static_cast<float>(stop - block));
+        }
+        map.cells[cell] = best;
+    }
+}
+
+// side must be a power of two. tiles of RARITY_TILE bytes go to the pool
+// when there is one, so a file of many GB is only ever touched a tile at a time
+inline rarity_map make_rarity_map(const uint8_t *data, size_t size, const uint32_t *counts, uint64_t total, uint32_t side,
+                                  work_stealing_pool *pool = nullptr)
+{
+    if (side < 2 || (side & (side - 1)) != 0)
+    {
+        throw std::runtime_error("Rarity map side must be a power of two");
+    }
+
+    rarity_map map;
+    map.side = side;
+    map.input_size = size;
+    uint64_t cell_count = uint64_t(side) * side;
+    uint64_t per_cell = std::max<uint64_t>((size + cell_count - 1) / cell_count, 1);
+    map.cell_bytes = (per_cell + RARITY_BLOCK - 1) / RARITY_BLOCK * RARITY_BLOCK;
+    map.cells.assign(cell_count, 0.0f);
+
+    float log_total = static_cast<float>(std::log2(static_cast<double>(std::max<uint64_t>(total, 1))));
+    size_t used = static_cast<size_t>(std::min<uint64_t>((size + map.cell_bytes - 1) / map.cell_bytes, cell_count));
+    size_t tile_cells = static_cast<size_t>(std::max<uint64_t>(RARITY_TILE / map.cell_bytes, 1));
+    if (!pool)
+    {
+        rarity_cells(data, size, counts, log_total, map, 0, used);
+        return map;
+    }
+
+    std::vector<work_stealing_pool::task> tasks;
+    for (size_t first = 0; first < used; first += tile_cells)
+    {
+        size_t last = std::min(first + tile_cells, used);
+        tasks.push_back([&, first, last](size_t)
+                        { rarity_cells(data, size, counts, log_total, map, first, last); });
+    }
+    pool->run(std::move(tasks));
+    return map;
+}
+
+// the rarest cell comes out white
+inline rarity_image rarity_pixels(const rarity_map &map)
+{
+    rarity_image image;
+    image.side = map.side;
+    image.cell_bytes = map.cell_bytes;
+    image.input_size = map.input_size;
+    image.pixels.assign(map.cells.size(), 0);
+
+    float top = *std::max_element(map.cells.begin(), map.cells.end());
+    float scale = top > 0.0f ? 255.0f / top : 0.0f;
+    for (uint64_t d = 0; d < map.cells.size(); d++)
+    {
+        uint32_t x, y;
+        hilbert_point(map.side, d, x, y);
+        image.pixels[uint64_t(y) * map.side + x] = static_cast<uint8_t>(std::lround(map.cells[d] * scale));
+    }
+    return image;
+}
+
+// binary pgm, any viewer opens it. a comment keeps what a pixel stands for
+inline void write_rarity_pgm(const std::string &path, const rarity_image &image)
+{
+    std::ofstream out(path, std::ios::binary);
+    out << "P5\n# fcube-rarity " << image.input_size << " " << image.cell_bytes << "\n"
+        << image.side << " " << image.side << "\n255\n";
+    out.write(reinterpret_cast<const char *>(image.pixels.data()), static_cast<std::streamsize>(image.pixels.size()));
+    if (!out)
+    {
+        throw std::runtime_error("Failed to write " + path);
+    }
+}
+
+inline rarity_image read_rarity_pgm(const std::string &path)
+{
+    std::ifstream in(path, std::ios::binary);
+    std::string magic;
+    if (!(in >> magic) || magic != "P5")
+    {
+        throw std::runtime_error("Not a binary pgm: " + path);
+    }
+
+    rarity_image image;
+    uint64_t header[3] = {};
+    for (int read = 0; read < 3;)
+    {
+        in >> std::ws;
+        if (in.peek() == '#')
+        {
+            std::string comment;
+            std::getline(in, comment);
+            std::istringstream fields(comment);
+            std::string hash, tag;
+            if (fields >> hash >> tag && tag == "fcube-rarity")
+            {
+                fields >> image.input_size >> image.cell_bytes;
+            }
+            continue;
+        }
+        if (!(in >> header[read++]))
+        {
+            throw std::runtime_error("Bad pgm header in " + path);
+        }
+    }
+    if (header[0] != header[1] || header[0] == 0 || header[0] > 1 << 14 || header[2] != 255)
+    {
+        throw std::runtime_error("Expected a square 8 bit pgm: " + path);
+    }
+    in.get(); // the one whitespace byte before the pixels
+
+    image.side = static_cast<uint32_t>(header[0]);
+    image.pixels.resize(uint64_t(image.side) * image.side);
+    in.read(reinterpret_cast<char *>(image.pixels.data()), static_cast<std::streamsize>(image.pixels.size()));
+    if (!in)
+    {
+        throw std::runtime_error("Truncated pgm: " + path);
+    }
+    return image;
+}
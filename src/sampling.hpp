@@ -0,0 +1,192 @@
+//  ███████╗ █████╗ ███╗   ███╗██████╗ ██╗     ██╗███╗   ██╗ ██████╗    ██╗  ██╗██████╗ ██████╗
+//  ██╔════╝██╔══██╗████╗ ████║██╔══██╗██║     ██║████╗  ██║██╔════╝    ██║  ██║██╔══██╗██╔══██╗
+//  ███████╗███████║██╔████╔██║██████╔╝██║     ██║██╔██╗ ██║██║  ███╗   ███████║██████╔╝██████╔╝
+//  ╚════██║██╔══██║██║╚██╔╝██║██╔═══╝ ██║     ██║██║╚██╗██║██║   ██║   ██╔══██║██╔═══╝ ██╔═══╝
+//  ███████║██║  ██║██║ ╚═╝ ██║██║     ███████╗██║██║ ╚████║╚██████╔╝██╗██║  ██║██║     ██║
+//  ╚══════╝╚═╝  ╚═╝╚═╝     ╚═╝╚═╝     ╚══════╝╚═╝╚═╝  ╚═══╝ ╚═════╝ ╚═╝╚═╝  ╚═╝╚═╝     ╚═╝
+//
+//
+//
+//
+// estimates of a huge input's histogram from stratified random blocks, refined until it is exact
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include "histogram_io.hpp"
+
+// big enough that a read is one sequential request, small enough that the
+// first second of sampling already touches every part of the input
+constexpr uint64_t SAMPLE_BLOCK = uint64_t(1) << 20;
+
+// the input is cut into this many equal stretches and every round of blocks
+// takes one from each, so no region goes unsampled by bad luck
+constexpr size_t SAMPLE_STRATA = 64;
+
+// the trigrams starting in [offset, offset + length), which needs length + 2
+// bytes of input from offset
+struct sample_block
+{
+    uint64_t offset;
+    uint64_t length;
+};
+
+// the order blocks of one input are read in. every block comes up exactly
+// once, so reading the plan to the end counts the whole input
+class sample_plan
+{
+private:
+    uint64_t positions_;
+    uint64_t block_bytes_;
+    std::vector<uint64_t> order_;
+    size_t read_ = 0;
+    uint64_t sampled_ = 0;
+
+public:
+    sample_plan(uint64_t input_size, uint64_t block_bytes = SAMPLE_BLOCK, size_t strata = SAMPLE_STRATA, uint64_t seed = 1)
+        : positions_(input_size > 2 ? input_size - 2 : 0), block_bytes_(std::max<uint64_t>(block_bytes, 1))
+    {
+        uint64_t blocks = (positions_ + block_bytes_ - 1) / block_bytes_;
+        if (blocks == 0)
+        {
+            return;
+        }
+        strata = static_cast<size_t>(std::clamp<uint64_t>(strata, 1, blocks));
+
+        // each stratum shuffled on its own, then dealt out a round at a time
+        // with the strata in a fresh order every round
+        std::mt19937_64 rng(seed);
+        std::vector<std::vector<uint64_t>> stratum(strata);
+        for (size_t s = 0; s < strata; ++s)
+        {
+            uint64_t first = blocks * s / strata;
+            uint64_t last = blocks * (s + 1) / strata;
+            stratum[s].resize(last - first);
+            std::iota(stratum[s].begin(), stratum[s].end(), first);
+            std::shuffle(stratum[s].begin(), stratum[s].end(), rng);
+        }
+
+        std::vector<size_t> visit(strata);
+        std::iota(visit.begin(), visit.end(), 0);
+        order_.reserve(blocks);
+        for (size_t round = 0; order_.size() < blocks; ++round)
+        {
+            std::shuffle(visit.begin(), visit.end(), rng);
+            for (size_t s : visit)
+            {
+                if (round < stratum[s].size())
+                {
+                    order_.push_back(stratum[s][round]);
+                }
+            }
+        }
+    }
+
+    uint64_t positions() const
+    {
+        return positions_;
+    }
+
+    uint64_t blocks() const
+    {
+        return order_.size();
+    }
+
+    uint64_t blocks_read() const
+    {
+        return read_;
+    }
+
+    bool done() const
+    {
+        return read_ == order_.size();
+    }
+
+    // the next count blocks (fewer at the end), which count as sampled from now on
+    std::vector<sample_block> next(size_t count)
+    {
+        std::vector<sample_block> blocks;
+        while (blocks.size() < count && read_ < order_.size())
+        {
+            uint64_t offset = order_[read_++] * block_bytes_;
+            uint64_t length = std::min(block_bytes_, positions_ - offset);
+            blocks.push_back({offset, length});
+            sampled_ += length;
+        }
+        return blocks;
+    }
+
+    fcube_sample record() const
+    {
+        return {sampled_, positions_, read_, order_.size()};
+    }
+};
+
+// an estimate of the whole input from the counts of the blocks read so far
+inline histogram_layer estimate_layer(const histogram_layer &sampled, const fcube_sample &sample)
+{
+    histogram_layer layer;
+    layer.name = sampled.name;
+    layer.sample = sample;
+    layer.bins = sampled.bins;
+    layer.counts.resize(sampled.counts.size());
+    double scale = sample.sampled ? double(sample.positions) / sample.sampled : 0.0;
+    for (size_t i = 0; i < sampled.counts.size(); ++i)
+    {
+        layer.counts[i] = static_cast<uint64_t>(std::llround(sampled.counts[i] * scale));
+        layer.total += layer.counts[i];
+    }
+    return layer;
+}
+
+// the count entry i of an estimate was scaled up from. rounding moved the
+// estimate by at most half, which scales back down to less than half
+inline uint64_t sampled_count(const histogram_layer &layer, size_t i)
+{
+    const fcube_sample &sample = layer.sample;
+    if (sample.positions == 0)
+    {
+        return layer.counts[i];
+    }
+    return static_cast<uint64_t>(std::llround(layer.counts[i] * (double(sample.sampled) / sample.positions)));
+}
+
+struct count_interval
+{
+    double low;
+    double high;
+};
+
+// wilson score interval for a trigram seen `count` times in the sample,
+// scaled to the whole input. the finite population correction shrinks it to
+// nothing once the sample is the whole input. it takes the sampled positions
+// as independent draws, which neighbours in one block are not, so on clumpy
+// inputs the truth can stray further than z suggests
+inline count_interval wilson_interval(uint64_t count, const fcube_sample &sample, double z = 1.96)
+{
+    double n = static_cast<double>(sample.sampled);
+    double total = static_cast<double>(sample.positions);
+    if (sample.sampled == 0)
+    {
+        return {0.0, total};
+    }
+
+    double correction = sample.sampled < sample.positions ? std::sqrt((total - n) / (total - 1)) : 0.0;
+    double zz = z * correction;
+    double p = count / n;
+    double denominator = 1 + zz * zz / n;
+    double center = (p + zz * zz / (2 * n)) / denominator;
+    double half = zz / denominator * std::sqrt(p * (1 - p) / n + zz * zz / (4 * n * n));
+
+    // the sampled ones are certain, the unsampled positions could all be it or none
+    double low = std::max(total * (center - half), double(count));
+    double high = std::min(total * (center + half), total - (n - count));
+    return {low, std::max(low, high)};
+}
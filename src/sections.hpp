@@ -0,0 +1,290 @@
+//  ███████╗███████╗ ██████╗████████╗██╗ ██████╗ ███╗   ██╗███████╗   ██╗  ██╗██████╗ ██████╗
+//  ██╔════╝██╔════╝██╔════╝╚══██╔══╝██║██╔═══██╗████╗  ██║██╔════╝   ██║  ██║██╔══██╗██╔══██╗
+//  ███████╗█████╗  ██║        ██║   ██║██║   ██║██╔██╗ ██║███████╗   ███████║██████╔╝██████╔╝
+//  ╚════██║██╔══╝  ██║        ██║   ██║██║   ██║██║╚██╗██║╚════██║   ██╔══██║██╔═══╝ ██╔═══╝
+//  ███████║███████╗╚██████╗   ██║   ██║╚██████╔╝██║ ╚████║███████║██╗██║  ██║██║     ██║
+//  ╚══════╝╚══════╝ ╚═════╝   ╚═╝   ╚═╝ ╚═════╝ ╚═╝  ╚═══╝╚══════╝╚═╝╚═╝  ╚═╝╚═╝     ╚═╝
+//
+//
+//
+//
+// where the sections of an ELF, PE or Mach-O file lie, read in place from its mapping
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+struct binary_section
+{
+    std::string name;
+    uint64_t offset = 0;
+    uint64_t size = 0;
+};
+
+struct binary_layout
+{
+    std::string format; // elf32, elf64, pe, mach-o32, mach-o64 or mach-o fat
+    std::vector<binary_section> sections;
+};
+
+namespace sections_detail
+{
+    // bounds checked loads in either byte order, nothing is copied out but the names
+    struct reader
+    {
+        const uint8_t *data;
+        size_t size;
+        bool big = false;
+
+        template <typename T>
+        T get(uint64_t offset) const
+        {
+            if (offset > size || sizeof(T) > size - offset)
+            {
+                throw std::runtime_error("Truncated executable header");
+            }
+            T value = 0;
+            for (size_t i = 0; i < sizeof(T); i++)
+            {
+                value |= static_cast<T>(data[offset + i]) << (8 * (big ? sizeof(T) - 1 - i : i));
+            }
+            return value;
+        }
+
+        // up to the first nul or max bytes
+        std::string text(uint64_t offset, size_t max) const
+        {
+            std::string out;
+            for (uint64_t at = offset; at < size && out.size() < max && data[at]; at++)
+            {
+                out += static_cast<char>(data[at]);
+            }
+            return out;
+        }
+    };
+
+    // sections reaching past the end of the file (a truncated sample) are cut at it
+    inline void add(binary_layout &layout, std::string name, uint64_t offset, uint64_t size, uint64_t file_size)
+    {
+        if (size == 0 || offset >= file_size)
+        {
+            return;
+        }
+        layout.sections.push_back({std::move(name), offset, std::min(size, file_size - offset)});
+    }
+
+    // section headers when there are any, else the loadable segments
+    inline binary_layout parse_elf(const reader &r)
+    {
+        constexpr uint32_t SHT_NOBITS = 8;
+        constexpr uint32_t PT_LOAD = 1;
+
+        bool wide = r.data[4] == 2;
+        binary_layout layout;
+        layout.format = wide ? "elf64" : "elf32";
+
+        uint64_t shoff = wide ? r.get<uint64_t>(40) : r.get<uint32_t>(32);
+        uint64_t shentsize = r.get<uint16_t>(wide ? 58 : 46);
+        uint64_t shnum = r.get<uint16_t>(wide ? 60 : 48);
+        uint64_t shstrndx = r.get<uint16_t>(wide ? 62 : 50);
+        if (shoff != 0 && shentsize >= (wide ? 64u : 40u))
+        {
+            // past 0xff00 sections the real count and string table index live in section 0
+            if (shnum == 0)
+            {
+                shnum = wide ? r.get<uint64_t>(shoff + 32) : r.get<uint32_t>(shoff + 20);
+            }
+            if (shstrndx == 0xffff)
+            {
+                shstrndx = r.get<uint32_t>(shoff + (wide ? 40 : 24));
+            }
+            shnum = std::min<uint64_t>(shnum, (r.size - std::min<uint64_t>(shoff, r.size)) / shentsize);
+
+            uint64_t strtab = 0;
+            if (shstrndx < shnum)
+            {
+                uint64_t header = shoff + shstrndx * shentsize;
+                strtab = wide ? r.get<uint64_t>(header + 24) : r.get<uint32_t>(header + 16);
+            }
+            for (uint64_t i = 1; i < shnum; i++)
+            {
+                uint64_t header = shoff + i * shentsize;
+                uint32_t type = r.get<uint32_t>(header + 4);
+                if (type == SHT_NOBITS || type == 0)
+                {
+                    continue;
+                }
+                uint64_t offset = wide ? r.get<uint64_t>(header + 24) : r.get<uint32_t>(header + 16);
+                uint64_t size = wide ? r.get<uint64_t>(header + 32) : r.get<uint32_t>(header + 20);
+                std::string name = strtab ? r.text(strtab + r.get<uint32_t>(header), 64) : "";
+                add(layout, name.empty() ? "section " + std::to_string(i) : name, offset, size, r.size);
+            }
+        }
+        if (!layout.sections.empty())
+        {
+            return layout;
+        }
+
+        uint64_t phoff = wide ? r.get<uint64_t>(32) : r.get<uint32_t>(28);
+        uint64_t phentsize = r.get<uint16_t>(wide ? 54 : 42);
+        uint64_t phnum = r.get<uint16_t>(wide ? 56 : 44);
+        if (phoff == 0 || phentsize < (wide ? 56u : 32u))
+        {
+            return layout;
+        }
+        phnum = std::min<uint64_t>(phnum, (r.size - std::min<uint64_t>(phoff, r.size)) / phentsize);
+        for (uint64_t i = 0; i < phnum; i++)
+        {
+            uint64_t header = phoff + i * phentsize;
+            if (r.get<uint32_t>(header) != PT_LOAD)
+            {
+                continue;
+            }
+            uint64_t offset = wide ? r.get<uint64_t>(header + 8) : r.get<uint32_t>(header + 4);
+            uint64_t size = wide ? r.get<uint64_t>(header + 32) : r.get<uint32_t>(header + 16);
+            add(layout, "segment " + std::to_string(i), offset, size, r.size);
+        }
+        return layout;
+    }
+
+    // the section table, plus whatever is appended after the last section
+    inline binary_layout parse_pe(const reader &r)
+    {
+        binary_layout layout;
+        layout.format = "pe";
+        uint64_t pe = r.get<uint32_t>(0x3c);
+        if (r.get<uint32_t>(pe) != 0x00004550)
+        {
+            throw std::runtime_error("Not an ELF, PE or Mach-O file");
+        }
+        uint64_t count = r.get<uint16_t>(pe + 6);
+        uint64_t table = pe + 24 + r.get<uint16_t>(pe + 20);
+
+        uint64_t end = 0;
+        for (uint64_t i = 0; i < count; i++)
+        {
+            uint64_t header = table + i * 40;
+            std::string name = r.text(header, 8);
+            uint64_t size = r.get<uint32_t>(header + 16);
+            uint64_t offset = r.get<uint32_t>(header + 20);
+            add(layout, name.empty() ? "section " + std::to_string(i) : name, offset, size, r.size);
+            if (size && offset < r.size)
+            {
+                end = std::max(end, offset + size);
+            }
+        }
+        if (end && end < r.size)
+        {
+            add(layout, "overlay", end, r.size - end, r.size);
+        }
+        return layout;
+    }
+
+    // segment,section like otool, and a segment with no sections (__LINKEDIT) as itself
+    inline void parse_macho(const reader &whole, uint64_t base, uint64_t size, const std::string &prefix, binary_layout &layout)
+    {
+        constexpr uint32_t LC_SEGMENT = 0x1;
+        constexpr uint32_t LC_SEGMENT_64 = 0x19;
+
+        if (base > whole.size || size > whole.size - base)
+        {
+            throw std::runtime_error("Truncated executable header");
+        }
+        reader r{whole.data + base, static_cast<size_t>(size)};
+        uint32_t magic = r.get<uint32_t>(0);
+        r.big = magic == 0xcefaedfe || magic == 0xcffaedfe;
+        bool wide = magic == 0xfeedfacf || magic == 0xcffaedfe;
+        if (!wide && magic != 0xfeedface && magic != 0xcefaedfe)
+        {
+            throw std::runtime_error("Not a Mach-O slice");
+        }
+        if (layout.format.empty())
+        {
+            layout.format = wide ? "mach-o64" : "mach-o32";
+        }
+
+        uint32_t commands = r.get<uint32_t>(16);
+        uint64_t at = wide ? 32 : 28;
+        for (uint32_t c = 0; c < commands; c++)
+        {
+            uint32_t cmd = r.get<uint32_t>(at);
+            uint32_t cmdsize = r.get<uint32_t>(at + 4);
+            if (cmdsize < 8)
+            {
+                throw std::runtime_error("Corrupt Mach-O load command");
+            }
+            if (cmd == LC_SEGMENT || cmd == LC_SEGMENT_64)
+            {
+                bool segment64 = cmd == LC_SEGMENT_64;
+                std::string segment = r.text(at + 8, 16);
+                uint64_t fileoff = segment64 ? r.get<uint64_t>(at + 40) : r.get<uint32_t>(at + 32);
+                uint64_t filesize = segment64 ? r.get<uint64_t>(at + 48) : r.get<uint32_t>(at + 36);
+                uint32_t nsects = r.get<uint32_t>(at + (segment64 ? 64 : 48));
+                uint64_t header = at + (segment64 ? 72 : 56);
+                uint64_t stride = segment64 ? 80 : 68;
+                if (nsects == 0)
+                {
+                    add(layout, prefix + segment, base + fileoff, filesize, whole.size);
+                }
+                for (uint32_t s = 0; s < nsects && header + stride <= at + cmdsize; s++, header += stride)
+                {
+                    uint32_t type = r.get<uint32_t>(header + (segment64 ? 64 : 56)) & 0xff;
+                    if (type == 0x1 || type == 0xc || type == 0x12)
+                    {
+                        continue; // zerofill, nothing in the file
+                    }
+                    uint64_t sectsize = segment64 ? r.get<uint64_t>(header + 40) : r.get<uint32_t>(header + 36);
+                    uint64_t offset = r.get<uint32_t>(header + (segment64 ? 48 : 40));
+                    add(layout, prefix + segment + "," + r.text(header, 16), base + offset, sectsize, whole.size);
+                }
+            }
+            at += cmdsize;
+        }
+    }
+}
+
+// throws for anything that is none of the three
+inline binary_layout parse_sections(const uint8_t *data, size_t size)
+{
+    sections_detail::reader r{data, size};
+    if (size >= 16 && data[0] == 0x7f && data[1] == 'E' && data[2] == 'L' && data[3] == 'F' &&
+        (data[4] == 1 || data[4] == 2) && (data[5] == 1 || data[5] == 2))
+    {
+        r.big = data[5] == 2;
+        return sections_detail::parse_elf(r);
+    }
+    if (size >= 0x40 && data[0] == 'M' && data[1] == 'Z')
+    {
+        return sections_detail::parse_pe(r);
+    }
+
+    uint32_t magic = size >= 4 ? r.get<uint32_t>(0) : 0;
+    binary_layout layout;
+    if (magic == 0xfeedface || magic == 0xfeedfacf || magic == 0xcefaedfe || magic == 0xcffaedfe)
+    {
+        sections_detail::parse_macho(r, 0, size, "", layout);
+        return layout;
+    }
+
+    // a universal binary, one slice per architecture. java class files share
+    // the magic but their version is never this small an arch count
+    r.big = true;
+    if (size >= 8 && r.get<uint32_t>(0) == 0xcafebabe && r.get<uint32_t>(4) > 0 && r.get<uint32_t>(4) < 32)
+    {
+        layout.format = "mach-o fat";
+        uint32_t arches = r.get<uint32_t>(4);
+        for (uint32_t a = 0; a < arches; a++)
+        {
+            uint64_t entry = 8 + uint64_t(a) * 20;
+            sections_detail::parse_macho(r, r.get<uint32_t>(entry + 8), r.get<uint32_t>(entry + 12),
+                                         "arch" + std::to_string(a) + "/", layout);
+        }
+        return layout;
+    }
+    throw std::runtime_error("Not an ELF, PE or Mach-O file");
+}
@@ -0,0 +1,203 @@
+//  ███████╗███████╗ ██████╗ ███╗   ███╗███████╗███╗   ██╗████████╗   ██╗  ██╗██████╗ ██████╗
+//  ██╔════╝██╔════╝██╔════╝ ████╗ ████║██╔════╝████╗  ██║╚══██╔══╝   ██║  ██║██╔══██╗██╔══██╗
+//  ███████╗█████╗  ██║  ███╗██╔████╔██║█████╗  ██╔██╗ ██║   ██║      ███████║██████╔╝██████╔╝
+//  ╚════██║██╔══╝  ██║   ██║██║╚██╔╝██║██╔══╝  ██║╚██╗██║   ██║      ██╔══██║██╔═══╝ ██╔═══╝
+//  ███████║███████╗╚██████╔╝██║ ╚═╝ ██║███████╗██║ ╚████║   ██║   ██╗██║  ██║██║     ██║
+//  ╚══════╝╚══════╝ ╚═════╝ ╚═╝     ╚═╝╚══════╝╚═╝  ╚═══╝   ╚═╝   ╚═╝╚═╝  ╚═╝╚═╝     ╚═╝
+//
+//
+// change points in a binary from sliding window trigram shapes, in linear time
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "fingerprint.hpp"
+
+// fingerprint cell of the trigram starting at p
+inline size_t trigram_cell(const uint8_t *p)
+{
+    return ((size_t(p[0] >> FINGERPRINT_SHIFT) * FINGERPRINT_SIDE) + (p[1] >> FINGERPRINT_SHIFT)) * FINGERPRINT_SIDE + (p[2] >> FINGERPRINT_SHIFT);
+}
+
+struct segment_options
+{
+    size_t window = 64 << 10; // trigrams on each side of a candidate cut
+    float threshold = 0.1f;   // squared hellinger distance a cut needs, in [0, 1]
+    size_t stride = 0;        // positions between distance samples, 0 for window / 64
+};
+
+// two windows of `window` trigrams sit back to back at position t, left
+// [t - window, t) and right [t, t + window), counted per fingerprint cell.
+// stepping t moves one trigram from right to left, drops one off the left
+// and takes one on at the right: three cells change, and so does their
+// term of S = sum (sqrt(L) - sqrt(R))^2, the rest of the sum stands. the
+// squared hellinger distance of the windows is S / (2 window), so the
+// whole scan is linear in the input and independent of the cell count
+class window_pair
+{
+    const uint8_t *data_;
+    size_t window_;
+    size_t t_;
+    std::vector<double> roots_;
+    std::vector<uint32_t> left_, right_;
+    double sum_ = 0.0;
+
+    double term(size_t cell) const
+    {
+        double d = roots_[left_[cell]] - roots_[right_[cell]];
+        return d * d;
+    }
+
+public:
+    // data must hold at least 2 window trigrams
+    window_pair(const uint8_t *data, size_t window)
+        : data_(data), window_(window), t_(window), roots_(window + 1), left_(FINGERPRINT_DIMS, 0), right_(FINGERPRINT_DIMS, 0)
+    {
+        for (size_t i = 0; i <= window; i++)
+        {
+            roots_[i] = std::sqrt(double(i));
+        }
+        for (size_t i = 0; i < window; i++)
+        {
+            left_[trigram_cell(data + i)]++;
+            right_[trigram_cell(data + window + i)]++;
+        }
+        sum_ = exact();
+    }
+
+    size_t position() const
+    {
+        return t_;
+    }
+
+    double distance() const
+    {
+        return sum_ / (2.0 * double(window_));
+    }
+
+    // S summed over every cell, what the steps keep up to date
+    double exact() const
+    {
+        double sum = 0.0;
+        for (size_t cell = 0; cell < FINGERPRINT_DIMS; cell++)
+        {
+            sum += term(cell);
+        }
+        return sum;
+    }
+
+    // t to t + 1, the caller keeps t + window below the trigram count
+    void step()
+    {
+        size_t moved = trigram_cell(data_ + t_), dropped = trigram_cell(data_ + t_ - window_), taken = trigram_cell(data_ + t_ + window_);
+        t_++;
+
+        // rounding would creep in over a multi GB scan, so start over now and then
+        if ((t_ - window_) % window_ == 0)
+        {
+            right_[moved]--;
+            left_[moved]++;
+            left_[dropped]--;
+            right_[taken]++;
+            sum_ = exact();
+            return;
+        }
+
+        // left takes moved before it loses dropped, both land before either
+        // term is read so a cell never passes window in between
+        sum_ -= term(moved);
+        if (dropped != moved)
+        {
+            sum_ -= term(dropped);
+        }
+        right_[moved]--;
+        left_[moved]++;
+        left_[dropped]--;
+        sum_ += term(moved);
+        if (dropped != moved)
+        {
+            sum_ += term(dropped);
+        }
+
+        sum_ -= term(taken);
+        right_[taken]++;
+        sum_ += term(taken);
+    }
+};
+
+// a cut is the highest distance above threshold with nothing higher
+// within a window after it, and cuts are at least a window apart
+inline std::vector<uint64_t> find_change_points(const uint8_t *data, size_t size, const segment_options &options)
+{
+    std::vector<uint64_t> cuts;
+    const size_t window = std::max<size_t>(options.window, 1);
+    const size_t trigrams = size >= 3 ? size - 2 : 0;
+    if (trigrams < 2 * window)
+    {
+        return cuts;
+    }
+    const size_t stride = options.stride ? options.stride : std::max<size_t>(1, window / 64);
+
+    window_pair pair(data, window);
+    bool have_peak = false;
+    uint64_t peak = 0, last_cut = 0;
+    double peak_distance = 0.0;
+
+    for (;; pair.step())
+    {
+        size_t t = pair.position();
+        if ((t - window) % stride == 0)
+        {
+            double distance = pair.distance();
+            if (distance >= options.threshold && t - last_cut >= window && (!have_peak || distance > peak_distance))
+            {
+                have_peak = true;
+                peak = t;
+                peak_distance = distance;
+            }
+            if (have_peak && t - peak >= window)
+            {
+                cuts.push_back(peak);
+                last_cut = peak;
+                have_peak = false;
+            }
+        }
+
+        if (t + window >= trigrams)
+        {
+            break;
+        }
+    }
+
+    // a peak too close to the end still counts
+    if (have_peak)
+    {
+        cuts.push_back(peak);
+    }
+    return cuts;
+}
+
+struct segment_region
+{
+    uint64_t offset;
+    uint64_t length;
+};
+
+// regions between consecutive cuts, covering all of size bytes
+inline std::vector<segment_region> cut_regions(const std::vector<uint64_t> &cuts, uint64_t size)
+{
+    std::vector<segment_region> regions;
+    uint64_t start = 0;
+    for (uint64_t cut : cuts)
+    {
+        regions.push_back({start, cut - start});
+        start = cut;
+    }
+    regions.push_back({start, size - start});
+    return regions;
+}
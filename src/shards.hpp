@@ -0,0 +1,245 @@
+//  ███████╗██╗  ██╗ █████╗ ██████╗ ██████╗ ███████╗   ██╗  ██╗██████╗ ██████╗
+//  ██╔════╝██║  ██║██╔══██╗██╔══██╗██╔══██╗██╔════╝   ██║  ██║██╔══██╗██╔══██╗
+//  ███████╗███████║███████║██████╔╝██║  ██║███████╗   ███████║██████╔╝██████╔╝
+//  ╚════██║██╔══██║██╔══██║██╔══██╗██║  ██║╚════██║   ██╔══██║██╔═══╝ ██╔═══╝
+//  ███████║██║  ██║██║  ██║██║  ██║██████╔╝███████║██╗██║  ██║██║     ██║
+//  ╚══════╝╚═╝  ╚═╝╚═╝  ╚═╝╚═╝  ╚═╝╚═════╝ ╚══════╝╚═╝╚═╝  ╚═╝╚═╝     ╚═╝
+//
+//
+//
+// histograms of pieces of one input, merged back into the histogram of the whole
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "histogram_io.hpp"
+#include "tasks.hpp"
+
+// records where data (the piece counted into layer) sits in the whole input
+inline void set_shard_edges(histogram_layer &layer, const uint8_t *data, size_t size, uint64_t offset, uint64_t input_size)
+{
+    fcube_shard &shard = layer.shard;
+    shard = fcube_shard{};
+    shard.offset = offset;
+    shard.length = size;
+    shard.input_size = input_size;
+    shard.head_length = static_cast<uint8_t>(std::min<size_t>(size, 2));
+    shard.tail_length = shard.head_length;
+    for (size_t i = 0; i < shard.head_length; ++i)
+    {
+        shard.head[i] = data[i];
+        shard.tail[i] = data[size - shard.tail_length + i];
+    }
+}
+
+namespace shards_detail
+{
+    struct cursor
+    {
+        const uint32_t *bin;
+        const uint32_t *end;
+        const uint64_t *count;
+    };
+
+    // sums the parts' entries with bins in [first, last), in bin order. a
+    // small binary heap of cursors, k stays around the number of machines
+    inline void merge_range(const std::vector<const histogram_layer *> &parts, uint32_t first, uint32_t last,
+                            std::vector<uint32_t> &bins, std::vector<uint64_t> &counts)
+    {
+        std::vector<cursor> heap;
+        for (const histogram_layer *part : parts)
+        {
+            const uint32_t *begin = std::lower_bound(part->bins.data(), part->bins.data() + part->bins.size(), first);
+            const uint32_t *end = std::lower_bound(begin, part->bins.data() + part->bins.size(), last);
+            if (begin != end)
+            {
+                heap.push_back({begin, end, part->counts.data() + (begin - part->bins.data())});
+            }
+        }
+
+        auto later = [](const cursor &a, const cursor &b)
+        { return *a.bin > *b.bin; };
+        std::make_heap(heap.begin(), heap.end(), later);
+        while (!heap.empty())
+        {
+            std::pop_heap(heap.begin(), heap.end(), later);
+            cursor &top = heap.back();
+            if (!bins.empty() && bins.back() == *top.bin)
+            {
+                counts.back() += *top.count;
+            }
+            else
+            {
+                bins.push_back(*top.bin);
+                counts.push_back(*top.count);
+            }
+
+            if (++top.bin == top.end)
+            {
+                heap.pop_back();
+            }
+            else
+            {
+                ++top.count;
+                std::push_heap(heap.begin(), heap.end(), later);
+            }
+        }
+    }
+}
+
+// the shards of one input, in any order, must tile one contiguous range of
+// it. their histograms are summed by a k-way merge, split over `pool` by bin
+// range when there is one, then the trigrams across every seam are added.
+// the sum is exact, so any grouping of merges gives the same bits as
+// counting the whole range in one go. positions don't survive a merge
+inline histogram_layer merge_shards(std::vector<const histogram_layer *> parts, work_stealing_pool *pool = nullptr)
+{
+    if (parts.empty())
+    {
+        throw std::runtime_error("No shards to merge");
+    }
+    // empty shards first at their offset, they sit before whatever starts there
+    std::sort(parts.begin(), parts.end(), [](const histogram_layer *a, const histogram_layer *b)
+              { return a->shard.offset != b->shard.offset ? a->shard.offset < b->shard.offset : a->shard.length < b->shard.length; });
+    for (size_t i = 0; i < parts.size(); ++i)
+    {
+        const fcube_shard &shard = parts[i]->shard;
+        if (shard.head_length != std::min<uint64_t>(shard.length, 2) || shard.tail_length != shard.head_length ||
+            shard.offset + shard.length > shard.input_size || shard.input_size != parts[0]->shard.input_size ||
+            parts[i]->bins.size() != parts[i]->counts.size())
+        {
+            throw std::runtime_error("Bad shard of " + parts[i]->name);
+        }
+        if (i > 0 && parts[i - 1]->shard.offset + parts[i - 1]->shard.length != shard.offset)
+        {
+            throw std::runtime_error("Shards of " + parts[0]->name + " leave a gap or overlap at offset " + std::to_string(shard.offset));
+        }
+    }
+
+    // equal slices of the bin space, a few per worker so a dense corner
+    // doesn't leave the rest waiting
+    size_t slices = pool ? pool->size() * 4 : 1;
+    std::vector<std::vector<uint32_t>> slice_bins(slices);
+    std::vector<std::vector<uint64_t>> slice_counts(slices);
+    auto slice_bounds = [&](size_t slice)
+    { return std::make_pair(uint32_t(TRIGRAM_BINS * slice / slices), uint32_t(TRIGRAM_BINS * (slice + 1) / slices)); };
+    if (pool)
+    {
+        std::vector<work_stealing_pool::task> tasks;
+        for (size_t slice = 0; slice < slices; ++slice)
+        {
+            tasks.push_back([&, slice](size_t)
+                            {
+                auto bounds = slice_bounds(slice);
+                shards_detail::merge_range(parts, bounds.first, bounds.second, slice_bins[slice], slice_counts[slice]); });
+        }
+        pool->run(std::move(tasks));
+    }
+    else
+    {
+        shards_detail::merge_range(parts, 0, uint32_t(TRIGRAM_BINS), slice_bins[0], slice_counts[0]);
+    }
+
+    // walks the seams with the last two bytes of everything so far, a shard
+    // shorter than two bytes leaves part of the previous tail in place
+    std::vector<uint32_t> seam_bins;
+    uint8_t tail[4];
+    size_t tail_length = 0;
+    for (const histogram_layer *part : parts)
+    {
+        const fcube_shard &shard = part->shard;
+        uint8_t joined[4];
+        size_t joined_length = 0;
+        for (size_t i = 0; i < tail_length; ++i)
+        {
+            joined[joined_length++] = tail[i];
+        }
+        for (size_t i = 0; i < shard.head_length; ++i)
+        {
+            joined[joined_length++] = shard.head[i];
+        }
+        for (size_t p = 0; p < tail_length && p + 3 <= joined_length; ++p)
+        {
+            seam_bins.push_back(trigram_bin(joined[p], joined[p + 1], joined[p + 2]));
+        }
+
+        for (size_t i = 0; i < shard.tail_length; ++i)
+        {
+            tail[tail_length++] = shard.tail[i];
+        }
+        if (tail_length > 2)
+        {
+            std::copy(tail + tail_length - 2, tail + tail_length, tail);
+            tail_length = 2;
+        }
+    }
+    std::sort(seam_bins.begin(), seam_bins.end());
+
+    histogram_layer merged;
+    merged.name = parts[0]->name;
+    size_t entries = seam_bins.size();
+    for (const auto &bins : slice_bins)
+    {
+        entries += bins.size();
+    }
+    merged.bins.reserve(entries);
+    merged.counts.reserve(entries);
+    size_t seam = 0;
+    auto add = [&](uint32_t bin, uint64_t count)
+    {
+        if (!merged.bins.empty() && merged.bins.back() == bin)
+        {
+            merged.counts.back() += count;
+        }
+        else
+        {
+            merged.bins.push_back(bin);
+            merged.counts.push_back(count);
+        }
+        merged.total += count;
+    };
+    for (size_t slice = 0; slice < slices; ++slice)
+    {
+        for (size_t i = 0; i < slice_bins[slice].size(); ++i)
+        {
+            while (seam < seam_bins.size() && seam_bins[seam] <= slice_bins[slice][i])
+            {
+                add(seam_bins[seam++], 1);
+            }
+            add(slice_bins[slice][i], slice_counts[slice][i]);
+        }
+    }
+    while (seam < seam_bins.size())
+    {
+        add(seam_bins[seam++], 1);
+    }
+
+    // the merged piece is a shard again, with the outer edges of the run
+    fcube_shard &shard = merged.shard;
+    shard.offset = parts.front()->shard.offset;
+    shard.length = parts.back()->shard.offset + parts.back()->shard.length - shard.offset;
+    shard.input_size = parts.front()->shard.input_size;
+    for (const histogram_layer *part : parts)
+    {
+        for (size_t i = 0; i < part->shard.head_length && shard.head_length < 2; ++i)
+        {
+            shard.head[shard.head_length++] = part->shard.head[i];
+        }
+    }
+    shard.tail_length = static_cast<uint8_t>(tail_length);
+    std::copy(tail, tail + tail_length, shard.tail);
+    return merged;
+}
+
+// a merged shard that covers its whole input is an ordinary histogram of it
+inline bool shard_complete(const histogram_layer &layer)
+{
+    return layer.shard.offset == 0 && layer.shard.length == layer.shard.input_size;
+}
@@ -0,0 +1,387 @@
+//  ███████╗██╗███╗   ███╗██╗██╗      █████╗ ██████╗ ██╗████████╗██╗   ██╗        ██╗███╗   ██╗██████╗ ███████╗██╗  ██╗   ██╗  ██╗██████╗ ██████╗
+//  ██╔════╝██║████╗ ████║██║██║     ██╔══██╗██╔══██╗██║╚══██╔══╝╚██╗ ██╔╝        ██║████╗  ██║██╔══██╗██╔════╝╚██╗██╔╝   ██║  ██║██╔══██╗██╔══██╗
+//  ███████╗██║██╔████╔██║██║██║     ███████║██████╔╝██║   ██║    ╚████╔╝         ██║██╔██╗ ██║██║  ██║█████╗   ╚███╔╝    ███████║██████╔╝██████╔╝
+//  ╚════██║██║██║╚██╔╝██║██║██║     ██╔══██║██╔══██╗██║   ██║     ╚██╔╝          ██║██║╚██╗██║██║  ██║██╔══╝   ██╔██╗    ██╔══██║██╔═══╝ ██╔═══╝
+//  ███████║██║██║ ╚═╝ ██║██║███████╗██║  ██║██║  ██║██║   ██║      ██║   ███████╗██║██║ ╚████║██████╔╝███████╗██╔╝ ██╗██╗██║  ██║██║     ██║
+//  ╚══════╝╚═╝╚═╝     ╚═╝╚═╝╚══════╝╚═╝  ╚═╝╚═╝  ╚═╝╚═╝   ╚═╝      ╚═╝   ╚══════╝╚═╝╚═╝  ╚═══╝╚═════╝ ╚══════╝╚═╝  ╚═╝╚═╝╚═╝  ╚═╝╚═╝     ╚═╝
+//
+//
+// nearest neighbour search over corpus fingerprints, random hyperplane LSH on disk
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fingerprint.hpp"
+
+// file layout, all little endian, sections in this order:
+//
+//   header        magic "FCSIM001", dims u32, count u32, tables u32, bits u32,
+//                 names size u64
+//   mean          float[dims], subtracted before hashing
+//   planes        float[tables * bits * dims], one random hyperplane per bit
+//   fingerprints  float[count * dims]
+//   buckets       per table, count (key u32, id u32) pairs sorted by key
+//   name offsets  u64[count + 1], zero padded to 8 before
+//   names         names size bytes
+//
+// a key has one bit per hyperplane of its table, set when the centered
+// fingerprint lies on its positive side. close fingerprints share keys
+const char SIMILARITY_INDEX_MAGIC[8] = {'F', 'C', 'S', 'I', 'M', '0', '0', '1'};
+
+struct similarity_index_header
+{
+    char magic[8];
+    uint32_t dims;
+    uint32_t count;
+    uint32_t tables;
+    uint32_t bits;
+    uint64_t names_size;
+};
+
+struct similarity_bucket
+{
+    uint32_t key;
+    uint32_t id;
+};
+
+static_assert(sizeof(similarity_index_header) == 32, "header is packed by hand");
+static_assert(sizeof(similarity_bucket) == 8, "bucket is packed by hand");
+
+enum class similarity_metric
+{
+    cosine,
+    js
+};
+
+struct similarity_match
+{
+    uint32_t id;
+    float distance;
+};
+
+// planes points at the bits hyperplanes of one table
+inline uint32_t lsh_key(const float *centered, const float *planes, uint32_t bits, uint32_t dims)
+{
+    uint32_t key = 0;
+    for (uint32_t bit = 0; bit < bits; bit++)
+    {
+        if (dot_product(centered, planes + size_t(bit) * dims, dims) > 0.0f)
+        {
+            key |= 1u << bit;
+        }
+    }
+    return key;
+}
+
+namespace similarity_detail
+{
+    struct layout
+    {
+        size_t mean, planes, fingerprints, buckets, name_offsets, names, end;
+    };
+
+    inline layout sections(const similarity_index_header &header)
+    {
+        layout l{};
+        l.mean = sizeof(similarity_index_header);
+        l.planes = l.mean + size_t(header.dims) * sizeof(float);
+        l.fingerprints = l.planes + size_t(header.tables) * header.bits * header.dims * sizeof(float);
+        l.buckets = l.fingerprints + size_t(header.count) * header.dims * sizeof(float);
+        l.name_offsets = (l.buckets + size_t(header.tables) * header.count * sizeof(similarity_bucket) + 7) & ~size_t(7);
+        l.names = l.name_offsets + (size_t(header.count) + 1) * sizeof(uint64_t);
+        l.end = l.names + header.names_size;
+        return l;
+    }
+}
+
+// fingerprints holds names.size() rows of FINGERPRINT_DIMS floats. more
+// tables find more true neighbours, more bits make buckets smaller
+inline void write_similarity_index(const std::string &path, const std::vector<std::string> &names,
+                                   const std::vector<float> &fingerprints, uint32_t tables = 8, uint32_t bits = 14,
+                                   uint32_t seed = 1)
+{
+    const uint32_t dims = static_cast<uint32_t>(FINGERPRINT_DIMS);
+    if (fingerprints.size() != names.size() * dims || bits == 0 || bits > 31 || tables == 0)
+    {
+        throw std::runtime_error("Bad similarity index parameters");
+    }
+
+    similarity_index_header header{};
+    std::memcpy(header.magic, SIMILARITY_INDEX_MAGIC, sizeof(header.magic));
+    header.dims = dims;
+    header.count = static_cast<uint32_t>(names.size());
+    header.tables = tables;
+    header.bits = bits;
+
+    std::vector<uint64_t> name_offsets = {0};
+    for (const auto &name : names)
+    {
+        name_offsets.push_back(name_offsets.back() + name.size());
+    }
+    header.names_size = name_offsets.back();
+
+    // every fingerprint is nonnegative, uncentered they would all hash alike
+    std::vector<float> mean(dims, 0.0f);
+    for (size_t id = 0; id < names.size(); id++)
+    {
+        for (uint32_t d = 0; d < dims; d++)
+        {
+            mean[d] += fingerprints[id * dims + d];
+        }
+    }
+    for (auto &m : mean)
+    {
+        m /= std::max<float>(1.0f, static_cast<float>(names.size()));
+    }
+
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> gaussian;
+    std::vector<float> planes(size_t(tables) * bits * dims);
+    for (auto &p : planes)
+    {
+        p = gaussian(rng);
+    }
+
+    std::vector<similarity_bucket> buckets(size_t(tables) * names.size());
+    std::vector<float> centered(dims);
+    for (uint32_t id = 0; id < header.count; id++)
+    {
+        for (uint32_t d = 0; d < dims; d++)
+        {
+            centered[d] = fingerprints[size_t(id) * dims + d] - mean[d];
+        }
+        for (uint32_t table = 0; table < tables; table++)
+        {
+            uint32_t key = lsh_key(centered.data(), planes.data() + size_t(table) * bits * dims, bits, dims);
+            buckets[size_t(table) * header.count + id] = {key, id};
+        }
+    }
+    for (uint32_t table = 0; table < tables; table++)
+    {
+        auto begin = buckets.begin() + size_t(table) * header.count;
+        std::sort(begin, begin + header.count, [](const similarity_bucket &a, const similarity_bucket &b)
+                  { return a.key != b.key ? a.key < b.key : a.id < b.id; });
+    }
+
+    std::ofstream out(path, std::ios::binary);
+    if (!out)
+    {
+        throw std::runtime_error("Failed to create " + path);
+    }
+
+    auto layout = similarity_detail::sections(header);
+    static const char zeros[8] = {};
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(mean.data()), mean.size() * sizeof(float));
+    out.write(reinterpret_cast<const char *>(planes.data()), planes.size() * sizeof(float));
+    out.write(reinterpret_cast<const char *>(fingerprints.data()), fingerprints.size() * sizeof(float));
+    out.write(reinterpret_cast<const char *>(buckets.data()), buckets.size() * sizeof(similarity_bucket));
+    out.write(zeros, layout.name_offsets - (layout.buckets + buckets.size() * sizeof(similarity_bucket)));
+    out.write(reinterpret_cast<const char *>(name_offsets.data()), name_offsets.size() * sizeof(uint64_t));
+    for (const auto &name : names)
+    {
+        out.write(name.data(), name.size());
+    }
+
+    if (!out)
+    {
+        throw std::runtime_error("Failed to write " + path);
+    }
+}
+
+// read only view of an index file. a query hashes the fingerprint into every
+// table, also probes the keys one bit away, and ranks only what it found
+class similarity_index
+{
+private:
+    const uint8_t *base_ = nullptr;
+    size_t size_ = 0;
+    const similarity_index_header *header_ = nullptr;
+    const float *mean_ = nullptr;
+    const float *planes_ = nullptr;
+    const float *fingerprints_ = nullptr;
+    const similarity_bucket *buckets_ = nullptr;
+    const uint64_t *name_offsets_ = nullptr;
+    const char *names_ = nullptr;
+
+public:
+    similarity_index() = default;
+
+    explicit similarity_index(const std::string &path)
+    {
+        open(path);
+    }
+
+    ~similarity_index()
+    {
+        close();
+    }
+
+    similarity_index(const similarity_index &) = delete;
+    similarity_index &operator=(const similarity_index &) = delete;
+
+    void open(const std::string &path)
+    {
+        close();
+
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            throw std::runtime_error("Failed to open " + path);
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(similarity_index_header))
+        {
+            ::close(fd);
+            throw std::runtime_error("Not a similarity index: " + path);
+        }
+
+        void *mapped = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED)
+        {
+            throw std::runtime_error("Failed to map " + path);
+        }
+
+        base_ = static_cast<const uint8_t *>(mapped);
+        size_ = static_cast<size_t>(st.st_size);
+        header_ = reinterpret_cast<const similarity_index_header *>(base_);
+
+        if (std::memcmp(header_->magic, SIMILARITY_INDEX_MAGIC, sizeof(header_->magic)) != 0 ||
+            header_->dims != FINGERPRINT_DIMS || header_->bits == 0 || header_->bits > 31 ||
+            similarity_detail::sections(*header_).end != size_)
+        {
+            close();
+            throw std::runtime_error("Not a similarity index: " + path);
+        }
+
+        auto layout = similarity_detail::sections(*header_);
+        mean_ = reinterpret_cast<const float *>(base_ + layout.mean);
+        planes_ = reinterpret_cast<const float *>(base_ + layout.planes);
+        fingerprints_ = reinterpret_cast<const float *>(base_ + layout.fingerprints);
+        buckets_ = reinterpret_cast<const similarity_bucket *>(base_ + layout.buckets);
+        name_offsets_ = reinterpret_cast<const uint64_t *>(base_ + layout.name_offsets);
+        names_ = reinterpret_cast<const char *>(base_ + layout.names);
+        if (name_offsets_[header_->count] != header_->names_size)
+        {
+            close();
+            throw std::runtime_error("Corrupt names in similarity index " + path);
+        }
+    }
+
+    void close()
+    {
+        if (base_ != nullptr)
+        {
+            munmap(const_cast<uint8_t *>(base_), size_);
+        }
+        base_ = nullptr;
+        size_ = 0;
+        header_ = nullptr;
+    }
+
+    bool is_open() const
+    {
+        return base_ != nullptr;
+    }
+
+    uint32_t count() const
+    {
+        return header_->count;
+    }
+
+    std::string name(uint32_t id) const
+    {
+        return std::string(names_ + name_offsets_[id], names_ + name_offsets_[id + 1]);
+    }
+
+    const float *fingerprint(uint32_t id) const
+    {
+        return fingerprints_ + size_t(id) * header_->dims;
+    }
+
+    // ids sharing a key, or a key one bit away, with the query in any table
+    std::vector<uint32_t> candidates(const float *query) const
+    {
+        const uint32_t dims = header_->dims, bits = header_->bits;
+        std::vector<float> centered(dims);
+        for (uint32_t d = 0; d < dims; d++)
+        {
+            centered[d] = query[d] - mean_[d];
+        }
+
+        std::vector<uint32_t> ids;
+        for (uint32_t table = 0; table < header_->tables; table++)
+        {
+            uint32_t key = lsh_key(centered.data(), planes_ + size_t(table) * bits * dims, bits, dims);
+            const similarity_bucket *begin = buckets_ + size_t(table) * header_->count;
+            const similarity_bucket *end = begin + header_->count;
+            for (uint32_t probe = 0; probe <= bits; probe++)
+            {
+                uint32_t probed = probe == bits ? key : key ^ (1u << probe);
+                auto range = std::equal_range(begin, end, similarity_bucket{probed, 0}, [](const similarity_bucket &a, const similarity_bucket &b)
+                                              { return a.key < b.key; });
+                for (auto it = range.first; it != range.second; ++it)
+                {
+                    ids.push_back(it->id);
+                }
+            }
+        }
+        std::sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+        return ids;
+    }
+
+    // the top closest, nearest first. exact, or too few candidates, ranks
+    // the whole corpus instead. scanned says how many were compared
+    std::vector<similarity_match> query(const float *fingerprint, size_t top, similarity_metric metric,
+                                        bool exact = false, size_t *scanned = nullptr) const
+    {
+        std::vector<uint32_t> ids;
+        if (!exact)
+        {
+            ids = candidates(fingerprint);
+        }
+        if (exact || ids.size() < top)
+        {
+            ids.resize(header_->count);
+            for (uint32_t id = 0; id < header_->count; id++)
+            {
+                ids[id] = id;
+            }
+        }
+
+        std::vector<similarity_match> matches;
+        matches.reserve(ids.size());
+        for (uint32_t id : ids)
+        {
+            float distance = metric == similarity_metric::js ? js_distance(fingerprint, this->fingerprint(id), header_->dims)
+                                                             : cosine_distance(fingerprint, this->fingerprint(id), header_->dims);
+            matches.push_back({id, distance});
+        }
+
+        size_t n = std::min(top, matches.size());
+        std::partial_sort(matches.begin(), matches.begin() + n, matches.end(), [](const similarity_match &a, const similarity_match &b)
+                          { return a.distance != b.distance ? a.distance < b.distance : a.id < b.id; });
+        matches.resize(n);
+        if (scanned)
+        {
+            *scanned = ids.size();
+        }
+        return matches;
+    }
+};
@@ -0,0 +1,267 @@
+//  ███████╗██╗  ██╗███████╗████████╗ ██████╗██╗  ██╗   ██╗  ██╗██████╗ ██████╗
+//  ██╔════╝██║ ██╔╝██╔════╝╚══██╔══╝██╔════╝██║  ██║   ██║  ██║██╔══██╗██╔══██╗
+//  ███████╗█████╔╝ █████╗     ██║   ██║     ███████║   ███████║██████╔╝██████╔╝
+//  ╚════██║██╔═██╗ ██╔══╝     ██║   ██║     ██╔══██║   ██╔══██║██╔═══╝ ██╔═══╝
+//  ███████║██║  ██╗███████╗   ██║   ╚██████╗██║  ██║██╗██║  ██║██║     ██║
+//  ╚══════╝╚═╝  ╚═╝╚══════╝   ╚═╝    ╚═════╝╚═╝  ╚═╝╚═╝╚═╝  ╚═╝╚═╝     ╚═╝
+//
+//
+//
+//
+// the most common trigrams of an input in a fixed amount of memory, with bounds on every count
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "histogram_io.hpp"
+#include "trigram.hpp"
+
+// one monitored trigram of a space_saving sketch. its true count is in
+// [count - error, count]
+struct sketch_entry
+{
+    uint32_t bin;
+    uint64_t count;
+    uint64_t error;
+};
+
+// space-saving (metwally et al.): a fixed set of counters, a trigram that
+// isn't monitored takes over the smallest one and inherits its count as its
+// error. every trigram occurring more than total / capacity times is
+// monitored, and no count is off by more than the smallest one
+//
+// hits only bump their counter. misses take counters from a list of the ones
+// at the smallest count, skipping any a hit has moved on since, and rebuild
+// the list with a sweep once it runs dry. the smallest count only grows and
+// stays under total / capacity, so sweeps cost O(1) per add amortized.
+// monitored trigrams sit in an open addressed table of twice the capacity
+class space_saving
+{
+private:
+    static constexpr uint32_t EMPTY = UINT32_MAX;
+
+    std::vector<sketch_entry> entries_;
+    std::vector<uint32_t> smallest_; // entries that were at smallest_count_ at the last sweep
+    uint64_t smallest_count_ = 0;
+    std::vector<uint32_t> slots_; // entry index per slot, EMPTY if none
+    uint32_t shift_ = 32;         // takes the top bits of the hash, as many as index slots_
+    size_t capacity_;
+    uint64_t total_ = 0;
+
+    size_t slot_of(uint32_t bin) const
+    {
+        return shift_ == 32 ? 0 : (bin * 0x9E3779B1u) >> shift_;
+    }
+
+    // the slot holding bin, or the empty one it would go in
+    size_t find(uint32_t bin) const
+    {
+        size_t slot = slot_of(bin);
+        while (slots_[slot] != EMPTY && entries_[slots_[slot]].bin != bin)
+        {
+            slot = (slot + 1) & (slots_.size() - 1);
+        }
+        return slot;
+    }
+
+    // backward shift deletion, so lookups never need tombstones
+    void erase(size_t slot)
+    {
+        size_t mask = slots_.size() - 1;
+        size_t next = (slot + 1) & mask;
+        while (slots_[next] != EMPTY)
+        {
+            size_t home = slot_of(entries_[slots_[next]].bin);
+            if (((next - home) & mask) >= ((next - slot) & mask))
+            {
+                slots_[slot] = slots_[next];
+                slot = next;
+            }
+            next = (next + 1) & mask;
+        }
+        slots_[slot] = EMPTY;
+    }
+
+    uint32_t take_smallest()
+    {
+        while (true)
+        {
+            while (!smallest_.empty())
+            {
+                uint32_t index = smallest_.back();
+                smallest_.pop_back();
+                if (entries_[index].count == smallest_count_)
+                {
+                    return index;
+                }
+            }
+
+            smallest_count_ = UINT64_MAX;
+            for (uint32_t index = 0; index < entries_.size(); ++index)
+            {
+                uint64_t count = entries_[index].count;
+                if (count < smallest_count_)
+                {
+                    smallest_count_ = count;
+                    smallest_.clear();
+                }
+                if (count == smallest_count_)
+                {
+                    smallest_.push_back(index);
+                }
+            }
+        }
+    }
+
+public:
+    // bytes per counter: the entry, its place in the smallest list and two slots
+    static constexpr size_t COUNTER_BYTES = sizeof(sketch_entry) + 3 * sizeof(uint32_t);
+
+    // as many counters as fit in memory_bytes
+    explicit space_saving(size_t memory_bytes)
+        : capacity_(memory_bytes / COUNTER_BYTES)
+    {
+        if (capacity_ < 1)
+        {
+            throw std::runtime_error("Sketch memory below one counter");
+        }
+        size_t slots = 1;
+        while (slots < 2 * capacity_)
+        {
+            slots <<= 1;
+            shift_--;
+        }
+        // the table rounds up to a power of two, the counters give that back
+        capacity_ = std::max<size_t>(1, (memory_bytes - slots * sizeof(uint32_t)) / (COUNTER_BYTES - 2 * sizeof(uint32_t)));
+        capacity_ = std::min(capacity_, slots / 2);
+        entries_.reserve(capacity_);
+        smallest_.reserve(capacity_);
+        slots_.assign(slots, EMPTY);
+    }
+
+    size_t capacity() const
+    {
+        return capacity_;
+    }
+
+    uint64_t total() const
+    {
+        return total_;
+    }
+
+    // no count is more than this above the truth, and a trigram not
+    // monitored occurs at most this often
+    uint64_t error_bound() const
+    {
+        if (entries_.size() < capacity_)
+        {
+            return 0;
+        }
+        uint64_t smallest = UINT64_MAX;
+        for (const auto &entry : entries_)
+        {
+            smallest = std::min(smallest, entry.count);
+        }
+        return smallest;
+    }
+
+    // weight occurrences at once, the bounds hold as for weight single adds
+    void add(uint32_t bin, uint64_t weight = 1)
+    {
+        total_ += weight;
+        size_t slot = find(bin);
+        if (slots_[slot] != EMPTY)
+        {
+            entries_[slots_[slot]].count += weight;
+            return;
+        }
+
+        uint32_t index;
+        if (entries_.size() < capacity_)
+        {
+            index = static_cast<uint32_t>(entries_.size());
+            entries_.push_back({bin, weight, 0});
+        }
+        else
+        {
+            index = take_smallest();
+            sketch_entry &victim = entries_[index];
+            erase(find(victim.bin));
+            victim = {bin, victim.count + weight, victim.count};
+            slot = find(bin);
+        }
+        slots_[slot] = index;
+    }
+
+    void count(const uint8_t *data, size_t size)
+    {
+        if (size < 3)
+        {
+            return;
+        }
+        // runs of one trigram (zero padding, fills) cost one add
+        uint32_t key = uint32_t(data[0]) << 8 | data[1];
+        uint32_t last = UINT32_MAX;
+        uint64_t run = 0;
+        for (size_t i = 2; i < size; ++i)
+        {
+            key = (key << 8 | data[i]) & (TRIGRAM_BINS - 1);
+            if (key == last)
+            {
+                run++;
+                continue;
+            }
+            if (run)
+            {
+                add(last, run);
+            }
+            last = key;
+            run = 1;
+        }
+        add(last, run);
+    }
+
+    // the n highest counts, highest first
+    std::vector<sketch_entry> top(size_t n) const
+    {
+        std::vector<sketch_entry> result = entries_;
+        n = std::min(n, result.size());
+        std::partial_sort(result.begin(), result.begin() + n, result.end(), [](const sketch_entry &a, const sketch_entry &b)
+                          { return a.count != b.count ? a.count > b.count : a.bin < b.bin; });
+        result.resize(n);
+        return result;
+    }
+
+    // empty again, for the next input
+    void clear()
+    {
+        entries_.clear();
+        smallest_.clear();
+        std::fill(slots_.begin(), slots_.end(), EMPTY);
+        total_ = 0;
+    }
+};
+
+// the top n as a layer, the same shape scan writes after --keep: total is the
+// sum of what was kept. counts are the sketch's, at most error_bound() high
+inline histogram_layer sketch_layer(const std::string &name, const space_saving &sketch, size_t n)
+{
+    std::vector<sketch_entry> top = sketch.top(n);
+    std::sort(top.begin(), top.end(), [](const sketch_entry &a, const sketch_entry &b)
+              { return a.bin < b.bin; });
+    histogram_layer layer;
+    layer.name = name;
+    for (const auto &entry : top)
+    {
+        layer.bins.push_back(entry.bin);
+        layer.counts.push_back(entry.count);
+        layer.total += entry.count;
+    }
+    return layer;
+}
@@ -0,0 +1,82 @@
+//  ███████╗██╗      █████╗ ██████╗    ██╗  ██╗██████╗ ██████╗
+//  ██╔════╝██║     ██╔══██╗██╔══██╗   ██║  ██║██╔══██╗██╔══██╗
+//  ███████╗██║     ███████║██████╔╝   ███████║██████╔╝██████╔╝
+//  ╚════██║██║     ██╔══██║██╔══██╗   ██╔══██║██╔═══╝ ██╔═══╝
+//  ███████║███████╗██║  ██║██████╔╝██╗██║  ██║██║     ██║
+//  ╚══════╝╚══════╝╚═╝  ╚═╝╚═════╝ ╚═╝╚═╝  ╚═╝╚═╝     ╚═╝
+//
+// axis-sorted orderings of the level 0 voxels for slab slicing
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "pyramid.hpp"
+
+const int AXIS_COUNT = 3;
+const int SLICE_COUNT = 256; // coordinates per axis at level 0
+
+// the cells are sorted once by x, once by y and once by z, and for every
+// coordinate we keep where its slice starts. a slab lo <= c <= hi along any
+// axis is then a single [slab_begin, slab_end) range of one ordering
+class axis_index
+{
+private:
+    std::array<std::vector<uint32_t>, AXIS_COUNT> order_;
+    std::array<std::array<uint32_t, SLICE_COUNT + 1>, AXIS_COUNT> offsets_{};
+
+public:
+    static int coordinate(const pyramid_cell &cell, int axis)
+    {
+        return axis == 0 ? cell.x : axis == 1 ? cell.y
+                                              : cell.z;
+    }
+
+    // counting sort per axis, stable so each slice keeps the input order
+    void build(const std::vector<pyramid_cell> &cells)
+    {
+        for (int axis = 0; axis < AXIS_COUNT; axis++)
+        {
+            auto &offsets = offsets_[axis];
+            offsets.fill(0);
+            for (const auto &cell : cells)
+            {
+                offsets[coordinate(cell, axis) + 1]++;
+            }
+            for (int slice = 0; slice < SLICE_COUNT; slice++)
+            {
+                offsets[slice + 1] += offsets[slice];
+            }
+
+            std::array<uint32_t, SLICE_COUNT> next;
+            std::copy(offsets.begin(), offsets.end() - 1, next.begin());
+            auto &order = order_[axis];
+            order.resize(cells.size());
+            for (uint32_t i = 0; i < cells.size(); i++)
+            {
+                order[next[coordinate(cells[i], axis)]++] = i;
+            }
+        }
+    }
+
+    // indices into the cells passed to build, sorted by this axis
+    const std::vector<uint32_t> &order(int axis) const
+    {
+        return order_[axis];
+    }
+
+    // [slab_begin, slab_end) indexes order(axis), lo and hi are inclusive
+    // and clamped to the trigram space
+    uint32_t slab_begin(int axis, int lo) const
+    {
+        return offsets_[axis][std::clamp(lo, 0, SLICE_COUNT)];
+    }
+
+    uint32_t slab_end(int axis, int hi) const
+    {
+        return offsets_[axis][std::clamp(hi + 1, 0, SLICE_COUNT)];
+    }
+};
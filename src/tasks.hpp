@@ -0,0 +1,377 @@
+//  ████████╗ █████╗ ███████╗██╗  ██╗███████╗   ██╗  ██╗██████╗ ██████╗
+//  ╚══██╔══╝██╔══██╗██╔════╝██║ ██╔╝██╔════╝   ██║  ██║██╔══██╗██╔══██╗
+//     ██║   ███████║███████╗█████╔╝ ███████╗   ███████║██████╔╝██████╔╝
+//     ██║   ██╔══██║╚════██║██╔═██╗ ╚════██║   ██╔══██║██╔═══╝ ██╔═══╝
+//     ██║   ██║  ██║███████║██║  ██╗███████║██╗██║  ██║██║     ██║
+//     ╚═╝   ╚═╝  ╚═╝╚══════╝╚═╝  ╚═╝╚══════╝╚═╝╚═╝  ╚═╝╚═╝     ╚═╝
+//
+// small header-only thread pools and dependency graph of tasks
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class thread_pool
+{
+private:
+    std::vector<std::thread> workers_;
+    std::queue<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stopping_ = false;
+
+public:
+    explicit thread_pool(size_t thread_count = std::thread::hardware_concurrency())
+    {
+        thread_count = std::max<size_t>(1, thread_count);
+        for (size_t i = 0; i < thread_count; ++i)
+        {
+            workers_.emplace_back([this]()
+                                  { worker_loop(); });
+        }
+    }
+
+    ~thread_pool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        for (auto &worker : workers_)
+        {
+            worker.join();
+        }
+    }
+
+    thread_pool(const thread_pool &) = delete;
+    thread_pool &operator=(const thread_pool &) = delete;
+
+    size_t size() const
+    {
+        return workers_.size();
+    }
+
+    // queue a task, the returned future rethrows anything the task throws
+    template <typename F>
+    std::future<void> submit(F &&task)
+    {
+        auto packaged = std::make_shared<std::packaged_task<void()>>(std::forward<F>(task));
+        std::future<void> result = packaged->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.emplace([packaged]()
+                           { (*packaged)(); });
+        }
+        cv_.notify_one();
+        return result;
+    }
+
+private:
+    void worker_loop()
+    {
+        for (;;)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this]()
+                         { return stopping_ || !tasks_.empty(); });
+                if (stopping_ && tasks_.empty())
+                {
+                    return;
+                }
+                task = std::move(tasks_.front());
+                tasks_.pop();
+            }
+            task();
+        }
+    }
+};
+
+// tasks must be added after everything they depend on, which keeps the graph
+// acyclic and lets run() hand them to the pool's FIFO queue in order: a task
+// only ever blocks on tasks that some worker has already picked up
+class task_graph
+{
+private:
+    struct node
+    {
+        std::string name;
+        std::function<void()> work;
+        std::vector<size_t> deps;
+    };
+
+    std::vector<node> nodes_;
+    std::unordered_map<std::string, size_t> index_;
+
+public:
+    void add(const std::string &name, std::function<void()> work, const std::vector<std::string> &deps = {})
+    {
+        if (index_.count(name))
+        {
+            throw std::runtime_error("Duplicate task: " + name);
+        }
+
+        node n{name, std::move(work), {}};
+        for (const auto &dep : deps)
+        {
+            auto it = index_.find(dep);
+            if (it == index_.end())
+            {
+                throw std::runtime_error("Task " + name + " depends on unknown task: " + dep);
+            }
+            n.deps.push_back(it->second);
+        }
+
+        index_[name] = nodes_.size();
+        nodes_.push_back(std::move(n));
+    }
+
+    size_t size() const
+    {
+        return nodes_.size();
+    }
+
+    // blocks until every task has finished, then rethrows the first failure
+    // (a failed task also fails everything downstream of it)
+    void run(thread_pool &pool)
+    {
+        std::vector<std::shared_future<void>> done;
+        done.reserve(nodes_.size());
+
+        for (const auto &n : nodes_)
+        {
+            std::vector<std::shared_future<void>> waits;
+            for (size_t dep : n.deps)
+            {
+                waits.push_back(done[dep]);
+            }
+
+            const node *task = &n;
+            auto job = [task, waits]()
+            {
+                for (const auto &wait : waits)
+                {
+                    wait.get();
+                }
+                task->work();
+            };
+            done.push_back(pool.submit(job).share());
+        }
+
+        std::exception_ptr first_error;
+        for (auto &result : done)
+        {
+            try
+            {
+                result.get();
+            }
+            catch (...)
+            {
+                if (!first_error)
+                {
+                    first_error = std::current_exception();
+                }
+            }
+        }
+
+        if (first_error)
+        {
+            std::rethrow_exception(first_error);
+        }
+    }
+};
+
+// per worker deques plus one shared injection queue, for work that splits
+// itself up as it goes. roots start in the injection queue and anything a
+// task spawns goes on the deque of the worker running it. a worker takes its
+// own newest task first, then steals the oldest task of another worker, and
+// only then starts a new root, so work already under way is finished (by
+// everyone) before more of it is started
+class work_stealing_pool
+{
+public:
+    // worker is the index of the thread running the task, for per thread state
+    using task = std::function<void(size_t worker)>;
+
+private:
+    struct task_queue
+    {
+        std::mutex mutex;
+        std::deque<task> tasks;
+    };
+
+    size_t thread_count_;
+    std::vector<std::unique_ptr<task_queue>> queues_;
+    task_queue injector_;
+    std::atomic<size_t> pending_{0};
+    std::atomic<bool> failed_{false};
+    std::mutex error_mutex_;
+    std::exception_ptr error_;
+
+    // workers with nothing to take park here until a spawn or the end of the run
+    std::mutex idle_mutex_;
+    std::condition_variable idle_;
+    uint64_t spawned_ = 0;
+
+public:
+    explicit work_stealing_pool(size_t thread_count = std::thread::hardware_concurrency())
+        : thread_count_(std::max<size_t>(1, thread_count))
+    {
+        for (size_t i = 0; i < thread_count_; ++i)
+        {
+            queues_.push_back(std::make_unique<task_queue>());
+        }
+    }
+
+    work_stealing_pool(const work_stealing_pool &) = delete;
+    work_stealing_pool &operator=(const work_stealing_pool &) = delete;
+
+    size_t size() const
+    {
+        return thread_count_;
+    }
+
+    // blocks until the roots and everything they spawned have run, then
+    // rethrows the first failure. after a failure the remaining tasks are
+    // dropped instead of run
+    void run(std::vector<task> roots)
+    {
+        failed_ = false;
+        error_ = nullptr;
+        pending_ = roots.size();
+        for (auto &root : roots)
+        {
+            injector_.tasks.push_back(std::move(root));
+        }
+
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i < thread_count_; ++i)
+        {
+            workers.emplace_back([this, i]()
+                                 { worker_loop(i); });
+        }
+        for (auto &worker : workers)
+        {
+            worker.join();
+        }
+
+        if (error_)
+        {
+            std::rethrow_exception(error_);
+        }
+    }
+
+    // only from inside a running task, with the worker index it was given
+    void spawn(size_t worker, task t)
+    {
+        pending_++;
+        {
+            std::lock_guard<std::mutex> lock(queues_[worker]->mutex);
+            queues_[worker]->tasks.push_back(std::move(t));
+        }
+        std::lock_guard<std::mutex> lock(idle_mutex_);
+        spawned_++;
+        idle_.notify_one();
+    }
+
+private:
+    static bool pop_back(task_queue &queue, task &out)
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty())
+        {
+            return false;
+        }
+        out = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+        return true;
+    }
+
+    static bool pop_front(task_queue &queue, task &out)
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty())
+        {
+            return false;
+        }
+        out = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+        return true;
+    }
+
+    bool next(size_t worker, task &out)
+    {
+        if (pop_back(*queues_[worker], out))
+        {
+            return true;
+        }
+        for (size_t i = 1; i < thread_count_; ++i)
+        {
+            if (pop_front(*queues_[(worker + i) % thread_count_], out))
+            {
+                return true;
+            }
+        }
+        return pop_front(injector_, out);
+    }
+
+    void worker_loop(size_t worker)
+    {
+        while (pending_ > 0)
+        {
+            // read before looking, a spawn after it shows up as a new count
+            uint64_t seen;
+            {
+                std::lock_guard<std::mutex> lock(idle_mutex_);
+                seen = spawned_;
+            }
+            task t;
+            if (!next(worker, t))
+            {
+                std::unique_lock<std::mutex> lock(idle_mutex_);
+                idle_.wait(lock, [&]()
+                           { return pending_ == 0 || spawned_ != seen; });
+                continue;
+            }
+
+            if (!failed_)
+            {
+                try
+                {
+                    t(worker);
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(error_mutex_);
+                    if (!error_)
+                    {
+                        error_ = std::current_exception();
+                    }
+                    failed_ = true;
+                }
+            }
+            if (--pending_ == 0)
+            {
+                std::lock_guard<std::mutex> lock(idle_mutex_);
+                idle_.notify_all();
+            }
+        }
+    }
+};
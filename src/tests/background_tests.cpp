@@ -0,0 +1,67 @@
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <vector>
+
+#include "../background.hpp"
+#include "test_runner.hpp"
+
+int main() {
+    TestRunner runner;
+    const std::string path = "background_test.bin";
+
+    // 10 documents: bin 1 in all of them, bin 2 in five, bin 3 in one
+    std::vector<uint32_t> df(TRIGRAM_BINS, 0);
+    df[1] = 10;
+    df[2] = 5;
+    df[3] = 1;
+    write_background(path, 10, 4096, df.data());
+
+    runner.run_test("Round trips through the mapped file", [&]() {
+        background_model background(path);
+        runner.assert_equals(uint64_t(10), background.documents());
+        runner.assert_equals(uint64_t(4096), background.input_size());
+        runner.assert_equals(uint32_t(5), background.df(2));
+        runner.assert_equals(uint32_t(0), background.df(TRIGRAM_BINS - 1));
+    });
+
+    runner.run_test("Weights fall with document frequency", [&]() {
+        background_model background(path);
+        runner.assert_true(background.weight(1) == 0.0f, "in every document");
+        runner.assert_true(std::fabs(background.weight(3) - std::log(11.0f / 2.0f)) < 1e-6f, "in one");
+        runner.assert_true(background.weight(0) > background.weight(3) && background.weight(3) > background.weight(2), "ordered");
+    });
+
+    runner.run_test("Keeps the highest scoring bins in bin order", [&]() {
+        background_model background(path);
+        histogram_layer layer;
+        layer.name = "sample";
+        layer.bins = {0, 1, 2, 3};
+        layer.counts = {1, 1000, 100, 10};
+        layer.total = 1111;
+        layer.position_mean = {1, 2, 3, 4};
+        layer.position_spread = {5, 6, 7, 8};
+
+        histogram_layer all = informative_bins(layer, background, 0);
+        runner.assert_true(all.bins == std::vector<uint32_t>({0, 2, 3}), "ubiquitous bin dropped");
+        runner.assert_equals(uint64_t(111), all.total);
+
+        // scores: bin 0 2.4, bin 2 60.8, bin 3 17.0
+        histogram_layer top = informative_bins(layer, background, 2);
+        runner.assert_true(top.bins == std::vector<uint32_t>({2, 3}), "top two");
+        runner.assert_true(top.counts == std::vector<uint64_t>({100, 10}), "counts unweighted");
+        runner.assert_true(top.position_mean == std::vector<uint16_t>({3, 4}), "positions follow");
+    });
+
+    runner.run_test("Rejects other files", [&]() {
+        {
+            std::ofstream out(path, std::ios::binary);
+            out << "short";
+        }
+        runner.assert_throws([&]() { background_model background(path); }, "Not a background model");
+    });
+
+    std::remove(path.c_str());
+    runner.print_summary();
+    return runner.tests_passed == runner.tests_run ? 0 : 1;
+}
@@ -0,0 +1,100 @@
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "../bit_trigrams.hpp"
+#include "test_runner.hpp"
+
+// every position of one phase through bit_trigram, the definition
+std::vector<uint32_t> reference_phase(const std::vector<uint8_t> &data, int phase) {
+    std::vector<uint32_t> counts(TRIGRAM_BINS, 0);
+    for (size_t i = 0; i + 4 <= data.size(); ++i) {
+        counts[bit_trigram(data.data() + i, phase)]++;
+    }
+    // the last position only has room for phase 0
+    if (phase == 0 && data.size() >= 3) {
+        counts[trigram_bin(data[data.size() - 3], data[data.size() - 2], data[data.size() - 1])]++;
+    }
+    return counts;
+}
+
+bool same_layer(const histogram_layer &a, const histogram_layer &b) {
+    return a.bins == b.bins && a.counts == b.counts && a.total == b.total;
+}
+
+// data shifted right by `bits`, so its phase `bits` reads the original bytes
+std::vector<uint8_t> shift_right(const std::vector<uint8_t> &data, int bits) {
+    std::vector<uint8_t> out(data.size() + 1, 0);
+    for (size_t i = 0; i < data.size(); ++i) {
+        out[i] |= data[i] >> bits;
+        out[i + 1] |= uint8_t(data[i] << (8 - bits));
+    }
+    return out;
+}
+
+int main() {
+    TestRunner runner;
+    std::mt19937 rng(8);
+    std::vector<uint8_t> data(5000);
+    for (auto &b : data) {
+        b = uint8_t(rng() % 7 * 37);
+    }
+
+    trigram_counter counter;
+    std::vector<uint8_t> buffer;
+
+    runner.run_test("Phase 0 is the byte histogram", [&]() {
+        std::vector<uint32_t> bytes(TRIGRAM_BINS, 0);
+        count_trigrams(data.data(), data.size(), bytes);
+        histogram_layer layer = count_bit_phase(counter, data.data(), data.size(), 0, buffer, "x");
+        runner.assert_true(same_layer(layer, layer_from_dense("x", bytes.data())), "same counts");
+    });
+
+    runner.run_test("Phase b of data shifted by b bits reads the original bytes", [&]() {
+        std::vector<uint32_t> bytes(TRIGRAM_BINS, 0);
+        count_trigrams(data.data(), data.size(), bytes);
+        for (int bits : {1, 3, 7}) {
+            std::vector<uint8_t> shifted = shift_right(data, bits);
+            histogram_layer layer = count_bit_phase(counter, shifted.data(), shifted.size(), bits, buffer, "x");
+            runner.assert_true(same_layer(layer, layer_from_dense("x", bytes.data())), "phase " + std::to_string(bits));
+        }
+    });
+
+    runner.run_test("Shifted bytes are the phase's symbols", [&]() {
+        std::vector<uint8_t> out(data.size());
+        for (int phase = 0; phase < BIT_PHASES; ++phase) {
+            // an odd count leaves a tail past the 16 byte steps
+            size_t first = 5, count = 1001;
+            shift_bytes(data.data(), first, count, phase, out.data());
+            bool same = true;
+            for (size_t j = 0; j < count; ++j) {
+                same = same && out[j] == uint8_t(bit_trigram(data.data() + first + j, phase) >> 16);
+            }
+            runner.assert_true(same, "phase " + std::to_string(phase));
+        }
+    });
+
+    runner.run_test("Phases through the counter match bit_trigram", [&]() {
+        for (int phase = 0; phase < BIT_PHASES; ++phase) {
+            std::vector<uint32_t> expected = reference_phase(data, phase);
+            // blocks well below the input, and an odd size for the shift's tail
+            for (size_t block : {size_t(999), BIT_PHASE_BLOCK}) {
+                histogram_layer layer = count_bit_phase(counter, data.data(), data.size(), phase, buffer, "x", block);
+                runner.assert_true(same_layer(layer, layer_from_dense("x", expected.data())),
+                                   "phase " + std::to_string(phase) + " block " + std::to_string(block));
+            }
+        }
+        histogram_layer tiny = count_bit_phase(counter, data.data(), 3, 1, buffer, "x");
+        runner.assert_true(tiny.bins.empty(), "no room for a shifted trigram");
+    });
+
+    runner.run_test("Bit strides pick phases", [&]() {
+        runner.assert_equals(0xffu, bit_stride_mask(1));
+        runner.assert_equals(0x55u, bit_stride_mask(2));
+        runner.assert_equals(0x11u, bit_stride_mask(4));
+        runner.assert_equals(0x01u, bit_stride_mask(8));
+    });
+
+    runner.print_summary();
+    return runner.tests_passed == runner.tests_run ? 0 : 1;
+}
@@ -0,0 +1,88 @@
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../classifier.hpp"
+#include "test_runner.hpp"
+
+// fingerprint features of a few KB of bytes drawn by pick
+template <typename F>
+std::vector<float> sample_features(std::mt19937 &rng, F pick) {
+    std::vector<uint8_t> data(8192);
+    for (auto &b : data) {
+        b = pick(rng);
+    }
+    std::vector<uint32_t> counts(TRIGRAM_BINS, 0);
+    count_trigrams(data.data(), data.size(), counts);
+    return classifier_features(make_fingerprint(layer_from_dense("", counts.data())));
+}
+
+uint8_t text_byte(std::mt19937 &rng) {
+    const char letters[] = "etaoinshrdlu   \n";
+    return uint8_t(letters[rng() % 16]);
+}
+
+uint8_t random_byte(std::mt19937 &rng) {
+    return uint8_t(rng());
+}
+
+uint8_t sparse_byte(std::mt19937 &rng) {
+    return rng() % 4 == 0 ? uint8_t(rng() % 16) : 0;
+}
+
+int main() {
+    TestRunner runner;
+    const std::string path = "classifier_test.fcm";
+    std::mt19937 rng(11);
+
+    classifier_trainer trainer;
+    for (int i = 0; i < 20; ++i) {
+        trainer.add("text", sample_features(rng, text_byte));
+        trainer.add("random", sample_features(rng, random_byte));
+        trainer.add("sparse", sample_features(rng, sparse_byte));
+    }
+    classifier_model model = trainer.finish();
+
+    runner.run_test("Classes come out in label order with their sample counts", [&]() {
+        runner.assert_equals(size_t(3), model.classes.size());
+        runner.assert_equals(std::string("random"), model.classes[0].name);
+        runner.assert_equals(std::string("text"), model.classes[2].name);
+        runner.assert_equals(uint32_t(20), model.classes[1].samples);
+    });
+
+    runner.run_test("Held out samples get their own class", [&]() {
+        for (int i = 0; i < 5; ++i) {
+            runner.assert_equals(std::string("text"), model.classes[classify(model, sample_features(rng, text_byte)).best].name);
+            runner.assert_equals(std::string("random"), model.classes[classify(model, sample_features(rng, random_byte)).best].name);
+            runner.assert_equals(std::string("sparse"), model.classes[classify(model, sample_features(rng, sparse_byte)).best].name);
+        }
+        classification c = classify(model, sample_features(rng, text_byte));
+        runner.assert_true(c.margin > 0.0f, "runner-up scores worse");
+    });
+
+    runner.run_test("Model file round trip classifies the same", [&]() {
+        write_classifier_model(path, model);
+        classifier_model back = read_classifier_model(path);
+        runner.assert_equals(model.classes.size(), back.classes.size());
+        runner.assert_equals(model.classes[1].name, back.classes[1].name);
+
+        std::vector<float> features = sample_features(rng, sparse_byte);
+        classification a = classify(model, features);
+        classification b = classify(back, features);
+        runner.assert_equals(a.best, b.best);
+        runner.assert_true(a.score == b.score, "same score");
+    });
+
+    runner.run_test("Other files are rejected", [&]() {
+        std::ofstream(path) << "not a model";
+        runner.assert_throws([&]() { read_classifier_model(path); }, "Not a classifier model");
+        runner.assert_throws([&]() { classify(classifier_model{}, std::vector<float>(FINGERPRINT_DIMS)); }, "no classes");
+    });
+
+    std::remove(path.c_str());
+    runner.print_summary();
+    return runner.tests_passed == runner.tests_run ? 0 : 1;
+}
@@ -0,0 +1,111 @@
+#include <random>
+#include <vector>
+
+#include "../counters.hpp"
+#include "test_runner.hpp"
+
+histogram_layer exact_layer(const std::vector<uint8_t> &data) {
+    std::vector<uint32_t> counts(TRIGRAM_BINS, 0);
+    count_trigrams(data.data(), data.size(), counts);
+    return layer_from_dense("input", counts.data());
+}
+
+bool same(const histogram_layer &a, const histogram_layer &b) {
+    return a.bins == b.bins && a.counts == b.counts && a.total == b.total;
+}
+
+std::vector<uint8_t> random_bytes(size_t size, unsigned seed) {
+    std::vector<uint8_t> data(size);
+    std::mt19937 rng(seed);
+    for (auto &byte : data) {
+        byte = static_cast<uint8_t>(rng());
+    }
+    return data;
+}
+
+int main() {
+    TestRunner runner;
+
+    runner.run_test("Small inputs stay in the hash", [&]() {
+        std::vector<uint8_t> data;
+        for (int i = 0; i < 5000; i++) {
+            data.push_back(static_cast<uint8_t>("the quick brown fox "[i % 20]));
+        }
+        trigram_counter counter;
+        counter.count(data.data(), data.size());
+        runner.assert_true(counter.current_mode() == trigram_counter::mode::hash);
+        runner.assert_true(counter.memory() < (1 << 20));
+        runner.assert_true(same(exact_layer(data), counter.take("input")));
+    });
+
+    runner.run_test("Many distinct trigrams go dense with the same counts", [&]() {
+        // past the hash, with one trigram far past 16 bits
+        std::vector<uint8_t> data = random_bytes(200000, 1);
+        data.resize(600000, 0);
+        trigram_counter counter;
+        counter.count(data.data(), data.size());
+        runner.assert_true(counter.current_mode() == trigram_counter::mode::narrow);
+        histogram_layer layer = counter.take("input");
+        runner.assert_true(same(exact_layer(data), layer));
+        runner.assert_true(counter.current_mode() == trigram_counter::mode::hash);
+    });
+
+    runner.run_test("Pieces overlapping by two count as the whole", [&]() {
+        std::vector<uint8_t> data = random_bytes(300000, 2);
+        trigram_counter counter;
+        for (size_t offset = 0; offset + 2 < data.size(); offset += 70000) {
+            counter.count(data.data() + offset, std::min<size_t>(data.size() - offset, 70002));
+        }
+        runner.assert_true(same(exact_layer(data), counter.take("input")));
+    });
+
+    runner.run_test("Narrow goes wide past its limit", [&]() {
+        std::vector<uint8_t> data = random_bytes(100000, 3);
+        data.resize(400000, 0x90);
+        trigram_counter counter(150000);
+        counter.count(data.data(), 100002);
+        runner.assert_true(counter.current_mode() == trigram_counter::mode::narrow);
+        counter.count(data.data() + 100000, data.size() - 100000);
+        runner.assert_true(counter.current_mode() == trigram_counter::mode::wide);
+        runner.assert_true(same(exact_layer(data), counter.take("input")));
+
+        // and the tables are clean for the next input
+        std::vector<uint8_t> next = random_bytes(50000, 4);
+        counter.count(next.data(), next.size());
+        runner.assert_true(same(exact_layer(next), counter.take("input")));
+    });
+
+    runner.run_test("Radix partitioning counts the same as direct increments", [&]() {
+        // over a batch and a half, with a zero run that carries out of 16 bits
+        std::vector<uint8_t> data = random_bytes(COUNTER_RADIX_BATCH + COUNTER_RADIX_BATCH / 2, 5);
+        data.resize(data.size() + 300000, 0);
+        histogram_layer exact = exact_layer(data);
+        for (uint64_t narrow_limit : {COUNTER_NARROW_LIMIT, uint64_t(0)}) {
+            trigram_counter counter(narrow_limit);
+            counter.set_dense_path(trigram_counter::dense_path::radix);
+            counter.count(data.data(), data.size());
+            runner.assert_true(same(exact, counter.take("input")));
+
+            // pieces carry their key across the seam
+            size_t half = data.size() / 2;
+            counter.count(data.data(), half + 2);
+            counter.count(data.data() + half, data.size() - half);
+            runner.assert_true(same(exact, counter.take("input")));
+        }
+    });
+
+    runner.run_test("Entropy probe tells random bytes from text", [&]() {
+        std::vector<uint8_t> random = random_bytes(1 << 20, 6);
+        std::vector<uint8_t> text;
+        for (size_t i = 0; i < random.size(); i++) {
+            text.push_back(static_cast<uint8_t>("the quick brown fox "[random[i] % 20]));
+        }
+        runner.assert_true(counters_detail::byte_entropy(random.data(), random.size()) > 7.9);
+        runner.assert_true(trigram_counter::high_entropy(random.data(), random.size(), trigram_counter::mode::narrow));
+        runner.assert_true(!trigram_counter::high_entropy(text.data(), text.size(), trigram_counter::mode::wide));
+        runner.assert_equals(0.0, counters_detail::byte_entropy(text.data(), 1));
+    });
+
+    runner.print_summary();
+    return runner.tests_passed == runner.tests_run ? 0 : 1;
+}
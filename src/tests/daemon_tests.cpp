@@ -0,0 +1,112 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../daemon.hpp"
+#include "test_runner.hpp"
+
+// a histogram whose single bin records how long the file is, counted slowly
+fcube fake_count(const std::string &path, std::atomic<int> &calls) {
+    calls++;
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    histogram_layer layer;
+    layer.name = path;
+    layer.bins = {static_cast<uint32_t>(in.tellg())};
+    layer.counts = {1};
+    layer.total = 1;
+    fcube cube;
+    cube.input_size = static_cast<uint64_t>(in.tellg());
+    cube.layers.push_back(layer);
+    return cube;
+}
+
+std::string make_file(const std::string &name, size_t size) {
+    std::string path = "/tmp/daemon_tests_" + std::to_string(::getpid()) + "_" + name;
+    std::ofstream(path, std::ios::binary) << std::string(size, 'x');
+    return path;
+}
+
+int main() {
+    TestRunner runner;
+    std::string socket_path = "/tmp/daemon_tests_" + std::to_string(::getpid()) + ".sock";
+    std::string a = make_file("a", 100);
+    std::string b = make_file("b", 200);
+    std::string c = make_file("c", 300);
+
+    std::atomic<int> calls{0};
+    // too little room for all three small results
+    histogram_server server(socket_path, 200, [&](const std::string &path) { return fake_count(path, calls); });
+    std::thread serving([&]() { server.run(); });
+    while (::access(socket_path.c_str(), F_OK) != 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    runner.run_test("Counts a file once for concurrent requests", [&]() {
+        std::vector<std::thread> clients;
+        std::atomic<int> good{0};
+        for (int i = 0; i < 8; i++) {
+            clients.emplace_back([&]() {
+                auto histogram = request_histogram(socket_path, a);
+                std::vector<fcube_layer_view> layers = histogram->layers();
+                good += layers.size() == 1 && layers[0].bins[0] == 100;
+            });
+        }
+        for (auto &t : clients) {
+            t.join();
+        }
+        runner.assert_equals(8, good.load());
+        runner.assert_equals(1, calls.load());
+    });
+
+    runner.run_test("Answers later opens from the cache", [&]() {
+        auto histogram = request_histogram(socket_path, a);
+        runner.assert_equals(uint32_t(100), histogram->layers()[0].bins[0]);
+        runner.assert_equals(1, calls.load());
+        runner.assert_equals(uint64_t(9), server.statistics().hits + server.statistics().counts);
+    });
+
+    runner.run_test("Evicts the oldest results past the budget", [&]() {
+        request_histogram(socket_path, b);
+        request_histogram(socket_path, c);
+        histogram_server::stats stats = server.statistics();
+        runner.assert_true(stats.cached_bytes <= 200);
+        runner.assert_true(stats.entries < 3);
+
+        // a was evicted, so it is counted again
+        request_histogram(socket_path, a);
+        runner.assert_equals(4, calls.load());
+    });
+
+    runner.run_test("Recounts a file that changed", [&]() {
+        std::ofstream(c, std::ios::binary | std::ios::app) << "yy";
+        auto histogram = request_histogram(socket_path, c);
+        runner.assert_equals(uint32_t(302), histogram->layers()[0].bins[0]);
+    });
+
+    runner.run_test("Only the owner can connect", [&]() {
+        struct stat st{};
+        runner.assert_true(::stat(socket_path.c_str(), &st) == 0, "socket exists");
+        runner.assert_equals(unsigned(S_IRUSR | S_IWUSR), unsigned(st.st_mode & 0777));
+    });
+
+    runner.run_test("Reports errors without a descriptor", [&]() {
+        runner.assert_throws([&]() { request_histogram(socket_path, a + ".missing"); }, "Failed to resolve");
+        runner.assert_throws([&]() { request_histogram(socket_path + ".none", a); }, "No daemon");
+    });
+
+    server.stop();
+    serving.join();
+    std::remove(a.c_str());
+    std::remove(b.c_str());
+    std::remove(c.c_str());
+    runner.print_summary();
+    return runner.tests_passed == runner.tests_run ? 0 : 1;
+}
@@ -0,0 +1,64 @@
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "../diff.hpp"
+#include "test_runner.hpp"
+
+histogram_layer make_layer(const std::vector<uint32_t> &bins, const std::vector<uint64_t> &counts) {
+    histogram_layer layer;
+    layer.bins = bins;
+    layer.counts = counts;
+    for (uint64_t count : counts) {
+        layer.total += count;
+    }
+    return layer;
+}
+
+int main() {
+    TestRunner runner;
+
+    runner.run_test("Shares line up over the union of bins", [&]() {
+        histogram_diff diff = diff_layers(make_layer({1, 5, 9}, {2, 2, 4}), make_layer({5, 7}, {1, 3}));
+        runner.assert_true(diff.bins == std::vector<uint32_t>({1, 5, 7, 9}), "union");
+        runner.assert_true(diff.before == std::vector<float>({0.25f, 0.25f, 0.0f, 0.5f}), "before shares");
+        runner.assert_true(diff.after == std::vector<float>({0.0f, 0.25f, 0.75f, 0.0f}), "after shares");
+        runner.assert_true(diff.delta == std::vector<float>({-0.25f, 0.0f, 0.75f, -0.5f}), "delta");
+        runner.assert_true(std::fabs(diff.distance - 0.75f) < 1e-6f, "total variation");
+    });
+
+    runner.run_test("Same shape is no change, disjoint is all change", [&]() {
+        histogram_layer a = make_layer({3, 4}, {10, 30});
+        runner.assert_true(diff_layers(a, make_layer({3, 4}, {1, 3})).distance < 1e-6f, "scaled copy");
+        runner.assert_true(std::fabs(diff_layers(a, make_layer({8}, {5})).distance - 1.0f) < 1e-6f, "disjoint");
+        runner.assert_true(diff_layers(histogram_layer(), histogram_layer()).bins.empty(), "both empty");
+    });
+
+    runner.run_test("Vector kernel matches the scalar one", [&]() {
+        std::mt19937 rng(41);
+        size_t n = 1003;
+        std::vector<float> a(n), b(n), a2, b2, d1(n), d2(n);
+        for (size_t i = 0; i < n; i++) {
+            a[i] = float(rng() % 1000);
+            b[i] = float(rng() % 1000);
+        }
+        a2 = a;
+        b2 = b;
+        float s1 = diff_detail::shares_scalar(a.data(), b.data(), d1.data(), 1e-3f, 2e-3f, n);
+        float s2 = diff_detail::shares(a2.data(), b2.data(), d2.data(), 1e-3f, 2e-3f, n);
+        runner.assert_true(std::fabs(s1 - s2) < 1e-3f * s1, "sums");
+        runner.assert_true(d1 == d2 && a == a2 && b == b2, "elementwise");
+    });
+
+    runner.run_test("Top changes go either way, largest first", [&]() {
+        histogram_diff diff = diff_layers(make_layer({1, 2, 3}, {50, 30, 20}), make_layer({1, 2, 4}, {50, 10, 40}));
+        std::vector<size_t> top = top_changes(diff, 2);
+        runner.assert_equals(size_t(2), top.size());
+        runner.assert_equals(uint32_t(4), diff.bins[top[0]]);
+        runner.assert_true(diff.delta[top[0]] > 0.0f && diff.delta[top[1]] < 0.0f, "signs");
+        runner.assert_equals(size_t(4), top_changes(diff, 10).size());
+    });
+
+    runner.print_summary();
+    return runner.tests_passed == runner.tests_run ? 0 : 1;
+}
@@ -0,0 +1,77 @@
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "../fingerprint.hpp"
+#include "test_runner.hpp"
+
+std::vector<float> random_distribution(std::mt19937 &rng, size_t n, float zero_fraction) {
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    std::vector<float> p(n);
+    float total = 0.0f;
+    for (auto &v : p) {
+        v = uniform(rng) < zero_fraction ? 0.0f : uniform(rng);
+        total += v;
+    }
+    if (total == 0.0f) {
+        p[0] = total = 1.0f;
+    }
+    for (auto &v : p) {
+        v /= total;
+    }
+    return p;
+}
+
+int main() {
+    TestRunner runner;
+
+    runner.run_test("Fingerprint cells are 32 trigrams wide and sum to one", [&]() {
+        histogram_layer layer;
+        layer.bins = {trigram_bin(0, 0, 0), trigram_bin(31, 31, 31), trigram_bin(32, 0, 0), trigram_bin(255, 255, 255)};
+        layer.counts = {1, 1, 2, 4};
+        std::vector<float> fp = make_fingerprint(layer);
+
+        runner.assert_equals(FINGERPRINT_DIMS, fp.size());
+        runner.assert_true(std::abs(fp[0] - 0.25f) < 1e-6f, "first cell");
+        runner.assert_true(std::abs(fp[FINGERPRINT_SIDE * FINGERPRINT_SIDE] - 0.25f) < 1e-6f, "x = 32 is the next x cell");
+        runner.assert_true(std::abs(fp[FINGERPRINT_DIMS - 1] - 0.5f) < 1e-6f, "last cell");
+
+        histogram_layer empty;
+        std::vector<float> none = make_fingerprint(empty);
+        runner.assert_true(none[0] == 0.0f, "empty layer stays zero");
+    });
+
+    runner.run_test("Distances of identical and disjoint distributions", [&]() {
+        std::vector<float> a(FINGERPRINT_DIMS, 0.0f), b(FINGERPRINT_DIMS, 0.0f);
+        a[3] = 1.0f;
+        b[400] = 1.0f;
+        runner.assert_true(cosine_distance(a.data(), a.data()) < 1e-6f, "cosine self");
+        runner.assert_true(js_distance(a.data(), a.data()) < 1e-3f, "js self");
+        runner.assert_true(std::abs(cosine_distance(a.data(), b.data()) - 1.0f) < 1e-6f, "cosine disjoint");
+        runner.assert_true(std::abs(js_distance(a.data(), b.data()) - 1.0f) < 1e-4f, "js disjoint");
+    });
+
+    runner.run_test("Dispatched kernels agree with the scalar ones", [&]() {
+        std::mt19937 rng(5);
+        for (size_t n : {size_t(FINGERPRINT_DIMS), size_t(13), size_t(1)}) {
+            std::vector<float> p = random_distribution(rng, n, 0.3f);
+            std::vector<float> q = random_distribution(rng, n, 0.3f);
+            float js = js_distance(p.data(), q.data(), n);
+            float js_ref = fingerprint_detail::js_scalar(p.data(), q.data(), n);
+            float cos = cosine_distance(p.data(), q.data(), n);
+            float cos_ref = fingerprint_detail::cosine_scalar(p.data(), q.data(), n);
+            float dot = dot_product(p.data(), q.data(), n);
+            float dot_ref = fingerprint_detail::dot_scalar(p.data(), q.data(), n);
+            runner.assert_true(std::abs(js - js_ref) < 1e-4f, "js n=" + std::to_string(n));
+            runner.assert_true(std::abs(cos - cos_ref) < 1e-5f, "cosine n=" + std::to_string(n));
+            runner.assert_true(std::abs(dot - dot_ref) < 1e-5f * std::max(1.0f, dot_ref), "dot n=" + std::to_string(n));
+            float weighted = weighted_distance(p.data(), q.data(), p.data(), n);
+            float weighted_ref = fingerprint_detail::weighted_scalar(p.data(), q.data(), p.data(), n);
+            runner.assert_true(std::abs(weighted - weighted_ref) < 1e-6f, "weighted n=" + std::to_string(n));
+        }
+    });
+
+    runner.print_summary();
+    return runner.tests_passed == runner.tests_run ? 0 : 1;
+}
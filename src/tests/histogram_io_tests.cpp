@@ -0,0 +1,153 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../histogram_io.hpp"
+#include "test_runner.hpp"
+
+int main() {
+    TestRunner runner;
+    const std::string path = "histogram_io_test.fcube";
+
+    runner.run_test("Dense histogram becomes sorted sparse layer", [&]() {
+        std::vector<uint32_t> dense(TRIGRAM_BINS, 0);
+        dense[trigram_bin('a', 'b', 'c')] = 3;
+        dense[trigram_bin(0, 0, 0)] = 5;
+        dense[TRIGRAM_BINS - 1] = 1;
+
+        histogram_layer layer = layer_from_dense("x", dense.data());
+        runner.assert_equals(size_t(3), layer.bins.size());
+        runner.assert_equals(uint32_t(0), layer.bins[0]);
+        runner.assert_equals(uint32_t(TRIGRAM_BINS - 1), layer.bins[2]);
+        runner.assert_equals(uint64_t(9), layer.total);
+    });
+
+    runner.run_test("Layers round trip", [&]() {
+        fcube cube;
+        cube.input_size = 12345;
+        histogram_layer a;
+        a.name = "first.bin";
+        a.bins = {1, 70000, 16000000};
+        a.counts = {4, 1ull << 40, 7};
+        a.total = 4 + (1ull << 40) + 7;
+        histogram_layer empty;
+        empty.name = "";
+        histogram_layer b;
+        b.name = "dir/second";
+        b.bins = {9};
+        b.counts = {2};
+        b.total = 2;
+        cube.layers = {a, empty, b};
+        write_fcube(path, cube);
+
+        fcube back = read_fcube(path);
+        runner.assert_equals(uint64_t(12345), back.input_size);
+        runner.assert_equals(size_t(3), back.layers.size());
+        runner.assert_true(back.layers[0].bins == a.bins && back.layers[0].counts == a.counts, "first layer");
+        runner.assert_equals(a.total, back.layers[0].total);
+        runner.assert_true(back.layers[1].bins.empty(), "empty layer");
+        runner.assert_true(back.find("dir/second") != nullptr, "find by name");
+        runner.assert_equals(uint64_t(2), back.find("dir/second")->counts[0]);
+        runner.assert_true(back.find("missing") == nullptr, "missing layer");
+    });
+
+    runner.run_test("Rejects truncated and foreign files", [&]() {
+        {
+            std::ofstream out(path, std::ios::binary);
+            out << "not a histogram at all, really";
+        }
+        runner.assert_throws([&]() { read_fcube(path); }, "Not an fcube");
+
+        fcube cube;
+        histogram_layer a;
+        a.name = "a";
+        a.bins = {1, 2, 3};
+        a.counts = {1, 1, 1};
+        cube.layers = {a};
+        write_fcube(path, cube);
+        std::string bytes;
+        {
+            std::ifstream in(path, std::ios::binary);
+            bytes.assign(std::istreambuf_iterator<char>(in), {});
+        }
+        {
+            std::ofstream out(path, std::ios::binary);
+            out.write(bytes.data(), bytes.size() - 4);
+        }
+        runner.assert_throws([&]() { read_fcube(path); }, "Truncated");
+    });
+
+    runner.run_test("Positions round trip when flagged", [&]() {
+        fcube cube;
+        cube.flags = FCUBE_POSITIONS;
+        histogram_layer a;
+        a.name = "a";
+        a.bins = {5, 6, 7};
+        a.counts = {1, 2, 3};
+        a.total = 6;
+        a.position_mean = {0, 32768, 65535};
+        a.position_spread = {0, 100, 7};
+        histogram_layer empty;
+        empty.name = "empty";
+        cube.layers = {a, empty, a};
+        write_fcube(path, cube);
+
+        fcube back = read_fcube(path);
+        runner.assert_equals(FCUBE_POSITIONS, back.flags);
+        runner.assert_true(back.layers[2].position_mean == a.position_mean, "means");
+        runner.assert_true(back.layers[2].position_spread == a.position_spread, "spreads");
+        runner.assert_true(back.layers[0].has_positions() && !back.layers[1].has_positions(), "has_positions");
+
+        // unflagged files carry none, and a flagged writer wants them on every layer
+        cube.flags = 0;
+        write_fcube(path, cube);
+        runner.assert_true(!read_fcube(path).layers[0].has_positions(), "unflagged");
+        histogram_layer bare;
+        bare.bins = {1};
+        bare.counts = {1};
+        fcube_writer writer(path, FCUBE_POSITIONS);
+        runner.assert_throws([&]() { writer.add(bare); }, "Bad histogram layer");
+    });
+
+    runner.run_test("Views layers in place from memory", [&]() {
+        fcube cube;
+        cube.flags = FCUBE_POSITIONS | FCUBE_SHARD;
+        histogram_layer a;
+        a.name = "odd";
+        a.bins = {1, 2, 3};
+        a.counts = {7, 8, 9};
+        a.total = 24;
+        a.position_mean = {1, 2, 3};
+        a.position_spread = {4, 5, 6};
+        histogram_layer b = a;
+        b.name = "second";
+        b.bins = {16000000};
+        b.counts = {1};
+        b.total = 1;
+        b.position_mean = {0};
+        b.position_spread = {0};
+        cube.layers = {a, b};
+        write_fcube(path, cube);
+
+        std::ifstream in(path, std::ios::binary);
+        std::string bytes((std::istreambuf_iterator<char>(in)), {});
+        std::vector<uint64_t> aligned((bytes.size() + 7) / 8);
+        std::memcpy(aligned.data(), bytes.data(), bytes.size());
+        const uint8_t *data = reinterpret_cast<const uint8_t *>(aligned.data());
+
+        std::vector<fcube_layer_view> views = view_fcube(data, bytes.size());
+        runner.assert_equals(size_t(2), views.size());
+        runner.assert_equals(std::string("odd"), views[0].name);
+        runner.assert_equals(uint64_t(9), views[0].counts[2]);
+        runner.assert_equals(uint32_t(16000000), views[1].bins[0]);
+        runner.assert_equals(uint64_t(1), views[1].total);
+        runner.assert_throws([&]() { view_fcube(data, bytes.size() - 1); }, "Truncated");
+    });
+
+    std::remove(path.c_str());
+    runner.print_summary();
+    return runner.tests_passed == runner.tests_run ? 0 : 1;
+}
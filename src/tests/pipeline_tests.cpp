@@ -0,0 +1,93 @@
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "../pipeline.hpp"
+#include "test_runner.hpp"
+
+int main() {
+    TestRunner runner;
+
+    runner.run_test("Keeps order and refuses pushes when full", [&]() {
+        bounded_queue<int> queue(3);
+        runner.assert_equals(size_t(4), queue.capacity());
+        for (int i = 0; i < 4; i++) {
+            runner.assert_true(queue.try_push(i));
+        }
+        int extra = 9;
+        runner.assert_true(!queue.try_push(extra));
+        runner.assert_equals(size_t(4), queue.size());
+        for (int i = 0; i < 4; i++) {
+            int value = -1;
+            runner.assert_true(queue.try_pop(value));
+            runner.assert_equals(i, value);
+        }
+        int value;
+        runner.assert_true(!queue.try_pop(value));
+    });
+
+    runner.run_test("Drains after close, then stops consumers", [&]() {
+        bounded_queue<std::unique_ptr<int>> queue(4);
+        queue.push(std::make_unique<int>(1));
+        queue.push(std::make_unique<int>(2));
+        queue.close();
+        std::unique_ptr<int> value;
+        runner.assert_true(queue.pop(value));
+        runner.assert_equals(1, *value);
+        runner.assert_true(queue.pop(value));
+        runner.assert_equals(2, *value);
+        runner.assert_true(!queue.pop(value));
+    });
+
+    runner.run_test("Passes every item exactly once between many threads", [&]() {
+        bounded_queue<uint64_t> queue(8);
+        const uint64_t per_producer = 20000;
+        std::atomic<uint64_t> sum{0};
+        std::atomic<uint64_t> popped{0};
+        std::vector<std::thread> producers, consumers;
+        for (uint64_t p = 0; p < 4; p++) {
+            producers.emplace_back([&, p]() {
+                for (uint64_t i = 0; i < per_producer; i++) {
+                    queue.push(p * per_producer + i + 1);
+                }
+            });
+        }
+        for (int c = 0; c < 4; c++) {
+            consumers.emplace_back([&]() {
+                uint64_t value;
+                while (queue.pop(value)) {
+                    sum += value;
+                    popped++;
+                }
+            });
+        }
+        for (auto &t : producers) {
+            t.join();
+        }
+        queue.close();
+        for (auto &t : consumers) {
+            t.join();
+        }
+        uint64_t n = 4 * per_producer;
+        runner.assert_equals(n, popped.load());
+        runner.assert_equals(n * (n + 1) / 2, sum.load());
+    });
+
+    runner.run_test("Latency percentiles land in the right bucket", [&]() {
+        latency_histogram latency;
+        runner.assert_equals(uint64_t(0), latency.percentile_us(0.5));
+        for (int i = 0; i < 99; i++) {
+            latency.add(100);
+        }
+        latency.add(50000);
+        runner.assert_equals(uint64_t(100), latency.count());
+        runner.assert_equals(uint64_t(127), latency.percentile_us(0.5));
+        runner.assert_equals(uint64_t(50000), latency.percentile_us(1.0));
+        runner.assert_equals(uint64_t(50000), latency.max_us());
+        runner.assert_true(latency.mean_us() > 500.0 && latency.mean_us() < 700.0);
+    });
+
+    runner.print_summary();
+    return runner.tests_passed == runner.tests_run ? 0 : 1;
+}
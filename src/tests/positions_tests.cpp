@@ -0,0 +1,95 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "../positions.hpp"
+#include "test_runner.hpp"
+
+histogram_layer counted(const std::vector<uint8_t> &data) {
+    std::vector<uint32_t> dense(TRIGRAM_BINS, 0);
+    count_trigrams(data.data(), data.size(), dense);
+    return layer_from_dense("data", dense.data());
+}
+
+size_t index_of(const histogram_layer &layer, uint32_t bin) {
+    return std::lower_bound(layer.bins.begin(), layer.bins.end(), bin) - layer.bins.begin();
+}
+
+int main() {
+    TestRunner runner;
+    std::mt19937 rng(39);
+    std::vector<uint32_t> slots(TRIGRAM_BINS, 0);
+
+    runner.run_test("Clustered and spread trigrams get their offsets", [&]() {
+        // "abc" only in the first 1%, zeros all over, "xyz" evenly spaced
+        std::vector<uint8_t> data(1 << 20, 0);
+        for (size_t i = 0; i < data.size() / 100; i += 3) {
+            data[i] = 'a'; data[i + 1] = 'b'; data[i + 2] = 'c';
+        }
+        for (size_t i = data.size() / 50; i + 3 < data.size(); i += 4096) {
+            data[i] = 'x'; data[i + 1] = 'y'; data[i + 2] = 'z';
+        }
+        histogram_layer layer = counted(data);
+        add_positions(layer, data.data(), data.size(), slots.data());
+        runner.assert_equals(layer.bins.size(), layer.position_mean.size());
+
+        size_t abc = index_of(layer, trigram_bin('a', 'b', 'c'));
+        size_t xyz = index_of(layer, trigram_bin('x', 'y', 'z'));
+        runner.assert_true(layer.position_mean[abc] < 65536 / 100, "abc sits at the start");
+        runner.assert_true(layer.position_spread[abc] < 65536 / 300, "abc is tight");
+
+        // uniform over [0.02, 1): mean 0.51, std dev 0.98 / sqrt(12)
+        double mean = layer.position_mean[xyz] / 65536.0;
+        double spread = layer.position_spread[xyz] / 65536.0;
+        runner.assert_true(std::fabs(mean - 0.51) < 0.005, "xyz mean " + std::to_string(mean));
+        runner.assert_true(std::fabs(spread - 0.98 / std::sqrt(12.0)) < 0.005, "xyz spread " + std::to_string(spread));
+    });
+
+    runner.run_test("Matches a direct computation", [&]() {
+        std::vector<uint8_t> data(200000);
+        for (auto &byte : data) {
+            byte = uint8_t(rng() % 6);
+        }
+        histogram_layer layer = counted(data);
+        add_positions(layer, data.data(), data.size(), slots.data());
+
+        std::vector<double> sum(TRIGRAM_BINS, 0), squares(TRIGRAM_BINS, 0);
+        for (size_t i = 0; i + 2 < data.size(); ++i) {
+            double p = double(i) / data.size();
+            uint32_t bin = trigram_bin(data[i], data[i + 1], data[i + 2]);
+            sum[bin] += p;
+            squares[bin] += p * p;
+        }
+        double worst = 0;
+        for (size_t i = 0; i < layer.bins.size(); ++i) {
+            double n = double(layer.counts[i]);
+            double mean = sum[layer.bins[i]] / n;
+            double spread = std::sqrt(std::max(squares[layer.bins[i]] / n - mean * mean, 0.0));
+            worst = std::max(worst, std::fabs(mean - layer.position_mean[i] / 65536.0));
+            worst = std::max(worst, std::fabs(spread - layer.position_spread[i] / 65536.0));
+        }
+        runner.assert_true(worst < 1e-3, "off by " + std::to_string(worst));
+    });
+
+    runner.run_test("Leaves the slot table zeroed", [&]() {
+        bool clean = true;
+        for (uint32_t slot : slots) {
+            clean = clean && slot == 0;
+        }
+        runner.assert_true(clean, "slots cleared");
+    });
+
+    runner.run_test("Tiny inputs", [&]() {
+        std::vector<uint8_t> data = {1, 2, 3};
+        histogram_layer layer = counted(data);
+        add_positions(layer, data.data(), data.size(), slots.data());
+        runner.assert_equals(uint16_t(0), layer.position_mean[0]);
+        runner.assert_equals(uint16_t(0), layer.position_spread[0]);
+        runner.assert_equals(uint32_t(0), slots[trigram_bin(1, 2, 3)]);
+    });
+
+    runner.print_summary();
+    return runner.tests_passed == runner.tests_run ? 0 : 1;
+}
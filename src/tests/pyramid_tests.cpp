@@ -0,0 +1,100 @@
+#include <cmath>
+#include <iostream>
+#include <vector>
+#include <random>
+
+#include "../pyramid.hpp"
+#include "test_runner.hpp"
+
+int main() {
+    TestRunner runner;
+
+    runner.run_test("Counts are preserved at every level", [&]() {
+        std::mt19937 rng(7);
+        std::vector<Voxel> voxels;
+        uint64_t total = 0;
+        for (int i = 0; i < 5000; ++i) {
+            Voxel v{int(rng() % 256), int(rng() % 256), int(rng() % 256), uint64_t(rng() % 1000 + 1)};
+            voxels.push_back(v);
+            total += v.count;
+        }
+
+        voxel_pyramid pyramid;
+        pyramid.build(voxels);
+
+        runner.assert_equals(voxels.size(), pyramid.cells(0).size());
+        for (int level = 0; level < PYRAMID_LEVELS; ++level) {
+            uint64_t sum = 0;
+            for (const auto& cell : pyramid.cells(level)) {
+                sum += uint64_t(cell.count);
+            }
+            runner.assert_equals(total, sum);
+        }
+        runner.assert_true(pyramid.cells(4).size() <= size_t(BRICK_COUNT), "top level has one cell per brick at most");
+    });
+
+    runner.run_test("Neighbouring voxels merge into one coarse cell", [&]() {
+        std::vector<Voxel> voxels = {
+            {0, 0, 0, 1}, {1, 0, 0, 2}, {0, 1, 1, 3}, {1, 1, 1, 4}, // one level 1 cell
+            {2, 0, 0, 10}};
+
+        voxel_pyramid pyramid;
+        pyramid.build(voxels);
+
+        const auto& level1 = pyramid.cells(1);
+        runner.assert_equals(size_t(2), level1.size());
+        runner.assert_equals(int64_t(10), level1[0].count);
+        runner.assert_equals(1, level1[1].x);
+        runner.assert_equals(int64_t(10), pyramid.max_count(1));
+
+        runner.assert_equals(size_t(1), pyramid.cells(4).size());
+        runner.assert_equals(int64_t(20), pyramid.cells(4)[0].count);
+    });
+
+    runner.run_test("Bricks are contiguous runs of cells", [&]() {
+        std::vector<Voxel> voxels = {{255, 255, 255, 1}, {0, 0, 0, 1}, {17, 0, 0, 1}, {3, 2, 1, 1}};
+
+        voxel_pyramid pyramid;
+        pyramid.build(voxels);
+
+        for (int level = 0; level < PYRAMID_LEVELS; ++level) {
+            uint32_t covered = 0;
+            for (int brick = 0; brick < BRICK_COUNT; ++brick) {
+                for (uint32_t i = pyramid.brick_begin(level, brick); i < pyramid.brick_end(level, brick); ++i) {
+                    runner.assert_equals(brick, voxel_pyramid::brick_of(pyramid.cells(level)[i], level));
+                    covered++;
+                }
+            }
+            runner.assert_equals(uint32_t(pyramid.cells(level).size()), covered);
+        }
+
+        runner.assert_equals(uint32_t(2), pyramid.brick_end(0, 0) - pyramid.brick_begin(0, 0));
+        runner.assert_equals(uint32_t(1), pyramid.brick_end(0, BRICK_COUNT - 1) - pyramid.brick_begin(0, BRICK_COUNT - 1));
+    });
+
+    runner.run_test("Positions and deltas pool into the coarse cells", [&]() {
+        // offsets {0.1, 0.1, 0.1} and {0.5}: mean 0.2, spread sqrt(0.03)
+        std::vector<Voxel> voxels = {{0, 0, 0, 3, 0.1f, 0.0f, 0.25f}, {1, 1, 1, 1, 0.5f, 0.0f, -0.25f}, {2, 0, 0, 1, -1.0f, 0.0f, 0.5f}};
+
+        voxel_pyramid pyramid;
+        pyramid.build(voxels);
+
+        const auto& merged = pyramid.cells(1)[0];
+        runner.assert_true(std::fabs(merged.position - 0.2f) < 1e-6f, "pooled mean");
+        runner.assert_true(std::fabs(merged.spread - std::sqrt(0.03f)) < 1e-6f, "pooled spread");
+
+        // deltas are shares, so they add up
+        runner.assert_true(std::fabs(merged.delta) < 1e-6f, "no delta");
+        // anything without positions leaves its parents without them too
+        runner.assert_true(pyramid.cells(2)[0].position < 0.0f, "unknown stays unknown");
+        runner.assert_true(std::fabs(pyramid.cells(2)[0].delta - 0.5f) < 1e-6f, "delta summed");
+    });
+
+    runner.run_test("Out of range voxels are rejected", [&]() {
+        voxel_pyramid pyramid;
+        runner.assert_throws([&]() { pyramid.build({{256, 0, 0, 1}}); }, "outside");
+    });
+
+    runner.print_summary();
+    return runner.tests_passed == runner.tests_run ? 0 : 1;
+}
@@ -0,0 +1,87 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "../rarity.hpp"
+#include "test_runner.hpp"
+
+std::vector<uint32_t> dense_counts(const std::vector<uint8_t> &data) {
+    std::vector<uint32_t> counts(TRIGRAM_BINS, 0);
+    count_trigrams(data.data(), data.size(), counts);
+    return counts;
+}
+
+int main() {
+    TestRunner runner;
+
+    runner.run_test("Hilbert curve visits every cell once, each next to the last", [&]() {
+        const uint32_t side = 64;
+        std::vector<bool> seen(side * side, false);
+        uint32_t px = 0, py = 0;
+        bool adjacent = true, inverse = true, unique = true;
+        for (uint64_t d = 0; d < side * side; d++) {
+            uint32_t x, y;
+            hilbert_point(side, d, x, y);
+            unique = unique && !seen[y * side + x];
+            seen[y * side + x] = true;
+            inverse = inverse && hilbert_index(side, x, y) == d;
+            if (d > 0) {
+                adjacent = adjacent && std::abs(int(x) - int(px)) + std::abs(int(y) - int(py)) == 1;
+            }
+            px = x;
+            py = y;
+        }
+        runner.assert_true(unique);
+        runner.assert_true(inverse);
+        runner.assert_true(adjacent);
+    });
+
+    // a repeating pattern with 512 random bytes at 300000
+    std::vector<uint8_t> data(1 << 20);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = static_cast<uint8_t>("abcdefgh"[i % 8]);
+    }
+    std::mt19937 rng(3);
+    for (size_t i = 300000; i < 300512; i++) {
+        data[i] = static_cast<uint8_t>(rng());
+    }
+    std::vector<uint32_t> counts = dense_counts(data);
+
+    runner.run_test("The island is the rarest cell", [&]() {
+        rarity_map map = make_rarity_map(data.data(), data.size(), counts.data(), data.size() - 2, 32);
+        runner.assert_equals(uint64_t(1024), map.cell_bytes);
+        size_t rarest = std::max_element(map.cells.begin(), map.cells.end()) - map.cells.begin();
+        runner.assert_equals(size_t(300256 / 1024), rarest); // the cell holding most of the island
+        runner.assert_true(std::abs(map.cells[0] - 3.0f) < 0.1f); // eight trigrams, equally common
+        runner.assert_true(map.cells[rarest] > 15.0f);
+    });
+
+    runner.run_test("Tiles on the pool give the same map", [&]() {
+        work_stealing_pool pool(4);
+        rarity_map serial = make_rarity_map(data.data(), data.size(), counts.data(), data.size() - 2, 512);
+        rarity_map tiled = make_rarity_map(data.data(), data.size(), counts.data(), data.size() - 2, 512, &pool);
+        runner.assert_true(serial.cells == tiled.cells);
+        runner.assert_throws([&]() { make_rarity_map(data.data(), data.size(), counts.data(), data.size() - 2, 100); }, "power of two");
+    });
+
+    runner.run_test("Writes and reads the image back", [&]() {
+        rarity_image image = rarity_pixels(make_rarity_map(data.data(), data.size(), counts.data(), data.size() - 2, 32));
+        uint32_t x, y;
+        hilbert_point(32, 300256 / 1024, x, y);
+        runner.assert_equals(uint8_t(255), image.pixels[y * 32 + x]);
+
+        std::string path = "/tmp/rarity_tests.pgm";
+        write_rarity_pgm(path, image);
+        rarity_image back = read_rarity_pgm(path);
+        runner.assert_equals(uint32_t(32), back.side);
+        runner.assert_equals(uint64_t(1024), back.cell_bytes);
+        runner.assert_equals(uint64_t(data.size()), back.input_size);
+        runner.assert_true(back.pixels == image.pixels);
+        std::remove(path.c_str());
+    });
+
+    runner.print_summary();
+    return runner.tests_passed == runner.tests_run ? 0 : 1;
+}
@@ -1 +1,23 @@
 g++ -std=c++17 -o ap_tests arg_parser_tests.cpp && ./ap_tests
+g++ -std=c++17 -pthread -o tasks_tests tasks_tests.cpp && ./tasks_tests
+g++ -std=c++17 -o pyramid_tests pyramid_tests.cpp && ./pyramid_tests
+g++ -std=c++17 -o slab_tests slab_tests.cpp && ./slab_tests
+g++ -std=c++17 -O2 -o trigram_tests trigram_tests.cpp && ./trigram_tests
+g++ -std=c++17 -O2 -o trigram_index_tests trigram_index_tests.cpp && ./trigram_index_tests
+g++ -std=c++17 -O2 -o histogram_io_tests histogram_io_tests.cpp && ./histogram_io_tests
+g++ -std=c++17 -O2 -o fingerprint_tests fingerprint_tests.cpp && ./fingerprint_tests
+g++ -std=c++17 -O2 -o similarity_index_tests similarity_index_tests.cpp && ./similarity_index_tests
+g++ -std=c++17 -O2 -o classifier_tests classifier_tests.cpp && ./classifier_tests
+g++ -std=c++17 -O2 -o segment_tests segment_tests.cpp && ./segment_tests
+g++ -std=c++17 -O2 -o bit_trigrams_tests bit_trigrams_tests.cpp && ./bit_trigrams_tests
+g++ -std=c++17 -O2 -o positions_tests positions_tests.cpp && ./positions_tests
+g++ -std=c++17 -O2 -o background_tests background_tests.cpp && ./background_tests
+g++ -std=c++17 -O2 -o diff_tests diff_tests.cpp && ./diff_tests
+g++ -std=c++17 -O2 -pthread -o shards_tests shards_tests.cpp && ./shards_tests
+g++ -std=c++17 -O2 -pthread -o daemon_tests daemon_tests.cpp && ./daemon_tests
+g++ -std=c++17 -O2 -pthread -o pipeline_tests pipeline_tests.cpp && ./pipeline_tests
+g++ -std=c++17 -O2 -o sections_tests sections_tests.cpp && ./sections_tests
+g++ -std=c++17 -O2 -pthread -o rarity_tests rarity_tests.cpp && ./rarity_tests
+g++ -std=c++17 -O2 -o sampling_tests sampling_tests.cpp && ./sampling_tests
+g++ -std=c++17 -O2 -o sketch_tests sketch_tests.cpp && ./sketch_tests
+g++ -std=c++17 -O2 -o counters_tests counters_tests.cpp && ./counters_tests
@@ -0,0 +1,131 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "../sampling.hpp"
+#include "test_runner.hpp"
+
+// what a sampler has counted after taking `blocks` more blocks of the plan
+histogram_layer count_blocks(sample_plan &plan, const std::vector<uint8_t> &data, size_t blocks, std::vector<uint32_t> &counts) {
+    for (const sample_block &block : plan.next(blocks)) {
+        count_trigrams(data.data() + block.offset, block.length + 2, counts);
+    }
+    return layer_from_dense("input", counts.data());
+}
+
+int main() {
+    TestRunner runner;
+
+    runner.run_test("Plan deals every block once, one per stratum per round", [&]() {
+        // 100 blocks, the last one short, in 8 strata of 12 or 13
+        sample_plan plan(99 * 4096 + 1000 + 2, 4096, 8, 7);
+        runner.assert_equals(uint64_t(100), plan.blocks());
+
+        std::vector<sample_block> first = plan.next(8);
+        std::vector<bool> stratum_hit(8, false);
+        for (const auto &block : first) {
+            uint64_t index = block.offset / 4096;
+            for (size_t s = 0; s < 8; s++) {
+                stratum_hit[s] = stratum_hit[s] || (100 * s / 8 <= index && index < 100 * (s + 1) / 8);
+            }
+        }
+        runner.assert_true(std::count(stratum_hit.begin(), stratum_hit.end(), true) == 8);
+
+        std::vector<int> seen(100, 0);
+        uint64_t positions = 0;
+        for (const auto &block : first) {
+            seen[block.offset / 4096]++;
+            positions += block.length;
+        }
+        for (const auto &block : plan.next(1000)) {
+            seen[block.offset / 4096]++;
+            positions += block.length;
+        }
+        runner.assert_true(plan.done());
+        runner.assert_true(std::count(seen.begin(), seen.end(), 1) == 100);
+        runner.assert_equals(plan.positions(), positions);
+        runner.assert_equals(positions, plan.record().sampled);
+    });
+
+    // noisy text: a few common trigrams and a long tail
+    std::vector<uint8_t> data(4 << 20);
+    std::mt19937 rng(11);
+    std::geometric_distribution<int> letter(0.3);
+    for (auto &byte : data) {
+        byte = static_cast<uint8_t>('a' + std::min(letter(rng), 25));
+    }
+    std::vector<uint32_t> exact_counts(TRIGRAM_BINS, 0);
+    count_trigrams(data.data(), data.size(), exact_counts);
+    histogram_layer exact = layer_from_dense("input", exact_counts.data());
+
+    runner.run_test("Intervals of a tenth hold the true counts", [&]() {
+        sample_plan plan(data.size(), 16384);
+        std::vector<uint32_t> counts(TRIGRAM_BINS, 0);
+        histogram_layer sampled = count_blocks(plan, data, plan.blocks() / 10, counts);
+        histogram_layer estimate = estimate_layer(sampled, plan.record());
+        runner.assert_equals(sampled.bins.size(), estimate.bins.size());
+
+        size_t held = 0, checked = 0;
+        for (size_t i = 0; i < estimate.bins.size(); i++) {
+            if (sampled.counts[i] < 100) {
+                continue;
+            }
+            runner.assert_equals(sampled.counts[i], sampled_count(estimate, i));
+            count_interval interval = wilson_interval(sampled.counts[i], estimate.sample);
+            uint64_t truth = exact_counts[estimate.bins[i]];
+            held += interval.low <= truth && truth <= interval.high;
+            checked++;
+        }
+        runner.assert_true(checked > 100);
+        runner.assert_true(held >= checked * 9 / 10);
+    });
+
+    runner.run_test("The whole plan is exact and certain", [&]() {
+        sample_plan plan(data.size(), 16384);
+        std::vector<uint32_t> counts(TRIGRAM_BINS, 0);
+        count_blocks(plan, data, plan.blocks() / 2, counts);
+        histogram_layer sampled = count_blocks(plan, data, plan.blocks(), counts);
+        histogram_layer estimate = estimate_layer(sampled, plan.record());
+        runner.assert_true(estimate.bins == exact.bins);
+        runner.assert_true(estimate.counts == exact.counts);
+        runner.assert_equals(exact.total, estimate.total);
+
+        count_interval interval = wilson_interval(estimate.counts[0], estimate.sample);
+        runner.assert_equals(double(estimate.counts[0]), interval.low);
+        runner.assert_equals(double(estimate.counts[0]), interval.high);
+    });
+
+    runner.run_test("Sample records survive the file", [&]() {
+        sample_plan plan(data.size(), 16384);
+        std::vector<uint32_t> counts(TRIGRAM_BINS, 0);
+        histogram_layer sampled = count_blocks(plan, data, 5, counts);
+        histogram_layer estimate = estimate_layer(sampled, plan.record());
+        fcube cube;
+        cube.input_size = data.size();
+        cube.flags = FCUBE_SAMPLED;
+        cube.layers.push_back(estimate);
+        std::string path = "/tmp/sampling_tests.fcube";
+        write_fcube(path, cube);
+
+        fcube back = read_fcube(path);
+        runner.assert_equals(uint64_t(5), back.layers[0].sample.blocks_read);
+        runner.assert_equals(plan.blocks(), back.layers[0].sample.blocks);
+        runner.assert_equals(estimate.sample.sampled, back.layers[0].sample.sampled);
+        runner.assert_true(back.layers[0].counts == estimate.counts);
+
+        std::ifstream in(path, std::ios::binary);
+        std::string bytes((std::istreambuf_iterator<char>(in)), {});
+        std::vector<uint64_t> aligned((bytes.size() + 7) / 8);
+        std::memcpy(aligned.data(), bytes.data(), bytes.size());
+        std::vector<fcube_layer_view> views = view_fcube(reinterpret_cast<const uint8_t *>(aligned.data()), bytes.size());
+        runner.assert_equals(estimate.bins.size(), views[0].entries);
+        std::remove(path.c_str());
+    });
+
+    runner.print_summary();
+    return runner.tests_passed == runner.tests_run ? 0 : 1;
+}
@@ -0,0 +1,142 @@
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../sections.hpp"
+#include "test_runner.hpp"
+
+// writes value at offset in either byte order, growing bytes as needed
+template <typename T>
+void put(std::vector<uint8_t> &bytes, size_t offset, T value, bool big = false) {
+    if (bytes.size() < offset + sizeof(T)) {
+        bytes.resize(offset + sizeof(T));
+    }
+    for (size_t i = 0; i < sizeof(T); i++) {
+        bytes[offset + (big ? sizeof(T) - 1 - i : i)] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+void put_text(std::vector<uint8_t> &bytes, size_t offset, const std::string &text) {
+    if (bytes.size() < offset + text.size() + 1) {
+        bytes.resize(offset + text.size() + 1);
+    }
+    std::memcpy(bytes.data() + offset, text.c_str(), text.size() + 1);
+}
+
+// 32 bit big endian: null, .text, .bss (no bits), .shstrtab
+std::vector<uint8_t> elf32_be() {
+    std::vector<uint8_t> elf(0x400);
+    const uint8_t ident[] = {0x7f, 'E', 'L', 'F', 1, 2, 1};
+    std::memcpy(elf.data(), ident, sizeof(ident));
+    put<uint32_t>(elf, 32, 0x200, true);  // e_shoff
+    put<uint16_t>(elf, 46, 40, true);     // e_shentsize
+    put<uint16_t>(elf, 48, 4, true);      // e_shnum
+    put<uint16_t>(elf, 50, 3, true);      // e_shstrndx
+    put_text(elf, 0x100, std::string("\0.text\0.bss\0.shstrtab", 22));
+    auto section = [&](size_t i, uint32_t name, uint32_t type, uint32_t offset, uint32_t size) {
+        size_t header = 0x200 + i * 40;
+        put<uint32_t>(elf, header, name, true);
+        put<uint32_t>(elf, header + 4, type, true);
+        put<uint32_t>(elf, header + 16, offset, true);
+        put<uint32_t>(elf, header + 20, size, true);
+    };
+    section(1, 1, 1, 0x40, 0x80);
+    section(2, 7, 8, 0xc0, 0x1000);
+    section(3, 12, 3, 0x100, 22);
+    return elf;
+}
+
+int main() {
+    TestRunner runner;
+
+    runner.run_test("Lists ELF sections with data, by name", [&]() {
+        std::vector<uint8_t> elf = elf32_be();
+        binary_layout layout = parse_sections(elf.data(), elf.size());
+        runner.assert_equals(std::string("elf32"), layout.format);
+        runner.assert_equals(size_t(2), layout.sections.size());
+        runner.assert_equals(std::string(".text"), layout.sections[0].name);
+        runner.assert_equals(uint64_t(0x40), layout.sections[0].offset);
+        runner.assert_equals(uint64_t(0x80), layout.sections[0].size);
+        runner.assert_equals(std::string(".shstrtab"), layout.sections[1].name);
+    });
+
+    runner.run_test("Lists PE sections and the overlay after them", [&]() {
+        std::vector<uint8_t> pe(0x800);
+        pe[0] = 'M';
+        pe[1] = 'Z';
+        put<uint32_t>(pe, 0x3c, 0x80);
+        put<uint32_t>(pe, 0x80, 0x00004550);
+        put<uint16_t>(pe, 0x86, 2);      // sections
+        put<uint16_t>(pe, 0x94, 0xe0);   // optional header size
+        size_t table = 0x80 + 24 + 0xe0;
+        put_text(pe, table, ".text");
+        put<uint32_t>(pe, table + 16, 0x200);
+        put<uint32_t>(pe, table + 20, 0x200);
+        put_text(pe, table + 40, ".rsrc");
+        put<uint32_t>(pe, table + 56, 0x400); // past the end of the file, cut
+        put<uint32_t>(pe, table + 60, 0x600);
+        binary_layout layout = parse_sections(pe.data(), pe.size());
+        runner.assert_equals(std::string("pe"), layout.format);
+        runner.assert_equals(size_t(2), layout.sections.size());
+        runner.assert_equals(uint64_t(0x200), layout.sections[1].size);
+
+        pe.resize(0xb00);
+        layout = parse_sections(pe.data(), pe.size());
+        runner.assert_equals(size_t(3), layout.sections.size());
+        runner.assert_equals(std::string("overlay"), layout.sections[2].name);
+        runner.assert_equals(uint64_t(0x100), layout.sections[2].size);
+    });
+
+    runner.run_test("Lists Mach-O sections, alone and in a universal binary", [&]() {
+        // one __TEXT segment with __text and a zerofill section, and a bare __LINKEDIT
+        std::vector<uint8_t> macho(0x400);
+        put<uint32_t>(macho, 0, 0xfeedfacf);
+        put<uint32_t>(macho, 16, 2);
+        size_t at = 32;
+        put<uint32_t>(macho, at, 0x19);
+        put<uint32_t>(macho, at + 4, 72 + 2 * 80);
+        put_text(macho, at + 8, "__TEXT");
+        put<uint32_t>(macho, at + 64, 2);
+        put_text(macho, at + 72, "__text");
+        put_text(macho, at + 72 + 16, "__TEXT");
+        put<uint64_t>(macho, at + 72 + 40, 0x100);
+        put<uint32_t>(macho, at + 72 + 48, 0x200);
+        put_text(macho, at + 152, "__bss");
+        put<uint64_t>(macho, at + 152 + 40, 0x100);
+        put<uint32_t>(macho, at + 152 + 64, 0x1);
+        at += 72 + 2 * 80;
+        put<uint32_t>(macho, at, 0x19);
+        put<uint32_t>(macho, at + 4, 72);
+        put_text(macho, at + 8, "__LINKEDIT");
+        put<uint64_t>(macho, at + 40, 0x300);
+        put<uint64_t>(macho, at + 48, 0x100);
+
+        binary_layout layout = parse_sections(macho.data(), macho.size());
+        runner.assert_equals(std::string("mach-o64"), layout.format);
+        runner.assert_equals(size_t(2), layout.sections.size());
+        runner.assert_equals(std::string("__TEXT,__text"), layout.sections[0].name);
+        runner.assert_equals(uint64_t(0x200), layout.sections[0].offset);
+        runner.assert_equals(std::string("__LINKEDIT"), layout.sections[1].name);
+
+        std::vector<uint8_t> fat(0x1000);
+        put<uint32_t>(fat, 0, 0xcafebabe, true);
+        put<uint32_t>(fat, 4, 1, true);
+        put<uint32_t>(fat, 16, 0x800, true);
+        put<uint32_t>(fat, 20, 0x400, true);
+        std::memcpy(fat.data() + 0x800, macho.data(), macho.size());
+        layout = parse_sections(fat.data(), fat.size());
+        runner.assert_equals(std::string("mach-o fat"), layout.format);
+        runner.assert_equals(std::string("arch0/__TEXT,__text"), layout.sections[0].name);
+        runner.assert_equals(uint64_t(0xa00), layout.sections[0].offset);
+    });
+
+    runner.run_test("Rejects other files and truncated headers", [&]() {
+        std::vector<uint8_t> text(100, 'a');
+        runner.assert_throws([&]() { parse_sections(text.data(), text.size()); }, "Not an ELF");
+        std::vector<uint8_t> elf = elf32_be();
+        runner.assert_throws([&]() { parse_sections(elf.data(), 40); }, "Truncated");
+    });
+
+    runner.print_summary();
+    return runner.tests_passed == runner.tests_run ? 0 : 1;
+}
@@ -0,0 +1,105 @@
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "../segment.hpp"
+#include "test_runner.hpp"
+
+void append_text(std::vector<uint8_t> &data, std::mt19937 &rng, size_t n) {
+    const char letters[] = "etaoinshrdlu   \n";
+    for (size_t i = 0; i < n; ++i) {
+        data.push_back(uint8_t(letters[rng() % 16]));
+    }
+}
+
+void append_random(std::vector<uint8_t> &data, std::mt19937 &rng, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        data.push_back(uint8_t(rng()));
+    }
+}
+
+void append_sparse(std::vector<uint8_t> &data, std::mt19937 &rng, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        data.push_back(rng() % 4 == 0 ? uint8_t(rng() % 16) : 0);
+    }
+}
+
+int main() {
+    TestRunner runner;
+    std::mt19937 rng(21);
+    segment_options options;
+    options.window = 16 << 10;
+
+    runner.run_test("Cuts land on the seams between kinds of data", [&]() {
+        std::vector<uint8_t> data;
+        append_text(data, rng, 100000);
+        append_random(data, rng, 150000);
+        append_sparse(data, rng, 120000);
+        append_text(data, rng, 80000);
+
+        std::vector<uint64_t> cuts = find_change_points(data.data(), data.size(), options);
+        std::vector<uint64_t> seams = {100000, 250000, 370000};
+        runner.assert_equals(seams.size(), cuts.size());
+        for (size_t i = 0; i < seams.size() && i < cuts.size(); ++i) {
+            long error = std::labs(long(cuts[i]) - long(seams[i]));
+            runner.assert_true(error <= long(options.window / 8), "cut " + std::to_string(i) + " off by " + std::to_string(error));
+        }
+    });
+
+    runner.run_test("Uniform data has no cuts", [&]() {
+        std::vector<uint8_t> data;
+        append_random(data, rng, 300000);
+        runner.assert_true(find_change_points(data.data(), data.size(), options).empty(), "random");
+        data.clear();
+        append_text(data, rng, 300000);
+        runner.assert_true(find_change_points(data.data(), data.size(), options).empty(), "text");
+    });
+
+    runner.run_test("Inputs shorter than two windows are one region", [&]() {
+        std::vector<uint8_t> data;
+        append_text(data, rng, 20000);
+        append_random(data, rng, 10000);
+        std::vector<uint64_t> cuts = find_change_points(data.data(), data.size(), options);
+        runner.assert_true(cuts.empty(), "no room for a cut");
+
+        std::vector<segment_region> regions = cut_regions(cuts, data.size());
+        runner.assert_equals(size_t(1), regions.size());
+        runner.assert_equals(uint64_t(data.size()), regions[0].length);
+    });
+
+    runner.run_test("Constant runs keep the running distance exact", [&]() {
+        // a run fills one cell with the whole left window, the step must
+        // not read past it on the way through
+        segment_options small;
+        small.window = 1000;
+        std::vector<uint8_t> data(5000, 0);
+        append_random(data, rng, 3000);
+        data.resize(data.size() + 4000, 0x41);
+        append_text(data, rng, 3000);
+
+        window_pair pair(data.data(), small.window);
+        double worst = 0.0;
+        while (pair.position() + small.window < data.size() - 2) {
+            worst = std::max(worst, std::fabs(pair.distance() - pair.exact() / (2.0 * small.window)));
+            pair.step();
+        }
+        runner.assert_true(worst < 1e-9, "drift " + std::to_string(worst));
+
+        std::vector<uint64_t> cuts = find_change_points(data.data(), data.size(), small);
+        std::vector<uint64_t> seams = {5000, 8000, 12000};
+        runner.assert_equals(seams.size(), cuts.size());
+    });
+
+    runner.run_test("Regions tile the input", [&]() {
+        std::vector<segment_region> regions = cut_regions({10, 25}, 40);
+        runner.assert_equals(size_t(3), regions.size());
+        runner.assert_equals(uint64_t(10), regions[1].offset);
+        runner.assert_equals(uint64_t(15), regions[1].length);
+        runner.assert_equals(uint64_t(15), regions[2].length);
+    });
+
+    runner.print_summary();
+    return runner.tests_passed == runner.tests_run ? 0 : 1;
+}
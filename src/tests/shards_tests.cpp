@@ -0,0 +1,106 @@
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "../shards.hpp"
+#include "test_runner.hpp"
+
+histogram_layer whole_histogram(const std::vector<uint8_t> &data, size_t first, size_t last) {
+    std::vector<uint32_t> dense(TRIGRAM_BINS, 0);
+    count_trigrams(data.data() + first, last - first, dense);
+    return layer_from_dense("input", dense.data());
+}
+
+histogram_layer shard_of(const std::vector<uint8_t> &data, size_t first, size_t last) {
+    histogram_layer layer = whole_histogram(data, first, last);
+    set_shard_edges(layer, data.data() + first, last - first, first, data.size());
+    return layer;
+}
+
+bool same_histogram(const histogram_layer &a, const histogram_layer &b) {
+    return a.bins == b.bins && a.counts == b.counts && a.total == b.total;
+}
+
+int main() {
+    TestRunner runner;
+    std::mt19937 rng(42);
+
+    // skewed bytes so bins repeat across shards and seams
+    std::vector<uint8_t> data(300000);
+    for (auto &byte : data) {
+        byte = uint8_t(rng() % 5 == 0 ? rng() : rng() % 4);
+    }
+    histogram_layer whole = whole_histogram(data, 0, data.size());
+
+    // cuts include empty, one and two byte shards
+    std::vector<size_t> cuts = {0, 1, 1, 3, 4, 6, 1000, 1001, 50000, 50002, 123457, 200000, data.size()};
+    std::vector<histogram_layer> shards;
+    for (size_t i = 0; i + 1 < cuts.size(); ++i) {
+        shards.push_back(shard_of(data, cuts[i], cuts[i + 1]));
+    }
+
+    runner.run_test("Merging every shard matches one pass over the whole", [&]() {
+        std::vector<const histogram_layer *> parts;
+        for (auto it = shards.rbegin(); it != shards.rend(); ++it) {
+            parts.push_back(&*it); // order doesn't matter
+        }
+        histogram_layer merged = merge_shards(parts);
+        runner.assert_true(same_histogram(whole, merged), "bit identical");
+        runner.assert_true(shard_complete(merged), "covers the input");
+        runner.assert_equals(data[0], merged.shard.head[0]);
+        runner.assert_equals(data.back(), merged.shard.tail[1]);
+    });
+
+    runner.run_test("Any grouping gives the same result", [&]() {
+        // merge runs of three, then merge the results
+        std::vector<histogram_layer> partial;
+        for (size_t i = 0; i < shards.size(); i += 3) {
+            std::vector<const histogram_layer *> group;
+            for (size_t j = i; j < std::min(i + 3, shards.size()); ++j) {
+                group.push_back(&shards[j]);
+            }
+            partial.push_back(merge_shards(group));
+            runner.assert_true(same_histogram(whole_histogram(data, cuts[i], cuts[std::min(i + 3, shards.size())]), partial.back()),
+                               "partial run");
+        }
+        std::vector<const histogram_layer *> parts;
+        for (const auto &p : partial) {
+            parts.push_back(&p);
+        }
+        runner.assert_true(same_histogram(whole, merge_shards(parts)), "merge of merges");
+    });
+
+    runner.run_test("Parallel merge matches the serial one", [&]() {
+        work_stealing_pool pool(4);
+        std::vector<const histogram_layer *> parts;
+        for (const auto &shard : shards) {
+            parts.push_back(&shard);
+        }
+        runner.assert_true(same_histogram(whole, merge_shards(parts, &pool)), "bit identical");
+    });
+
+    runner.run_test("Gaps and overlaps are refused", [&]() {
+        runner.assert_throws([&]() { merge_shards({&shards[5], &shards[7]}); }, "gap or overlap");
+        histogram_layer overlapping = shard_of(data, 5, 2000);
+        runner.assert_throws([&]() { merge_shards({&shards[6], &overlapping}); }, "gap or overlap");
+    });
+
+    runner.run_test("Shard records round trip", [&]() {
+        const std::string path = "shards_test.fcube";
+        fcube cube;
+        cube.flags = FCUBE_SHARD;
+        cube.layers = {shards[1], shards[7]};
+        write_fcube(path, cube);
+        fcube back = read_fcube(path);
+        std::remove(path.c_str());
+        runner.assert_equals(shards[7].shard.offset, back.layers[1].shard.offset);
+        runner.assert_equals(shards[7].shard.input_size, back.layers[1].shard.input_size);
+        runner.assert_equals(shards[1].shard.head[0], back.layers[0].shard.head[0]);
+        runner.assert_true(same_histogram(whole, merge_shards({&back.layers[0], &shards[0], &shards[2], &shards[3], &shards[4], &shards[5],
+                                                              &shards[6], &back.layers[1], &shards[8], &shards[9], &shards[10], &shards[11]})),
+                           "merges like the originals");
+    });
+
+    runner.print_summary();
+    return runner.tests_passed == runner.tests_run ? 0 : 1;
+}
@@ -0,0 +1,96 @@
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../similarity_index.hpp"
+#include "test_runner.hpp"
+
+// samples scattered around a few random centres, id / per_cluster is the cluster
+std::vector<float> clustered_fingerprints(size_t clusters, size_t per_cluster, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    std::vector<std::vector<float>> centres(clusters, std::vector<float>(FINGERPRINT_DIMS));
+    for (auto &centre : centres) {
+        for (auto &v : centre) {
+            v = uniform(rng) < 0.8f ? 0.0f : uniform(rng);
+        }
+    }
+
+    std::vector<float> rows;
+    for (size_t c = 0; c < clusters; ++c) {
+        for (size_t i = 0; i < per_cluster; ++i) {
+            std::vector<float> row(FINGERPRINT_DIMS);
+            float total = 0.0f;
+            for (size_t d = 0; d < FINGERPRINT_DIMS; ++d) {
+                row[d] = centres[c][d] * (0.8f + 0.4f * uniform(rng));
+                total += row[d];
+            }
+            for (auto &v : row) {
+                rows.push_back(v / total);
+            }
+        }
+    }
+    return rows;
+}
+
+int main() {
+    TestRunner runner;
+    const std::string path = "similarity_index_test.fsim";
+    const size_t clusters = 20, per_cluster = 50;
+
+    std::vector<float> rows = clustered_fingerprints(clusters, per_cluster, 3);
+    std::vector<std::string> names;
+    for (size_t i = 0; i < clusters * per_cluster; ++i) {
+        names.push_back("sample_" + std::to_string(i));
+    }
+    write_similarity_index(path, names, rows);
+
+    runner.run_test("Index keeps names and fingerprints", [&]() {
+        similarity_index index(path);
+        runner.assert_equals(uint32_t(clusters * per_cluster), index.count());
+        runner.assert_equals(std::string("sample_0"), index.name(0));
+        runner.assert_equals(std::string("sample_999"), index.name(999));
+        runner.assert_true(index.fingerprint(7)[11] == rows[7 * FINGERPRINT_DIMS + 11], "fingerprint row");
+    });
+
+    runner.run_test("Approximate neighbours come from the same cluster", [&]() {
+        similarity_index index(path);
+        size_t right = 0, total = 0, scanned_sum = 0;
+        for (size_t c = 0; c < clusters; ++c) {
+            uint32_t probe = uint32_t(c * per_cluster + 3);
+            size_t scanned = 0;
+            auto matches = index.query(index.fingerprint(probe), 10, similarity_metric::js, false, &scanned);
+            scanned_sum += scanned;
+            runner.assert_equals(probe, matches[0].id);
+            for (const auto &m : matches) {
+                right += m.id / per_cluster == c;
+                total++;
+            }
+        }
+        runner.assert_true(right * 10 >= total * 9, "at least 90% of neighbours in the right cluster");
+        runner.assert_true(scanned_sum < clusters * clusters * per_cluster, "candidates, not a linear scan");
+    });
+
+    runner.run_test("Exact queries rank the whole corpus", [&]() {
+        similarity_index index(path);
+        size_t scanned = 0;
+        auto matches = index.query(index.fingerprint(42), 5, similarity_metric::cosine, true, &scanned);
+        runner.assert_equals(size_t(clusters * per_cluster), scanned);
+        runner.assert_equals(size_t(5), matches.size());
+        runner.assert_true(matches[0].distance <= matches[4].distance, "nearest first");
+    });
+
+    runner.run_test("Other files are rejected", [&]() {
+        std::ofstream(path) << "definitely not a similarity index, far too short";
+        similarity_index index;
+        runner.assert_throws([&]() { index.open(path); }, "Not a similarity index");
+        runner.assert_true(!index.is_open(), "stays closed");
+    });
+
+    std::remove(path.c_str());
+    runner.print_summary();
+    return runner.tests_passed == runner.tests_run ? 0 : 1;
+}
@@ -0,0 +1,94 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "../sketch.hpp"
+#include "test_runner.hpp"
+
+int main() {
+    TestRunner runner;
+
+    // zipf-ish: trigram k of 20000 about 1 / k as often as the first
+    std::vector<uint32_t> stream;
+    std::vector<uint64_t> truth(20000, 0);
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    for (size_t i = 0; i < 400000; i++) {
+        uint32_t k = static_cast<uint32_t>(std::min(std::exp(uniform(rng) * std::log(20000.0)), 19999.0));
+        stream.push_back(k * 2654435761u & (TRIGRAM_BINS - 1));
+        truth[k]++;
+    }
+    auto truth_of = [&](uint32_t bin) {
+        for (uint32_t k = 0; k < truth.size(); k++) {
+            if ((k * 2654435761u & (TRIGRAM_BINS - 1)) == bin) {
+                return truth[k];
+            }
+        }
+        return uint64_t(0);
+    };
+
+    runner.run_test("Memory budget sets the counters", [&]() {
+        space_saving sketch(256 << 10);
+        runner.assert_true(sketch.capacity() > 4000);
+        runner.assert_true(sketch.capacity() * (space_saving::COUNTER_BYTES - 8) <= (256 << 10));
+        runner.assert_throws([]() { space_saving tiny(8); }, "below one counter");
+    });
+
+    runner.run_test("Exact while every trigram has a counter", [&]() {
+        std::vector<uint8_t> data;
+        for (int i = 0; i < 1000; i++) {
+            data.push_back(static_cast<uint8_t>("abcab"[i % 5]));
+        }
+        space_saving sketch(1 << 16);
+        sketch.count(data.data(), data.size());
+        runner.assert_equals(uint64_t(0), sketch.error_bound());
+        runner.assert_equals(uint64_t(998), sketch.total());
+        std::vector<sketch_entry> top = sketch.top(10);
+        runner.assert_equals(size_t(5), top.size());
+        runner.assert_equals(trigram_bin('a', 'b', 'c'), top[0].bin);
+        runner.assert_equals(uint64_t(200), top[0].count);
+        runner.assert_equals(uint64_t(0), top[0].error);
+    });
+
+    runner.run_test("Counts bracket the truth within the bound", [&]() {
+        space_saving sketch(32 << 10);
+        for (uint32_t bin : stream) {
+            sketch.add(bin);
+        }
+        uint64_t bound = sketch.error_bound();
+        runner.assert_true(bound > 0);
+        runner.assert_true(bound <= stream.size() / sketch.capacity());
+
+        bool bracketed = true;
+        for (const auto &entry : sketch.top(sketch.capacity())) {
+            uint64_t exact = truth_of(entry.bin);
+            bracketed = bracketed && entry.count - entry.error <= exact && exact <= entry.count && entry.error <= bound;
+        }
+        runner.assert_true(bracketed);
+    });
+
+    runner.run_test("Every heavy trigram is reported", [&]() {
+        space_saving sketch(32 << 10);
+        for (uint32_t bin : stream) {
+            sketch.add(bin);
+        }
+        histogram_layer layer = sketch_layer("stream", sketch, sketch.capacity());
+        bool all = true;
+        size_t heavy = 0;
+        for (uint32_t k = 0; k < truth.size(); k++) {
+            if (truth[k] > stream.size() / sketch.capacity()) {
+                uint32_t bin = k * 2654435761u & (TRIGRAM_BINS - 1);
+                all = all && std::binary_search(layer.bins.begin(), layer.bins.end(), bin);
+                heavy++;
+            }
+        }
+        runner.assert_true(heavy > 50);
+        runner.assert_true(all);
+        runner.assert_true(std::is_sorted(layer.bins.begin(), layer.bins.end()));
+    });
+
+    runner.print_summary();
+    return runner.tests_passed == runner.tests_run ? 0 : 1;
+}
@@ -0,0 +1,80 @@
+#include <iostream>
+#include <vector>
+#include <random>
+
+#include "../slab.hpp"
+#include "test_runner.hpp"
+
+int main() {
+    TestRunner runner;
+
+    runner.run_test("Every ordering is sorted and covers all cells", [&]() {
+        std::mt19937 rng(11);
+        std::vector<pyramid_cell> cells;
+        for (int i = 0; i < 3000; ++i) {
+            cells.push_back({int(rng() % 256), int(rng() % 256), int(rng() % 256), 1});
+        }
+
+        axis_index index;
+        index.build(cells);
+
+        for (int axis = 0; axis < 3; ++axis) {
+            const auto& order = index.order(axis);
+            runner.assert_equals(cells.size(), order.size());
+            std::vector<bool> seen(cells.size(), false);
+            for (size_t i = 0; i < order.size(); ++i) {
+                seen[order[i]] = true;
+                if (i > 0) {
+                    runner.assert_true(axis_index::coordinate(cells[order[i - 1]], axis) <=
+                                       axis_index::coordinate(cells[order[i]], axis), "sorted by axis");
+                }
+            }
+            for (bool s : seen) {
+                runner.assert_true(s, "every cell appears once");
+            }
+        }
+    });
+
+    runner.run_test("A slab is exactly the cells inside it", [&]() {
+        std::mt19937 rng(3);
+        std::vector<pyramid_cell> cells;
+        for (int i = 0; i < 2000; ++i) {
+            cells.push_back({int(rng() % 256), int(rng() % 256), int(rng() % 256), 1});
+        }
+
+        axis_index index;
+        index.build(cells);
+
+        int lo = 40, hi = 71;
+        for (int axis = 0; axis < 3; ++axis) {
+            uint32_t inside = 0;
+            for (const auto& cell : cells) {
+                int c = axis_index::coordinate(cell, axis);
+                inside += (c >= lo && c <= hi) ? 1 : 0;
+            }
+            uint32_t begin = index.slab_begin(axis, lo);
+            uint32_t end = index.slab_end(axis, hi);
+            runner.assert_equals(inside, end - begin);
+            for (uint32_t i = begin; i < end; ++i) {
+                int c = axis_index::coordinate(cells[index.order(axis)[i]], axis);
+                runner.assert_true(c >= lo && c <= hi, "cell inside slab");
+            }
+        }
+    });
+
+    runner.run_test("Slices keep input order and clamp at the edges", [&]() {
+        std::vector<pyramid_cell> cells = {{5, 0, 0, 1}, {0, 9, 0, 1}, {5, 1, 0, 1}, {255, 0, 0, 1}};
+
+        axis_index index;
+        index.build(cells);
+
+        runner.assert_equals(uint32_t(2), index.slab_end(0, 5) - index.slab_begin(0, 5));
+        runner.assert_equals(uint32_t(0), index.order(0)[index.slab_begin(0, 5)]);
+        runner.assert_equals(uint32_t(2), index.order(0)[index.slab_begin(0, 5) + 1]);
+        runner.assert_equals(uint32_t(4), index.slab_end(0, 1000) - index.slab_begin(0, -5));
+        runner.assert_equals(uint32_t(0), index.slab_end(1, 8) - index.slab_begin(1, 2));
+    });
+
+    runner.print_summary();
+    return runner.tests_passed == runner.tests_run ? 0 : 1;
+}
@@ -0,0 +1,166 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <ctime>
+
+#include "../tasks.hpp"
+#include "test_runner.hpp"
+
+int main() {
+    TestRunner runner;
+
+    runner.run_test("Pool runs submitted tasks", [&]() {
+        thread_pool pool(4);
+        std::atomic<int> counter{0};
+        std::vector<std::future<void>> results;
+        for (int i = 0; i < 100; ++i) {
+            results.push_back(pool.submit([&counter]() { counter++; }));
+        }
+        for (auto& r : results) {
+            r.get();
+        }
+        runner.assert_equals(100, counter.load());
+    });
+
+    runner.run_test("Pool future rethrows task exception", [&]() {
+        thread_pool pool(2);
+        auto result = pool.submit([]() { throw std::runtime_error("boom"); });
+        runner.assert_throws([&]() { result.get(); }, "boom");
+    });
+
+    runner.run_test("Graph respects dependencies", [&]() {
+        thread_pool pool(4);
+        std::mutex m;
+        std::vector<std::string> order;
+        auto record = [&](const std::string& name) {
+            return [&, name]() {
+                std::this_thread::sleep_for(std::chrono::milliseconds(name == "a" ? 20 : 1));
+                std::lock_guard<std::mutex> lock(m);
+                order.push_back(name);
+            };
+        };
+
+        task_graph graph;
+        graph.add("a", record("a"));
+        graph.add("b", record("b"));
+        graph.add("c", record("c"), {"a", "b"});
+        graph.add("d", record("d"), {"c"});
+        graph.run(pool);
+
+        auto pos = [&](const std::string& name) {
+            return std::find(order.begin(), order.end(), name) - order.begin();
+        };
+        runner.assert_equals(size_t(4), order.size());
+        runner.assert_true(pos("a") < pos("c"), "a before c");
+        runner.assert_true(pos("b") < pos("c"), "b before c");
+        runner.assert_true(pos("c") < pos("d"), "c before d");
+    });
+
+    runner.run_test("Graph runs independent tasks concurrently", [&]() {
+        thread_pool pool(2);
+        auto start = std::chrono::steady_clock::now();
+
+        task_graph graph;
+        graph.add("slow1", []() { std::this_thread::sleep_for(std::chrono::milliseconds(100)); });
+        graph.add("slow2", []() { std::this_thread::sleep_for(std::chrono::milliseconds(100)); });
+        graph.run(pool);
+
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        runner.assert_true(elapsed < std::chrono::milliseconds(190), "tasks should overlap");
+    });
+
+    runner.run_test("Graph failure skips dependents and rethrows", [&]() {
+        thread_pool pool(2);
+        bool dependent_ran = false;
+
+        task_graph graph;
+        graph.add("bad", []() { throw std::runtime_error("bad task"); });
+        graph.add("after", [&]() { dependent_ran = true; }, {"bad"});
+
+        runner.assert_throws([&]() { graph.run(pool); }, "bad task");
+        runner.assert_true(!dependent_ran, "dependent should not run");
+    });
+
+    runner.run_test("Graph rejects unknown and duplicate tasks", [&]() {
+        task_graph graph;
+        graph.add("a", []() {});
+        runner.assert_throws([&]() { graph.add("b", []() {}, {"missing"}); }, "unknown task");
+        runner.assert_throws([&]() { graph.add("a", []() {}); }, "Duplicate task");
+    });
+
+    runner.run_test("Stealing pool runs roots and spawned tasks", [&]() {
+        work_stealing_pool pool(4);
+        std::atomic<int> counter{0};
+        std::vector<work_stealing_pool::task> roots;
+        for (int i = 0; i < 10; ++i) {
+            roots.push_back([&](size_t worker) {
+                for (int j = 0; j < 10; ++j) {
+                    pool.spawn(worker, [&](size_t) { counter++; });
+                }
+            });
+        }
+        pool.run(std::move(roots));
+        runner.assert_equals(100, counter.load());
+    });
+
+    runner.run_test("Stealing pool spreads one root over workers", [&]() {
+        work_stealing_pool pool(4);
+        std::mutex mutex;
+        std::vector<size_t> workers;
+        pool.run({[&](size_t worker) {
+            for (int i = 0; i < 8; ++i) {
+                pool.spawn(worker, [&](size_t w) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                    std::lock_guard<std::mutex> lock(mutex);
+                    workers.push_back(w);
+                });
+            }
+        }});
+        std::sort(workers.begin(), workers.end());
+        size_t distinct = std::unique(workers.begin(), workers.end()) - workers.begin();
+        runner.assert_true(distinct > 1, "chunks should be stolen by other workers");
+    });
+
+    runner.run_test("Stealing pool runs recursive splits", [&]() {
+        work_stealing_pool pool(3);
+        std::atomic<long> sum{0};
+        std::function<void(size_t, long, long)> split = [&](size_t worker, long lo, long hi) {
+            if (hi - lo <= 16) {
+                for (long i = lo; i < hi; ++i) sum += i;
+                return;
+            }
+            long mid = lo + (hi - lo) / 2;
+            pool.spawn(worker, [&, lo, mid](size_t w) { split(w, lo, mid); });
+            split(worker, mid, hi);
+        };
+        pool.run({[&](size_t worker) { split(worker, 0, 10000); }});
+        runner.assert_equals(10000L * 9999L / 2, sum.load());
+    });
+
+    runner.run_test("Stealing pool rethrows and can run again", [&]() {
+        work_stealing_pool pool(2);
+        runner.assert_throws([&]() {
+            pool.run({[](size_t) { throw std::runtime_error("chunk failed"); }});
+        }, "chunk failed");
+
+        std::atomic<int> counter{0};
+        pool.run({[&](size_t) { counter++; }, [&](size_t) { counter++; }});
+        runner.assert_equals(2, counter.load());
+    });
+
+    runner.run_test("Stealing pool parks idle workers", [&]() {
+        // three workers with nothing to steal while one task sleeps
+        work_stealing_pool pool(4);
+        std::clock_t before = std::clock();
+        pool.run({[](size_t) { std::this_thread::sleep_for(std::chrono::milliseconds(300)); }});
+        double cpu = double(std::clock() - before) / CLOCKS_PER_SEC;
+        runner.assert_true(cpu < 0.1, "idle workers used " + std::to_string(cpu) + " s of cpu");
+    });
+
+    runner.print_summary();
+    return runner.tests_passed == runner.tests_run ? 0 : 1;
+}
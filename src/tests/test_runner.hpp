@@ -0,0 +1,80 @@
+#pragma once
+
+#include <iostream>
+#include <sstream>
+#include <functional>
+#include <stdexcept>
+#include <string>
+
+// Simple test framework
+class TestRunner {
+private:
+
+
+    std::string current_test;
+
+public: // variables
+    int tests_run = 0;    
+    int tests_passed = 0; 
+public: // functions
+
+    void run_test(const std::string& name, std::function<void()> test_func) {
+        current_test = name;
+        tests_run++;
+        try {
+            test_func();
+            tests_passed++;
+            std::cout << "✓ " << name << std::endl;
+        } catch (const std::exception& e) {
+            std::cout << "✗ " << name << " - " << e.what() << std::endl;
+        } catch (...) {
+            std::cout << "✗ " << name << " - Unknown exception" << std::endl;
+        }
+    }
+
+    void assert_true(bool condition, const std::string& message = "") {
+        if (!condition) {
+            throw std::runtime_error("Assertion failed in " + current_test + ": " + message);
+        }
+    }
+
+    void assert_equals(const std::string& expected, const std::string& actual) {
+        if (expected != actual) {
+            throw std::runtime_error("Expected '" + expected + "', got '" + actual + "'");
+        }
+    }
+
+    template<typename T>
+    void assert_equals(T expected, T actual) {
+        if (expected != actual) {
+            std::ostringstream oss;
+            oss << "Expected " << expected << ", got " << actual;
+            throw std::runtime_error(oss.str());
+        }
+    }
+
+    void assert_throws(std::function<void()> func, const std::string& expected_message = "") {
+        bool thrown = false;
+        try {
+            func();
+        } catch (const std::exception& e) {
+            thrown = true;
+            if (!expected_message.empty() && std::string(e.what()).find(expected_message) == std::string::npos) {
+                throw std::runtime_error("Expected exception with message containing '" + expected_message + 
+                                       "', got '" + e.what() + "'");
+            }
+        }
+        if (!thrown) {
+            throw std::runtime_error("Expected exception to be thrown");
+        }
+    }
+
+    void print_summary() {
+        std::cout << "\n" << tests_passed << "/" << tests_run << " tests passed";
+        if (tests_passed == tests_run) {
+            std::cout << " ✓" << std::endl;
+        } else {
+            std::cout << " ✗" << std::endl;
+        }
+    }
+};
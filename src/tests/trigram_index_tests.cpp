@@ -0,0 +1,84 @@
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../trigram_index.hpp"
+#include "test_runner.hpp"
+
+int main() {
+    TestRunner runner;
+    const std::string path = "trigram_index_test.idx";
+
+    runner.run_test("Varints round trip", [&]() {
+        std::vector<uint64_t> values = {0, 1, 127, 128, 300, 1ull << 35, UINT64_MAX};
+        std::vector<uint8_t> bytes;
+        for (uint64_t v : values) {
+            put_varint(bytes, v);
+        }
+
+        const uint8_t* p = bytes.data();
+        for (uint64_t v : values) {
+            uint64_t decoded;
+            p = get_varint(p, bytes.data() + bytes.size(), decoded);
+            runner.assert_equals(v, decoded);
+        }
+        runner.assert_true(p == bytes.data() + bytes.size(), "consumed everything");
+
+        uint64_t decoded;
+        runner.assert_throws([&]() { get_varint(bytes.data(), bytes.data(), decoded); }, "Truncated");
+    });
+
+    runner.run_test("Offsets match a scan of the input", [&]() {
+        std::mt19937 rng(9);
+        std::vector<uint8_t> data(20000);
+        for (auto& b : data) {
+            b = uint8_t(rng() % 6);
+        }
+
+        write_trigram_index(path, data.data(), data.size(), 1000000);
+        trigram_index index(path);
+
+        runner.assert_equals(uint64_t(data.size()), index.input_size());
+        runner.assert_equals(uint32_t(6 * 6 * 6), index.entry_count());
+
+        uint32_t bin = trigram_bin(1, 2, 3);
+        std::vector<uint64_t> expected;
+        for (size_t i = 0; i + 2 < data.size(); ++i) {
+            if (trigram_bin(data[i], data[i + 1], data[i + 2]) == bin) {
+                expected.push_back(i);
+            }
+        }
+        runner.assert_true(index.offsets(bin) == expected, "postings are every occurrence in order");
+        runner.assert_equals(uint64_t(expected.size()), index.find(bin)->total);
+        runner.assert_true(index.find(trigram_bin(9, 9, 9)) == nullptr, "absent trigram");
+        runner.assert_true(index.offsets(trigram_bin(9, 9, 9)).empty(), "absent trigram has no offsets");
+    });
+
+    runner.run_test("Postings are capped but totals are not", [&]() {
+        std::vector<uint8_t> data(100, 0xAA);
+
+        write_trigram_index(path, data.data(), data.size(), 10);
+        trigram_index index(path);
+
+        const trigram_index_entry* entry = index.find(trigram_bin(0xAA, 0xAA, 0xAA));
+        runner.assert_true(entry != nullptr, "entry present");
+        runner.assert_equals(uint64_t(98), entry->total);
+        runner.assert_equals(uint32_t(10), entry->stored);
+
+        std::vector<uint64_t> offsets = index.offsets(entry->bin, 3);
+        runner.assert_true(offsets == std::vector<uint64_t>({0, 1, 2}), "first offsets in order");
+    });
+
+    runner.run_test("Other files are rejected", [&]() {
+        std::ofstream(path) << "definitely not an index, but long enough";
+        trigram_index index;
+        runner.assert_throws([&]() { index.open(path); }, "Not a trigram index");
+        runner.assert_true(!index.is_open(), "stays closed");
+    });
+
+    std::remove(path.c_str());
+    runner.print_summary();
+    return runner.tests_passed == runner.tests_run ? 0 : 1;
+}
@@ -0,0 +1,50 @@
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../trigram.hpp"
+#include "test_runner.hpp"
+
+int main() {
+    TestRunner runner;
+
+    runner.run_test("Bins put the first byte in x", [&]() {
+        runner.assert_equals(uint32_t(0x010203), trigram_bin(1, 2, 3));
+        runner.assert_equals(uint32_t(TRIGRAM_BINS - 1), trigram_bin(255, 255, 255));
+    });
+
+    runner.run_test("Every position but the last two starts a trigram", [&]() {
+        std::vector<uint8_t> data = {0, 0, 0, 0, 7};
+        std::vector<uint32_t> counts(TRIGRAM_BINS, 0);
+        count_trigrams(data.data(), data.size(), counts);
+
+        runner.assert_equals(uint32_t(2), counts[trigram_bin(0, 0, 0)]);
+        runner.assert_equals(uint32_t(1), counts[trigram_bin(0, 0, 7)]);
+
+        std::vector<uint32_t> empty(TRIGRAM_BINS, 0);
+        count_trigrams(data.data(), 2, empty);
+        runner.assert_equals(uint32_t(0), empty[0]);
+    });
+
+    runner.run_test("Streaming matches counting in one go across blocks", [&]() {
+        std::mt19937 rng(5);
+        std::string data(3 * (1 << 20) + 17, '\0');
+        for (auto& c : data) {
+            c = char(rng() % 4); // few distinct trigrams, so block edges matter
+        }
+
+        std::vector<uint32_t> whole(TRIGRAM_BINS, 0);
+        count_trigrams(reinterpret_cast<const uint8_t*>(data.data()), data.size(), whole);
+
+        std::vector<uint32_t> streamed(TRIGRAM_BINS, 0);
+        std::istringstream in(data);
+        count_trigrams(in, streamed);
+
+        runner.assert_true(whole == streamed, "streamed histogram matches");
+    });
+
+    runner.print_summary();
+    return runner.tests_passed == runner.tests_run ? 0 : 1;
+}
@@ -0,0 +1,65 @@
+//  ████████╗██████╗ ██╗ ██████╗ ██████╗  █████╗ ███╗   ███╗   ██╗  ██╗██████╗ ██████╗
+//  ╚══██╔══╝██╔══██╗██║██╔════╝ ██╔══██╗██╔══██╗████╗ ████║   ██║  ██║██╔══██╗██╔══██╗
+//     ██║   ██████╔╝██║██║  ███╗██████╔╝███████║██╔████╔██║   ███████║██████╔╝██████╔╝
+//     ██║   ██╔══██╗██║██║   ██║██╔══██╗██╔══██║██║╚██╔╝██║   ██╔══██║██╔═══╝ ██╔═══╝
+//     ██║   ██║  ██║██║╚██████╔╝██║  ██║██║  ██║██║ ╚═╝ ██║██╗██║  ██║██║     ██║
+//     ╚═╝   ╚═╝  ╚═╝╚═╝ ╚═════╝ ╚═╝  ╚═╝╚═╝  ╚═╝╚═╝     ╚═╝╚═╝╚═╝  ╚═╝╚═╝     ╚═╝
+//
+// trigram voxels shared by the viewer and the analysis tools
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <vector>
+
+// a histogram over every possible trigram has 2^24 bins
+const size_t TRIGRAM_BINS = size_t(1) << 24;
+
+// one trigram: x, y, z are its three bytes, count how often it occurs.
+// position is the mean offset it occurs at and spread the std dev of those
+// offsets, as fractions of the input, position < 0 when they weren't counted.
+// delta is its share of a compared histogram minus its share of this one
+struct Voxel
+{
+    int x, y, z;
+    uint64_t count; // a single trigram can fill a file past 4 GB
+    float position = -1.0f;
+    float spread = 0.0f;
+    float delta = 0.0f;
+};
+
+// bin of the trigram a b c, x = a in the most significant byte
+inline uint32_t trigram_bin(uint8_t a, uint8_t b, uint8_t c)
+{
+    return (uint32_t(a) << 16) | (uint32_t(b) << 8) | uint32_t(c);
+}
+
+// adds every trigram starting in data[0, size - 2) to counts, which must
+// hold TRIGRAM_BINS entries
+inline void count_trigrams(const uint8_t *data, size_t size, std::vector<uint32_t> &counts)
+{
+    for (size_t i = 0; i + 2 < size; i++)
+    {
+        counts[trigram_bin(data[i], data[i + 1], data[i + 2])]++;
+    }
+}
+
+// the same for a whole stream, read in blocks. the last two bytes of each
+// block are carried over so trigrams spanning a boundary are counted once
+inline void count_trigrams(std::istream &in, std::vector<uint32_t> &counts)
+{
+    std::vector<uint8_t> block(1 << 20);
+    size_t carried = 0;
+    while (in)
+    {
+        in.read(reinterpret_cast<char *>(block.data() + carried), block.size() - carried);
+        size_t size = carried + static_cast<size_t>(in.gcount());
+        count_trigrams(block.data(), size, counts);
+
+        carried = std::min<size_t>(size, 2);
+        std::copy(block.begin() + (size - carried), block.begin() + size, block.begin());
+    }
+}
@@ -0,0 +1,299 @@
+//  ████████╗██████╗ ██╗ ██████╗ ██████╗  █████╗ ███╗   ███╗        ██╗███╗   ██╗██████╗ ███████╗██╗  ██╗   ██╗  ██╗██████╗ ██████╗
+//  ╚══██╔══╝██╔══██╗██║██╔════╝ ██╔══██╗██╔══██╗████╗ ████║        ██║████╗  ██║██╔══██╗██╔════╝╚██╗██╔╝   ██║  ██║██╔══██╗██╔══██╗
+//     ██║   ██████╔╝██║██║  ███╗██████╔╝███████║██╔████╔██║        ██║██╔██╗ ██║██║  ██║█████╗   ╚███╔╝    ███████║██████╔╝██████╔╝
+//     ██║   ██╔══██╗██║██║   ██║██╔══██╗██╔══██║██║╚██╔╝██║        ██║██║╚██╗██║██║  ██║██╔══╝   ██╔██╗    ██╔══██║██╔═══╝ ██╔═══╝
+//     ██║   ██║  ██║██║╚██████╔╝██║  ██║██║  ██║██║ ╚═╝ ██║███████╗██║██║ ╚████║██████╔╝███████╗██╔╝ ██╗██╗██║  ██║██║     ██║
+//     ╚═╝   ╚═╝  ╚═╝╚═╝ ╚═════╝ ╚═╝  ╚═╝╚═╝  ╚═╝╚═╝     ╚═╝╚══════╝╚═╝╚═╝  ╚═══╝╚═════╝ ╚══════╝╚═╝  ╚═╝╚═╝╚═╝  ╚═╝╚═╝     ╚═╝
+//
+// trigram -> file offset postings, written by the extractor, mmapped by the viewer
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "trigram.hpp"
+
+// file layout, all little endian:
+//
+//   header     magic "TRIIDX01", input size u64, cap u32, entry count u32
+//   directory  one entry per trigram present, sorted by bin:
+//                bin u32, stored u32, total u64, postings offset u64
+//   postings   per entry, `stored` LEB128 varints: the first offset, then
+//              the gaps between consecutive offsets
+//
+// only the first `cap` occurrences of a trigram are stored, `total` still
+// says how many there were. python/extract_trigrams.py --index writes the same
+const char TRIGRAM_INDEX_MAGIC[8] = {'T', 'R', 'I', 'I', 'D', 'X', '0', '1'};
+
+struct trigram_index_header
+{
+    char magic[8];
+    uint64_t input_size;
+    uint32_t cap;
+    uint32_t entry_count;
+};
+
+struct trigram_index_entry
+{
+    uint32_t bin;
+    uint32_t stored;
+    uint64_t total;
+    uint64_t postings; // byte offset from the start of the postings section
+};
+
+static_assert(sizeof(trigram_index_header) == 24, "header is packed by hand");
+static_assert(sizeof(trigram_index_entry) == 24, "entry is packed by hand");
+
+inline void put_varint(std::vector<uint8_t> &out, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back(static_cast<uint8_t>(value) | 0x80);
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+// returns the position after the varint, throws rather than read past end
+inline const uint8_t *get_varint(const uint8_t *p, const uint8_t *end, uint64_t &value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        if (p == end)
+        {
+            throw std::runtime_error("Truncated varint in trigram index");
+        }
+        uint8_t byte = *p++;
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+        {
+            return p;
+        }
+    }
+    throw std::runtime_error("Overlong varint in trigram index");
+}
+
+// builds the index of data in two passes: the first counts every trigram,
+// the second fills one flat array in file order so every list comes out sorted
+inline void write_trigram_index(const std::string &path, const uint8_t *data, size_t size, uint32_t cap)
+{
+    std::vector<uint64_t> totals(TRIGRAM_BINS, 0);
+    for (size_t i = 0; i + 2 < size; i++)
+    {
+        totals[trigram_bin(data[i], data[i + 1], data[i + 2])]++;
+    }
+
+    // entry_of maps a bin to its directory entry, first/next are where its
+    // stored offsets start in the flat array and where the next one goes
+    std::vector<trigram_index_entry> entries;
+    std::vector<uint32_t> entry_of(TRIGRAM_BINS, 0);
+    std::vector<uint64_t> first;
+    uint64_t stored_total = 0;
+    for (uint32_t bin = 0; bin < TRIGRAM_BINS; bin++)
+    {
+        if (totals[bin] != 0)
+        {
+            uint32_t stored = static_cast<uint32_t>(std::min<uint64_t>(totals[bin], cap));
+            entry_of[bin] = static_cast<uint32_t>(entries.size());
+            entries.push_back({bin, stored, totals[bin], 0});
+            first.push_back(stored_total);
+            stored_total += stored;
+        }
+    }
+    first.push_back(stored_total);
+    totals = std::vector<uint64_t>();
+
+    std::vector<uint64_t> offsets(stored_total);
+    std::vector<uint64_t> next(first.begin(), first.end() - 1);
+    for (size_t i = 0; i + 2 < size; i++)
+    {
+        uint32_t e = entry_of[trigram_bin(data[i], data[i + 1], data[i + 2])];
+        if (next[e] < first[e + 1])
+        {
+            offsets[next[e]++] = i;
+        }
+    }
+
+    std::vector<uint8_t> postings;
+    for (size_t e = 0; e < entries.size(); e++)
+    {
+        entries[e].postings = postings.size();
+        uint64_t previous = 0;
+        for (uint64_t k = first[e]; k < first[e + 1]; k++)
+        {
+            put_varint(postings, offsets[k] - previous);
+            previous = offsets[k];
+        }
+    }
+
+    trigram_index_header header{};
+    std::memcpy(header.magic, TRIGRAM_INDEX_MAGIC, sizeof(header.magic));
+    header.input_size = size;
+    header.cap = cap;
+    header.entry_count = static_cast<uint32_t>(entries.size());
+
+    std::ofstream out(path, std::ios::binary);
+    if (!out.is_open())
+    {
+        throw std::runtime_error("Failed to create " + path);
+    }
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(entries.data()), entries.size() * sizeof(trigram_index_entry));
+    out.write(reinterpret_cast<const char *>(postings.data()), postings.size());
+    if (!out)
+    {
+        throw std::runtime_error("Failed to write " + path);
+    }
+}
+
+// read only view of an index file. opening maps it and checks the header and
+// directory, a lookup is a binary search over the directory and decodes only
+// the postings asked for, so it does not matter how large the input was
+class trigram_index
+{
+private:
+    const uint8_t *base_ = nullptr;
+    size_t size_ = 0;
+    const trigram_index_header *header_ = nullptr;
+    const trigram_index_entry *entries_ = nullptr;
+    const uint8_t *postings_ = nullptr;
+
+public:
+    trigram_index() = default;
+
+    explicit trigram_index(const std::string &path)
+    {
+        open(path);
+    }
+
+    ~trigram_index()
+    {
+        close();
+    }
+
+    trigram_index(const trigram_index &) = delete;
+    trigram_index &operator=(const trigram_index &) = delete;
+
+    void open(const std::string &path)
+    {
+        close();
+
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            throw std::runtime_error("Failed to open " + path);
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(trigram_index_header))
+        {
+            ::close(fd);
+            throw std::runtime_error("Not a trigram index: " + path);
+        }
+
+        void *mapped = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED)
+        {
+            throw std::runtime_error("Failed to map " + path);
+        }
+
+        base_ = static_cast<const uint8_t *>(mapped);
+        size_ = static_cast<size_t>(st.st_size);
+        header_ = reinterpret_cast<const trigram_index_header *>(base_);
+
+        size_t directory_end = sizeof(trigram_index_header) + size_t(header_->entry_count) * sizeof(trigram_index_entry);
+        if (std::memcmp(header_->magic, TRIGRAM_INDEX_MAGIC, sizeof(header_->magic)) != 0 || directory_end > size_)
+        {
+            close();
+            throw std::runtime_error("Not a trigram index: " + path);
+        }
+
+        entries_ = reinterpret_cast<const trigram_index_entry *>(base_ + sizeof(trigram_index_header));
+        postings_ = base_ + directory_end;
+    }
+
+    void close()
+    {
+        if (base_ != nullptr)
+        {
+            munmap(const_cast<uint8_t *>(base_), size_);
+        }
+        base_ = nullptr;
+        size_ = 0;
+        header_ = nullptr;
+        entries_ = nullptr;
+        postings_ = nullptr;
+    }
+
+    bool is_open() const
+    {
+        return base_ != nullptr;
+    }
+
+    uint64_t input_size() const
+    {
+        return header_->input_size;
+    }
+
+    uint32_t cap() const
+    {
+        return header_->cap;
+    }
+
+    uint32_t entry_count() const
+    {
+        return header_->entry_count;
+    }
+
+    // nullptr when the trigram never occurs
+    const trigram_index_entry *find(uint32_t bin) const
+    {
+        const trigram_index_entry *end = entries_ + header_->entry_count;
+        const trigram_index_entry *it = std::lower_bound(entries_, end, bin, [](const trigram_index_entry &entry, uint32_t b)
+                                                         { return entry.bin < b; });
+        return it != end && it->bin == bin ? it : nullptr;
+    }
+
+    // the first `limit` stored offsets of bin, in file order
+    std::vector<uint64_t> offsets(uint32_t bin, size_t limit = SIZE_MAX) const
+    {
+        std::vector<uint64_t> result;
+        const trigram_index_entry *entry = find(bin);
+        if (entry == nullptr)
+        {
+            return result;
+        }
+
+        const uint8_t *end = base_ + size_;
+        if (entry->postings > static_cast<uint64_t>(end - postings_))
+        {
+            throw std::runtime_error("Corrupt trigram index entry for bin " + std::to_string(bin));
+        }
+
+        const uint8_t *p = postings_ + entry->postings;
+        uint64_t offset = 0;
+        size_t n = std::min<size_t>(entry->stored, limit);
+        result.reserve(n);
+        for (size_t i = 0; i < n; i++)
+        {
+            uint64_t gap;
+            p = get_varint(p, end, gap);
+            offset += gap;
+            result.push_back(offset);
+        }
+        return result;
+    }
+};